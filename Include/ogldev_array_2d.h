@@ -22,10 +22,54 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <utility>
 #ifndef _WIN32
 #include <unistd.h>
+#else
+#include <malloc.h>
 #endif
 
+// Every row starts on a cache line when the row size is a multiple of it
+#define ARRAY_2D_ALIGNMENT 64
+
+
+inline void* AllocArray2DMemory(size_t Size)
+{
+#ifdef _WIN32
+    void* p = _aligned_malloc(Size, ARRAY_2D_ALIGNMENT);
+#else
+    void* p = NULL;
+
+    if (posix_memalign(&p, ARRAY_2D_ALIGNMENT, Size) != 0) {
+        p = NULL;
+    }
+#endif
+
+    if (!p && (Size > 0)) {
+        printf("%s:%d - failed to allocate %zu bytes\n", __FILE__, __LINE__, Size);
+        exit(0);
+    }
+
+    return p;
+}
+
+
+inline void FreeArray2DMemory(void* p)
+{
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+
+//
+// A row major 2D array. The rows are contiguous so GetRow() returns a span of GetCols()
+// elements and the whole array can be handed to OpenGL with GetBaseAddr(). The memory
+// is aligned to ARRAY_2D_ALIGNMENT. The array owns its memory so it can be moved but not
+// copied.
+//
 template<typename Type>
 class Array2D {
  public:
@@ -37,16 +81,53 @@ class Array2D {
     }
 
 
+    Array2D(const Array2D&) = delete;
+
+    Array2D& operator=(const Array2D&) = delete;
+
+
+    Array2D(Array2D&& Other) noexcept
+    {
+        Swap(Other);
+    }
+
+
+    Array2D& operator=(Array2D&& Other) noexcept
+    {
+        if (this != &Other) {
+            Destroy();
+            Swap(Other);
+        }
+
+        return *this;
+    }
+
+
+    void Swap(Array2D& Other) noexcept
+    {
+        std::swap(m_p, Other.m_p);
+        std::swap(m_cols, Other.m_cols);
+        std::swap(m_rows, Other.m_rows);
+        std::swap(m_aligned, Other.m_aligned);
+    }
+
+
+    // The current memory is reused if the size doesn't change
     void InitArray2D(int Cols, int Rows)
     {
+        if (m_p && m_aligned && (Cols * Rows == m_cols * m_rows)) {
+            m_cols = Cols;
+            m_rows = Rows;
+            return;
+        }
+
+        Destroy();
+
         m_cols = Cols;
         m_rows = Rows;
 
-        if (m_p) {
-            free(m_p);
-        }
-
-        m_p = (Type*)malloc(Cols * Rows * sizeof(Type));
+        m_p = (Type*)AllocArray2DMemory((size_t)Cols * Rows * sizeof(Type));
+        m_aligned = true;
     }
 
 
@@ -54,22 +135,22 @@ class Array2D {
     {
         InitArray2D(Cols, Rows);
 
-        for (int i = 0 ; i < Cols * Rows ; i++) {
+        for (size_t i = 0 ; i < (size_t)Cols * Rows ; i++) {
             m_p[i] = InitVal;
         }
     }
 
 
+    // Takes ownership of a buffer from malloc (e.g. from ReadBinaryFile)
     void InitArray2D(int Cols, int Rows, void* pData)
     {
+        Destroy();
+
         m_cols = Cols;
         m_rows = Rows;
 
-        if (m_p) {
-            free(m_p);
-        }
-
         m_p = (Type*)pData;
+        m_aligned = false;
     }
 
 
@@ -82,9 +163,17 @@ class Array2D {
     void Destroy()
     {
         if (m_p) {
-            free(m_p);
+            if (m_aligned) {
+                FreeArray2DMemory(m_p);
+            } else {
+                free(m_p);
+            }
+
             m_p = NULL;
         }
+
+        m_cols = 0;
+        m_rows = 0;
     }
 
     Type* GetAddr(int Col, int Row) const
@@ -101,6 +190,25 @@ class Array2D {
     }
 
 
+    // Span of GetCols() elements
+    Type* GetRow(int Row) const
+    {
+        return GetAddr(0, Row);
+    }
+
+
+    int GetCols() const
+    {
+        return m_cols;
+    }
+
+
+    int GetRows() const
+    {
+        return m_rows;
+    }
+
+
     int GetSize() const
     {
         return m_rows * m_cols;
@@ -228,7 +336,7 @@ class Array2D {
             exit(0);
         }
 #endif
-        size_t Index = Row * m_cols + Col;
+        size_t Index = (size_t)Row * m_cols + Col;
 
         return Index;
     }
@@ -236,6 +344,7 @@ class Array2D {
     Type* m_p = NULL;
     int m_cols = 0;
     int m_rows = 0;
+    bool m_aligned = true;     // false if the memory came from malloc
 };
 
 
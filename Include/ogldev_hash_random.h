@@ -0,0 +1,113 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_HASH_RANDOM_H
+#define OGLDEV_HASH_RANDOM_H
+
+//
+// Counter based random numbers. Instead of advancing a global state like rand()
+// every value is a hash of its "coordinates" (seed, level, x, y, ...) so it
+// doesn't depend on the order in which the values are requested. This makes
+// generators reproducible from a seed no matter how the work is split between
+// threads.
+//
+
+#include "ogldev_types.h"
+#include "ogldev_simd.h"
+
+
+// 'lowbias32' integer hash by Chris Wellons
+inline u32 HashU32(u32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+
+inline u32 HashCoords(u32 Seed, u32 Level, u32 x, u32 y)
+{
+    u32 h = HashU32(Seed ^ 0x9e3779b9U);
+    h = HashU32(h ^ Level);
+    h = HashU32(h ^ x);
+    h = HashU32(h ^ y);
+    return h;
+}
+
+
+// Uses the top 24 bits so that the result is exact in a float: [0, 1)
+inline float HashToFloat01(u32 h)
+{
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+
+// [-1, 1)
+inline float HashToFloatSigned(u32 h)
+{
+    return HashToFloat01(h) * 2.0f - 1.0f;
+}
+
+
+#ifdef OGLDEV_SSE2
+
+// SSE2 has no 32 bit low multiply (that came with SSE4.1) so it is built from two 32x32->64 multiplies
+inline __m128i MulLo32_SSE2(__m128i a, __m128i b)
+{
+    __m128i Even = _mm_mul_epu32(a, b);
+    __m128i Odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(Even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(Odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+inline __m128i HashU32_SSE2(__m128i x)
+{
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    x = MulLo32_SSE2(x, _mm_set1_epi32((int)0x7feb352dU));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+    x = MulLo32_SSE2(x, _mm_set1_epi32((int)0x846ca68bU));
+    x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+    return x;
+}
+
+
+// Four hashes with the same seed/level/y and four different x values. Matches HashCoords.
+inline __m128i HashCoords_SSE2(u32 Seed, u32 Level, __m128i x, u32 y)
+{
+    u32 h = HashU32(HashU32(Seed ^ 0x9e3779b9U) ^ Level);
+    __m128i h4 = HashU32_SSE2(_mm_xor_si128(_mm_set1_epi32((int)h), x));
+    h4 = HashU32_SSE2(_mm_xor_si128(h4, _mm_set1_epi32((int)y)));
+    return h4;
+}
+
+
+inline __m128 HashToFloatSigned_SSE2(__m128i h)
+{
+    __m128 f = _mm_cvtepi32_ps(_mm_srli_epi32(h, 8));
+    f = _mm_mul_ps(f, _mm_set1_ps(1.0f / 16777216.0f));
+    return _mm_sub_ps(_mm_mul_ps(f, _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f));
+}
+
+#endif
+
+#endif
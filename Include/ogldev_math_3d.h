@@ -836,8 +836,55 @@ public:
         return Inside;
     }
 
+    // Returns false only if the box is completely on the outer side of one of the planes
+    bool IsAABBInsideViewFrustum(const Vector3f& Min, const Vector3f& Max) const
+    {
+        bool Inside =
+            (MaxPlaneDistance(m_leftClipPlane, Min, Max)   >= 0) &&
+            (MinPlaneDistance(m_rightClipPlane, Min, Max)  <= 0) &&
+            (MaxPlaneDistance(m_bottomClipPlane, Min, Max) >= 0) &&
+            (MinPlaneDistance(m_topClipPlane, Min, Max)    <= 0) &&
+            (MaxPlaneDistance(m_nearClipPlane, Min, Max)   >= 0) &&
+            (MinPlaneDistance(m_farClipPlane, Min, Max)    <= 0);
+
+        return Inside;
+    }
+
+    bool IsAABBFullyInsideViewFrustum(const Vector3f& Min, const Vector3f& Max) const
+    {
+        bool Inside =
+            (MinPlaneDistance(m_leftClipPlane, Min, Max)   >= 0) &&
+            (MaxPlaneDistance(m_rightClipPlane, Min, Max)  <= 0) &&
+            (MinPlaneDistance(m_bottomClipPlane, Min, Max) >= 0) &&
+            (MaxPlaneDistance(m_topClipPlane, Min, Max)    <= 0) &&
+            (MinPlaneDistance(m_nearClipPlane, Min, Max)   >= 0) &&
+            (MaxPlaneDistance(m_farClipPlane, Min, Max)    <= 0);
+
+        return Inside;
+    }
+
 private:
 
+    // The box corner that is furthest along the plane normal
+    static float MaxPlaneDistance(const Vector4f& Plane, const Vector3f& Min, const Vector3f& Max)
+    {
+        Vector4f p(Plane.x >= 0.0f ? Max.x : Min.x,
+                   Plane.y >= 0.0f ? Max.y : Min.y,
+                   Plane.z >= 0.0f ? Max.z : Min.z,
+                   1.0f);
+        return Plane.Dot(p);
+    }
+
+    // The box corner that is furthest against the plane normal
+    static float MinPlaneDistance(const Vector4f& Plane, const Vector3f& Min, const Vector3f& Max)
+    {
+        Vector4f p(Plane.x >= 0.0f ? Min.x : Max.x,
+                   Plane.y >= 0.0f ? Min.y : Max.y,
+                   Plane.z >= 0.0f ? Min.z : Max.z,
+                   1.0f);
+        return Plane.Dot(p);
+    }
+
     Vector4f m_leftClipPlane;
     Vector4f m_rightClipPlane;
     Vector4f m_bottomClipPlane;
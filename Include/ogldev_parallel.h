@@ -0,0 +1,100 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_PARALLEL_H
+#define OGLDEV_PARALLEL_H
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+
+inline int& NumWorkerThreadsOverride()
+{
+    static int NumThreads = 0;
+    return NumThreads;
+}
+
+
+// Number of threads used by ParallelFor. Defaults to the number of hardware threads.
+inline int GetNumWorkerThreads()
+{
+    int NumThreads = NumWorkerThreadsOverride();
+
+    if (NumThreads <= 0) {
+        NumThreads = (int)std::thread::hardware_concurrency();
+    }
+
+    return std::max(NumThreads, 1);
+}
+
+
+// Zero restores the default
+inline void SetNumWorkerThreads(int NumThreads)
+{
+    NumWorkerThreadsOverride() = NumThreads;
+}
+
+
+//
+// Splits [Start, End) into contiguous chunks and calls Func(ChunkStart, ChunkEnd)
+// for each chunk on a separate thread. The calling thread takes the first chunk
+// and returns after all the chunks are done. Chunks are never smaller than
+// MinItemsPerThread so small ranges run on the calling thread only.
+//
+template<typename Func>
+void ParallelFor(int Start, int End, const Func& f, int MinItemsPerThread = 1)
+{
+    int NumItems = End - Start;
+
+    if (NumItems <= 0) {
+        return;
+    }
+
+    int MaxThreads = NumItems / std::max(MinItemsPerThread, 1);
+    int NumThreads = std::max(std::min(GetNumWorkerThreads(), MaxThreads), 1);
+
+    if (NumThreads == 1) {
+        f(Start, End);
+        return;
+    }
+
+    int ItemsPerThread = NumItems / NumThreads;
+    int Remainder = NumItems % NumThreads;
+
+    std::vector<std::thread> Threads;
+    Threads.reserve(NumThreads - 1);
+
+    int FirstEnd = Start + ItemsPerThread + (Remainder > 0 ? 1 : 0);
+    int ChunkStart = FirstEnd;
+
+    for (int i = 1 ; i < NumThreads ; i++) {
+        int ChunkEnd = ChunkStart + ItemsPerThread + (i < Remainder ? 1 : 0);
+        Threads.emplace_back([&f, ChunkStart, ChunkEnd]() { f(ChunkStart, ChunkEnd); });
+        ChunkStart = ChunkEnd;
+    }
+
+    f(Start, FirstEnd);
+
+    for (std::thread& t : Threads) {
+        t.join();
+    }
+}
+
+#endif
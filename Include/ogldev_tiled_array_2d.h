@@ -0,0 +1,228 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_TILED_ARRAY_2D_H
+#define OGLDEV_TILED_ARRAY_2D_H
+
+#include "ogldev_array_2d.h"
+
+#define TILED_ARRAY_2D_TILE_BITS 3
+#define TILED_ARRAY_2D_TILE_SIZE (1 << TILED_ARRAY_2D_TILE_BITS)
+#define TILED_ARRAY_2D_TILE_MASK (TILED_ARRAY_2D_TILE_SIZE - 1)
+
+
+//
+// A 2D array that is stored in 8x8 tiles. The tiles are in row major order and the
+// elements inside a tile are in Morton (Z) order so the neighbors of a point in every
+// direction are usually in the same cache lines. This makes walking down a column (or
+// along a diagonal) about as cheap as walking along a row, which a row major Array2D
+// can't do once a row is larger than the cache.
+//
+// The number of columns and rows is rounded up to whole tiles. The padding is never
+// read by the accessors.
+//
+template<typename Type>
+class TiledArray2D {
+ public:
+    TiledArray2D() {}
+
+    TiledArray2D(const TiledArray2D&) = delete;
+
+    TiledArray2D& operator=(const TiledArray2D&) = delete;
+
+
+    TiledArray2D(TiledArray2D&& Other) noexcept
+    {
+        Swap(Other);
+    }
+
+
+    TiledArray2D& operator=(TiledArray2D&& Other) noexcept
+    {
+        if (this != &Other) {
+            Destroy();
+            Swap(Other);
+        }
+
+        return *this;
+    }
+
+
+    ~TiledArray2D()
+    {
+        Destroy();
+    }
+
+
+    void Swap(TiledArray2D& Other) noexcept
+    {
+        std::swap(m_p, Other.m_p);
+        std::swap(m_cols, Other.m_cols);
+        std::swap(m_rows, Other.m_rows);
+        std::swap(m_tilesX, Other.m_tilesX);
+        std::swap(m_tilesZ, Other.m_tilesZ);
+    }
+
+
+    void InitArray2D(int Cols, int Rows)
+    {
+        int TilesX = (Cols + TILED_ARRAY_2D_TILE_MASK) >> TILED_ARRAY_2D_TILE_BITS;
+        int TilesZ = (Rows + TILED_ARRAY_2D_TILE_MASK) >> TILED_ARRAY_2D_TILE_BITS;
+
+        if (!m_p || (TilesX * TilesZ != m_tilesX * m_tilesZ)) {
+            Destroy();
+            m_p = (Type*)AllocArray2DMemory((size_t)TilesX * TilesZ * TILE_ELEMENTS * sizeof(Type));
+        }
+
+        m_cols = Cols;
+        m_rows = Rows;
+        m_tilesX = TilesX;
+        m_tilesZ = TilesZ;
+    }
+
+
+    void InitArray2D(int Cols, int Rows, Type InitVal)
+    {
+        InitArray2D(Cols, Rows);
+
+        for (size_t i = 0 ; i < (size_t)m_tilesX * m_tilesZ * TILE_ELEMENTS ; i++) {
+            m_p[i] = InitVal;
+        }
+    }
+
+
+    // Converts a row major array. The rows of the source are read as spans.
+    void InitFromArray2D(const Array2D<Type>& Src)
+    {
+        InitArray2D(Src.GetCols(), Src.GetRows());
+
+        for (int z = 0 ; z < m_rows ; z++) {
+            const Type* pRow = Src.GetRow(z);
+
+            for (int x = 0 ; x < m_cols ; x++) {
+                m_p[CalcIndex(x, z)] = pRow[x];
+            }
+        }
+    }
+
+
+    void CopyToArray2D(Array2D<Type>& Dst) const
+    {
+        Dst.InitArray2D(m_cols, m_rows);
+
+        for (int z = 0 ; z < m_rows ; z++) {
+            Type* pRow = Dst.GetRow(z);
+
+            for (int x = 0 ; x < m_cols ; x++) {
+                pRow[x] = m_p[CalcIndex(x, z)];
+            }
+        }
+    }
+
+
+    void Destroy()
+    {
+        if (m_p) {
+            FreeArray2DMemory(m_p);
+            m_p = NULL;
+        }
+
+        m_cols = 0;
+        m_rows = 0;
+        m_tilesX = 0;
+        m_tilesZ = 0;
+    }
+
+
+    int GetCols() const
+    {
+        return m_cols;
+    }
+
+
+    int GetRows() const
+    {
+        return m_rows;
+    }
+
+
+    const Type& Get(int Col, int Row) const
+    {
+        return m_p[CheckIndex(Col, Row)];
+    }
+
+
+    Type& At(int Col, int Row)
+    {
+        return m_p[CheckIndex(Col, Row)];
+    }
+
+
+    void Set(int Col, int Row, const Type& Val)
+    {
+        m_p[CheckIndex(Col, Row)] = Val;
+    }
+
+
+    // The 64 elements of a tile in Morton order
+    Type* GetTileAddr(int TileX, int TileZ) const
+    {
+        return &m_p[((size_t)TileZ * m_tilesX + TileX) * TILE_ELEMENTS];
+    }
+
+ private:
+
+    static const int TILE_ELEMENTS = TILED_ARRAY_2D_TILE_SIZE * TILED_ARRAY_2D_TILE_SIZE;
+
+    // Spreads the three low bits of v to the even bits
+    static size_t SpreadBits(int v)
+    {
+        static const unsigned char Spread[TILED_ARRAY_2D_TILE_SIZE] = { 0, 1, 4, 5, 16, 17, 20, 21 };
+        return Spread[v & TILED_ARRAY_2D_TILE_MASK];
+    }
+
+
+    size_t CalcIndex(int Col, int Row) const
+    {
+        size_t Tile = (size_t)(Row >> TILED_ARRAY_2D_TILE_BITS) * m_tilesX + (Col >> TILED_ARRAY_2D_TILE_BITS);
+
+        return Tile * TILE_ELEMENTS + (SpreadBits(Col) | (SpreadBits(Row) << 1));
+    }
+
+
+    size_t CheckIndex(int Col, int Row) const
+    {
+#ifndef NDEBUG
+        if ((Col < 0) || (Col >= m_cols) || (Row < 0) || (Row >= m_rows)) {
+            printf("%s:%d - (%d, %d) is out of bounds (%d x %d)\n", __FILE__, __LINE__, Col, Row, m_cols, m_rows);
+            exit(0);
+        }
+#endif
+        return CalcIndex(Col, Row);
+    }
+
+    Type* m_p = NULL;
+    int m_cols = 0;
+    int m_rows = 0;
+    int m_tilesX = 0;
+    int m_tilesZ = 0;
+};
+
+
+#endif
@@ -5,13 +5,31 @@ CC=g++
 CPPFLAGS=`pkg-config --cflags glew glfw3 assimp`
 CPPFLAGS="$CPPFLAGS -I$OGLDEV_DIR/Include -I$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW -ggdb3"
 LDFLAGS=`pkg-config --libs glew glfw3 assimp`
-LDFLAGS="$LDFLAGS -lX11 -ldl -lmeshoptimizer"
+LDFLAGS="$LDFLAGS -lX11 -ldl -lmeshoptimizer -pthread"
 SOURCES="terrain_demo12.cpp \
 	geomip_grid.cpp \
 	terrain_technique.cpp \
 	midpoint_disp_terrain.cpp \
 	terrain.cpp \
 	lod_manager.cpp \
+	height_quadtree.cpp \
+	patch_index_cache.cpp \
+	geomip_cull_technique.cpp \
+	cdlod_grid.cpp \
+	cdlod_technique.cpp \
+	geomip_compact_technique.cpp \
+	terrain_normals.cpp \
+	terrain_height_query.cpp \
+	height_map_pager.cpp \
+	height_map_codec.cpp \
+	mapped_file.cpp \
+	geomip_cache.cpp \
+	terrain_noise.cpp \
+	chunked_terrain.cpp \
+	horizon_culler.cpp \
+	terrain_scatter.cpp \
+	scatter_technique.cpp \
+	scatter_cull_technique.cpp \
 	$OGLDEV_DIR/Common/ogldev_util.cpp \
 	$OGLDEV_DIR/Common/math_3d.cpp \
 	$OGLDEV_DIR/Common/ogldev_basic_glfw_camera.cpp \
@@ -0,0 +1,95 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#version 330
+
+layout (location = 0) in vec2 InGridPos;       // [0, 1] across the node
+layout (location = 1) in vec4 InNode;          // per instance - world x/z of the node corner, world size, LOD
+
+uniform mat4 gVP;
+uniform float gMinHeight;
+uniform float gMaxHeight;
+uniform sampler2D gHeightMap;
+uniform vec3 gCameraPos;
+uniform float gTerrainSize;                    // height map points per side
+uniform float gHeightMapSize;                  // texture texels per side (a window of the terrain when paged)
+uniform vec4 gResidentRegion;                  // first and last points in the texture (x0, z0, x1, z1)
+uniform float gWorldScale;
+uniform float gTextureScale;
+uniform float gGridSize;                       // grid quads per side
+uniform vec2 gMorphRanges[16];                 // start/end distance of the morph of every LOD
+
+out vec4 Color;
+out vec2 Tex;
+out vec3 WorldPos;
+out vec3 Normal;
+out float gl_ClipDistance[4];
+
+// x and z are in height map units. Point (x, z) is at the center of texel (x, z) modulo
+// the texture size (the paged window wraps around).
+float GetHeight(vec2 p)
+{
+    p = clamp(p, gResidentRegion.xy, gResidentRegion.zw);
+    return textureLod(gHeightMap, (p + 0.5) / gHeightMapSize, 0.0).r;
+}
+
+
+void main()
+{
+    int Lod = int(InNode.w);
+    float MaxCoord = gTerrainSize - 1.0;
+
+    vec2 p = min((InNode.xy + InGridPos * InNode.z) / gWorldScale, vec2(MaxCoord));
+    float Distance = distance(gCameraPos, vec3(p.x * gWorldScale, GetHeight(p), p.y * gWorldScale));
+
+    vec2 Range = gMorphRanges[Lod];
+    float Morph = clamp((Distance - Range.x) / (Range.y - Range.x), 0.0, 1.0);
+
+    // The odd vertices of the grid slide onto their even neighbors so that a fully
+    // morphed node matches the grid of the next LOD
+    vec2 Frac = fract(InGridPos * gGridSize * 0.5) * 2.0 / gGridSize;
+    vec2 GridPos = InGridPos - Frac * Morph;
+
+    p = min((InNode.xy + GridPos * InNode.z) / gWorldScale, vec2(MaxCoord));
+
+    float Height = GetHeight(p);
+
+    WorldPos = vec3(p.x * gWorldScale, Height, p.y * gWorldScale);
+
+    gl_Position = gVP * vec4(WorldPos, 1.0);
+
+    // Cuts the nodes at the edges of the resident region (only enabled when paged)
+    gl_ClipDistance[0] = p.x - gResidentRegion.x;
+    gl_ClipDistance[1] = p.y - gResidentRegion.y;
+    gl_ClipDistance[2] = gResidentRegion.z - p.x;
+    gl_ClipDistance[3] = gResidentRegion.w - p.y;
+
+    float HeightRatio = (Height - gMinHeight) / (gMaxHeight - gMinHeight);
+
+    float c = HeightRatio * 0.8 + 0.2;
+
+    Color = vec4(c, c, c, 1.0);
+
+    Tex = gTextureScale * p / gTerrainSize;
+
+    float HeightL = GetHeight(p - vec2(1.0, 0.0));
+    float HeightR = GetHeight(p + vec2(1.0, 0.0));
+    float HeightD = GetHeight(p - vec2(0.0, 1.0));
+    float HeightU = GetHeight(p + vec2(0.0, 1.0));
+
+    Normal = normalize(vec3(HeightL - HeightR, 2.0 * gWorldScale, HeightD - HeightU));
+}
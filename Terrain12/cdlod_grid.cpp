@@ -0,0 +1,532 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <float.h>
+#include <algorithm>
+
+#include "cdlod_grid.h"
+#include "terrain.h"
+#include "height_map_pager.h"
+#include "texture_config.h"
+
+// Vertex attribute locations in cdlod.vs
+#define GRID_POS_LOC 0
+#define NODE_LOC     1
+
+// The part of the range of every LOD over which it morphs into the next LOD
+#define CDLOD_MORPH_REGION 0.3f
+
+// Texels per side of the height map texture of a paged terrain
+#define CDLOD_PAGED_WINDOW_SIZE 4096
+
+
+CdlodGrid::~CdlodGrid()
+{
+    Destroy();
+}
+
+
+void CdlodGrid::Destroy()
+{
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+
+    GLuint Buffers[3] = { m_vb, m_ib, m_instanceBuffer };
+
+    for (int i = 0 ; i < 3 ; i++) {
+        if (Buffers[i] > 0) {
+            glDeleteBuffers(1, &Buffers[i]);
+        }
+    }
+
+    m_vb = m_ib = m_instanceBuffer = 0;
+
+    if (m_heightMapTexture > 0) {
+        glDeleteTextures(1, &m_heightMapTexture);
+        m_heightMapTexture = 0;
+    }
+
+    m_pTerrain = NULL;
+    m_pPager = NULL;
+    m_levelSizes.clear();
+    m_windowX = m_windowZ = -1;
+    m_numSelectedNodes = 0;
+}
+
+
+void CdlodGrid::CreateCdlodGrid(const BaseTerrain* pTerrain, int GridSize)
+{
+    if ((GridSize < 2) || (GridSize > 128) || ((GridSize & (GridSize - 1)) != 0)) {
+        printf("%s:%d - grid size must be a power of two between 2 and 128 (%d)\n", __FILE__, __LINE__, GridSize);
+        exit(0);
+    }
+
+    Destroy();
+
+    m_pTerrain = pTerrain;
+    m_pPager = pTerrain->IsPaged() ? &pTerrain->GetPager() : NULL;
+    m_terrainSize = pTerrain->GetSize();
+    m_gridSize = GridSize;
+    m_worldScale = pTerrain->GetWorldScale();
+
+    // A paged terrain doesn't have a quadtree so the levels are calculated here
+    int LevelSize = m_terrainSize - 1;
+
+    while (true) {
+        m_levelSizes.push_back(LevelSize);
+
+        if (LevelSize == 1) {
+            break;
+        }
+
+        LevelSize = (LevelSize + 1) / 2;
+    }
+
+    int TopLevel = (int)m_levelSizes.size() - 1;
+
+    // The leaf nodes have one grid quad per height map quad unless there are too many LODs
+    m_leafLevel = std::min((int)log2f((float)GridSize), TopLevel);
+    m_leafLevel = std::max(m_leafLevel, TopLevel - (CDLOD_MAX_LODS - 1));
+    m_numLods = TopLevel - m_leafLevel + 1;
+
+    printf("CDLOD: grid size %d, %d LODs, leaf level %d\n", GridSize, m_numLods, m_leafLevel);
+
+    CalcLodRanges();
+
+    if (m_pPager) {
+        CreatePagedHeightMapTexture();
+    } else {
+        CreateHeightMapTexture();
+    }
+
+    CreateGridMesh();
+}
+
+
+void CdlodGrid::SetDetailDistance(float Distance)
+{
+    m_detailDistance = std::max(Distance, 2.0f);
+
+    if (m_numLods > 0) {
+        CalcLodRanges();
+    }
+}
+
+
+void CdlodGrid::CalcLodRanges()
+{
+    float LeafSize = (float)(1 << m_leafLevel) * m_worldScale;
+    float PrevRange = 0.0f;
+
+    for (int Lod = 0 ; Lod < m_numLods ; Lod++) {
+        // The top LOD covers everything and never morphs
+        if (Lod == m_numLods - 1) {
+            m_lodRanges[Lod] = FLT_MAX;
+            m_morphRanges[Lod * 2] = 1e30f;
+            m_morphRanges[Lod * 2 + 1] = 2e30f;
+            break;
+        }
+
+        float Range = m_detailDistance * LeafSize * (float)powi(2, Lod);
+
+        m_lodRanges[Lod] = Range;
+        m_morphRanges[Lod * 2] = PrevRange + (Range - PrevRange) * (1.0f - CDLOD_MORPH_REGION);
+        m_morphRanges[Lod * 2 + 1] = Range;
+
+        PrevRange = Range;
+    }
+}
+
+
+void CdlodGrid::CreateHeightMapTexture()
+{
+    int TerrainSize = m_pTerrain->GetSize();
+
+    GLint MaxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxTextureSize);
+
+    if (TerrainSize > MaxTextureSize) {
+        printf("%s:%d - terrain size %d is larger than the max texture size %d\n", __FILE__, __LINE__, TerrainSize, MaxTextureSize);
+        exit(0);
+    }
+
+    glGenTextures(1, &m_heightMapTexture);
+    glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, TerrainSize, TerrainSize, 0, GL_RED, GL_FLOAT,
+                 m_pTerrain->GetHeightMap().GetBaseAddr());
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_heightMapTextureSize = TerrainSize;
+    m_residentX0 = m_residentZ0 = 0;
+    m_residentX1 = m_residentZ1 = TerrainSize - 1;
+}
+
+
+void CdlodGrid::CreatePagedHeightMapTexture()
+{
+    GLint MaxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxTextureSize);
+
+    int TileSize = m_pPager->GetTileSize();
+
+    m_windowTiles = std::min(CDLOD_PAGED_WINDOW_SIZE, (int)MaxTextureSize) / TileSize;
+    m_windowTiles = std::min(m_windowTiles, m_pPager->GetNumTiles());
+
+    if (m_windowTiles < std::min(3, m_pPager->GetNumTiles())) {
+        printf("%s:%d - tile size %d is too large for the paged window\n", __FILE__, __LINE__, TileSize);
+        exit(0);
+    }
+
+    m_heightMapTextureSize = m_windowTiles * TileSize;
+    m_windowX = m_windowZ = -1;
+
+    glGenTextures(1, &m_heightMapTexture);
+    glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_heightMapTextureSize, m_heightMapTextureSize, 0, GL_RED, GL_FLOAT, NULL);
+
+    // The shader never samples across the edges of the resident region so the wrap
+    // around only affects the addressing
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    printf("CDLOD: paged window of %dx%d tiles (%d texels)\n", m_windowTiles, m_windowTiles, m_heightMapTextureSize);
+}
+
+
+void CdlodGrid::UpdateWindow(const Vector3f& CameraPos)
+{
+    int TileSize = m_pPager->GetTileSize();
+    int NumTiles = m_pPager->GetNumTiles();
+    int MaxFirstTile = NumTiles - m_windowTiles;
+
+    int CameraTileX = std::min(std::max((int)(CameraPos.x / m_worldScale) / TileSize, 0), NumTiles - 1);
+    int CameraTileZ = std::min(std::max((int)(CameraPos.z / m_worldScale) / TileSize, 0), NumTiles - 1);
+
+    int WindowX = std::min(std::max(CameraTileX - m_windowTiles / 2, 0), MaxFirstTile);
+    int WindowZ = std::min(std::max(CameraTileZ - m_windowTiles / 2, 0), MaxFirstTile);
+
+    bool HasWindow = (m_windowX >= 0);
+
+    if (HasWindow && (abs(WindowX - m_windowX) <= 1) && (abs(WindowZ - m_windowZ) <= 1)) {
+        return;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+
+    for (int TileZ = WindowZ ; TileZ < WindowZ + m_windowTiles ; TileZ++) {
+        for (int TileX = WindowX ; TileX < WindowX + m_windowTiles ; TileX++) {
+            bool WasResident = HasWindow &&
+                               (TileX >= m_windowX) && (TileX < m_windowX + m_windowTiles) &&
+                               (TileZ >= m_windowZ) && (TileZ < m_windowZ + m_windowTiles);
+
+            if (!WasResident) {
+                UploadTile(TileX, TileZ);
+            }
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_windowX = WindowX;
+    m_windowZ = WindowZ;
+
+    m_residentX0 = WindowX * TileSize;
+    m_residentZ0 = WindowZ * TileSize;
+    m_residentX1 = std::min((WindowX + m_windowTiles) * TileSize, m_terrainSize) - 1;
+    m_residentZ1 = std::min((WindowZ + m_windowTiles) * TileSize, m_terrainSize) - 1;
+}
+
+
+void CdlodGrid::UploadTile(int TileX, int TileZ)
+{
+    int TileSize = m_pPager->GetTileSize();
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (TileX % m_windowTiles) * TileSize, (TileZ % m_windowTiles) * TileSize,
+                    TileSize, TileSize, GL_RED, GL_FLOAT, m_pPager->GetTile(TileX, TileZ));
+}
+
+
+//
+// The indices of every quarter of the grid are contiguous so a quarter can be drawn on
+// its own and the whole grid is the range that covers all four of them.
+//
+void CdlodGrid::CreateGridMesh()
+{
+    int NumVerticesPerSide = m_gridSize + 1;
+
+    std::vector<Vector2f> Vertices(NumVerticesPerSide * NumVerticesPerSide);
+
+    for (int z = 0 ; z < NumVerticesPerSide ; z++) {
+        for (int x = 0 ; x < NumVerticesPerSide ; x++) {
+            Vertices[z * NumVerticesPerSide + x] = Vector2f((float)x / (float)m_gridSize, (float)z / (float)m_gridSize);
+        }
+    }
+
+    std::vector<u16> Indices;
+    int Half = m_gridSize / 2;
+
+    for (int Quarter = 0 ; Quarter < 4 ; Quarter++) {
+        int x0 = (Quarter & 1) * Half;
+        int z0 = (Quarter >> 1) * Half;
+
+        m_partStart[FULL_NODE + 1 + Quarter] = (int)Indices.size();
+
+        for (int z = z0 ; z < z0 + Half ; z++) {
+            for (int x = x0 ; x < x0 + Half ; x++) {
+                u16 Index00 = (u16)(z * NumVerticesPerSide + x);
+                u16 Index10 = (u16)(Index00 + 1);
+                u16 Index01 = (u16)(Index00 + NumVerticesPerSide);
+                u16 Index11 = (u16)(Index01 + 1);
+
+                // Same winding as the geomip grid
+                Indices.push_back(Index00);
+                Indices.push_back(Index01);
+                Indices.push_back(Index11);
+
+                Indices.push_back(Index00);
+                Indices.push_back(Index11);
+                Indices.push_back(Index10);
+            }
+        }
+
+        m_partCount[FULL_NODE + 1 + Quarter] = (int)Indices.size() - m_partStart[FULL_NODE + 1 + Quarter];
+    }
+
+    m_partStart[FULL_NODE] = 0;
+    m_partCount[FULL_NODE] = (int)Indices.size();
+
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+    glBufferData(GL_ARRAY_BUFFER, Vertices.size() * sizeof(Vertices[0]), &Vertices[0], GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(GRID_POS_LOC);
+    glVertexAttribPointer(GRID_POS_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f), (const void*)0);
+
+    glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, Indices.size() * sizeof(Indices[0]), &Indices[0], GL_STATIC_DRAW);
+
+    // The pointer of the per node attribute is set for every draw in Render
+    glGenBuffers(1, &m_instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glEnableVertexAttribArray(NODE_LOC);
+    glVertexAttribDivisor(NODE_LOC, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+void CdlodGrid::GetNodeAABB(int Level, int NodeX, int NodeZ, Vector3f& Min, Vector3f& Max) const
+{
+    int NodeSize = 1 << Level;
+    int NumQuads = m_terrainSize - 1;
+
+    int x0 = NodeX * NodeSize;
+    int z0 = NodeZ * NodeSize;
+    int x1 = std::min(x0 + NodeSize, NumQuads);
+    int z1 = std::min(z0 + NodeSize, NumQuads);
+
+    float MinHeight, MaxHeight;
+
+    if (m_pPager) {
+        m_pPager->GetMinMax(x0, z0, x1, z1, MinHeight, MaxHeight);
+    } else {
+        m_pTerrain->GetHeightQuadtree().GetNodeMinMax(Level, NodeX, NodeZ, MinHeight, MaxHeight);
+    }
+
+    Min = Vector3f((float)x0 * m_worldScale, MinHeight, (float)z0 * m_worldScale);
+    Max = Vector3f((float)x1 * m_worldScale, MaxHeight, (float)z1 * m_worldScale);
+}
+
+
+static bool IntersectSphere(const Vector3f& Min, const Vector3f& Max, const Vector3f& Center, float Radius)
+{
+    float dx = std::max(std::max(Min.x - Center.x, Center.x - Max.x), 0.0f);
+    float dy = std::max(std::max(Min.y - Center.y, Center.y - Max.y), 0.0f);
+    float dz = std::max(std::max(Min.z - Center.z, Center.z - Max.z), 0.0f);
+
+    return (dx * dx + dy * dy + dz * dz) < Radius * Radius;
+}
+
+
+bool CdlodGrid::SelectNode(int Level, int NodeX, int NodeZ, const Vector3f& CameraPos, const FrustumCulling& FC, bool FullyInside)
+{
+    Vector3f Min, Max;
+    GetNodeAABB(Level, NodeX, NodeZ, Min, Max);
+
+    // Nothing to draw outside of the paged window
+    if (m_pPager && ((Max.x < (float)m_residentX0 * m_worldScale) || (Min.x > (float)m_residentX1 * m_worldScale) ||
+                     (Max.z < (float)m_residentZ0 * m_worldScale) || (Min.z > (float)m_residentZ1 * m_worldScale))) {
+        return true;
+    }
+
+    int Lod = Level - m_leafLevel;
+
+    if (!IntersectSphere(Min, Max, CameraPos, m_lodRanges[Lod])) {
+        return false;
+    }
+
+    // Outside the frustum - handled, nothing to draw
+    if (!FullyInside) {
+        if (!FC.IsAABBInsideViewFrustum(Min, Max)) {
+            return true;
+        }
+
+        FullyInside = FC.IsAABBFullyInsideViewFrustum(Min, Max);
+    }
+
+    if ((Lod == 0) || !IntersectSphere(Min, Max, CameraPos, m_lodRanges[Lod - 1])) {
+        AddNode(Level, NodeX, NodeZ, FULL_NODE);
+        return true;
+    }
+
+    int ChildSize = m_levelSizes[Level - 1];
+
+    // Children which are too far for the finer LOD leave their quarter to this node
+    for (int i = 0 ; i < 4 ; i++) {
+        int ChildX = NodeX * 2 + (i & 1);
+        int ChildZ = NodeZ * 2 + (i >> 1);
+
+        if ((ChildX >= ChildSize) || (ChildZ >= ChildSize)) {
+            continue;
+        }
+
+        if (!SelectNode(Level - 1, ChildX, ChildZ, CameraPos, FC, FullyInside)) {
+            AddNode(Level, NodeX, NodeZ, FULL_NODE + 1 + i);
+        }
+    }
+
+    return true;
+}
+
+
+void CdlodGrid::AddNode(int Level, int NodeX, int NodeZ, int Part)
+{
+    float NodeSize = (float)(1 << Level) * m_worldScale;
+
+    NodeInstance Node;
+    Node.x = (float)NodeX * NodeSize;
+    Node.z = (float)NodeZ * NodeSize;
+    Node.Size = NodeSize;
+    Node.Lod = (float)(Level - m_leafLevel);
+
+    m_instances[Part].push_back(Node);
+}
+
+
+void CdlodGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj, CdlodTechnique& Tech)
+{
+    for (int Part = 0 ; Part < NUM_NODE_PARTS ; Part++) {
+        m_instances[Part].clear();
+    }
+
+    if (m_pPager) {
+        UpdateWindow(CameraPos);
+    }
+
+    FrustumCulling FC(ViewProj);
+
+    int TopLevel = m_leafLevel + m_numLods - 1;
+    int TopSize = m_levelSizes[TopLevel];
+
+    for (int NodeZ = 0 ; NodeZ < TopSize ; NodeZ++) {
+        for (int NodeX = 0 ; NodeX < TopSize ; NodeX++) {
+            SelectNode(TopLevel, NodeX, NodeZ, CameraPos, FC, false);
+        }
+    }
+
+    // All the parts share one instance buffer
+    int FirstInstance[NUM_NODE_PARTS];
+    m_instanceData.clear();
+
+    for (int Part = 0 ; Part < NUM_NODE_PARTS ; Part++) {
+        FirstInstance[Part] = (int)m_instanceData.size();
+        m_instanceData.insert(m_instanceData.end(), m_instances[Part].begin(), m_instances[Part].end());
+    }
+
+    m_numSelectedNodes = (int)m_instanceData.size();
+
+    if (m_instanceData.empty()) {
+        return;
+    }
+
+    Tech.SetCameraPos(CameraPos);
+    Tech.SetTerrainParams(m_pTerrain->GetSize(), m_worldScale, m_pTerrain->GetTextureScale());
+    Tech.SetGridSize(m_gridSize);
+    Tech.SetHeightMapRegion(m_heightMapTextureSize, m_residentX0, m_residentZ0, m_residentX1, m_residentZ1);
+    Tech.SetMorphRanges(m_morphRanges, m_numLods);
+
+    glActiveTexture(HEIGHT_MAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+
+    glBindVertexArray(m_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, m_instanceData.size() * sizeof(NodeInstance), &m_instanceData[0], GL_STREAM_DRAW);
+
+    if (m_pPager) {
+        for (int i = 0 ; i < 4 ; i++) {
+            glEnable(GL_CLIP_DISTANCE0 + i);
+        }
+    }
+
+    for (int Part = 0 ; Part < NUM_NODE_PARTS ; Part++) {
+        int NumInstances = (int)m_instances[Part].size();
+
+        if (NumInstances == 0) {
+            continue;
+        }
+
+        glVertexAttribPointer(NODE_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance),
+                              (const void*)(FirstInstance[Part] * sizeof(NodeInstance)));
+
+        glDrawElementsInstanced(GL_TRIANGLES, m_partCount[Part], GL_UNSIGNED_SHORT,
+                                (const void*)(m_partStart[Part] * sizeof(u16)), NumInstances);
+    }
+
+    if (m_pPager) {
+        for (int i = 0 ; i < 4 ; i++) {
+            glDisable(GL_CLIP_DISTANCE0 + i);
+        }
+    }
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
@@ -0,0 +1,139 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CDLOD_GRID_H
+#define CDLOD_GRID_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_types.h"
+#include "cdlod_technique.h"
+
+class BaseTerrain;
+class HeightMapPager;
+
+//
+// Continuous distance-dependent LOD (CDLOD). The only geometry is a single grid mesh of
+// GridSize x GridSize quads which is instanced for every selected node of the height
+// quadtree. The vertex shader takes the heights from a texture and morphs each vertex
+// towards the grid of the next LOD by its distance from the camera, so vertex memory
+// doesn't depend on the size of the terrain and the number of draw calls is constant.
+//
+// When the terrain is paged from a tiled file the texture holds a window of tiles around
+// the camera. The window wraps around the texture so moving it only uploads the tiles
+// that enter it, and the geometry is clipped to the tiles that are resident.
+//
+class CdlodGrid {
+ public:
+    CdlodGrid() {}
+
+    ~CdlodGrid();
+
+    // GridSize must be a power of two
+    void CreateCdlodGrid(const BaseTerrain* pTerrain, int GridSize);
+
+    void Destroy();
+
+    bool IsCreated() const { return m_vao != 0; }
+
+    // The technique must be enabled
+    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj, CdlodTechnique& Tech);
+
+    //
+    // The finest LOD is used up to Distance leaf node sizes from the camera and the range
+    // of every other LOD is twice the range of the previous one. Adjacent nodes never
+    // differ by more than one LOD as long as this is at least two.
+    //
+    void SetDetailDistance(float Distance);
+
+    int GetNumSelectedNodes() const { return m_numSelectedNodes; }
+
+ private:
+
+    // A node is drawn in full or one of its quarters is drawn at the LOD of the node
+    // (when its child covers the rest). The quarters are ordered like the children.
+    enum NODE_PART {
+        FULL_NODE = 0,
+        NUM_NODE_PARTS = 5
+    };
+
+    struct NodeInstance {
+        float x = 0.0f;     // world space corner
+        float z = 0.0f;
+        float Size = 0.0f;  // world space
+        float Lod = 0.0f;
+    };
+
+    void CreateGridMesh();
+
+    void CreateHeightMapTexture();
+
+    void CreatePagedHeightMapTexture();
+
+    // Moves the paged window when the camera is more than one tile away from its center
+    void UpdateWindow(const Vector3f& CameraPos);
+
+    void UploadTile(int TileX, int TileZ);
+
+    void CalcLodRanges();
+
+    // Returns false if the node is too far for its LOD so that its parent covers it
+    bool SelectNode(int Level, int NodeX, int NodeZ, const Vector3f& CameraPos, const FrustumCulling& FC, bool FullyInside);
+
+    void AddNode(int Level, int NodeX, int NodeZ, int Part);
+
+    void GetNodeAABB(int Level, int NodeX, int NodeZ, Vector3f& Min, Vector3f& Max) const;
+
+    const BaseTerrain* m_pTerrain = NULL;
+    const HeightMapPager* m_pPager = NULL;      // NULL unless the terrain is paged
+    int m_terrainSize = 0;
+    std::vector<int> m_levelSizes;              // same as the height quadtree
+    int m_gridSize = 0;
+    int m_leafLevel = 0;            // the quadtree level of the finest LOD
+    int m_numLods = 0;
+    float m_worldScale = 1.0f;
+    float m_detailDistance = 3.0f;
+    float m_lodRanges[CDLOD_MAX_LODS] = { 0 };
+    float m_morphRanges[CDLOD_MAX_LODS * 2] = { 0 };
+
+    GLuint m_vao = 0;
+    GLuint m_vb = 0;
+    GLuint m_ib = 0;
+    GLuint m_instanceBuffer = 0;
+    GLuint m_heightMapTexture = 0;
+    int m_heightMapTextureSize = 0;
+
+    int m_windowTiles = 0;                      // per side
+    int m_windowX = -1;                         // first tile of the window
+    int m_windowZ = -1;
+    int m_residentX0 = 0;                       // first and last resident points
+    int m_residentZ0 = 0;
+    int m_residentX1 = 0;
+    int m_residentZ1 = 0;
+    int m_partStart[NUM_NODE_PARTS] = { 0 };        // in indices
+    int m_partCount[NUM_NODE_PARTS] = { 0 };
+
+    std::vector<NodeInstance> m_instances[NUM_NODE_PARTS];
+    std::vector<NodeInstance> m_instanceData;
+    int m_numSelectedNodes = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "cdlod_technique.h"
+#include "texture_config.h"
+
+
+CdlodTechnique::CdlodTechnique() : TerrainTechnique("cdlod.vs")
+{
+}
+
+bool CdlodTechnique::Init()
+{
+    if (!TerrainTechnique::Init()) {
+        return false;
+    }
+
+    m_heightMapLoc = GetUniformLocation("gHeightMap");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_terrainSizeLoc = GetUniformLocation("gTerrainSize");
+    m_heightMapSizeLoc = GetUniformLocation("gHeightMapSize");
+    m_residentRegionLoc = GetUniformLocation("gResidentRegion");
+    m_worldScaleLoc = GetUniformLocation("gWorldScale");
+    m_textureScaleLoc = GetUniformLocation("gTextureScale");
+    m_gridSizeLoc = GetUniformLocation("gGridSize");
+    m_morphRangesLoc = GetUniformLocation("gMorphRanges");
+
+    if (m_heightMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_terrainSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_heightMapSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_residentRegionLoc == INVALID_UNIFORM_LOCATION ||
+        m_worldScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_textureScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_gridSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_morphRangesLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    Enable();
+
+    glUniform1i(m_heightMapLoc, HEIGHT_MAP_TEXTURE_UNIT_INDEX);
+
+    glUseProgram(0);
+
+    return true;
+}
+
+
+void CdlodTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void CdlodTechnique::SetTerrainParams(int TerrainSize, float WorldScale, float TextureScale)
+{
+    glUniform1f(m_terrainSizeLoc, (float)TerrainSize);
+    glUniform1f(m_worldScaleLoc, WorldScale);
+    glUniform1f(m_textureScaleLoc, TextureScale);
+}
+
+
+void CdlodTechnique::SetGridSize(int GridSize)
+{
+    glUniform1f(m_gridSizeLoc, (float)GridSize);
+}
+
+
+void CdlodTechnique::SetHeightMapRegion(int TextureSize, int x0, int z0, int x1, int z1)
+{
+    glUniform1f(m_heightMapSizeLoc, (float)TextureSize);
+    glUniform4f(m_residentRegionLoc, (float)x0, (float)z0, (float)x1, (float)z1);
+}
+
+
+void CdlodTechnique::SetMorphRanges(const float* pMorphRanges, int NumLods)
+{
+    glUniform2fv(m_morphRangesLoc, NumLods, pMorphRanges);
+}
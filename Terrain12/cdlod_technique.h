@@ -0,0 +1,63 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CDLOD_TECHNIQUE_H
+#define CDLOD_TECHNIQUE_H
+
+#include "terrain_technique.h"
+
+#define CDLOD_MAX_LODS 16
+
+//
+// Same fragment shader and material uniforms as the terrain technique. The vertex
+// shader places an instance of the grid mesh per quadtree node and takes the heights
+// from the height map texture.
+//
+class CdlodTechnique : public TerrainTechnique
+{
+public:
+
+    CdlodTechnique();
+
+    virtual bool Init();
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    void SetTerrainParams(int TerrainSize, float WorldScale, float TextureScale);
+
+    void SetGridSize(int GridSize);
+
+    // The points [x0, x1] x [z0, z1] are in the height map texture
+    void SetHeightMapRegion(int TextureSize, int x0, int z0, int x1, int z1);
+
+    // Start and end distance of the morph of every LOD
+    void SetMorphRanges(const float* pMorphRanges, int NumLods);
+
+private:
+    GLuint m_heightMapLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_terrainSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_heightMapSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_residentRegionLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_worldScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_textureScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_gridSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_morphRangesLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* CDLOD_TECHNIQUE_H */
@@ -0,0 +1,643 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "chunked_terrain.h"
+
+#define POS_LOC              0
+#define TEX_LOC              1
+#define NORMAL_LOC           2
+#define MORPH_LOC            3      // the morph attributes of terrain.vs are constant zero
+#define PATCH_SIDE_LODS_LOC  4
+#define PATCH_SIDE_MORPH_LOC 5
+#define PATCH_CORE_LOC       6
+
+
+ChunkedTerrain::~ChunkedTerrain()
+{
+    Destroy();
+}
+
+
+void ChunkedTerrain::Destroy()
+{
+    StopWorkers();
+
+    m_jobs.clear();
+    m_built.clear();
+    m_chunks.clear();
+    m_uploads.clear();
+    m_nextUploadPatch = 0;
+    m_freeSlots.clear();
+    m_offsets.clear();
+    m_queueValid = false;
+
+    m_indexCache.Destroy();
+
+    if (m_vb > 0) {
+        glDeleteBuffers(1, &m_vb);
+        m_vb = 0;
+    }
+
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+}
+
+
+void ChunkedTerrain::CreateChunkedTerrain(const ChunkedTerrainParams& Params, const TerrainNoiseParams& NoiseParams)
+{
+    Destroy();
+
+    m_params = Params;
+    m_patchSegments = m_params.PatchSize - 1;
+
+    if ((m_patchSegments < 2) || ((m_patchSegments & (m_patchSegments - 1)) != 0)) {
+        printf("%s:%d - the patch size minus one must be a power of two (patch size %d)\n", __FILE__, __LINE__, m_params.PatchSize);
+        exit(0);
+    }
+
+    // Same as LodManager - the coarsest LOD has two quads on each side of the patch
+    m_maxLOD = -1;
+
+    for (int Segments = m_patchSegments ; Segments > 1 ; Segments /= 2) {
+        m_maxLOD++;
+    }
+
+    m_chunkSegments = m_patchSegments * m_params.PatchesPerChunk;
+    m_numPatchesPerChunk = m_params.PatchesPerChunk * m_params.PatchesPerChunk;
+    m_numVerticesPerChunk = m_numPatchesPerChunk * m_params.PatchSize * m_params.PatchSize;
+    m_lodDistance = (m_params.LodDistance > 0.0f) ? m_params.LodDistance : 2.0f * m_patchSegments * m_params.WorldScale;
+
+    // The chunks sample the noise at whole point coordinates so the shared edges are exact
+    TerrainNoiseParams PointNoiseParams = NoiseParams;
+    PointNoiseParams.Frequency *= m_params.WorldScale;
+    m_noise.Init(PointNoiseParams);
+
+    int ViewDistance = m_params.ViewDistance;
+
+    for (int z = -ViewDistance ; z <= ViewDistance ; z++) {
+        for (int x = -ViewDistance ; x <= ViewDistance ; x++) {
+            if (x * x + z * z <= ViewDistance * ViewDistance) {
+                m_offsets.push_back(Vector2i{ x, z });
+            }
+        }
+    }
+
+    std::stable_sort(m_offsets.begin(), m_offsets.end(), [](const Vector2i& a, const Vector2i& b) {
+        return a.x * a.x + a.y * a.y < b.x * b.x + b.y * b.y;
+    });
+
+    int MaxChunks = m_params.MaxChunks;
+
+    if (MaxChunks == 0) {
+        int Radius = ViewDistance + 1;
+
+        for (int z = -Radius ; z <= Radius ; z++) {
+            for (int x = -Radius ; x <= Radius ; x++) {
+                MaxChunks += (x * x + z * z <= Radius * Radius) ? 1 : 0;
+            }
+        }
+    }
+
+    // All the chunks in range must fit
+    m_params.MaxChunks = std::max(MaxChunks, (int)m_offsets.size());
+
+    for (int i = m_params.MaxChunks - 1 ; i >= 0 ; i--) {
+        m_freeSlots.push_back(i);
+    }
+
+    m_stats = ChunkedTerrainStats();
+
+    CreateGLState();
+
+    StartWorkers();
+}
+
+
+void ChunkedTerrain::CreateGLState()
+{
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+    GLsizeiptr Size = (GLsizeiptr)m_params.MaxChunks * m_numVerticesPerChunk * sizeof(Vertex);
+    glBufferData(GL_ARRAY_BUFFER, Size, NULL, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexCache.GetIndexBuffer());
+
+    glEnableVertexAttribArray(POS_LOC);
+    glVertexAttribPointer(POS_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Pos));
+
+    glEnableVertexAttribArray(TEX_LOC);
+    glVertexAttribPointer(TEX_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Tex));
+
+    glEnableVertexAttribArray(NORMAL_LOC);
+    glVertexAttribPointer(NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Normal));
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    printf("Chunked terrain: %d chunk slots, vertex buffer %zu bytes\n", m_params.MaxChunks, (size_t)Size);
+}
+
+
+void ChunkedTerrain::StartWorkers()
+{
+    int NumWorkers = m_params.NumWorkers;
+
+    if (NumWorkers <= 0) {
+        NumWorkers = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+    }
+
+    m_quit = false;
+
+    for (int i = 0 ; i < NumWorkers ; i++) {
+        m_workers.push_back(std::thread(&ChunkedTerrain::WorkerThread, this));
+    }
+}
+
+
+void ChunkedTerrain::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_workAvailable.notify_all();
+
+    for (std::thread& Worker : m_workers) {
+        Worker.join();
+    }
+
+    m_workers.clear();
+}
+
+
+void ChunkedTerrain::WorkerThread()
+{
+    for (;;) {
+        Vector2i Job;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+            m_workAvailable.wait(Lock, [this] { return m_quit || !m_jobs.empty(); });
+
+            if (m_quit) {
+                return;
+            }
+
+            Job = m_jobs.back();
+            m_jobs.pop_back();
+        }
+
+        BuiltChunk Result;
+        BuildChunk(Job.x, Job.y, Result);
+
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_built.push_back(std::move(Result));
+    }
+}
+
+
+//
+// The heights of the chunk have an apron of one point for the central differences of
+// the normals, so the normals on the chunk edges match those of the neighbors too.
+//
+void ChunkedTerrain::BuildChunk(int ChunkX, int ChunkZ, BuiltChunk& Result) const
+{
+    int NumPoints = m_chunkSegments + 1;
+    int Pitch = NumPoints + 2;
+    int StartX = ChunkX * m_chunkSegments;
+    int StartZ = ChunkZ * m_chunkSegments;
+
+    std::vector<float> Heights((size_t)Pitch * Pitch);
+
+    for (int z = 0 ; z < Pitch ; z++) {
+        m_noise.GetHeights((float)(StartX - 1), (float)(StartZ - 1 + z), 1.0f, Pitch, &Heights[z * Pitch]);
+    }
+
+    Result.X = ChunkX;
+    Result.Z = ChunkZ;
+    Result.MinHeight = Heights[Pitch + 1];
+    Result.MaxHeight = Heights[Pitch + 1];
+
+    for (int z = 1 ; z <= NumPoints ; z++) {
+        for (int x = 1 ; x <= NumPoints ; x++) {
+            Result.MinHeight = std::min(Result.MinHeight, Heights[z * Pitch + x]);
+            Result.MaxHeight = std::max(Result.MaxHeight, Heights[z * Pitch + x]);
+        }
+    }
+
+    float WorldScale = m_params.WorldScale;
+    float TexScale = m_params.TextureScale / (float)m_chunkSegments;
+    int PatchSize = m_params.PatchSize;
+
+    Result.Vertices.resize(m_numVerticesPerChunk);
+    Vertex* pDst = Result.Vertices.data();
+
+    for (int PatchZ = 0 ; PatchZ < m_params.PatchesPerChunk ; PatchZ++) {
+        for (int PatchX = 0 ; PatchX < m_params.PatchesPerChunk ; PatchX++) {
+            for (int z = 0 ; z < PatchSize ; z++) {
+                for (int x = 0 ; x < PatchSize ; x++) {
+                    int LocalX = PatchX * m_patchSegments + x;
+                    int LocalZ = PatchZ * m_patchSegments + z;
+                    const float* pHeight = &Heights[(LocalZ + 1) * Pitch + LocalX + 1];
+
+                    pDst->Pos = Vector3f((float)(StartX + LocalX) * WorldScale, *pHeight, (float)(StartZ + LocalZ) * WorldScale);
+                    pDst->Tex = Vector2f((float)LocalX * TexScale, (float)LocalZ * TexScale);
+
+                    float dx = (pHeight[1] - pHeight[-1]) / (2.0f * WorldScale);
+                    float dz = (pHeight[Pitch] - pHeight[-Pitch]) / (2.0f * WorldScale);
+                    pDst->Normal = Vector3f(-dx, 1.0f, -dz);
+                    pDst->Normal.Normalize();
+
+                    pDst++;
+                }
+            }
+        }
+    }
+}
+
+
+bool ChunkedTerrain::IsInRange(int ChunkX, int ChunkZ) const
+{
+    int dx = ChunkX - m_cameraChunkX;
+    int dz = ChunkZ - m_cameraChunkZ;
+
+    return dx * dx + dz * dz <= m_params.ViewDistance * m_params.ViewDistance;
+}
+
+
+void ChunkedTerrain::Update(const Vector3f& CameraPos)
+{
+    auto StartTime = std::chrono::steady_clock::now();
+
+    m_frame++;
+
+    float ChunkWorldSize = GetChunkWorldSize();
+    int CameraChunkX = (int)floorf(CameraPos.x / ChunkWorldSize);
+    int CameraChunkZ = (int)floorf(CameraPos.z / ChunkWorldSize);
+
+    if (!m_queueValid || (CameraChunkX != m_cameraChunkX) || (CameraChunkZ != m_cameraChunkZ)) {
+        m_cameraChunkX = CameraChunkX;
+        m_cameraChunkZ = CameraChunkZ;
+        UpdateQueue();
+        m_queueValid = true;
+    }
+
+    ReceiveBuiltChunks();
+
+    UploadChunks();
+
+    m_stats.ResidentChunks = 0;
+    m_stats.QueuedChunks = 0;
+
+    for (const auto& it : m_chunks) {
+        m_stats.ResidentChunks += (it.second.State == CHUNK_READY) ? 1 : 0;
+        m_stats.QueuedChunks += (it.second.State == CHUNK_QUEUED) ? 1 : 0;
+    }
+
+    m_stats.UploadingChunks = (int)m_uploads.size();
+
+    auto EndTime = std::chrono::steady_clock::now();
+    m_stats.UpdateTime = std::chrono::duration<float, std::milli>(EndTime - StartTime).count();
+    m_stats.MaxUpdateTime = std::max(m_stats.MaxUpdateTime, m_stats.UpdateTime);
+}
+
+
+//
+// Called when the camera enters another chunk. The jobs that haven't started are dropped
+// if they are out of range, the missing chunks in range are added and everything is
+// sorted by the distance from the new camera chunk.
+//
+void ChunkedTerrain::UpdateQueue()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+
+        size_t NumKept = 0;
+
+        for (size_t i = 0 ; i < m_jobs.size() ; i++) {
+            if (IsInRange(m_jobs[i].x, m_jobs[i].y)) {
+                m_jobs[NumKept++] = m_jobs[i];
+            } else {
+                m_chunks.erase(GetChunkKey(m_jobs[i].x, m_jobs[i].y));
+            }
+        }
+
+        m_jobs.resize(NumKept);
+
+        for (const Vector2i& Offset : m_offsets) {
+            int ChunkX = m_cameraChunkX + Offset.x;
+            int ChunkZ = m_cameraChunkZ + Offset.y;
+            uint64_t Key = GetChunkKey(ChunkX, ChunkZ);
+
+            if (m_chunks.find(Key) == m_chunks.end()) {
+                Chunk& c = m_chunks[Key];
+                c.X = ChunkX;
+                c.Z = ChunkZ;
+                m_jobs.push_back(Vector2i{ ChunkX, ChunkZ });
+            }
+        }
+
+        int CameraChunkX = m_cameraChunkX;
+        int CameraChunkZ = m_cameraChunkZ;
+
+        // The workers take the jobs from the back
+        std::sort(m_jobs.begin(), m_jobs.end(), [CameraChunkX, CameraChunkZ](const Vector2i& a, const Vector2i& b) {
+            int ax = a.x - CameraChunkX;
+            int az = a.y - CameraChunkZ;
+            int bx = b.x - CameraChunkX;
+            int bz = b.y - CameraChunkZ;
+            return ax * ax + az * az > bx * bx + bz * bz;
+        });
+    }
+
+    m_workAvailable.notify_all();
+}
+
+
+void ChunkedTerrain::ReceiveBuiltChunks()
+{
+    std::vector<BuiltChunk> Built;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        Built.swap(m_built);
+    }
+
+    for (BuiltChunk& b : Built) {
+        auto it = m_chunks.find(GetChunkKey(b.X, b.Z));
+
+        if (it == m_chunks.end()) {
+            continue;
+        }
+
+        // The camera moved away while the chunk was being built
+        if (!IsInRange(b.X, b.Z)) {
+            m_chunks.erase(it);
+            continue;
+        }
+
+        it->second.State = CHUNK_UPLOADING;
+        it->second.MinHeight = b.MinHeight;
+        it->second.MaxHeight = b.MaxHeight;
+
+        m_uploads.push_back(std::move(b));
+    }
+}
+
+
+void ChunkedTerrain::UploadChunks()
+{
+    int PatchVertices = m_params.PatchSize * m_params.PatchSize;
+    int PatchBytes = PatchVertices * (int)sizeof(Vertex);
+
+    m_stats.UploadedBytes = 0;
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+    while (!m_uploads.empty()) {
+        BuiltChunk& b = m_uploads.front();
+        auto it = m_chunks.find(GetChunkKey(b.X, b.Z));
+        Chunk& c = it->second;
+
+        if (m_nextUploadPatch == 0) {
+            if (!IsInRange(b.X, b.Z)) {
+                // The slot can belong to a chunk that didn't fit in the budget of an earlier frame
+                if (c.Slot >= 0) {
+                    m_freeSlots.push_back(c.Slot);
+                }
+
+                m_chunks.erase(it);
+                m_uploads.pop_front();
+                continue;
+            }
+
+            // Don't hold a slot for a chunk that can't start uploading in this frame
+            if ((m_stats.UploadedBytes > 0) && (m_stats.UploadedBytes + PatchBytes > m_params.UploadBudget)) {
+                break;
+            }
+
+            if (c.Slot < 0) {
+                c.Slot = AllocSlot();
+
+                if (c.Slot < 0) {
+                    break;
+                }
+            }
+        }
+
+        // At least one patch per frame so that a budget below the size of a patch doesn't stop the uploads
+        while ((m_nextUploadPatch < m_numPatchesPerChunk) &&
+               ((m_stats.UploadedBytes == 0) || (m_stats.UploadedBytes + PatchBytes <= m_params.UploadBudget))) {
+            size_t FirstVertex = (size_t)c.Slot * m_numVerticesPerChunk + (size_t)m_nextUploadPatch * PatchVertices;
+            glBufferSubData(GL_ARRAY_BUFFER, FirstVertex * sizeof(Vertex), PatchBytes,
+                            &b.Vertices[(size_t)m_nextUploadPatch * PatchVertices]);
+            m_nextUploadPatch++;
+            m_stats.UploadedBytes += PatchBytes;
+        }
+
+        if (m_nextUploadPatch < m_numPatchesPerChunk) {
+            break;
+        }
+
+        c.State = CHUNK_READY;
+        c.LastUsed = m_frame;
+        m_uploads.pop_front();
+        m_nextUploadPatch = 0;
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+int ChunkedTerrain::AllocSlot()
+{
+    if (!m_freeSlots.empty()) {
+        int Slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return Slot;
+    }
+
+    // Evict the least recently used chunk out of range
+    auto Oldest = m_chunks.end();
+
+    for (auto it = m_chunks.begin() ; it != m_chunks.end() ; it++) {
+        const Chunk& c = it->second;
+
+        if ((c.State == CHUNK_READY) && !IsInRange(c.X, c.Z) &&
+            ((Oldest == m_chunks.end()) || (c.LastUsed < Oldest->second.LastUsed))) {
+            Oldest = it;
+        }
+    }
+
+    if (Oldest == m_chunks.end()) {
+        return -1;
+    }
+
+    int Slot = Oldest->second.Slot;
+    m_chunks.erase(Oldest);
+
+    return Slot;
+}
+
+
+int ChunkedTerrain::CalcPatchLod(int PatchX, int PatchZ, const Vector3f& CameraPos) const
+{
+    float PatchWorldSize = m_patchSegments * m_params.WorldScale;
+    float dx = ((float)PatchX + 0.5f) * PatchWorldSize - CameraPos.x;
+    float dz = ((float)PatchZ + 0.5f) * PatchWorldSize - CameraPos.z;
+    float Distance = sqrtf(dx * dx + dz * dz);
+
+    if (Distance < m_lodDistance) {
+        return 0;
+    }
+
+    // Every LOD covers twice the distance of the previous one
+    int Lod = 1 + (int)log2f(Distance / m_lodDistance);
+
+    return std::min(Lod, m_maxLOD);
+}
+
+
+void ChunkedTerrain::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    FrustumCulling fc(ViewProj);
+
+    float ChunkWorldSize = GetChunkWorldSize();
+    int PatchesPerChunk = m_params.PatchesPerChunk;
+    int PatchVertices = m_params.PatchSize * m_params.PatchSize;
+
+    m_drawCommands.clear();
+    m_stats.RenderedChunks = 0;
+
+    for (const Vector2i& Offset : m_offsets) {
+        int ChunkX = m_cameraChunkX + Offset.x;
+        int ChunkZ = m_cameraChunkZ + Offset.y;
+
+        auto it = m_chunks.find(GetChunkKey(ChunkX, ChunkZ));
+
+        if ((it == m_chunks.end()) || (it->second.State != CHUNK_READY)) {
+            continue;
+        }
+
+        Chunk& c = it->second;
+        c.LastUsed = m_frame;
+
+        Vector3f Min((float)ChunkX * ChunkWorldSize, c.MinHeight, (float)ChunkZ * ChunkWorldSize);
+        Vector3f Max(Min.x + ChunkWorldSize, c.MaxHeight, Min.z + ChunkWorldSize);
+
+        if (!fc.IsAABBInsideViewFrustum(Min, Max)) {
+            continue;
+        }
+
+        m_stats.RenderedChunks++;
+
+        for (int z = 0 ; z < PatchesPerChunk ; z++) {
+            for (int x = 0 ; x < PatchesPerChunk ; x++) {
+                int PatchX = ChunkX * PatchesPerChunk + x;
+                int PatchZ = ChunkZ * PatchesPerChunk + z;
+
+                const PatchIndexCache::IndexRange& Range =
+                    m_indexCache.GetIndices(m_params.PatchSize,
+                                            CalcPatchLod(PatchX, PatchZ, CameraPos),
+                                            CalcPatchLod(PatchX - 1, PatchZ, CameraPos),
+                                            CalcPatchLod(PatchX + 1, PatchZ, CameraPos),
+                                            CalcPatchLod(PatchX, PatchZ + 1, CameraPos),
+                                            CalcPatchLod(PatchX, PatchZ - 1, CameraPos));
+
+                DrawCommand Cmd;
+                Cmd.Count = Range.Count;
+                Cmd.Start = Range.Start;
+                Cmd.BaseVertex = (c.Slot * m_numPatchesPerChunk + z * PatchesPerChunk + x) * PatchVertices;
+                m_drawCommands.push_back(Cmd);
+            }
+        }
+    }
+
+    // New permutations are built by GetIndices on first use
+    m_indexCache.UpdateIndexBuffer();
+
+    glBindVertexArray(m_vao);
+
+    // Side zero and zero morph - the vertices are used as is
+    glVertexAttrib3f(MORPH_LOC, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(PATCH_SIDE_LODS_LOC, 0.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib4f(PATCH_SIDE_MORPH_LOC, 0.0f, 0.0f, 0.0f, 0.0f);
+    glVertexAttrib2f(PATCH_CORE_LOC, 0.0f, 0.0f);
+
+    for (const DrawCommand& Cmd : m_drawCommands) {
+        glDrawElementsBaseVertex(GL_TRIANGLES, Cmd.Count, GL_UNSIGNED_SHORT, (void*)(sizeof(u16) * Cmd.Start), Cmd.BaseVertex);
+    }
+
+    glBindVertexArray(0);
+}
+
+
+void ChunkedTerrain::GetWorldHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals) const
+{
+    float WorldScale = m_params.WorldScale;
+
+    for (int i = 0 ; i < Count ; i++) {
+        float x = pX[i] / WorldScale;
+        float z = pZ[i] / WorldScale;
+        float x0 = floorf(x);
+        float z0 = floorf(z);
+        float fx = x - x0;
+        float fz = z - z0;
+
+        // The same samples as the vertices of the chunks
+        float h00 = m_noise.GetHeight(x0, z0);
+        float h10 = m_noise.GetHeight(x0 + 1.0f, z0);
+        float h01 = m_noise.GetHeight(x0, z0 + 1.0f);
+        float h11 = m_noise.GetHeight(x0 + 1.0f, z0 + 1.0f);
+
+        float Bottom = h00 + (h10 - h00) * fx;
+        float Top    = h01 + (h11 - h01) * fx;
+        pHeights[i] = Bottom + (Top - Bottom) * fz;
+
+        if (pNormals) {
+            float dx = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) / WorldScale;
+            float dz = ((h01 - h00) + ((h11 - h10) - (h01 - h00)) * fx) / WorldScale;
+            pNormals[i] = Vector3f(-dx, 1.0f, -dz);
+            pNormals[i].Normalize();
+        }
+    }
+}
+
+
+float ChunkedTerrain::GetWorldHeight(float x, float z) const
+{
+    float Height = 0.0f;
+
+    GetWorldHeights(&x, &z, 1, &Height, NULL);
+
+    return Height;
+}
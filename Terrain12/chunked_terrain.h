@@ -0,0 +1,205 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CHUNKED_TERRAIN_H
+#define CHUNKED_TERRAIN_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ogldev_math_3d.h"
+#include "patch_index_cache.h"
+#include "terrain_noise.h"
+
+struct ChunkedTerrainParams {
+    int PatchSize = 33;             // vertices on the side of a patch (a power of two plus one)
+    int PatchesPerChunk = 4;        // on each side of a chunk
+    float WorldScale = 4.0f;        // distance between two points
+    float TextureScale = 4.0f;      // texture repeats per chunk. A whole number keeps the chunk edges seamless.
+    int ViewDistance = 5;           // in chunks from the chunk of the camera
+    int MaxChunks = 0;              // resident chunks. Zero - the view distance plus one ring.
+    int UploadBudget = 1 << 20;     // bytes of vertex data uploaded per frame
+    int NumWorkers = 0;             // zero - one less than the number of hardware threads
+    float LodDistance = 0.0f;       // the end of LOD 0 in world units. Zero - two patches.
+};
+
+struct ChunkedTerrainStats {
+    int ResidentChunks = 0;         // ready to render
+    int QueuedChunks = 0;           // waiting for a worker or being built
+    int UploadingChunks = 0;        // built and waiting for (or in the middle of) the upload
+    int RenderedChunks = 0;
+    int UploadedBytes = 0;          // in the last frame
+    float UpdateTime = 0.0f;        // milliseconds of the last call to Update
+    float MaxUpdateTime = 0.0f;
+};
+
+//
+// Terrain without bounds that is made of square chunks generated around the camera from
+// TerrainNoise. A chunk is a grid of geomip patches which are drawn with the shared
+// PatchIndexCache like the patches of GeomipGrid.
+//
+// The chunks in range of the camera are queued nearest first and built by worker threads
+// (heights, normals and the per patch copies of the vertices). The render thread uploads
+// the finished chunks into the slots of a single vertex buffer one patch at a time with a
+// budget of bytes per frame and evicts the least recently used chunk out of range when it
+// needs a slot. The queue is re-sorted when the camera moves to another chunk and jobs
+// that are out of range by then are dropped, so the render thread never waits for the
+// generation and its work per frame is bounded.
+//
+// The LOD of a patch depends only on the horizontal distance of its center from the camera
+// so the LODs of the neighbors in other chunks are known without looking them up. There
+// is no geomorphing.
+//
+class ChunkedTerrain {
+ public:
+    ChunkedTerrain() {}
+
+    ~ChunkedTerrain();
+
+    void CreateChunkedTerrain(const ChunkedTerrainParams& Params, const TerrainNoiseParams& NoiseParams);
+
+    void Destroy();
+
+    bool IsCreated() const { return m_vao != 0; }
+
+    // Queues the chunks around the camera and uploads the built ones. Called every frame before Render.
+    void Update(const Vector3f& CameraPos);
+
+    // The terrain technique must be enabled
+    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    // The height of the surface at LOD 0 (bilinear between the points). Thread safe.
+    float GetWorldHeight(float x, float z) const;
+
+    // Same as BaseTerrain::GetWorldHeights. pNormals can be NULL.
+    void GetWorldHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals) const;
+
+    float GetMinHeight() const { return m_noise.GetParams().MinHeight; }
+
+    float GetMaxHeight() const { return m_noise.GetParams().MaxHeight; }
+
+    float GetChunkWorldSize() const { return m_chunkSegments * m_params.WorldScale; }
+
+    const ChunkedTerrainStats& GetStats() const { return m_stats; }
+
+ private:
+
+    struct Vertex {
+        Vector3f Pos;
+        Vector2f Tex;
+        Vector3f Normal;
+    };
+
+    enum CHUNK_STATE {
+        CHUNK_QUEUED,       // waiting for a worker or being built
+        CHUNK_UPLOADING,
+        CHUNK_READY
+    };
+
+    struct Chunk {
+        int X = 0;
+        int Z = 0;
+        CHUNK_STATE State = CHUNK_QUEUED;
+        int Slot = -1;
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        uint64_t LastUsed = 0;          // frame
+    };
+
+    struct BuiltChunk {
+        int X = 0;
+        int Z = 0;
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        std::vector<Vertex> Vertices;   // PatchSize x PatchSize per patch
+    };
+
+    struct DrawCommand {
+        int Count;
+        int Start;
+        int BaseVertex;
+    };
+
+    void CreateGLState();
+
+    void StartWorkers();
+
+    void StopWorkers();
+
+    void WorkerThread();
+
+    void BuildChunk(int ChunkX, int ChunkZ, BuiltChunk& Result) const;
+
+    void UpdateQueue();
+
+    void ReceiveBuiltChunks();
+
+    void UploadChunks();
+
+    int AllocSlot();
+
+    bool IsInRange(int ChunkX, int ChunkZ) const;
+
+    int CalcPatchLod(int PatchX, int PatchZ, const Vector3f& CameraPos) const;
+
+    static uint64_t GetChunkKey(int ChunkX, int ChunkZ) { return ((uint64_t)(u32)ChunkX << 32) | (uint64_t)(u32)ChunkZ; }
+
+    ChunkedTerrainParams m_params;
+    TerrainNoise m_noise;                       // in height map points rather than world units
+    int m_patchSegments = 0;
+    int m_chunkSegments = 0;
+    int m_numPatchesPerChunk = 0;
+    int m_numVerticesPerChunk = 0;
+    int m_maxLOD = 0;
+    float m_lodDistance = 0.0f;
+
+    std::vector<Vector2i> m_offsets;            // of the chunks in range, nearest first
+    int m_cameraChunkX = 0;
+    int m_cameraChunkZ = 0;
+    bool m_queueValid = false;
+    uint64_t m_frame = 0;
+
+    // Render thread only
+    std::unordered_map<uint64_t, Chunk> m_chunks;
+    std::deque<BuiltChunk> m_uploads;
+    int m_nextUploadPatch = 0;                  // of the first chunk in m_uploads
+    std::vector<int> m_freeSlots;
+    std::vector<DrawCommand> m_drawCommands;
+
+    // Shared with the workers
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_workAvailable;
+    std::vector<Vector2i> m_jobs;               // the nearest is at the back
+    std::vector<BuiltChunk> m_built;
+    bool m_quit = false;
+
+    PatchIndexCache m_indexCache;
+    GLuint m_vao = 0;
+    GLuint m_vb = 0;
+
+    ChunkedTerrainStats m_stats;
+};
+
+#endif
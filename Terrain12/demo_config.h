@@ -3,4 +3,18 @@
 
 #define Z_FAR 5000.0f
 
+#define CDLOD_GRID_SIZE 32
+
+// In height map points
+#define PAGER_UPDATE_RADIUS 256.0f
+
+#define TILED_HEIGHT_MAP_FILE       "heightmap.tiled"
+#define TILED_HEIGHT_MAP_TILE_SIZE  256
+#define TILED_HEIGHT_MAP_CACHE_SIZE 256     // tiles
+
+#define COMPRESSED_HEIGHT_MAP_FILE      "heightmap.chm"
+#define COMPRESSED_HEIGHT_MAP_TILE_SIZE 64
+
+#define GEOMIP_CACHE_FILE "geomip.cache"
+
 #endif
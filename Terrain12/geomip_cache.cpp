@@ -0,0 +1,267 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "ogldev_parallel.h"
+#include "geomip_cache.h"
+
+#define HASH_SEED            0xcbf29ce484222325ull
+#define HASH_PRIME           0x100000001b3ull
+#define MIN_ROWS_PER_THREAD  64
+
+enum GEOMIP_CACHE_SECTION {
+    VERTICES_SECTION = 0,
+    GEOMETRIC_ERRORS_SECTION = 1,
+    PATCH_HEIGHTS_SECTION = 2,
+    INDEX_KEYS_SECTION = 3,
+    INDEX_RANGES_SECTION = 4,
+    INDICES_SECTION = 5,
+    NUM_SECTIONS = 6
+};
+
+
+// FNV-1a over 8 byte words. The shift feeds the high bits of every step back into the low ones.
+static uint64_t HashBytes(const void* pData, size_t Size, uint64_t Hash)
+{
+    const u8* p = (const u8*)pData;
+    size_t i = 0;
+
+    for ( ; i + sizeof(uint64_t) <= Size ; i += sizeof(uint64_t)) {
+        uint64_t Word;
+        memcpy(&Word, p + i, sizeof(Word));
+        Hash = (Hash ^ Word) * HASH_PRIME;
+        Hash ^= Hash >> 29;
+    }
+
+    for ( ; i < Size ; i++) {
+        Hash = (Hash ^ p[i]) * HASH_PRIME;
+    }
+
+    return Hash;
+}
+
+
+static uint64_t AlignOffset(uint64_t Offset)
+{
+    return (Offset + GEOMIP_CACHE_ALIGNMENT - 1) / GEOMIP_CACHE_ALIGNMENT * GEOMIP_CACHE_ALIGNMENT;
+}
+
+
+static void CalcSectionSizes(const GeomipCacheHeader& Header, uint64_t* pSizes)
+{
+    pSizes[VERTICES_SECTION] = (uint64_t)Header.NumVertices * Header.VertexSize;
+    pSizes[GEOMETRIC_ERRORS_SECTION] = (uint64_t)Header.NumPatches * Header.NumLods * sizeof(float);
+    pSizes[PATCH_HEIGHTS_SECTION] = (uint64_t)Header.NumPatches * 2 * sizeof(float);
+    pSizes[INDEX_KEYS_SECTION] = (uint64_t)Header.NumIndexSets * sizeof(uint64_t);
+    pSizes[INDEX_RANGES_SECTION] = (uint64_t)Header.NumIndexSets * 2 * sizeof(int);
+    pSizes[INDICES_SECTION] = (uint64_t)Header.NumIndices * sizeof(u16);
+}
+
+
+// The last offset is the size of the file
+static void CalcSectionOffsets(const GeomipCacheHeader& Header, uint64_t* pOffsets)
+{
+    uint64_t Sizes[NUM_SECTIONS];
+    CalcSectionSizes(Header, Sizes);
+
+    uint64_t Offset = AlignOffset(sizeof(GeomipCacheHeader));
+
+    for (int i = 0 ; i < NUM_SECTIONS ; i++) {
+        pOffsets[i] = Offset;
+        Offset = AlignOffset(Offset + Sizes[i]);
+    }
+
+    pOffsets[NUM_SECTIONS] = Offset;
+}
+
+
+uint64_t GeomipCache::CalcKey(const Array2D<float>& HeightMap, int Width, int Depth, int PatchSize,
+                              float WorldScale, float TextureScale, int VertexFormat, int MaxLOD)
+{
+    std::vector<uint64_t> RowHashes(Depth);
+
+    ParallelFor(0, Depth, [&](int Start, int End) {
+        for (int z = Start ; z < End ; z++) {
+            RowHashes[z] = HashBytes(HeightMap.GetRow(z), Width * sizeof(float), HASH_SEED);
+        }
+    }, MIN_ROWS_PER_THREAD);
+
+    struct {
+        int Version = GEOMIP_CACHE_VERSION;
+        int Width, Depth, PatchSize;
+        float WorldScale, TextureScale;
+        int VertexFormat, MaxLOD;
+    } Params;
+
+    Params.Width = Width;
+    Params.Depth = Depth;
+    Params.PatchSize = PatchSize;
+    Params.WorldScale = WorldScale;
+    Params.TextureScale = TextureScale;
+    Params.VertexFormat = VertexFormat;
+    Params.MaxLOD = MaxLOD;
+
+    uint64_t Hash = HashBytes(&Params, sizeof(Params), HASH_SEED);
+
+    return HashBytes(RowHashes.data(), RowHashes.size() * sizeof(uint64_t), Hash);
+}
+
+
+bool GeomipCache::WriteFile(const char* pFilename, const GeomipCacheData& Data)
+{
+    GeomipCacheHeader Header;
+    Header.Key = Data.Key;
+    Header.VertexFormat = (u32)Data.VertexFormat;
+    Header.VertexSize = (u32)Data.VertexSize;
+    Header.NumVertices = (u32)Data.NumVertices;
+    Header.NumPatches = (u32)Data.NumPatches;
+    Header.NumLods = (u32)Data.NumLods;
+    Header.NumIndexSets = (u32)Data.NumIndexSets;
+    Header.NumIndices = (u32)Data.NumIndices;
+    Header.MinHeight = Data.MinHeight;
+    Header.MaxHeight = Data.MaxHeight;
+
+    uint64_t Sizes[NUM_SECTIONS];
+    CalcSectionSizes(Header, Sizes);
+
+    uint64_t Offsets[NUM_SECTIONS + 1];
+    CalcSectionOffsets(Header, Offsets);
+
+    const void* Sections[NUM_SECTIONS] = { Data.pVertices, Data.pGeometricErrors, Data.pPatchHeights,
+                                           Data.pIndexKeys, Data.pIndexRanges, Data.pIndices };
+
+    FILE* f = fopen(pFilename, "wb");
+
+    if (!f) {
+        printf("%s:%d - unable to create '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    fwrite(&Header, sizeof(Header), 1, f);
+
+    const u8 Zeros[GEOMIP_CACHE_ALIGNMENT] = { 0 };
+    uint64_t Pos = sizeof(Header);
+
+    // The padding before every section and after the last one
+    for (int i = 0 ; i <= NUM_SECTIONS ; i++) {
+        fwrite(Zeros, 1, (size_t)(Offsets[i] - Pos), f);
+
+        if ((i < NUM_SECTIONS) && (Sizes[i] > 0)) {
+            fwrite(Sections[i], 1, (size_t)Sizes[i], f);
+            Pos = Offsets[i] + Sizes[i];
+        } else {
+            Pos = Offsets[i];
+        }
+    }
+
+    bool Success = (ferror(f) == 0);
+
+    fclose(f);
+
+    if (!Success) {
+        printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, pFilename);
+        remove(pFilename);
+        return false;
+    }
+
+    return true;
+}
+
+
+bool GeomipCache::Open(const char* pFilename, uint64_t Key)
+{
+    Close();
+
+    if (!m_file.Open(pFilename)) {
+        return false;
+    }
+
+    GeomipCacheHeader Header;
+
+    if (m_file.GetSize() < sizeof(Header)) {
+        printf("%s:%d - '%s' is too small for a geomip cache\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    memcpy(&Header, m_file.GetData(), sizeof(Header));
+
+    if (Header.Magic != GEOMIP_CACHE_MAGIC) {
+        printf("%s:%d - '%s' is not a geomip cache\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    // An older version or another terrain - the caller generates the data again
+    if ((Header.Version != GEOMIP_CACHE_VERSION) || (Header.Key != Key)) {
+        Close();
+        return false;
+    }
+
+    uint64_t Offsets[NUM_SECTIONS + 1];
+    CalcSectionOffsets(Header, Offsets);
+
+    if (m_file.GetSize() < Offsets[NUM_SECTIONS]) {
+        printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    const u8* p = m_file.GetData();
+
+    m_data.Key = Header.Key;
+    m_data.VertexFormat = (int)Header.VertexFormat;
+    m_data.VertexSize = (int)Header.VertexSize;
+    m_data.NumVertices = (int)Header.NumVertices;
+    m_data.pVertices = p + Offsets[VERTICES_SECTION];
+    m_data.MinHeight = Header.MinHeight;
+    m_data.MaxHeight = Header.MaxHeight;
+    m_data.NumPatches = (int)Header.NumPatches;
+    m_data.NumLods = (int)Header.NumLods;
+    m_data.pGeometricErrors = (const float*)(p + Offsets[GEOMETRIC_ERRORS_SECTION]);
+    m_data.pPatchHeights = (const float*)(p + Offsets[PATCH_HEIGHTS_SECTION]);
+    m_data.NumIndexSets = (int)Header.NumIndexSets;
+    m_data.pIndexKeys = (const uint64_t*)(p + Offsets[INDEX_KEYS_SECTION]);
+    m_data.pIndexRanges = (const int*)(p + Offsets[INDEX_RANGES_SECTION]);
+    m_data.NumIndices = (int)Header.NumIndices;
+    m_data.pIndices = (const u16*)(p + Offsets[INDICES_SECTION]);
+
+    for (int i = 0 ; i < m_data.NumIndexSets ; i++) {
+        int Start = m_data.pIndexRanges[i * 2];
+        int Count = m_data.pIndexRanges[i * 2 + 1];
+
+        if ((Start < 0) || (Count < 0) || (Start > m_data.NumIndices - Count)) {
+            printf("%s:%d - '%s' has an invalid index range\n", __FILE__, __LINE__, pFilename);
+            Close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void GeomipCache::Close()
+{
+    m_file.Close();
+    m_data = GeomipCacheData();
+}
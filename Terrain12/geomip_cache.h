@@ -0,0 +1,114 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef GEOMIP_CACHE_H
+#define GEOMIP_CACHE_H
+
+#include "ogldev_types.h"
+#include "ogldev_array_2d.h"
+#include "mapped_file.h"
+
+//
+// Geometry cache file of the geomip grid:
+//
+//   GeomipCacheHeader
+//   the vertex buffer in the format of the grid (none for the vertex-less format)
+//   geometric errors - (MaxLOD + 1) floats per patch
+//   min and max height of every patch
+//   keys of the index sets (uint64_t)
+//   index ranges of the sets (start and count)
+//   all the indices of the sets (u16)
+//
+// Every section starts at a multiple of GEOMIP_CACHE_ALIGNMENT. The key is a hash of the
+// height map and of every parameter that the generated data depends on, so a cache that
+// was made for another terrain is never used. Bump the version whenever the layout of
+// the vertices or the generation code changes.
+//
+#define GEOMIP_CACHE_MAGIC     0x43474730      // "0GGC"
+#define GEOMIP_CACHE_VERSION   1
+#define GEOMIP_CACHE_ALIGNMENT 64
+
+struct GeomipCacheHeader {
+    u32 Magic = GEOMIP_CACHE_MAGIC;
+    u32 Version = GEOMIP_CACHE_VERSION;
+    uint64_t Key = 0;
+    u32 VertexFormat = 0;
+    u32 VertexSize = 0;         // in bytes
+    u32 NumVertices = 0;
+    u32 NumPatches = 0;
+    u32 NumLods = 0;            // MaxLOD + 1
+    u32 NumIndexSets = 0;
+    u32 NumIndices = 0;
+    float MinHeight = 0.0f;     // the range of the compact heights
+    float MaxHeight = 0.0f;
+    u32 Padding = 0;
+};
+
+//
+// The content of a cache file. When it comes from GeomipCache::Open the pointers are
+// into the mapping of the file and are valid until the cache is closed.
+//
+struct GeomipCacheData {
+    uint64_t Key = 0;
+    int VertexFormat = 0;
+    int VertexSize = 0;
+    int NumVertices = 0;
+    const void* pVertices = NULL;
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+    int NumPatches = 0;
+    int NumLods = 0;
+    const float* pGeometricErrors = NULL;   // NumLods per patch
+    const float* pPatchHeights = NULL;      // min and max of every patch
+    int NumIndexSets = 0;
+    const uint64_t* pIndexKeys = NULL;      // see PatchIndexCache
+    const int* pIndexRanges = NULL;         // start and count of every set
+    int NumIndices = 0;
+    const u16* pIndices = NULL;
+};
+
+class GeomipCache {
+ public:
+    GeomipCache() {}
+
+    // Hash of the height map (hashed by all the threads) and the parameters of the grid
+    static uint64_t CalcKey(const Array2D<float>& HeightMap, int Width, int Depth, int PatchSize,
+                            float WorldScale, float TextureScale, int VertexFormat, int MaxLOD);
+
+    static bool WriteFile(const char* pFilename, const GeomipCacheData& Data);
+
+    //
+    // Maps the file. Returns false if it doesn't exist, is not a valid cache file or
+    // was made for another key. Only a corrupt file is reported.
+    //
+    bool Open(const char* pFilename, uint64_t Key);
+
+    void Close();
+
+    bool IsOpen() const { return m_file.IsOpen(); }
+
+    const GeomipCacheData& GetData() const { return m_data; }
+
+ private:
+
+    MappedFile m_file;
+    GeomipCacheData m_data;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "geomip_compact_technique.h"
+#include "texture_config.h"
+
+
+GeomipCompactTechnique::GeomipCompactTechnique() : TerrainTechnique("terrain_compact.vs")
+{
+}
+
+bool GeomipCompactTechnique::Init()
+{
+    if (!TerrainTechnique::Init()) {
+        return false;
+    }
+
+    m_heightMapLoc = GetUniformLocation("gHeightMap");
+    m_patchSizeLoc = GetUniformLocation("gPatchSize");
+    m_numPatchesXLoc = GetUniformLocation("gNumPatchesX");
+    m_terrainSizeLoc = GetUniformLocation("gTerrainSize");
+    m_worldScaleLoc = GetUniformLocation("gWorldScale");
+    m_textureScaleLoc = GetUniformLocation("gTextureScale");
+    m_maxLodLoc = GetUniformLocation("gMaxLod");
+    m_heightRangeLoc = GetUniformLocation("gHeightRange");
+    m_vertexlessLoc = GetUniformLocation("gVertexless");
+
+    if (m_heightMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_patchSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_numPatchesXLoc == INVALID_UNIFORM_LOCATION ||
+        m_terrainSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_worldScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_textureScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_maxLodLoc == INVALID_UNIFORM_LOCATION ||
+        m_heightRangeLoc == INVALID_UNIFORM_LOCATION ||
+        m_vertexlessLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    Enable();
+
+    glUniform1i(m_heightMapLoc, HEIGHT_MAP_TEXTURE_UNIT_INDEX);
+
+    glUseProgram(0);
+
+    return true;
+}
+
+
+void GeomipCompactTechnique::SetGridParams(int PatchSize, int NumPatchesX, int TerrainSize, float WorldScale, float TextureScale, int MaxLod)
+{
+    glUniform1i(m_patchSizeLoc, PatchSize);
+    glUniform1i(m_numPatchesXLoc, NumPatchesX);
+    glUniform1i(m_terrainSizeLoc, TerrainSize);
+    glUniform1f(m_worldScaleLoc, WorldScale);
+    glUniform1f(m_textureScaleLoc, TextureScale);
+    glUniform1i(m_maxLodLoc, MaxLod);
+}
+
+
+void GeomipCompactTechnique::SetHeightRange(float MinHeight, float MaxHeight)
+{
+    glUniform2f(m_heightRangeLoc, MinHeight, MaxHeight - MinHeight);
+}
+
+
+void GeomipCompactTechnique::SetVertexless(bool Vertexless)
+{
+    glUniform1i(m_vertexlessLoc, Vertexless ? 1 : 0);
+}
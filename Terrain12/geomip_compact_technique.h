@@ -0,0 +1,57 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GEOMIP_COMPACT_TECHNIQUE_H
+#define GEOMIP_COMPACT_TECHNIQUE_H
+
+#include "terrain_technique.h"
+
+//
+// Renders the geomip grid from the compact vertex format or without vertices at all.
+// The vertex shader finds the grid position of the vertex from gl_VertexID (which
+// includes the base vertex of the patch) so only the heights, the normal and the morph
+// data are stored per vertex, or taken from the height map texture when vertex-less.
+//
+class GeomipCompactTechnique : public TerrainTechnique
+{
+public:
+
+    GeomipCompactTechnique();
+
+    virtual bool Init();
+
+    void SetGridParams(int PatchSize, int NumPatchesX, int TerrainSize, float WorldScale, float TextureScale, int MaxLod);
+
+    // The range of the 16 bit heights of the compact vertices
+    void SetHeightRange(float MinHeight, float MaxHeight);
+
+    void SetVertexless(bool Vertexless);
+
+private:
+    GLuint m_heightMapLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_patchSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_numPatchesXLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_terrainSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_worldScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_textureScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_maxLodLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_heightRangeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_vertexlessLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* GEOMIP_COMPACT_TECHNIQUE_H */
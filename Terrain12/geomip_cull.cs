@@ -0,0 +1,247 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// GPU version of the LOD selection of LodManager and the patch culling of GeomipGrid.
+// Pass 0 selects the core LOD of every patch. Pass 1 culls the patches against the
+// frustum, finds the index set of the patch from the LODs of its neighbors and appends
+// a draw command for it together with the geomorphing parameters of the patch.
+//
+
+#version 430
+
+layout (local_size_x = 64) in;
+
+struct DrawElementsIndirectCommand {
+    uint Count;
+    uint InstanceCount;
+    uint FirstIndex;
+    int BaseVertex;
+    uint BaseInstance;
+};
+
+// See LodManager::PatchMorph
+struct PatchMorph {
+    vec4 SideLods;          // left, right, top, bottom
+    vec4 SideMorphs;
+    vec2 Core;              // LOD, morph
+};
+
+layout (std430, binding = 0) readonly buffer PatchHeights { vec2 gPatchHeights[]; };        // min/max height
+layout (std430, binding = 1) readonly buffer GeometricErrors { float gGeometricErrors[]; }; // (gMaxLod + 1) per patch
+layout (std430, binding = 2) readonly buffer IndexRanges { uvec2 gIndexRanges[]; };         // start/count
+layout (std430, binding = 3) buffer PatchLods { int gPatchLods[]; };
+layout (std430, binding = 4) writeonly buffer DrawCommands { DrawElementsIndirectCommand gCommands[]; };
+layout (std430, binding = 5) buffer DrawCount { uint gDrawCount; };
+layout (std430, binding = 6) writeonly buffer PatchMorphs { PatchMorph gPatchMorphs[]; };
+
+uniform int gPass;
+uniform vec3 gCameraPos;
+uniform vec4 gFrustumPlanes[6];     // the inside is where the dot product is non-negative
+uniform int gNumPatchesX;
+uniform int gNumPatchesZ;
+uniform int gPatchSize;
+uniform float gWorldScale;
+uniform int gMaxLod;
+uniform bool gUseScreenSpaceError;
+uniform float gRegions[8];
+uniform float gProjScale;
+uniform float gPixelTolerance;
+uniform float gHysteresis;
+uniform float gMorphRegion;
+
+
+float CalcPatchDistance(int PatchX, int PatchZ)
+{
+    if (gUseScreenSpaceError) {
+        vec2 Heights = gPatchHeights[PatchZ * gNumPatchesX + PatchX];
+        float PatchWorldSize = float(gPatchSize - 1) * gWorldScale;
+        vec3 Min = vec3(float(PatchX) * PatchWorldSize, Heights.x, float(PatchZ) * PatchWorldSize);
+        vec3 Max = vec3(Min.x + PatchWorldSize, Heights.y, Min.z + PatchWorldSize);
+        vec3 d = max(max(Min - gCameraPos, gCameraPos - Max), vec3(0.0));
+        return max(sqrt(d.x * d.x + d.y * d.y + d.z * d.z), 1.0);
+    } else {
+        int CenterStep = gPatchSize / 2;
+        float x = float(PatchX * (gPatchSize - 1) + CenterStep) * gWorldScale;
+        float z = float(PatchZ * (gPatchSize - 1) + CenterStep) * gWorldScale;
+        return distance(gCameraPos, vec3(x, 0.0, z));
+    }
+}
+
+
+float GetLodMinDistance(int Patch, int Lod)
+{
+    if (Lod <= 0) {
+        return 0.0;
+    }
+
+    if (gUseScreenSpaceError) {
+        return gGeometricErrors[Patch * (gMaxLod + 1) + Lod] * gProjScale / gPixelTolerance;
+    } else {
+        return gRegions[Lod - 1];
+    }
+}
+
+
+int SelectLod(int Patch, float Distance, int CurLod)
+{
+    if ((CurLod >= 0) && (CurLod <= gMaxLod)) {
+        bool AboveMin = (CurLod == 0) || (Distance >= GetLodMinDistance(Patch, CurLod) * (1.0 - gHysteresis));
+        bool BelowMax = (CurLod == gMaxLod) || (Distance < GetLodMinDistance(Patch, CurLod + 1) * (1.0 + gHysteresis));
+
+        if (AboveMin && BelowMax) {
+            return CurLod;
+        }
+    }
+
+    for (int Lod = gMaxLod ; Lod > 0 ; Lod--) {
+        if (Distance >= GetLodMinDistance(Patch, Lod)) {
+            return Lod;
+        }
+    }
+
+    return 0;
+}
+
+
+bool IsPatchInsideViewFrustum(int PatchX, int PatchZ)
+{
+    vec2 Heights = gPatchHeights[PatchZ * gNumPatchesX + PatchX];
+    vec3 Min = vec3(float(PatchX * (gPatchSize - 1)) * gWorldScale, Heights.x, float(PatchZ * (gPatchSize - 1)) * gWorldScale);
+    vec3 Max = vec3(float((PatchX + 1) * (gPatchSize - 1)) * gWorldScale, Heights.y, float((PatchZ + 1) * (gPatchSize - 1)) * gWorldScale);
+
+    for (int i = 0 ; i < 6 ; i++) {
+        vec4 Plane = gFrustumPlanes[i];
+        vec3 p = vec3(Plane.x >= 0.0 ? Max.x : Min.x,
+                      Plane.y >= 0.0 ? Max.y : Min.y,
+                      Plane.z >= 0.0 ? Max.z : Min.z);
+
+        if (dot(Plane, vec4(p, 1.0)) < 0.0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+int GetNeighborLodDelta(int PatchX, int PatchZ, int CoreLod)
+{
+    if ((PatchX < 0) || (PatchX >= gNumPatchesX) || (PatchZ < 0) || (PatchZ >= gNumPatchesZ)) {
+        return 0;
+    }
+
+    return max(gPatchLods[PatchZ * gNumPatchesX + PatchX] - CoreLod, 0);
+}
+
+
+// Same as LodManager::CalcMorphFactor
+float CalcMorphFactor(int PatchX, int PatchZ, int Lod)
+{
+    if ((gMorphRegion <= 0.0) || (Lod >= gMaxLod)) {
+        return 0.0;
+    }
+
+    int Patch = PatchZ * gNumPatchesX + PatchX;
+    float Distance = CalcPatchDistance(PatchX, PatchZ);
+
+    float End = GetLodMinDistance(Patch, Lod + 1) * (1.0 - gHysteresis);
+    float Start = End - gMorphRegion * (End - GetLodMinDistance(Patch, Lod));
+
+    if (Distance >= End) {
+        return 1.0;
+    }
+
+    if (Distance <= Start) {
+        return 0.0;
+    }
+
+    return (Distance - Start) / (End - Start);
+}
+
+
+// Same as LodManager::CalcPatchMorph for a single side
+void CalcSideMorph(int PatchX, int PatchZ, int Core, float CoreMorph, out float SideLod, out float SideMorph)
+{
+    SideLod = float(Core);
+    SideMorph = CoreMorph;
+
+    if ((PatchX < 0) || (PatchX >= gNumPatchesX) || (PatchZ < 0) || (PatchZ >= gNumPatchesZ)) {
+        return;
+    }
+
+    int NeighborCore = gPatchLods[PatchZ * gNumPatchesX + PatchX];
+
+    if (NeighborCore > Core) {
+        SideLod = float(NeighborCore);
+        SideMorph = CalcMorphFactor(PatchX, PatchZ, NeighborCore);
+    } else if (NeighborCore == Core) {
+        SideMorph = max(CoreMorph, CalcMorphFactor(PatchX, PatchZ, Core));
+    }
+}
+
+
+void main()
+{
+    int Patch = int(gl_GlobalInvocationID.x);
+
+    if (Patch >= gNumPatchesX * gNumPatchesZ) {
+        return;
+    }
+
+    int PatchX = Patch % gNumPatchesX;
+    int PatchZ = Patch / gNumPatchesX;
+
+    if (gPass == 0) {
+        float Distance = CalcPatchDistance(PatchX, PatchZ);
+        gPatchLods[Patch] = SelectLod(Patch, Distance, gPatchLods[Patch]);
+        return;
+    }
+
+    if (!IsPatchInsideViewFrustum(PatchX, PatchZ)) {
+        return;
+    }
+
+    int Core   = gPatchLods[Patch];
+    int Left   = GetNeighborLodDelta(PatchX - 1, PatchZ, Core);
+    int Right  = GetNeighborLodDelta(PatchX + 1, PatchZ, Core);
+    int Top    = GetNeighborLodDelta(PatchX, PatchZ + 1, Core);
+    int Bottom = GetNeighborLodDelta(PatchX, PatchZ - 1, Core);
+
+    // Same layout as GeomipGrid::GetPermutationIndex
+    int n = gMaxLod + 1;
+    int Permutation = (((Core * n + Left) * n + Right) * n + Top) * n + Bottom;
+    uvec2 Range = gIndexRanges[Permutation];
+
+    float CoreMorph = CalcMorphFactor(PatchX, PatchZ, Core);
+
+    PatchMorph Morph;
+    Morph.Core = vec2(float(Core), CoreMorph);
+    CalcSideMorph(PatchX - 1, PatchZ, Core, CoreMorph, Morph.SideLods.x, Morph.SideMorphs.x);
+    CalcSideMorph(PatchX + 1, PatchZ, Core, CoreMorph, Morph.SideLods.y, Morph.SideMorphs.y);
+    CalcSideMorph(PatchX, PatchZ + 1, Core, CoreMorph, Morph.SideLods.z, Morph.SideMorphs.z);
+    CalcSideMorph(PatchX, PatchZ - 1, Core, CoreMorph, Morph.SideLods.w, Morph.SideMorphs.w);
+    gPatchMorphs[Patch] = Morph;
+
+    uint Slot = atomicAdd(gDrawCount, 1u);
+
+    gCommands[Slot].Count = Range.y;
+    gCommands[Slot].InstanceCount = 1u;
+    gCommands[Slot].FirstIndex = Range.x;
+    gCommands[Slot].BaseVertex = Patch * gPatchSize * gPatchSize;
+    gCommands[Slot].BaseInstance = uint(Patch);      // selects the instanced morph attributes of the patch
+}
@@ -0,0 +1,131 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "geomip_cull_technique.h"
+
+
+GeomipCullTechnique::GeomipCullTechnique()
+{
+}
+
+bool GeomipCullTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_COMPUTE_SHADER, "geomip_cull.cs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_passLoc = GetUniformLocation("gPass");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_frustumPlanesLoc = GetUniformLocation("gFrustumPlanes");
+    m_numPatchesXLoc = GetUniformLocation("gNumPatchesX");
+    m_numPatchesZLoc = GetUniformLocation("gNumPatchesZ");
+    m_patchSizeLoc = GetUniformLocation("gPatchSize");
+    m_worldScaleLoc = GetUniformLocation("gWorldScale");
+    m_maxLodLoc = GetUniformLocation("gMaxLod");
+    m_useScreenSpaceErrorLoc = GetUniformLocation("gUseScreenSpaceError");
+    m_regionsLoc = GetUniformLocation("gRegions");
+    m_projScaleLoc = GetUniformLocation("gProjScale");
+    m_pixelToleranceLoc = GetUniformLocation("gPixelTolerance");
+    m_hysteresisLoc = GetUniformLocation("gHysteresis");
+    m_morphRegionLoc = GetUniformLocation("gMorphRegion");
+
+    if (m_passLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_frustumPlanesLoc == INVALID_UNIFORM_LOCATION ||
+        m_numPatchesXLoc == INVALID_UNIFORM_LOCATION ||
+        m_numPatchesZLoc == INVALID_UNIFORM_LOCATION ||
+        m_patchSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_worldScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_maxLodLoc == INVALID_UNIFORM_LOCATION ||
+        m_useScreenSpaceErrorLoc == INVALID_UNIFORM_LOCATION ||
+        m_regionsLoc == INVALID_UNIFORM_LOCATION ||
+        m_projScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_pixelToleranceLoc == INVALID_UNIFORM_LOCATION ||
+        m_hysteresisLoc == INVALID_UNIFORM_LOCATION ||
+        m_morphRegionLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void GeomipCullTechnique::SetPass(int Pass)
+{
+    glUniform1i(m_passLoc, Pass);
+}
+
+
+void GeomipCullTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void GeomipCullTechnique::SetFrustumPlanes(const Matrix4f& ViewProj)
+{
+    Vector4f l, r, b, t, n, f;
+    ViewProj.CalcClipPlanes(l, r, b, t, n, f);
+
+    // The right, top and far planes are flipped so that the inside is always on the positive side
+    Vector4f Planes[6] = { l, r * -1.0f, b, t * -1.0f, n, f * -1.0f };
+
+    glUniform4fv(m_frustumPlanesLoc, 6, (const GLfloat*)Planes);
+}
+
+
+void GeomipCullTechnique::SetGridParams(int NumPatchesX, int NumPatchesZ, int PatchSize, float WorldScale, int MaxLod)
+{
+    glUniform1i(m_numPatchesXLoc, NumPatchesX);
+    glUniform1i(m_numPatchesZLoc, NumPatchesZ);
+    glUniform1i(m_patchSizeLoc, PatchSize);
+    glUniform1f(m_worldScaleLoc, WorldScale);
+    glUniform1i(m_maxLodLoc, MaxLod);
+}
+
+
+void GeomipCullTechnique::SetLodParams(bool UseScreenSpaceError, const std::vector<int>& Regions, float ProjScale,
+                                       float PixelTolerance, float Hysteresis)
+{
+    float RegionsF[GEOMIP_CULL_MAX_LODS] = { 0 };
+
+    for (int i = 0 ; i < (int)Regions.size() && i < GEOMIP_CULL_MAX_LODS ; i++) {
+        RegionsF[i] = (float)Regions[i];
+    }
+
+    glUniform1i(m_useScreenSpaceErrorLoc, UseScreenSpaceError ? 1 : 0);
+    glUniform1fv(m_regionsLoc, GEOMIP_CULL_MAX_LODS, RegionsF);
+    glUniform1f(m_projScaleLoc, ProjScale);
+    glUniform1f(m_pixelToleranceLoc, PixelTolerance);
+    glUniform1f(m_hysteresisLoc, Hysteresis);
+}
+
+
+void GeomipCullTechnique::SetMorphRegion(float MorphRegion)
+{
+    glUniform1f(m_morphRegionLoc, MorphRegion);
+}
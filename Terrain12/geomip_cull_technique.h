@@ -0,0 +1,69 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GEOMIP_CULL_TECHNIQUE_H
+#define GEOMIP_CULL_TECHNIQUE_H
+
+#include <vector>
+
+#include "technique.h"
+#include "ogldev_math_3d.h"
+
+#define GEOMIP_CULL_GROUP_SIZE 64
+#define GEOMIP_CULL_MAX_LODS   8
+
+class GeomipCullTechnique : public Technique
+{
+public:
+
+    GeomipCullTechnique();
+
+    virtual bool Init();
+
+    void SetPass(int Pass);
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    // Planes in the convention of Matrix4f::CalcClipPlanes
+    void SetFrustumPlanes(const Matrix4f& ViewProj);
+
+    void SetGridParams(int NumPatchesX, int NumPatchesZ, int PatchSize, float WorldScale, int MaxLod);
+
+    void SetLodParams(bool UseScreenSpaceError, const std::vector<int>& Regions, float ProjScale,
+                      float PixelTolerance, float Hysteresis);
+
+    void SetMorphRegion(float MorphRegion);
+
+private:
+    GLuint m_passLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_frustumPlanesLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_numPatchesXLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_numPatchesZLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_patchSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_worldScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_maxLodLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_useScreenSpaceErrorLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_regionsLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_projScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_pixelToleranceLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_hysteresisLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_morphRegionLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* GEOMIP_CULL_TECHNIQUE_H */
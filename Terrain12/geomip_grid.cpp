@@ -18,14 +18,34 @@
 
 
 #include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <float.h>
 #include <vector>
+#include <algorithm>
 
 #include "ogldev_math_3d.h"
+#include "ogldev_util.h"
 #include "geomip_grid.h"
 #include "terrain.h"
+#include "texture_config.h"
+#include "terrain_normals.h"
 
 int gShowPoints = 0;
 
+// Vertex attribute locations in terrain.vs and terrain_compact.vs
+#define POS_LOC              0      // the two heights of the compact format
+#define TEX_LOC              1
+#define NORMAL_LOC           2
+#define MORPH_LOC            3
+#define PATCH_SIDE_LODS_LOC  4      // the per patch attributes are constant in the CPU path
+#define PATCH_SIDE_MORPH_LOC 5
+#define PATCH_CORE_LOC       6
+
+#define HORIZON_NUM_SECTORS  1024
+
+#define MAX_PERMUTATION_INDICES (16 * 1024 * 1024)
+
 
 GeomipGrid::GeomipGrid()
 {
@@ -40,17 +60,11 @@ GeomipGrid::~GeomipGrid()
 
 void GeomipGrid::Destroy()
 {
-    if (m_vao > 0) {
-        glDeleteVertexArrays(1, &m_vao);
-    }
+    DestroyVertexData();
 
-    if (m_vb > 0) {
-        glDeleteBuffers(1, &m_vb);
-    }
+    m_indexCache.Destroy();
 
-    if (m_ib > 0) {
-        glDeleteBuffers(1, &m_ib);
-    }
+    DestroyGpuDriven();
 }
 
 
@@ -90,14 +104,88 @@ void GeomipGrid::CreateGeomipGrid(int Width, int Depth, int PatchSize, const Bas
 
     m_worldScale = pTerrain->GetWorldScale();
     m_maxLOD = m_lodManager.InitLodManager(PatchSize, m_numPatchesX, m_numPatchesZ, m_worldScale);
-    m_lodInfo.resize(m_maxLOD + 1);
+    m_patchIndices.resize(m_numPatchesX * m_numPatchesZ);
+
+    m_patchLevel = (int)log2f((float)(PatchSize - 1));  // InitLodManager verified that it is a power of two
 
-    m_patchWorldSize = (m_patchSize - 1) * m_worldScale;  // m_patchSize is in vertices and PatchSize is the actual size (2 vertices --> size 1)
-    m_patchWorldHalfSize = m_patchWorldSize / 2.0f;
+    m_horizonCuller.Init(HORIZON_NUM_SECTORS);
 
-    CreateGLState();
+    long long StartTime = GetCurrentTimeMillis();
 
-	PopulateBuffers(pTerrain);
+    GeomipCache Cache;
+    uint64_t CacheKey = 0;
+
+    if (!m_cacheFilename.empty()) {
+        CacheKey = GeomipCache::CalcKey(pTerrain->GetHeightMap(), Width, Depth, PatchSize, m_worldScale,
+                                        pTerrain->GetTextureScale(), m_vertexFormat, m_maxLOD);
+
+        if (Cache.Open(m_cacheFilename.c_str(), CacheKey) && !IsCacheValid(Cache.GetData())) {
+            printf("%s:%d - '%s' doesn't match the geomip grid\n", __FILE__, __LINE__, m_cacheFilename.c_str());
+            Cache.Close();
+        }
+    }
+
+    std::vector<u8> VertexData;
+
+    if (Cache.IsOpen()) {
+        LoadFromCache(Cache.GetData());
+        CreateVertexData(pTerrain, &Cache.GetData(), VertexData);
+        Cache.Close();
+        printf("Geomip grid loaded from '%s': %lld ms\n", m_cacheFilename.c_str(), GetCurrentTimeMillis() - StartTime);
+    } else {
+        m_lodManager.CalcGeometricErrors(pTerrain->GetHeightMap());
+        CreateVertexData(pTerrain, NULL, VertexData);
+        printf("Geomip grid generated: %lld ms\n", GetCurrentTimeMillis() - StartTime);
+
+        if (!m_cacheFilename.empty()) {
+            SaveToCache(CacheKey, VertexData);
+        }
+    }
+
+    if (m_gpuDriven && !InitGpuDriven()) {
+        m_gpuDriven = false;
+    }
+}
+
+
+void GeomipGrid::SetVertexFormat(GEOMIP_VERTEX_FORMAT Format)
+{
+    if (Format == m_vertexFormat) {
+        return;
+    }
+
+    m_vertexFormat = Format;
+
+    if (IsCreated()) {
+        DestroyVertexData();
+        std::vector<u8> VertexData;
+        CreateVertexData(m_pTerrain, NULL, VertexData);
+    }
+}
+
+
+void GeomipGrid::CreateVertexData(const BaseTerrain* pTerrain, const GeomipCacheData* pCache, std::vector<u8>& VertexData)
+{
+    switch (m_vertexFormat) {
+    case GEOMIP_VERTEX_FULL:
+        CreateGLState();
+        PopulateBuffers(pTerrain, pCache, VertexData);
+        break;
+
+    case GEOMIP_VERTEX_COMPACT:
+        CreateCompactGLState();
+        PopulateBuffers(pTerrain, pCache, VertexData);
+        break;
+
+    case GEOMIP_VERTEX_NONE:
+        // The VAO only holds the index buffer
+        glGenVertexArrays(1, &m_vao);
+        glBindVertexArray(m_vao);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexCache.GetIndexBuffer());
+        m_numVertices = m_numPatchesX * m_numPatchesZ * m_patchSize * m_patchSize;
+        CreateHeightMapTexture(pTerrain);
+        break;
+    }
 
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -105,6 +193,25 @@ void GeomipGrid::CreateGeomipGrid(int Width, int Depth, int PatchSize, const Bas
 }
 
 
+void GeomipGrid::DestroyVertexData()
+{
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+
+    if (m_vb > 0) {
+        glDeleteBuffers(1, &m_vb);
+        m_vb = 0;
+    }
+
+    if (m_heightMapTexture > 0) {
+        glDeleteTextures(1, &m_heightMapTexture);
+        m_heightMapTexture = 0;
+    }
+}
+
+
 void GeomipGrid::CreateGLState()
 {
     glGenVertexArrays(1, &m_vao);
@@ -115,12 +222,7 @@ void GeomipGrid::CreateGLState()
 
     glBindBuffer(GL_ARRAY_BUFFER, m_vb);
 
-    glGenBuffers(1, &m_ib);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
-
-    int POS_LOC = 0;
-    int TEX_LOC = 1;
-	int NORMAL_LOC = 2;
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexCache.GetIndexBuffer());
 
 	size_t NumFloats = 0;
 	
@@ -135,44 +237,140 @@ void GeomipGrid::CreateGLState()
     glEnableVertexAttribArray(NORMAL_LOC);
     glVertexAttribPointer(NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(NumFloats * sizeof(float)));
     NumFloats += 3;
+
+    glEnableVertexAttribArray(MORPH_LOC);
+    glVertexAttribPointer(MORPH_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(NumFloats * sizeof(float)));
+    NumFloats += 3;
 }
 
 
-void GeomipGrid::PopulateBuffers(const BaseTerrain* pTerrain)
+void GeomipGrid::CreateCompactGLState()
 {
+    glGenVertexArrays(1, &m_vao);
+
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexCache.GetIndexBuffer());
+
+    glEnableVertexAttribArray(POS_LOC);
+    glVertexAttribPointer(POS_LOC, 2, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (const void*)offsetof(CompactVertex, Height));
+
+    glEnableVertexAttribArray(NORMAL_LOC);
+    glVertexAttribPointer(NORMAL_LOC, 2, GL_BYTE, GL_TRUE, sizeof(CompactVertex), (const void*)offsetof(CompactVertex, Normal));
+
+    glEnableVertexAttribArray(MORPH_LOC);
+    glVertexAttribPointer(MORPH_LOC, 2, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(CompactVertex), (const void*)offsetof(CompactVertex, MorphLevel));
+}
+
+
+void GeomipGrid::CreateHeightMapTexture(const BaseTerrain* pTerrain)
+{
+    int TerrainSize = pTerrain->GetSize();
+
+    GLint MaxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &MaxTextureSize);
+
+    if (TerrainSize > MaxTextureSize) {
+        printf("%s:%d - terrain size %d is larger than the max texture size %d\n", __FILE__, __LINE__, TerrainSize, MaxTextureSize);
+        exit(0);
+    }
+
+    glGenTextures(1, &m_heightMapTexture);
+    glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, TerrainSize, TerrainSize, 0, GL_RED, GL_FLOAT,
+                 pTerrain->GetHeightMap().GetBaseAddr());
+
+    // The shader uses texelFetch
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    printf("Vertex-less geomip grid, height map texture %zu bytes\n", (size_t)TerrainSize * TerrainSize * sizeof(float));
+}
+
+
+void GeomipGrid::SetCompactParams(GeomipCompactTechnique& Tech) const
+{
+    Tech.SetGridParams(m_patchSize, m_numPatchesX, m_pTerrain->GetSize(), m_worldScale, m_pTerrain->GetTextureScale(), m_maxLOD);
+    Tech.SetHeightRange(m_minHeight, m_maxHeight);
+    Tech.SetVertexless(m_vertexFormat == GEOMIP_VERTEX_NONE);
+}
+
+
+//
+// The vertex buffer is built in the raw bytes of VertexData so that the cache can save
+// it as is. A cached buffer is uploaded straight from the mapping of the file.
+//
+void GeomipGrid::PopulateBuffers(const BaseTerrain* pTerrain, const GeomipCacheData* pCache, std::vector<u8>& VertexData)
+{
+    if (pCache) {
+        m_numVertices = pCache->NumVertices;
+        m_minHeight = pCache->MinHeight;
+        m_maxHeight = pCache->MaxHeight;
+        glBufferData(GL_ARRAY_BUFFER, (size_t)pCache->NumVertices * pCache->VertexSize, pCache->pVertices, GL_STATIC_DRAW);
+        return;
+    }
+
     std::vector<Vertex> Vertices;
     Vertices.resize(m_width * m_depth);
-    printf("Preparing space for %zu vertices\n", Vertices.size());
     InitVertices(pTerrain, Vertices);
 
-    int NumIndices = CalcNumIndices();
-	std::vector<unsigned int> Indices;
-    Indices.resize(NumIndices);
+    CalcNormals(Vertices);
 
-    NumIndices = InitIndices(Indices);
-    printf("Final number of indices %d\n", NumIndices);
+    size_t NumPatchVertices = (size_t)m_numPatchesX * m_numPatchesZ * m_patchSize * m_patchSize;
+    printf("Number of vertices %zu\n", NumPatchVertices);
 
-    CalcNormals(Vertices, Indices);
+    m_numVertices = (int)NumPatchVertices;
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices[0]) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
+    if (m_vertexFormat == GEOMIP_VERTEX_COMPACT) {
+        std::vector<Vertex> PatchVertices(NumPatchVertices);
+        InitPatchVertices(Vertices, &PatchVertices[0]);
+        VertexData.resize(NumPatchVertices * sizeof(CompactVertex));
+        InitCompactVertices(PatchVertices, (CompactVertex*)&VertexData[0]);
+        printf("Compact vertex buffer %zu bytes\n", VertexData.size());
+    } else {
+        VertexData.resize(NumPatchVertices * sizeof(Vertex));
+        InitPatchVertices(Vertices, (Vertex*)&VertexData[0]);
+    }
 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * NumIndices, &Indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, VertexData.size(), &VertexData[0], GL_STATIC_DRAW);
 }
 
 
-int GeomipGrid::CalcNumIndices()
+void GeomipGrid::InitCompactVertices(const std::vector<Vertex>& PatchVertices, CompactVertex* pCompactVertices)
 {
-    int NumQuads = (m_patchSize - 1) * (m_patchSize - 1);
-    int NumIndices = 0;
-    int MaxPermutationsPerLevel = 16;    // true/false for each of the four sides
-    const int IndicesPerQuad = 6;        // two triangles
-    for (int lod = 0; lod <= m_maxLOD; lod++) {
-        printf("LOD %d: num quads %d\n", lod, NumQuads);
-        NumIndices += NumQuads * IndicesPerQuad * MaxPermutationsPerLevel;
-        NumQuads /= 4;
+    m_minHeight = FLT_MAX;
+    m_maxHeight = -FLT_MAX;
+
+    for (const Vertex& v : PatchVertices) {
+        m_minHeight = std::min(m_minHeight, std::min(v.Pos.y, v.Morph.x));
+        m_maxHeight = std::max(m_maxHeight, std::max(v.Pos.y, v.Morph.x));
+    }
+
+    float Scale = (m_maxHeight > m_minHeight) ? 65535.0f / (m_maxHeight - m_minHeight) : 0.0f;
+
+    auto Quantize = [&](float Height) {
+        return (u16)std::min(roundf((Height - m_minHeight) * Scale), 65535.0f);
+    };
+
+    for (size_t i = 0 ; i < PatchVertices.size() ; i++) {
+        const Vertex& Src = PatchVertices[i];
+        CompactVertex& Dst = pCompactVertices[i];
+
+        Dst.Height = Quantize(Src.Pos.y);
+        Dst.MorphHeight = Quantize(Src.Morph.x);
+        EncodeOctahedral(Src.Normal.x, Src.Normal.y, Src.Normal.z, Dst.Normal);
+        Dst.MorphLevel = (u8)Src.Morph.y;
+        Dst.Side = (u8)Src.Morph.z;
     }
-    printf("Initial number of indices %d\n", NumIndices);
-    return NumIndices;
 }
 
 
@@ -189,6 +387,29 @@ void GeomipGrid::Vertex::InitVertex(const BaseTerrain* pTerrain, int x, int z)
 }
 
 
+//
+// The vertex belongs to every LOD up to the number of trailing zero bits in x and z.
+// In the last of them it moves towards the surface of the next LOD, where it is dropped.
+// The side is patch local so it is set when the vertices are copied to the patches.
+//
+void GeomipGrid::Vertex::InitMorph(const BaseTerrain* pTerrain, int x, int z, int MaxLOD)
+{
+    int Level = 0;
+
+    while ((Level < MaxLOD) && (x % (2 << Level) == 0) && (z % (2 << Level) == 0)) {
+        Level++;
+    }
+
+    float MorphHeight = Pos.y;
+
+    if (Level < MaxLOD) {
+        MorphHeight = LodManager::CalcLodHeight(pTerrain->GetHeightMap(), x, z, Level + 1);
+    }
+
+    Morph = Vector3f(MorphHeight, (float)Level, 0.0f);
+}
+
+
 void GeomipGrid::InitVertices(const BaseTerrain* pTerrain, std::vector<Vertex>& Vertices)
 {
     int Index = 0;
@@ -197,6 +418,7 @@ void GeomipGrid::InitVertices(const BaseTerrain* pTerrain, std::vector<Vertex>&
         for (int x = 0 ; x < m_width ; x++) {
             assert(Index < Vertices.size());
 			Vertices[Index].InitVertex(pTerrain, x, z);
+            Vertices[Index].InitMorph(pTerrain, x, z, m_maxLOD);
 			Index++;
         }
     }
@@ -205,348 +427,731 @@ void GeomipGrid::InitVertices(const BaseTerrain* pTerrain, std::vector<Vertex>&
 }
 
 
-int GeomipGrid::InitIndices(std::vector<unsigned int>& Indices)
+void GeomipGrid::InitPatchVertices(const std::vector<Vertex>& Vertices, Vertex* pPatchVertices)
 {
-    int Index = 0;
+    int NumVerticesPerPatch = m_patchSize * m_patchSize;
 
-    for (int lod = 0 ; lod <= m_maxLOD ; lod++) {
-        printf("*** Init indices lod %d ***\n", lod);
-        Index = InitIndicesLOD(Index, Indices, lod);
-        printf("\n");
-    }
+    for (int PatchZ = 0 ; PatchZ < m_numPatchesZ ; PatchZ++) {
+        for (int PatchX = 0 ; PatchX < m_numPatchesX ; PatchX++) {
+            Vertex* pDst = &pPatchVertices[(size_t)(PatchZ * m_numPatchesX + PatchX) * NumVerticesPerPatch];
 
-    return Index;
-}
+            int x0 = PatchX * (m_patchSize - 1);
+            int z0 = PatchZ * (m_patchSize - 1);
 
-int GeomipGrid::InitIndicesLOD(int Index, std::vector<unsigned int>& Indices, int lod)
-{
-    int TotalIndicesForLOD = 0;
-
-    for (int l = 0 ; l < LEFT ; l++) {
-        for (int r = 0 ; r < RIGHT ; r++) {
-            for (int t = 0 ; t < TOP ; t++) {
-                for (int b = 0 ; b < BOTTOM ; b++) {
-                    m_lodInfo[lod].info[l][r][t][b].Start = Index;
-                    Index = InitIndicesLODSingle(Index, Indices, lod, lod + l, lod + r, lod + t, lod + b);
+            for (int z = 0 ; z < m_patchSize ; z++) {
+                const Vertex* pSrc = &Vertices[(z0 + z) * m_width + x0];
+                memcpy(pDst + z * m_patchSize, pSrc, m_patchSize * sizeof(Vertex));
+            }
 
-                    m_lodInfo[lod].info[l][r][t][b].Count = Index - m_lodInfo[lod].info[l][r][t][b].Start;
-                    TotalIndicesForLOD += m_lodInfo[lod].info[l][r][t][b].Count;
-                }
+            // 1 - left, 2 - right, 3 - top, 4 - bottom. The corners are never morphed.
+            for (int i = 0 ; i < m_patchSize ; i++) {
+                pDst[i * m_patchSize].Morph.z = 1.0f;
+                pDst[i * m_patchSize + m_patchSize - 1].Morph.z = 2.0f;
+                pDst[(m_patchSize - 1) * m_patchSize + i].Morph.z = 3.0f;
+                pDst[i].Morph.z = 4.0f;
             }
         }
     }
+}
 
-    printf("Total indices for LOD: %d\n", TotalIndicesForLOD);
 
-    return Index;
+void GeomipGrid::CalcNormals(std::vector<Vertex>& Vertices)
+{
+    Array2D<Vector3f> Normals;
+    CalcTerrainNormals(m_pTerrain->GetHeightMap(), m_width, m_worldScale, Normals);
+
+    for (int z = 0 ; z < m_depth ; z++) {
+        const Vector3f* pSrc = Normals.GetRow(z);
+
+        for (int x = 0 ; x < m_width ; x++) {
+            Vertices[z * m_width + x].Normal = pSrc[x];
+        }
+    }
 }
 
 
-int GeomipGrid::InitIndicesLODSingle(int Index, std::vector<unsigned int>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom)
+bool GeomipGrid::IsCacheValid(const GeomipCacheData& Data) const
 {
-    int FanStep = powi(2, lodCore + 1);   // lod = 0 --> 2, lod = 1 --> 4, lod = 2 --> 8, etc
-    int EndPos = m_patchSize - 1 - FanStep;  // patch size 5, fan step 2 --> EndPos = 2; patch size 9, fan step 2 --> EndPos = 6
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
+    int VertexSize = 0;
+
+    if (m_vertexFormat == GEOMIP_VERTEX_FULL) {
+        VertexSize = sizeof(Vertex);
+    } else if (m_vertexFormat == GEOMIP_VERTEX_COMPACT) {
+        VertexSize = sizeof(CompactVertex);
+    }
+
+    int NumVertices = (VertexSize > 0) ? NumPatches * m_patchSize * m_patchSize : 0;
+
+    if ((Data.VertexFormat != m_vertexFormat) || (Data.VertexSize != VertexSize) || (Data.NumVertices != NumVertices) ||
+        (Data.NumPatches != NumPatches) || (Data.NumLods != m_maxLOD + 1)) {
+        return false;
+    }
 
-    for (int z = 0 ; z <= EndPos ; z += FanStep) {
-        for (int x = 0 ; x <= EndPos ; x += FanStep) {
-            int lLeft   = x == 0      ? lodLeft : lodCore;
-            int lRight  = x == EndPos ? lodRight : lodCore;
-            int lBottom = z == 0      ? lodBottom : lodCore;
-            int lTop    = z == EndPos ? lodTop : lodCore;
+    // The indices are local to the patch
+    int NumVerticesPerPatch = m_patchSize * m_patchSize;
 
-            Index = CreateTriangleFan(Index, Indices, lodCore, lLeft, lRight, lTop, lBottom, x, z);
+    for (int i = 0 ; i < Data.NumIndices ; i++) {
+        if (Data.pIndices[i] >= NumVerticesPerPatch) {
+            return false;
         }
     }
 
-    return Index;
+    return true;
 }
 
 
-uint GeomipGrid::CreateTriangleFan(int Index, std::vector<unsigned int>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom, int x, int z)
+void GeomipGrid::LoadFromCache(const GeomipCacheData& Data)
 {
-    int StepLeft   = powi(2, lodLeft); // because LOD starts at zero...
-    int StepRight  = powi(2, lodRight);
-    int StepTop    = powi(2, lodTop);
-    int StepBottom = powi(2, lodBottom);
-    int StepCenter = powi(2, lodCore);
+    static_assert(sizeof(PatchIndexCache::IndexRange) == 2 * sizeof(int), "the cache stores the index ranges as pairs of ints");
+
+    m_lodManager.SetGeometricErrors(Data.pGeometricErrors, Data.pPatchHeights);
+
+    m_indexCache.LoadIndexSets(Data.pIndexKeys, (const PatchIndexCache::IndexRange*)Data.pIndexRanges, Data.NumIndexSets,
+                               Data.pIndices, Data.NumIndices);
+}
+
 
-    uint IndexCenter = (z + StepCenter) * m_width + x + StepCenter;
+//
+// Every permutation of the index sets is saved (if there aren't too many of them) so
+// that neither the CPU path nor the GPU driven path builds any sets after a cache hit.
+//
+void GeomipGrid::SaveToCache(uint64_t Key, const std::vector<u8>& VertexData)
+{
+    if (CalcNumPermutationIndices() <= MAX_PERMUTATION_INDICES) {
+        BuildAllIndexSets();
+    }
 
-    // first up
-    uint IndexTemp1 = z * m_width + x;
-    uint IndexTemp2 = (z + StepLeft) * m_width + x;
+    std::vector<uint64_t> IndexKeys;
+    std::vector<PatchIndexCache::IndexRange> IndexRanges;
+    m_indexCache.GetIndexSets(IndexKeys, IndexRanges);
+
+    std::vector<float> PatchHeights;
+    m_lodManager.GetPatchHeights(PatchHeights);
+
+    const std::vector<u16>& Indices = m_indexCache.GetAllIndices();
+
+    GeomipCacheData Data;
+    Data.Key = Key;
+    Data.VertexFormat = m_vertexFormat;
+    Data.VertexSize = (m_vertexFormat == GEOMIP_VERTEX_NONE) ? 0 : (int)(VertexData.size() / m_numVertices);
+    Data.NumVertices = (m_vertexFormat == GEOMIP_VERTEX_NONE) ? 0 : m_numVertices;
+    Data.pVertices = VertexData.data();
+    Data.MinHeight = m_minHeight;
+    Data.MaxHeight = m_maxHeight;
+    Data.NumPatches = m_numPatchesX * m_numPatchesZ;
+    Data.NumLods = m_maxLOD + 1;
+    Data.pGeometricErrors = m_lodManager.GetGeometricErrors().data();
+    Data.pPatchHeights = PatchHeights.data();
+    Data.NumIndexSets = (int)IndexKeys.size();
+    Data.pIndexKeys = IndexKeys.data();
+    Data.pIndexRanges = (const int*)IndexRanges.data();
+    Data.NumIndices = (int)Indices.size();
+    Data.pIndices = Indices.data();
+
+    if (GeomipCache::WriteFile(m_cacheFilename.c_str(), Data)) {
+        printf("Geomip grid saved to '%s' (%d index sets)\n", m_cacheFilename.c_str(), Data.NumIndexSets);
+    }
+}
 
-    Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
 
-    // second up
-    if (lodLeft == lodCore) {
-        IndexTemp1 = IndexTemp2;
-        IndexTemp2 += StepLeft * m_width;
+void clrscr()
+{
+    std::system("cls");
+}
 
-        Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+void GeomipGrid::PrepareRender(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    if (m_gpuDriven) {
+        RunGpuCulling(CameraPos, ViewProj);
     }
+}
 
-    // first right
-    IndexTemp1 = IndexTemp2;
-    IndexTemp2 += StepTop;
 
-    Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    if (m_vertexFormat == GEOMIP_VERTEX_NONE) {
+        glActiveTexture(HEIGHT_MAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_heightMapTexture);
+    }
 
-    // second right
-    if (lodTop == lodCore) {
-        IndexTemp1 = IndexTemp2;
-        IndexTemp2 += StepTop;
+    if (m_gpuDriven) {
+        RenderGpuDriven();
+        return;
+    }
 
-        Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+#ifdef _WIN64
+    if (gShowPoints == 3) {
+        clrscr();
     }
+#endif
+    m_lodManager.Update(CameraPos);
 
-    // first down
-    IndexTemp1 = IndexTemp2;
-    IndexTemp2 -= StepRight * m_width;
+    for (int Patch : m_lodManager.GetDirtyPatches()) {
+        m_patchIndices[Patch] = GetPatchIndices(Patch % m_numPatchesX, Patch / m_numPatchesX);
+    }
 
-    Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+    // New permutations are built by GetPatchIndices on first use
+    m_indexCache.UpdateIndexBuffer();
 
-    // second down
-    if (lodRight == lodCore) {
-        IndexTemp1 = IndexTemp2;
-        IndexTemp2 -= StepRight * m_width;
+    FrustumCulling fc(ViewProj);
 
-        Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+    glBindVertexArray(m_vao);
+
+    if (gShowPoints > 0) {
+        glDrawArrays(GL_POINTS, 0, m_numVertices);
     }
 
-    // first left
-    IndexTemp1 = IndexTemp2;
-    IndexTemp2 -= StepBottom;
+    if (gShowPoints != 2) {
+        // Whole quadtree nodes outside the frustum are rejected without looking at their patches
+        m_pTerrain->GetHeightQuadtree().GetVisibleNodes(fc, m_worldScale, m_patchLevel, m_visiblePatches);
+
+        if (m_horizonCulling) {
+            CullOccludedPatches(CameraPos);
+        }
+
+        if (gShowPoints == 3) {
+            printf("Visible patches %zu/%d\n", m_visiblePatches.size(), m_numPatchesX * m_numPatchesZ);
+        }
+
+        for (size_t i = 0 ; i < m_visiblePatches.size() ; i++) {
+            int PatchX = m_visiblePatches[i].x;
+            int PatchZ = m_visiblePatches[i].y;
+
+            int Patch = PatchZ * m_numPatchesX + PatchX;
+
+            const PatchIndexCache::IndexRange& Range = m_patchIndices[Patch];
+
+            size_t BaseIndex = sizeof(u16) * Range.Start;
 
-    Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+            int BaseVertex = Patch * m_patchSize * m_patchSize;
 
-    // second left
-    if (lodBottom == lodCore) {
-        IndexTemp1 = IndexTemp2;
-        IndexTemp2 -= StepBottom;
+            LodManager::PatchMorph Morph;
+            m_lodManager.CalcPatchMorph(PatchX, PatchZ, CameraPos, Morph);
+            glVertexAttrib4fv(PATCH_SIDE_LODS_LOC, Morph.SideLods);
+            glVertexAttrib4fv(PATCH_SIDE_MORPH_LOC, Morph.SideMorphs);
+            glVertexAttrib2f(PATCH_CORE_LOC, Morph.CoreLod, Morph.CoreMorph);
 
-        Index = AddTriangle(Index, Indices, IndexCenter, IndexTemp1, IndexTemp2);
+            glDrawElementsBaseVertex(GL_TRIANGLES, Range.Count, GL_UNSIGNED_SHORT, (void*)BaseIndex, BaseVertex);
+        }
     }
 
-    return Index;
+    glBindVertexArray(0);
+
+    gShowPoints = 0;
 }
 
 
-uint GeomipGrid::AddTriangle(uint Index, std::vector<uint>& Indices, uint v1, uint v2, uint v3)
+//
+// The patches are processed front to back. Before a patch is tested the occluders of the
+// patches that are entirely closer to the camera are added to the horizon, and if it is
+// visible its own occluders are queued.
+//
+void GeomipGrid::CullOccludedPatches(const Vector3f& CameraPos)
 {
-    assert(Index < Indices.size());
-    Indices[Index++] = v1;
-    assert(Index < Indices.size());
-    Indices[Index++] = v2;
-    assert(Index < Indices.size());
-    Indices[Index++] = v3;
+    m_horizonCuller.Begin(CameraPos);
+
+    m_sortedPatches.clear();
+
+    for (const Vector2i& Patch : m_visiblePatches) {
+        Vector3f Min, Max;
+        GetPatchAABB(Patch.x, Patch.y, Min, Max);
+        float Distance = m_horizonCuller.GetMinDistance(Min.x, Min.z, Max.x, Max.z);
+        m_sortedPatches.push_back(std::make_pair(Distance, Patch));
+    }
+
+    std::sort(m_sortedPatches.begin(), m_sortedPatches.end(),
+              [](const std::pair<float, Vector2i>& a, const std::pair<float, Vector2i>& b) { return a.first < b.first; });
+
+    m_visiblePatches.clear();
+    m_numOccludedPatches = 0;
+
+    for (const std::pair<float, Vector2i>& p : m_sortedPatches) {
+        m_horizonCuller.CommitOccluders(p.first);
 
-    return Index;
+        Vector3f Min, Max;
+        GetPatchAABB(p.second.x, p.second.y, Min, Max);
+
+        if (m_horizonCuller.IsOccluded(Min, Max)) {
+            m_numOccludedPatches++;
+            continue;
+        }
+
+        m_visiblePatches.push_back(p.second);
+        AddPatchOccluders(p.second.x, p.second.y);
+    }
+
+    // For the objects on the terrain
+    m_horizonCuller.CommitAllOccluders();
 }
 
 
-void GeomipGrid::CalcNormals(std::vector<Vertex>& Vertices, std::vector<uint>& Indices)
+//
+// The occluders are the four quadrants of the patch. At every LOD (including the stitching
+// and the geomorphing) the triangles of a quadrant only use the points of that quadrant,
+// so the surface is never below the minimum of the quadrant in the height quadtree.
+//
+void GeomipGrid::AddPatchOccluders(int PatchX, int PatchZ)
 {
-    unsigned int Index = 0;
+    const HeightQuadtree& Quadtree = m_pTerrain->GetHeightQuadtree();
+    int Level = m_patchLevel - 1;
+    int LevelSize = Quadtree.GetLevelSize(Level);
 
-    // Accumulate each triangle normal into each of the triangle vertices
-    for (int z = 0 ; z < m_depth - 1 ; z += (m_patchSize - 1)) {
-        for (int x = 0 ; x < m_width - 1; x += (m_patchSize - 1)) {
-            int BaseVertex = z * m_width + x;
-            //printf("Base index %d\n", BaseVertex);
-            int NumIndices = m_lodInfo[0].info[0][0][0][0].Count;
-            for (int i = 0 ; i < NumIndices ; i += 3) {
-                unsigned int Index0 = BaseVertex + Indices[i];
-                unsigned int Index1 = BaseVertex + Indices[i + 1];
-                unsigned int Index2 = BaseVertex + Indices[i + 2];
-		        Vector3f v1 = Vertices[Index1].Pos - Vertices[Index0].Pos;
-		        Vector3f v2 = Vertices[Index2].Pos - Vertices[Index0].Pos;
-		        Vector3f Normal = v1.Cross(v2);
-		        Normal.Normalize();
+    for (int i = 0 ; i < 4 ; i++) {
+        int NodeX = PatchX * 2 + (i & 1);
+        int NodeZ = PatchZ * 2 + (i >> 1);
 
-		        Vertices[Index0].Normal += Normal;
-		        Vertices[Index1].Normal += Normal;
-		        Vertices[Index2].Normal += Normal;
-    		}
+        if ((NodeX >= LevelSize) || (NodeZ >= LevelSize)) {
+            continue;
         }
-    }
 
-    // Normalize all the vertex normals
-    for (unsigned int i = 0 ; i < Vertices.size() ; i++) {
-        Vertices[i].Normal.Normalize();
+        float MinHeight, MaxHeight;
+        Quadtree.GetNodeMinMax(Level, NodeX, NodeZ, MinHeight, MaxHeight);
+
+        int x0, z0, x1, z1;
+        Quadtree.GetNodeRange(Level, NodeX, NodeZ, x0, z0, x1, z1);
+
+        m_horizonCuller.AddOccluder((float)x0 * m_worldScale, (float)z0 * m_worldScale,
+                                    (float)x1 * m_worldScale, (float)z1 * m_worldScale, MinHeight);
     }
 }
 
 
-void clrscr()
+const PatchIndexCache::IndexRange& GeomipGrid::GetPatchIndices(int PatchX, int PatchZ)
 {
-    std::system("cls");
+    const LodManager::PatchLod& plod = m_lodManager.GetPatchLod(PatchX, PatchZ);
+
+    return m_indexCache.GetIndices(m_patchSize, plod.Core, plod.Core + plod.Left, plod.Core + plod.Right,
+                                   plod.Core + plod.Top, plod.Core + plod.Bottom);
 }
 
-void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+
+bool GeomipGrid::SetGpuDriven(bool Enable)
 {
-#ifdef _WIN64
-    if (gShowPoints == 3) {
-        clrscr();
+    if (Enable && !m_gpuDrivenInitialized && !InitGpuDriven()) {
+        return false;
     }
-#endif
-    m_lodManager.Update(CameraPos);
 
-    FrustumCulling fc(ViewProj);
+    m_gpuDriven = Enable;
+    m_resetGpuLods = true;
 
-    glBindVertexArray(m_vao);
+    return true;
+}
 
-    if (gShowPoints > 0) {
-        glDrawElementsBaseVertex(GL_POINTS, m_lodInfo[0].info[0][0][0][0].Count, GL_UNSIGNED_INT, (void*)0, 0);
+
+int GeomipGrid::GetPermutationIndex(int Core, int Left, int Right, int Top, int Bottom) const
+{
+    int n = m_maxLOD + 1;
+    return (((Core * n + Left) * n + Right) * n + Top) * n + Bottom;
+}
+
+
+size_t GeomipGrid::CalcNumPermutationIndices() const
+{
+    size_t NumIndices = 0;
+
+    for (int Core = 0 ; Core <= m_maxLOD ; Core++) {
+        size_t NumPermutations = (size_t)powi(m_maxLOD - Core + 1, 4);
+        size_t NumQuads = (size_t)((m_patchSize - 1) * (m_patchSize - 1)) >> (2 * Core);
+        NumIndices += NumPermutations * NumQuads * 6;
     }
 
-    if (gShowPoints != 2) {
-        for (int PatchZ = 0 ; PatchZ < m_numPatchesZ ; PatchZ++) {
-            for (int PatchX = 0 ; PatchX < m_numPatchesX ; PatchX++) {
-
-                int x = PatchX * (m_patchSize - 1);
-                int z = PatchZ * (m_patchSize - 1);  
-
-                float x0 = x * m_worldScale;
-                float x1 = (x + m_patchSize - 1) * m_worldScale;
-                float z0 = z * m_worldScale;
-                float z1 = (z + m_patchSize - 1) * m_worldScale;
-
-                if (IsCameraInPatch(CameraPos, x, z)) {
-                    // continue to draw call
-                } else if (!IsPatchInsideViewFrustum_WorldSpace(x, z, fc)) {
-                    if (!IsCameraCloseToPatch(CameraPos, x, z)) {
-                        continue;
+    return NumIndices;
+}
+
+
+void GeomipGrid::BuildAllIndexSets()
+{
+    for (int Core = 0 ; Core <= m_maxLOD ; Core++) {
+        int MaxDelta = m_maxLOD - Core;
+
+        for (int l = 0 ; l <= MaxDelta ; l++) {
+            for (int r = 0 ; r <= MaxDelta ; r++) {
+                for (int t = 0 ; t <= MaxDelta ; t++) {
+                    for (int b = 0 ; b <= MaxDelta ; b++) {
+                        m_indexCache.GetIndices(m_patchSize, Core, Core + l, Core + r, Core + t, Core + b);
                     }
-                } else {
-                    if (gShowPoints == 3) printf(" (1)  ");
                 }
+            }
+        }
+    }
+}
+
+
+//
+// The GPU selects the index set of a patch by itself so every permutation that can
+// show up must be in the index buffer in advance. The number of permutations grows
+// quickly with the patch size so large patches fall back to the CPU path.
+//
+bool GeomipGrid::InitGpuDriven()
+{
+    if (!GLEW_VERSION_4_6 && !(GLEW_VERSION_4_3 && GLEW_ARB_indirect_parameters)) {
+        printf("GPU driven terrain requires OpenGL 4.6 or 4.3 with ARB_indirect_parameters\n");
+        return false;
+    }
 
-                const LodManager::PatchLod& plod = m_lodManager.GetPatchLod(PatchX, PatchZ);
-                int C = plod.Core;
-                int L = plod.Left;
-                int R = plod.Right;
-                int T = plod.Top;
-                int B = plod.Bottom;
+    if (m_maxLOD + 1 > GEOMIP_CULL_MAX_LODS) {
+        printf("GPU driven terrain supports up to %d LODs (%d)\n", GEOMIP_CULL_MAX_LODS, m_maxLOD + 1);
+        return false;
+    }
+
+    size_t NumIndices = CalcNumPermutationIndices();
+
+    if (NumIndices > MAX_PERMUTATION_INDICES) {
+        printf("Patch size %d needs too many index permutations for the GPU driven path (%zu)\n", m_patchSize, NumIndices);
+        return false;
+    }
 
-                size_t BaseIndex = sizeof(unsigned int) * m_lodInfo[C].info[L][R][T][B].Start;
+    if (!m_cullTechInitialized) {
+        if (!m_cullTech.Init()) {
+            printf("Error initializing the geomip culling technique\n");
+            return false;
+        }
 
-                int BaseVertex = z * m_width + x;
+        m_cullTechInitialized = true;
+    }
 
-                glDrawElementsBaseVertex(GL_TRIANGLES, m_lodInfo[C].info[L][R][T][B].Count, 
-                                         GL_UNSIGNED_INT, (void*)BaseIndex, BaseVertex);
+    int n = m_maxLOD + 1;
+    std::vector<GLuint> IndexRanges(powi(n, 5) * 2, 0);
+
+    for (int Core = 0 ; Core <= m_maxLOD ; Core++) {
+        int MaxDelta = m_maxLOD - Core;
+
+        for (int l = 0 ; l <= MaxDelta ; l++) {
+            for (int r = 0 ; r <= MaxDelta ; r++) {
+                for (int t = 0 ; t <= MaxDelta ; t++) {
+                    for (int b = 0 ; b <= MaxDelta ; b++) {
+                        const PatchIndexCache::IndexRange& Range =
+                            m_indexCache.GetIndices(m_patchSize, Core, Core + l, Core + r, Core + t, Core + b);
+                        int Permutation = GetPermutationIndex(Core, l, r, t, b);
+                        IndexRanges[Permutation * 2] = Range.Start;
+                        IndexRanges[Permutation * 2 + 1] = Range.Count;
+                    }
+                }
             }
+        }
+    }
+
+    m_indexCache.UpdateIndexBuffer();
 
-            if (gShowPoints == 3)  printf("\n");
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
+
+    std::vector<float> PatchHeights(NumPatches * 2);
+
+    for (int PatchZ = 0 ; PatchZ < m_numPatchesZ ; PatchZ++) {
+        for (int PatchX = 0 ; PatchX < m_numPatchesX ; PatchX++) {
+            int Patch = PatchZ * m_numPatchesX + PatchX;
+            m_pTerrain->GetHeightQuadtree().GetNodeMinMax(m_patchLevel, PatchX, PatchZ,
+                                                          PatchHeights[Patch * 2], PatchHeights[Patch * 2 + 1]);
         }
     }
 
-    glBindVertexArray(0);
+    const std::vector<float>& GeometricErrors = m_lodManager.GetGeometricErrors();
 
-    gShowPoints = 0;
+    std::vector<GLint> PatchLods(NumPatches, -1);
+
+    glGenBuffers(NUM_GPU_BUFFERS, m_gpuBuffers);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[PATCH_HEIGHTS_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PatchHeights.size() * sizeof(float), &PatchHeights[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[GEOMETRIC_ERRORS_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, GeometricErrors.size() * sizeof(float), &GeometricErrors[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[INDEX_RANGES_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, IndexRanges.size() * sizeof(GLuint), &IndexRanges[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[PATCH_LODS_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PatchLods.size() * sizeof(GLint), &PatchLods[0], GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[DRAW_COMMANDS_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NumPatches * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[DRAW_COUNT_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[PATCH_MORPHS_BUFFER]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, NumPatches * sizeof(GpuPatchMorph), NULL, GL_DYNAMIC_COPY);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    printf("GPU driven terrain: %d index sets, %zu indices\n", m_indexCache.GetNumIndexSets(), NumIndices);
+
+    m_gpuDrivenInitialized = true;
+    m_resetGpuLods = true;
+
+    return true;
 }
 
 
-bool GeomipGrid::IsPatchInsideViewFrustum_ViewSpace(int X, int Z, const Matrix4f& ViewProj)
+void GeomipGrid::DestroyGpuDriven()
 {
-    int x0 = X;
-    int x1 = X + m_patchSize - 1;
-    int z0 = Z;
-    int z1 = Z + m_patchSize - 1;
+    if (m_gpuDrivenInitialized) {
+        glDeleteBuffers(NUM_GPU_BUFFERS, m_gpuBuffers);
 
-    Vector3f p00((float)x0 * m_worldScale, m_pTerrain->GetHeight(x0, z0), (float)z0 * m_worldScale);
-    Vector3f p01((float)x0 * m_worldScale, m_pTerrain->GetHeight(x0, z1), (float)z1 * m_worldScale);
-    Vector3f p10((float)x1 * m_worldScale, m_pTerrain->GetHeight(x1, z0), (float)z0 * m_worldScale);
-    Vector3f p11((float)x1 * m_worldScale, m_pTerrain->GetHeight(x1, z1), (float)z1 * m_worldScale);
-
-    bool InsideViewFrustum =
-        IsPointInsideViewFrustum(p00, ViewProj) ||
-        IsPointInsideViewFrustum(p01, ViewProj) ||
-        IsPointInsideViewFrustum(p10, ViewProj) ||
-        IsPointInsideViewFrustum(p11, ViewProj);
+        for (int i = 0 ; i < NUM_GPU_BUFFERS ; i++) {
+            m_gpuBuffers[i] = 0;
+        }
 
-    return InsideViewFrustum;
+        m_gpuDrivenInitialized = false;
+    }
 }
 
 
-bool GeomipGrid::IsPatchInsideViewFrustum_WorldSpace(int X, int Z, const FrustumCulling& fc)
+void GeomipGrid::RunGpuCulling(const Vector3f& CameraPos, const Matrix4f& ViewProj)
 {
-    int x0 = X;
-    int x1 = X + m_patchSize - 1;
-    int z0 = Z;
-    int z1 = Z + m_patchSize - 1;
+    GpuLodParams Params;
+    Params.UseScreenSpaceError = m_lodManager.IsScreenSpaceErrorMode();
+    Params.ProjScale = m_lodManager.GetProjScale();
+    Params.PixelTolerance = m_lodManager.GetPixelTolerance();
+    Params.Hysteresis = m_lodManager.GetHysteresis();
+
+    // Same as the full update of the LOD manager when the selection changes
+    if ((Params.UseScreenSpaceError != m_gpuLodParams.UseScreenSpaceError) ||
+        (Params.ProjScale != m_gpuLodParams.ProjScale) ||
+        (Params.PixelTolerance != m_gpuLodParams.PixelTolerance) ||
+        (Params.Hysteresis != m_gpuLodParams.Hysteresis)) {
+        m_gpuLodParams = Params;
+        m_resetGpuLods = true;
+    }
+
+    if (m_resetGpuLods) {
+        GLint MinusOne = -1;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[PATCH_LODS_BUFFER]);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32I, GL_RED_INTEGER, GL_INT, &MinusOne);
+        m_resetGpuLods = false;
+    }
+
+    GLuint Zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[DRAW_COUNT_BUFFER]);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &Zero);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
-    float h00 = m_pTerrain->GetHeight(x0, z0);
-    float h01 = m_pTerrain->GetHeight(x0, z1);
-    float h10 = m_pTerrain->GetHeight(x1, z0);
-    float h11 = m_pTerrain->GetHeight(x1, z1);
+    for (int i = 0 ; i < NUM_GPU_BUFFERS ; i++) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, i, m_gpuBuffers[i]);
+    }
 
-    float MinHeight = std::min(h00, std::min(h01, std::min(h10, h11)));
-    float MaxHeight = std::max(h00, std::max(h01, std::max(h10, h11)));
+    m_cullTech.Enable();
+    m_cullTech.SetCameraPos(CameraPos);
+    m_cullTech.SetFrustumPlanes(ViewProj);
+    m_cullTech.SetGridParams(m_numPatchesX, m_numPatchesZ, m_patchSize, m_worldScale, m_maxLOD);
+    m_cullTech.SetLodParams(Params.UseScreenSpaceError, m_lodManager.GetRegions(), Params.ProjScale,
+                            Params.PixelTolerance, Params.Hysteresis);
+    m_cullTech.SetMorphRegion(m_lodManager.GetMorphRegion());
 
-    Vector3f p00_low((float)x0 * m_worldScale, h00, (float)z0 * m_worldScale);
-    Vector3f p01_low((float)x0 * m_worldScale, h01, (float)z1 * m_worldScale);
-    Vector3f p10_low((float)x1 * m_worldScale, h10, (float)z0 * m_worldScale);
-    Vector3f p11_low((float)x1 * m_worldScale, h11, (float)z1 * m_worldScale);
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
+    int NumGroups = (NumPatches + GEOMIP_CULL_GROUP_SIZE - 1) / GEOMIP_CULL_GROUP_SIZE;
 
-  /*  Vector3f p00_high((float)x0 * m_worldScale, MaxHeight, (float)z0 * m_worldScale);
-    Vector3f p01_high((float)x0 * m_worldScale, MaxHeight, (float)z1 * m_worldScale);
-    Vector3f p10_high((float)x1 * m_worldScale, MaxHeight, (float)z0 * m_worldScale);
-    Vector3f p11_high((float)x1 * m_worldScale, MaxHeight, (float)z1 * m_worldScale);*/
+    // Pass 1 reads the LODs of the neighbors so all of them must be ready
+    m_cullTech.SetPass(0);
+    glDispatchCompute(NumGroups, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 
-    bool InsideViewFrustm =
-        fc.IsPointInsideViewFrustum(p00_low) ||
-        fc.IsPointInsideViewFrustum(p01_low) ||
-        fc.IsPointInsideViewFrustum(p10_low) ||
-        fc.IsPointInsideViewFrustum(p11_low);// ||
-     /*   fc.IsPointInsideViewFrustum(p00_high) ||
-        fc.IsPointInsideViewFrustum(p01_high) ||
-        fc.IsPointInsideViewFrustum(p10_high) ||
-        fc.IsPointInsideViewFrustum(p11_high);*/
+    m_cullTech.SetPass(1);
+    glDispatchCompute(NumGroups, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT |
+                    GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
 
-    return InsideViewFrustm;
+    glUseProgram(0);
 }
 
 
-bool GeomipGrid::IsCameraInPatch(const Vector3f& CameraPos, int PatchBaseX, int PatchBaseZ)
+//
+// The base instance of every draw command is the patch index so the per patch morph
+// parameters are fetched as instanced attributes from the buffer written by pass 1.
+//
+void GeomipGrid::RenderGpuDriven()
 {
-    float x0 = PatchBaseX * m_worldScale;
-    float x1 = (PatchBaseX + m_patchSize - 1) * m_worldScale;
-    float z0 = PatchBaseZ * m_worldScale;
-    float z1 = (PatchBaseZ + m_patchSize - 1) * m_worldScale;
+    glBindVertexArray(m_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_gpuBuffers[PATCH_MORPHS_BUFFER]);
+
+    glEnableVertexAttribArray(PATCH_SIDE_LODS_LOC);
+    glVertexAttribPointer(PATCH_SIDE_LODS_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(GpuPatchMorph), (const void*)0);
+    glVertexAttribDivisor(PATCH_SIDE_LODS_LOC, 1);
+
+    glEnableVertexAttribArray(PATCH_SIDE_MORPH_LOC);
+    glVertexAttribPointer(PATCH_SIDE_MORPH_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(GpuPatchMorph), (const void*)(4 * sizeof(float)));
+    glVertexAttribDivisor(PATCH_SIDE_MORPH_LOC, 1);
+
+    glEnableVertexAttribArray(PATCH_CORE_LOC);
+    glVertexAttribPointer(PATCH_CORE_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(GpuPatchMorph), (const void*)(8 * sizeof(float)));
+    glVertexAttribDivisor(PATCH_CORE_LOC, 1);
 
-    bool CameraInPatch = ((CameraPos.x >= x0) &&
-                          (CameraPos.x < x1) &&
-                          (CameraPos.z >= z0) &&
-                          (CameraPos.z < z1));
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_gpuBuffers[DRAW_COMMANDS_BUFFER]);
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_gpuBuffers[DRAW_COUNT_BUFFER]);
 
-    if (CameraInPatch && (gShowPoints == 3)) {
-        printf(" (C)  ");
+    GLsizei MaxDrawCount = m_numPatchesX * m_numPatchesZ;
+
+    if (GLEW_VERSION_4_6) {
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_SHORT, NULL, 0, MaxDrawCount, 0);
+    } else {
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_SHORT, NULL, 0, MaxDrawCount, 0);
     }
 
-    return CameraInPatch;
+    glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    // Back to the constant attributes of the CPU path
+    glDisableVertexAttribArray(PATCH_SIDE_LODS_LOC);
+    glDisableVertexAttribArray(PATCH_SIDE_MORPH_LOC);
+    glDisableVertexAttribArray(PATCH_CORE_LOC);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 
-bool GeomipGrid::IsCameraCloseToPatch(const Vector3f& CameraPos, int PatchBaseX, int PatchBaseZ)
+//
+// The GPU LODs are selected from scratch (like the first update of the LOD manager)
+// and the CPU reference uses the same culling and index sets as the CPU render path.
+//
+bool GeomipGrid::RunGpuSelfCheck(const Vector3f& CameraPos, const Matrix4f& ViewProj)
 {
-    Vector3f PatchWorldBase(PatchBaseX * m_worldScale, 0.0f, PatchBaseZ * m_worldScale);
-    Vector3f PatchWorldCenter = PatchWorldBase + Vector3f(m_patchWorldHalfSize, 0.0f, m_patchWorldHalfSize);
-    Vector3f CameraPosZeroY = Vector3f(CameraPos.x, 0.0f, CameraPos.z);
-    float CameraToPatchCenter = CameraPosZeroY.Distance(PatchWorldCenter);
+    if (!m_gpuDrivenInitialized && !InitGpuDriven()) {
+        printf("GPU self check: GPU driven path is not available\n");
+        return false;
+    }
 
-    bool CameraCloseToPatch = (CameraToPatchCenter <= m_patchWorldSize * 2.0f);
+    m_resetGpuLods = true;
+    RunGpuCulling(CameraPos, ViewProj);
 
-    if (gShowPoints == 3) {
-        if (CameraCloseToPatch) {
-            printf(" (2)  ");
-        } else {
-            printf("%05.1f ", CameraToPatchCenter);
+    GLuint DrawCount = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[DRAW_COUNT_BUFFER]);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &DrawCount);
+
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
+
+    if ((int)DrawCount > NumPatches) {
+        printf("GPU self check: invalid draw count %u\n", DrawCount);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return false;
+    }
+
+    std::vector<DrawElementsIndirectCommand> Commands(DrawCount);
+
+    if (DrawCount > 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_gpuBuffers[DRAW_COMMANDS_BUFFER]);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, DrawCount * sizeof(DrawElementsIndirectCommand), &Commands[0]);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // CPU reference
+    std::vector<int> Lods;
+    m_lodManager.CalcReferenceLods(CameraPos, Lods);
+
+    FrustumCulling fc(ViewProj);
+    std::vector<Vector2i> VisiblePatches;
+    m_pTerrain->GetHeightQuadtree().GetVisibleNodes(fc, m_worldScale, m_patchLevel, VisiblePatches);
+
+    std::vector<PatchIndexCache::IndexRange> Expected(NumPatches);
+    std::vector<char> IsExpected(NumPatches, 0);
+
+    auto GetLod = [&](int PatchX, int PatchZ, int Default) {
+        if ((PatchX < 0) || (PatchX >= m_numPatchesX) || (PatchZ < 0) || (PatchZ >= m_numPatchesZ)) {
+            return Default;
+        }
+
+        return Lods[PatchZ * m_numPatchesX + PatchX];
+    };
+
+    for (const Vector2i& p : VisiblePatches) {
+        int Patch = p.y * m_numPatchesX + p.x;
+        int Core = Lods[Patch];
+
+        Expected[Patch] = m_indexCache.GetIndices(m_patchSize, Core,
+                                                  GetLod(p.x - 1, p.y, Core), GetLod(p.x + 1, p.y, Core),
+                                                  GetLod(p.x, p.y + 1, Core), GetLod(p.x, p.y - 1, Core));
+        IsExpected[Patch] = 1;
+    }
+
+    int NumMismatches = 0;
+    std::vector<char> IsFound(NumPatches, 0);
+
+    for (const DrawElementsIndirectCommand& Cmd : Commands) {
+        int Patch = (int)Cmd.BaseInstance;
+
+        bool Match = (Patch < NumPatches) && IsExpected[Patch] && !IsFound[Patch] &&
+                     (Cmd.FirstIndex == (GLuint)Expected[Patch].Start) &&
+                     (Cmd.Count == (GLuint)Expected[Patch].Count) &&
+                     (Cmd.BaseVertex == Patch * m_patchSize * m_patchSize) &&
+                     (Cmd.InstanceCount == 1);
+
+        if (!Match) {
+            if (NumMismatches < 10) {
+                printf("GPU self check: unexpected draw for patch %d (first index %u count %u)\n", Patch, Cmd.FirstIndex, Cmd.Count);
+            }
+            NumMismatches++;
+        }
+
+        if (Patch < NumPatches) {
+            IsFound[Patch] = 1;
         }
     }
 
-    return CameraCloseToPatch;
+    for (int Patch = 0 ; Patch < NumPatches ; Patch++) {
+        if (IsExpected[Patch] && !IsFound[Patch]) {
+            if (NumMismatches < 10) {
+                printf("GPU self check: patch %d is missing\n", Patch);
+            }
+            NumMismatches++;
+        }
+    }
+
+    bool Passed = (NumMismatches == 0);
+
+    printf("GPU self check %s: camera %f %f %f, GPU draws %u, CPU visible patches %zu, mismatches %d\n",
+           Passed ? "passed" : "FAILED", CameraPos.x, CameraPos.y, CameraPos.z, DrawCount, VisiblePatches.size(), NumMismatches);
+
+    // Restart the hysteresis of the regular frames
+    m_resetGpuLods = true;
+
+    return Passed;
 }
 
 
+void GeomipGrid::GetPatchAABB(int PatchX, int PatchZ, Vector3f& Min, Vector3f& Max) const
+{
+    float MinHeight, MaxHeight;
+    m_pTerrain->GetHeightQuadtree().GetNodeMinMax(m_patchLevel, PatchX, PatchZ, MinHeight, MaxHeight);
+
+    int x0 = PatchX * (m_patchSize - 1);
+    int z0 = PatchZ * (m_patchSize - 1);
+    int x1 = x0 + m_patchSize - 1;
+    int z1 = z0 + m_patchSize - 1;
+
+    Min = Vector3f((float)x0 * m_worldScale, MinHeight, (float)z0 * m_worldScale);
+    Max = Vector3f((float)x1 * m_worldScale, MaxHeight, (float)z1 * m_worldScale);
+}
+
 
+bool GeomipGrid::IsPatchInsideViewFrustum_ViewSpace(int X, int Z, const Matrix4f& ViewProj)
+{
+    int x0 = X;
+    int x1 = X + m_patchSize - 1;
+    int z0 = Z;
+    int z1 = Z + m_patchSize - 1;
+
+    Vector3f p00((float)x0 * m_worldScale, m_pTerrain->GetHeight(x0, z0), (float)z0 * m_worldScale);
+    Vector3f p01((float)x0 * m_worldScale, m_pTerrain->GetHeight(x0, z1), (float)z1 * m_worldScale);
+    Vector3f p10((float)x1 * m_worldScale, m_pTerrain->GetHeight(x1, z0), (float)z0 * m_worldScale);
+    Vector3f p11((float)x1 * m_worldScale, m_pTerrain->GetHeight(x1, z1), (float)z1 * m_worldScale);
+
+    bool InsideViewFrustum =
+        IsPointInsideViewFrustum(p00, ViewProj) ||
+        IsPointInsideViewFrustum(p01, ViewProj) ||
+        IsPointInsideViewFrustum(p10, ViewProj) ||
+        IsPointInsideViewFrustum(p11, ViewProj);
+
+    return InsideViewFrustum;
+}
+
+
+bool GeomipGrid::IsPatchInsideViewFrustum_WorldSpace(int X, int Z, const FrustumCulling& fc)
+{
+    Vector3f Min, Max;
+    GetPatchAABB(X / (m_patchSize - 1), Z / (m_patchSize - 1), Min, Max);
+
+    return fc.IsAABBInsideViewFrustum(Min, Max);
+}
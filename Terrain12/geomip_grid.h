@@ -22,14 +22,26 @@
 
 #include <GL/glew.h>
 #include <vector>
+#include <string>
 
 #include "ogldev_math_3d.h"
 #include "lod_manager.h"
+#include "patch_index_cache.h"
+#include "geomip_cache.h"
+#include "geomip_cull_technique.h"
+#include "geomip_compact_technique.h"
+#include "horizon_culler.h"
 
 // this header is included by terrain.h so we have a forward 
 // declaration for BaseTerrain.
 class BaseTerrain;
 
+enum GEOMIP_VERTEX_FORMAT {
+    GEOMIP_VERTEX_FULL = 0,         // position, texture coordinates, normal and morph data (44 bytes)
+    GEOMIP_VERTEX_COMPACT = 1,      // 16 bit heights, octahedral normal and morph data (8 bytes)
+    GEOMIP_VERTEX_NONE = 2          // no vertex buffer - the heights come from a texture
+};
+
 class GeomipGrid {
  public:
     GeomipGrid();
@@ -40,45 +52,135 @@ class GeomipGrid {
 
     void Destroy();
 
+    bool IsCreated() const { return m_vao != 0; }
+
+    // Runs the GPU culling and LOD selection when the GPU driven path is enabled. It
+    // switches shader programs so it must be called before the terrain technique is enabled.
+    void PrepareRender(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
     void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj);
 
+    // Returns false if the GPU driven path is not supported (the CPU path is used instead)
+    bool SetGpuDriven(bool Enable);
+
+    bool IsGpuDriven() const { return m_gpuDriven; }
+
+    // Compares the visible patches and their index sets between the GPU and the CPU for the given camera
+    bool RunGpuSelfCheck(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    void SetScreenSpaceErrorLod(const PersProjInfo& ProjInfo, float PixelTolerance) { m_lodManager.SetScreenSpaceErrorMode(ProjInfo, PixelTolerance); }
+
+    void SetDistanceLod() { m_lodManager.SetDistanceMode(); }
+
+    void SetMorphRegion(float Fraction) { m_lodManager.SetMorphRegion(Fraction); }
+
+    // Rebuilds the vertex data if the grid was already created
+    void SetVertexFormat(GEOMIP_VERTEX_FORMAT Format);
+
+    GEOMIP_VERTEX_FORMAT GetVertexFormat() const { return m_vertexFormat; }
+
+    // The compact and vertex-less formats are rendered with this technique. It must be enabled.
+    void SetCompactParams(GeomipCompactTechnique& Tech) const;
+
+    // World space bounding box of a patch including interior peaks
+    void GetPatchAABB(int PatchX, int PatchZ, Vector3f& Min, Vector3f& Max) const;
+
+    // Patches hidden behind the terrain are not drawn. The CPU path only.
+    void SetHorizonCulling(bool Enable) { m_horizonCulling = Enable; }
+
+    bool IsHorizonCulling() const { return m_horizonCulling; }
+
+    // The horizon of the last frame that was rendered with horizon culling
+    const HorizonCuller& GetHorizonCuller() const { return m_horizonCuller; }
+
+    int GetNumOccludedPatches() const { return m_numOccludedPatches; }
+
+    //
+    // The vertex buffer, the LOD tables and every index set are loaded from this file
+    // when it was made for the same height map and parameters. Otherwise they are
+    // generated and saved to it. Used by CreateGeomipGrid only. NULL disables the cache.
+    //
+    void SetCacheFile(const char* pFilename) { m_cacheFilename = pFilename ? pFilename : ""; }
+
  private:
 
     struct Vertex {
         Vector3f Pos;
         Vector2f Tex;
         Vector3f Normal = Vector3f(0.0f, 0.0f, 0.0f);
+        Vector3f Morph;     // height at the next coarser LOD, last LOD that has the vertex, patch side
 
         void InitVertex(const BaseTerrain* pTerrain, int x, int z);
+
+        void InitMorph(const BaseTerrain* pTerrain, int x, int z, int MaxLOD);
     };
 
+    // The grid position is implicit in the vertex index
+    struct CompactVertex {
+        u16 Height;         // normalized over the height range of the grid
+        u16 MorphHeight;
+        i8 Normal[2];       // octahedral
+        u8 MorphLevel;      // last LOD that has the vertex
+        u8 Side;
+    };
+
+    // The vertex buffer is uploaded from pCache if it isn't NULL. Otherwise it is generated
+    // and left in VertexData for the cache.
+    void CreateVertexData(const BaseTerrain* pTerrain, const GeomipCacheData* pCache, std::vector<u8>& VertexData);
+
+    void DestroyVertexData();
+
+    void CreateCompactGLState();
+
+    void CreateHeightMapTexture(const BaseTerrain* pTerrain);
+
+    void InitCompactVertices(const std::vector<Vertex>& PatchVertices, CompactVertex* pCompactVertices);
+
     void CreateGLState();
 	
-    void PopulateBuffers(const BaseTerrain* pTerrain);
+    void PopulateBuffers(const BaseTerrain* pTerrain, const GeomipCacheData* pCache, std::vector<u8>& VertexData);
     
     void InitVertices(const BaseTerrain* pTerrain, std::vector<Vertex>& Vertices);
-   
-    int InitIndices(std::vector<uint>& Indices);
-    
-    int InitIndicesLOD(int Index, std::vector<uint>& Indices, int lod);
-    
-    int InitIndicesLODSingle(int Index, std::vector<uint>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom);
-    
-    void CalcNormals(std::vector<Vertex>& Vertices, std::vector<uint>& Indices);
-    
-    uint AddTriangle(uint Index, std::vector<uint>& Indices, uint v1, uint v2, uint v3);
-    
-    uint CreateTriangleFan(int Index, std::vector<uint>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom, int x, int z);
 
-    int CalcNumIndices();
+    // Central differences of the height map so they don't depend on the LOD
+    void CalcNormals(std::vector<Vertex>& Vertices);
 
-    bool IsPatchInsideViewFrustum_ViewSpace(int X, int Z, const Matrix4f& ViewProj);
+    // Every patch gets its own copy of its vertices so that the indices can be local to the patch
+    void InitPatchVertices(const std::vector<Vertex>& Vertices, Vertex* pPatchVertices);
 
-    bool IsPatchInsideViewFrustum_WorldSpace(int X, int Z, const FrustumCulling& FC);
+    // Checks the parts of the cache that the key doesn't cover
+    bool IsCacheValid(const GeomipCacheData& Data) const;
+
+    void LoadFromCache(const GeomipCacheData& Data);
+
+    void SaveToCache(uint64_t Key, const std::vector<u8>& VertexData);
+
+    const PatchIndexCache::IndexRange& GetPatchIndices(int PatchX, int PatchZ);
+
+    bool InitGpuDriven();
+
+    // Number of indices in all the permutations of the core and side LODs
+    size_t CalcNumPermutationIndices() const;
 
-    bool IsCameraInPatch(const Vector3f& CameraPos, int PatchBaseX, int PatchBaseZ);
+    void BuildAllIndexSets();
 
-    bool IsCameraCloseToPatch(const Vector3f& CameraPos, int PatchBaseX, int PatchBaseZ);
+    void DestroyGpuDriven();
+
+    void RunGpuCulling(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    void RenderGpuDriven();
+
+    // Neighbor LODs are relative to the core LOD
+    int GetPermutationIndex(int Core, int Left, int Right, int Top, int Bottom) const;
+
+    // Sorts the visible patches front to back and removes those below the horizon
+    void CullOccludedPatches(const Vector3f& CameraPos);
+
+    void AddPatchOccluders(int PatchX, int PatchZ);
+
+    bool IsPatchInsideViewFrustum_ViewSpace(int X, int Z, const Matrix4f& ViewProj);
+
+    bool IsPatchInsideViewFrustum_WorldSpace(int X, int Z, const FrustumCulling& FC);
 
     int m_width = 0;
     int m_depth = 0;
@@ -86,30 +188,70 @@ class GeomipGrid {
     int m_maxLOD = 0;
     GLuint m_vao = 0;
     GLuint m_vb = 0;
-    GLuint m_ib = 0;
+    int m_numVertices = 0;
+    GEOMIP_VERTEX_FORMAT m_vertexFormat = GEOMIP_VERTEX_FULL;
+    GLuint m_heightMapTexture = 0;          // vertex-less format only
+    float m_minHeight = 0.0f;               // the range of the compact heights
+    float m_maxHeight = 0.0f;
     float m_worldScale = 1.0f;
 
-    struct SingleLodInfo {
-        int Start = 0;
-        int Count = 0;
-    };
-	
-    #define LEFT   2
-    #define RIGHT  2
-    #define TOP    2
-    #define BOTTOM 2
-	
-    struct LodInfo {
-        SingleLodInfo info[LEFT][RIGHT][TOP][BOTTOM];
-    };
-	
-    std::vector<LodInfo> m_lodInfo;
+    PatchIndexCache m_indexCache;
+    std::vector<PatchIndexCache::IndexRange> m_patchIndices;   // refreshed from the dirty list of the LOD manager
     int m_numPatchesX = 0;
     int m_numPatchesZ = 0;
     LodManager m_lodManager;
     const BaseTerrain* m_pTerrain = NULL;
-    float m_patchWorldSize = 0.0f;
-    float m_patchWorldHalfSize = 0.0f;
+    int m_patchLevel = 0;                   // the level of the height quadtree with one node per patch
+    std::vector<Vector2i> m_visiblePatches;
+    bool m_horizonCulling = false;
+    HorizonCuller m_horizonCuller;
+    std::vector<std::pair<float, Vector2i>> m_sortedPatches;   // distance from the camera, patch
+    int m_numOccludedPatches = 0;
+    std::string m_cacheFilename;
+
+    struct DrawElementsIndirectCommand {
+        GLuint Count;
+        GLuint InstanceCount;
+        GLuint FirstIndex;
+        GLint BaseVertex;
+        GLuint BaseInstance;
+    };
+
+    // Same layout as LodManager::PatchMorph and the PatchMorph struct of geomip_cull.cs (std430)
+    struct GpuPatchMorph {
+        float SideLods[4];
+        float SideMorphs[4];
+        float CoreLod;
+        float CoreMorph;
+        float Padding[2];
+    };
+
+    // The order matches the shader storage bindings in geomip_cull.cs
+    enum GPU_BUFFER {
+        PATCH_HEIGHTS_BUFFER = 0,
+        GEOMETRIC_ERRORS_BUFFER = 1,
+        INDEX_RANGES_BUFFER = 2,
+        PATCH_LODS_BUFFER = 3,
+        DRAW_COMMANDS_BUFFER = 4,
+        DRAW_COUNT_BUFFER = 5,
+        PATCH_MORPHS_BUFFER = 6,
+        NUM_GPU_BUFFERS = 7
+    };
+
+    struct GpuLodParams {
+        bool UseScreenSpaceError = false;
+        float ProjScale = 0.0f;
+        float PixelTolerance = 0.0f;
+        float Hysteresis = 0.0f;
+    };
+
+    bool m_gpuDriven = false;
+    bool m_gpuDrivenInitialized = false;
+    bool m_cullTechInitialized = false;
+    GeomipCullTechnique m_cullTech;
+    GLuint m_gpuBuffers[NUM_GPU_BUFFERS] = { 0 };
+    GpuLodParams m_gpuLodParams;        // used to restart the GPU hysteresis when the selection changes
+    bool m_resetGpuLods = true;
 };
 
 #endif
@@ -0,0 +1,588 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "ogldev_util.h"
+#include "ogldev_parallel.h"
+#include "height_map_codec.h"
+
+#define MAX_QUANTIZED_VALUE  65535
+#define RICE_PARAM_BITS      5
+#define RICE_MAX_PARAM       16
+#define RICE_ESCAPE          20      // quotients from here on are replaced by the raw value
+#define RICE_RAW_BITS        17      // enough for any residual after the zigzag mapping
+#define MIN_TILES_PER_THREAD 4
+
+
+static int CountTrailingZeros(uint64_t v)
+{
+#ifdef _MSC_VER
+    unsigned long Index;
+    _BitScanForward64(&Index, v);
+    return (int)Index;
+#else
+    return __builtin_ctzll(v);
+#endif
+}
+
+
+//
+// The bits are written from the least significant bit of every byte up. A Rice code is
+// the quotient in unary (zeros terminated by a one) followed by Param low bits.
+//
+class BitWriter {
+ public:
+    BitWriter(std::vector<u8>& Data) : m_data(Data) {}
+
+    // NumBits is at most 32
+    void Write(u32 Value, int NumBits)
+    {
+        m_buffer |= (uint64_t)Value << m_numBits;
+        m_numBits += NumBits;
+
+        while (m_numBits >= 8) {
+            m_data.push_back((u8)m_buffer);
+            m_buffer >>= 8;
+            m_numBits -= 8;
+        }
+    }
+
+    void WriteRice(u32 Value, int Param)
+    {
+        u32 Quotient = Value >> Param;
+
+        if (Quotient >= RICE_ESCAPE) {
+            Write(0, RICE_ESCAPE);
+            Write(Value, RICE_RAW_BITS);
+        } else {
+            Write(1u << Quotient, Quotient + 1);
+            Write(Value & ((1u << Param) - 1), Param);
+        }
+    }
+
+    void Flush()
+    {
+        if (m_numBits > 0) {
+            m_data.push_back((u8)m_buffer);
+        }
+
+        m_buffer = 0;
+        m_numBits = 0;
+    }
+
+ private:
+    std::vector<u8>& m_data;
+    uint64_t m_buffer = 0;
+    int m_numBits = 0;
+};
+
+
+//
+// Keeps at least 56 bits in the buffer, which is more than the longest code. The fast
+// refill loads eight bytes at once and advances only by the whole bytes that fit. The
+// bytes past them are loaded again by the next refill into the same bits.
+//
+class BitReader {
+ public:
+    BitReader(const u8* pData, size_t Size) : m_p(pData), m_end(pData + Size) {}
+
+    void Refill()
+    {
+        if (m_end - m_p >= 8) {
+            uint64_t Bytes;
+            memcpy(&Bytes, m_p, sizeof(Bytes));
+            m_buffer |= Bytes << m_numBits;
+            m_p += (63 - m_numBits) >> 3;
+            m_numBits |= 56;
+        } else {
+            while ((m_numBits <= 56) && (m_p < m_end)) {
+                m_buffer |= (uint64_t)*m_p++ << m_numBits;
+                m_numBits += 8;
+            }
+        }
+    }
+
+    // The buffer must have been refilled
+    u32 Read(int NumBits)
+    {
+        u32 Value = (u32)(m_buffer & ((1ull << NumBits) - 1));
+        Consume(NumBits);
+        return Value;
+    }
+
+    u32 ReadRice(int Param)
+    {
+        Refill();
+
+        int Zeros = (m_buffer == 0) ? RICE_ESCAPE : std::min(CountTrailingZeros(m_buffer), RICE_ESCAPE);
+
+        if (Zeros == RICE_ESCAPE) {
+            Consume(RICE_ESCAPE);
+            return Read(RICE_RAW_BITS);
+        }
+
+        Consume(Zeros + 1);
+
+        return ((u32)Zeros << Param) | Read(Param);
+    }
+
+    // True if more bits were read than there are in the data
+    bool IsOverrun() const { return m_numBits < 0; }
+
+ private:
+
+    void Consume(int NumBits)
+    {
+        m_buffer >>= NumBits;
+        m_numBits -= NumBits;
+    }
+
+    const u8* m_p;
+    const u8* m_end;
+    uint64_t m_buffer = 0;
+    int m_numBits = 0;
+};
+
+
+// The median predictor of LOCO-I from the left, bottom and bottom left neighbors
+static int PredictValue(const u16* pRow, const u16* pBelow, int x)
+{
+    if (!pBelow) {
+        return (x > 0) ? pRow[x - 1] : 0;
+    }
+
+    if (x == 0) {
+        return pBelow[0];
+    }
+
+    int Left = pRow[x - 1];
+    int Below = pBelow[x];
+    int BelowLeft = pBelow[x - 1];
+
+    int Min = std::min(Left, Below);
+    int Max = std::max(Left, Below);
+
+    if (BelowLeft >= Max) {
+        return Min;
+    }
+
+    if (BelowLeft <= Min) {
+        return Max;
+    }
+
+    return Left + Below - BelowLeft;
+}
+
+
+// The Rice parameter that codes the block with the fewest bits
+static int ChooseRiceParam(const u32* pValues, int Count)
+{
+    int BestParam = 0;
+    uint64_t BestBits = UINT64_MAX;
+
+    for (int Param = 0 ; Param <= RICE_MAX_PARAM ; Param++) {
+        uint64_t Bits = 0;
+
+        for (int i = 0 ; i < Count ; i++) {
+            u32 Quotient = pValues[i] >> Param;
+            Bits += (Quotient >= RICE_ESCAPE) ? RICE_ESCAPE + RICE_RAW_BITS : Quotient + 1 + Param;
+        }
+
+        if (Bits < BestBits) {
+            BestBits = Bits;
+            BestParam = Param;
+        }
+    }
+
+    return BestParam;
+}
+
+
+static void EncodeTile(const Array2D<float>& HeightMap, int x0, int z0, int Width, int Height, float MaxError,
+                       CompressedTileDesc& Desc, std::vector<u8>& Data)
+{
+    float Min = FLT_MAX;
+    float Max = -FLT_MAX;
+
+    for (int z = 0 ; z < Height ; z++) {
+        const float* pSrc = HeightMap.GetRow(z0 + z) + x0;
+
+        for (int x = 0 ; x < Width ; x++) {
+            Min = std::min(Min, pSrc[x]);
+            Max = std::max(Max, pSrc[x]);
+        }
+    }
+
+    float Step = std::max(2.0f * MaxError, (Max - Min) / (float)MAX_QUANTIZED_VALUE);
+
+    // A flat tile is all zeros
+    if (Step <= 0.0f) {
+        Step = 1.0f;
+    }
+
+    Desc.MinHeight = Min;
+    Desc.MaxHeight = Max;
+    Desc.Step = Step;
+
+    int NumValues = Width * Height;
+    std::vector<u16> Values(NumValues);
+    std::vector<u32> Residuals(NumValues);
+
+    for (int z = 0 ; z < Height ; z++) {
+        const float* pSrc = HeightMap.GetRow(z0 + z) + x0;
+        u16* pRow = &Values[z * Width];
+        const u16* pBelow = (z > 0) ? pRow - Width : NULL;
+
+        for (int x = 0 ; x < Width ; x++) {
+            float Value = roundf((pSrc[x] - Min) / Step);
+            pRow[x] = (u16)std::min(std::max(Value, 0.0f), (float)MAX_QUANTIZED_VALUE);
+
+            // Zigzag mapping of the residual - 0, -1, 1, -2, 2...
+            int Residual = (int)pRow[x] - PredictValue(pRow, pBelow, x);
+            Residuals[z * Width + x] = ((u32)Residual << 1) ^ (u32)(Residual >> 31);
+        }
+    }
+
+    Data.clear();
+    Data.reserve(NumValues);
+
+    BitWriter Writer(Data);
+
+    for (int Start = 0 ; Start < NumValues ; Start += COMPRESSED_HEIGHT_MAP_BLOCK_SIZE) {
+        int Count = std::min(COMPRESSED_HEIGHT_MAP_BLOCK_SIZE, NumValues - Start);
+        int Param = ChooseRiceParam(&Residuals[Start], Count);
+
+        Writer.Write(Param, RICE_PARAM_BITS);
+
+        for (int i = 0 ; i < Count ; i++) {
+            Writer.WriteRice(Residuals[Start + i], Param);
+        }
+    }
+
+    Writer.Flush();
+
+    Desc.Size = (u32)Data.size();
+}
+
+
+static bool DecodeTileData(const u8* pData, const CompressedTileDesc& Desc, int Width, int Height,
+                           float* pDst, int Pitch)
+{
+    BitReader Reader(pData, Desc.Size);
+
+    std::vector<u16> Values((size_t)Width * Height);
+    int Param = 0;
+    int BlockLeft = 0;
+
+    for (int z = 0 ; z < Height ; z++) {
+        u16* pRow = &Values[(size_t)z * Width];
+        const u16* pBelow = (z > 0) ? pRow - Width : NULL;
+        float* pDstRow = pDst + (size_t)z * Pitch;
+
+        for (int x = 0 ; x < Width ; x++) {
+            if (BlockLeft == 0) {
+                Reader.Refill();
+                Param = (int)Reader.Read(RICE_PARAM_BITS);
+                BlockLeft = COMPRESSED_HEIGHT_MAP_BLOCK_SIZE;
+
+                if (Param > RICE_MAX_PARAM) {
+                    return false;
+                }
+            }
+
+            BlockLeft--;
+
+            u32 Code = Reader.ReadRice(Param);
+            int Residual = (int)(Code >> 1) ^ -(int)(Code & 1);
+            int Value = PredictValue(pRow, pBelow, x) + Residual;
+
+            if ((Value < 0) || (Value > MAX_QUANTIZED_VALUE)) {
+                return false;
+            }
+
+            pRow[x] = (u16)Value;
+            pDstRow[x] = Desc.MinHeight + (float)Value * Desc.Step;
+        }
+    }
+
+    return !Reader.IsOverrun();
+}
+
+
+bool CompressedHeightMap::WriteFile(const char* pFilename, const Array2D<float>& HeightMap, int TerrainSize,
+                                    int TileSize, float MaxError, CompressedHeightMapStats* pStats)
+{
+    if ((TileSize < 2) || (TerrainSize < 2) || (TerrainSize > COMPRESSED_HEIGHT_MAP_MAX_SIZE) ||
+        (TileSize > TerrainSize) || (MaxError < 0.0f)) {
+        printf("%s:%d - invalid tile size %d, terrain size %d or max error %f\n", __FILE__, __LINE__,
+               TileSize, TerrainSize, MaxError);
+        return false;
+    }
+
+    long long StartTime = GetCurrentTimeMillis();
+
+    CompressedHeightMapHeader Header;
+    Header.TerrainSize = TerrainSize;
+    Header.TileSize = TileSize;
+    Header.NumTiles = (TerrainSize + TileSize - 1) / TileSize;
+    Header.MaxError = MaxError;
+
+    int NumTiles = (int)Header.NumTiles;
+    int TotalTiles = NumTiles * NumTiles;
+
+    std::vector<CompressedTileDesc> Tiles(TotalTiles);
+    std::vector<std::vector<u8>> TileData(TotalTiles);
+    std::vector<float> TileErrors(TotalTiles, 0.0f);
+    std::atomic<int> NumBadTiles(0);
+    std::atomic<int> NumTilesOverMaxError(0);
+
+    ParallelFor(0, TotalTiles, [&](int StartTile, int EndTile) {
+        std::vector<float> Decoded((size_t)TileSize * TileSize);
+
+        for (int Tile = StartTile ; Tile < EndTile ; Tile++) {
+            int x0 = (Tile % NumTiles) * TileSize;
+            int z0 = (Tile / NumTiles) * TileSize;
+            int Width = std::min(TileSize, TerrainSize - x0);
+            int Height = std::min(TileSize, TerrainSize - z0);
+
+            EncodeTile(HeightMap, x0, z0, Width, Height, MaxError, Tiles[Tile], TileData[Tile]);
+
+            // Round trip every tile. The error must be within half a step (plus the rounding of the floats).
+            const CompressedTileDesc& Desc = Tiles[Tile];
+            float Magnitude = std::max(fabsf(Desc.MinHeight), fabsf(Desc.MaxHeight));
+            float ErrorBound = Desc.Step * 0.5f * 1.01f + Magnitude * FLT_EPSILON * 4.0f;
+
+            if (!DecodeTileData(&TileData[Tile][0], Desc, Width, Height, &Decoded[0], TileSize)) {
+                NumBadTiles++;
+                continue;
+            }
+
+            for (int z = 0 ; z < Height ; z++) {
+                const float* pSrc = HeightMap.GetRow(z0 + z) + x0;
+
+                for (int x = 0 ; x < Width ; x++) {
+                    TileErrors[Tile] = std::max(TileErrors[Tile], fabsf(Decoded[z * TileSize + x] - pSrc[x]));
+                }
+            }
+
+            if (TileErrors[Tile] > ErrorBound) {
+                NumBadTiles++;
+            }
+
+            // The step of a tile with a large range is wider than 2 * MaxError so the requested bound is checked on its own
+            if ((MaxError > 0.0f) && (TileErrors[Tile] > MaxError * 1.01f + Magnitude * FLT_EPSILON * 4.0f)) {
+                NumTilesOverMaxError++;
+            }
+        }
+    }, MIN_TILES_PER_THREAD);
+
+    if (NumBadTiles > 0) {
+        printf("%s:%d - %d tiles failed the round trip check\n", __FILE__, __LINE__, NumBadTiles.load());
+        return false;
+    }
+
+    if (NumTilesOverMaxError > 0) {
+        float WorstError = *std::max_element(TileErrors.begin(), TileErrors.end());
+        printf("%s:%d - %d tiles exceed the max error %f (worst %f). Their height range needs more than 16 bits "
+               "at this error - use a larger max error or smaller tiles.\n", __FILE__, __LINE__,
+               NumTilesOverMaxError.load(), MaxError, WorstError);
+        return false;
+    }
+
+    Header.MinHeight = FLT_MAX;
+    Header.MaxHeight = -FLT_MAX;
+
+    uint64_t Offset = sizeof(Header) + (uint64_t)TotalTiles * sizeof(CompressedTileDesc);
+    float MeasuredError = 0.0f;
+
+    for (int Tile = 0 ; Tile < TotalTiles ; Tile++) {
+        Tiles[Tile].Offset = Offset;
+        Offset += Tiles[Tile].Size;
+
+        Header.MinHeight = std::min(Header.MinHeight, Tiles[Tile].MinHeight);
+        Header.MaxHeight = std::max(Header.MaxHeight, Tiles[Tile].MaxHeight);
+        MeasuredError = std::max(MeasuredError, TileErrors[Tile]);
+    }
+
+    FILE* f = fopen(pFilename, "wb");
+
+    if (!f) {
+        printf("%s:%d - unable to create '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    fwrite(&Header, sizeof(Header), 1, f);
+    fwrite(&Tiles[0], sizeof(CompressedTileDesc), Tiles.size(), f);
+
+    for (int Tile = 0 ; Tile < TotalTiles ; Tile++) {
+        fwrite(&TileData[Tile][0], 1, TileData[Tile].size(), f);
+    }
+
+    bool Success = (ferror(f) == 0);
+
+    fclose(f);
+
+    if (!Success) {
+        printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    CompressedHeightMapStats Stats;
+    Stats.FileSize = (size_t)Offset;
+    Stats.BitsPerPoint = (float)((double)Offset * 8.0 / ((double)TerrainSize * TerrainSize));
+    Stats.MaxError = MeasuredError;
+    Stats.EncodeTime = (float)(GetCurrentTimeMillis() - StartTime);
+
+    printf("Compressed height map '%s': %d points, %dx%d tiles of %d, %.2f bits per point (%.1f:1 vs float), max error %f, %.0f ms\n",
+           pFilename, TerrainSize, NumTiles, NumTiles, TileSize, Stats.BitsPerPoint, 32.0f / Stats.BitsPerPoint,
+           Stats.MaxError, Stats.EncodeTime);
+
+    if (pStats) {
+        *pStats = Stats;
+    }
+
+    return true;
+}
+
+
+bool CompressedHeightMap::Open(const char* pFilename)
+{
+    Close();
+
+    FILE* f = fopen(pFilename, "rb");
+
+    if (!f) {
+        printf("%s:%d - unable to open '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    long FileSize = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (FileSize < (long)sizeof(CompressedHeightMapHeader)) {
+        printf("%s:%d - '%s' is too small for a compressed height map\n", __FILE__, __LINE__, pFilename);
+        fclose(f);
+        return false;
+    }
+
+    m_data.resize((size_t)FileSize);
+    size_t BytesRead = fread(&m_data[0], 1, m_data.size(), f);
+    fclose(f);
+
+    if (BytesRead != m_data.size()) {
+        printf("%s:%d - error reading '%s'\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    memcpy(&m_header, &m_data[0], sizeof(m_header));
+
+    // The sizes are capped before any arithmetic so that a corrupt header cannot wrap around
+    if ((m_header.Magic != COMPRESSED_HEIGHT_MAP_MAGIC) || (m_header.Version != COMPRESSED_HEIGHT_MAP_VERSION) ||
+        (m_header.TerrainSize < 2) || (m_header.TerrainSize > COMPRESSED_HEIGHT_MAP_MAX_SIZE) ||
+        (m_header.TileSize < 2) || (m_header.TileSize > m_header.TerrainSize) ||
+        ((uint64_t)m_header.NumTiles != ((uint64_t)m_header.TerrainSize + m_header.TileSize - 1) / m_header.TileSize)) {
+        printf("%s:%d - '%s' is not a valid compressed height map\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    uint64_t TotalTiles = (uint64_t)m_header.NumTiles * m_header.NumTiles;
+
+    if ((m_data.size() - sizeof(m_header)) / sizeof(CompressedTileDesc) < TotalTiles) {
+        printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    m_tiles.resize((size_t)TotalTiles);
+    memcpy(&m_tiles[0], &m_data[sizeof(m_header)], (size_t)TotalTiles * sizeof(CompressedTileDesc));
+
+    for (const CompressedTileDesc& Desc : m_tiles) {
+        if ((Desc.Size == 0) || (Desc.Offset > m_data.size()) || (Desc.Size > m_data.size() - Desc.Offset)) {
+            printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, pFilename);
+            Close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void CompressedHeightMap::Close()
+{
+    m_header = CompressedHeightMapHeader();
+    m_tiles.clear();
+    m_data.clear();
+}
+
+
+bool CompressedHeightMap::DecodeTile(int TileX, int TileZ, float* pDst, int Pitch) const
+{
+    int TileSize = (int)m_header.TileSize;
+    int TerrainSize = (int)m_header.TerrainSize;
+    int x0 = TileX * TileSize;
+    int z0 = TileZ * TileSize;
+
+    const CompressedTileDesc& Desc = GetTileDesc(TileX, TileZ);
+
+    return DecodeTileData(&m_data[Desc.Offset], Desc, std::min(TileSize, TerrainSize - x0),
+                          std::min(TileSize, TerrainSize - z0), pDst, Pitch);
+}
+
+
+bool CompressedHeightMap::DecodeAll(Array2D<float>& HeightMap) const
+{
+    int TerrainSize = (int)m_header.TerrainSize;
+    int TileSize = (int)m_header.TileSize;
+    int NumTiles = (int)m_header.NumTiles;
+
+    HeightMap.InitArray2D(TerrainSize, TerrainSize);
+
+    std::atomic<int> NumBadTiles(0);
+
+    ParallelFor(0, NumTiles * NumTiles, [&](int StartTile, int EndTile) {
+        for (int Tile = StartTile ; Tile < EndTile ; Tile++) {
+            int TileX = Tile % NumTiles;
+            int TileZ = Tile / NumTiles;
+
+            if (!DecodeTile(TileX, TileZ, HeightMap.GetAddr(TileX * TileSize, TileZ * TileSize), TerrainSize)) {
+                NumBadTiles++;
+            }
+        }
+    }, MIN_TILES_PER_THREAD);
+
+    if (NumBadTiles > 0) {
+        printf("%s:%d - %d tiles are corrupt\n", __FILE__, __LINE__, NumBadTiles.load());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,127 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HEIGHT_MAP_CODEC_H
+#define HEIGHT_MAP_CODEC_H
+
+#include <vector>
+
+#include "ogldev_types.h"
+#include "ogldev_array_2d.h"
+
+//
+// Compressed height map file:
+//
+//   CompressedHeightMapHeader
+//   CompressedTileDesc of every tile (row major)
+//   the compressed tiles
+//
+// Every tile is quantized to 16 bits between its own min and max height. The step of the
+// quantization is the larger of 2 * MaxError and the range of the tile / 65535, so the
+// error of every point is at most half a step. A tile whose range needs a step wider than
+// 2 * MaxError cannot meet the requested error so the writer fails instead of writing it.
+// The quantized values are predicted from
+// the left, bottom and bottom left neighbors (the median predictor of LOCO-I) and the
+// residuals are Rice coded in blocks of COMPRESSED_HEIGHT_MAP_BLOCK_SIZE with the best
+// Rice parameter of each block. The tiles on the right and top edges are clipped to the
+// terrain.
+//
+// A tile doesn't depend on the other tiles so any tile can be decoded on its own and
+// the whole height map is decoded by all the threads.
+//
+#define COMPRESSED_HEIGHT_MAP_MAGIC      0x4d484330      // "0CHM"
+#define COMPRESSED_HEIGHT_MAP_VERSION    1
+#define COMPRESSED_HEIGHT_MAP_BLOCK_SIZE 32
+#define COMPRESSED_HEIGHT_MAP_MAX_SIZE   32768           // points per side (the point count fits in an int)
+
+struct CompressedHeightMapHeader {
+    u32 Magic = COMPRESSED_HEIGHT_MAP_MAGIC;
+    u32 Version = COMPRESSED_HEIGHT_MAP_VERSION;
+    u32 TerrainSize = 0;        // points per side
+    u32 TileSize = 0;           // points per tile side
+    u32 NumTiles = 0;           // per side
+    float MaxError = 0.0f;      // requested by the writer (zero is the full 16 bit precision of every tile)
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+};
+
+struct CompressedTileDesc {
+    uint64_t Offset = 0;        // from the start of the file
+    u32 Size = 0;               // in bytes
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+    float Step = 0.0f;          // height = MinHeight + value * Step
+};
+
+struct CompressedHeightMapStats {
+    size_t FileSize = 0;
+    float BitsPerPoint = 0.0f;
+    float MaxError = 0.0f;      // measured by decoding every tile after it is encoded
+    float EncodeTime = 0.0f;    // milliseconds
+};
+
+class CompressedHeightMap {
+ public:
+    CompressedHeightMap() {}
+
+    //
+    // The tiles are encoded in parallel and every tile is decoded and checked against MaxError
+    // (zero is the full 16 bit precision of every tile). Returns false on failure, including
+    // a tile whose height range cannot be quantized to 16 bits within MaxError.
+    //
+    static bool WriteFile(const char* pFilename, const Array2D<float>& HeightMap, int TerrainSize,
+                          int TileSize, float MaxError, CompressedHeightMapStats* pStats = NULL);
+
+    // Reads the whole file into memory. Nothing is decoded.
+    bool Open(const char* pFilename);
+
+    void Close();
+
+    bool IsOpen() const { return !m_data.empty(); }
+
+    int GetTerrainSize() const { return (int)m_header.TerrainSize; }
+
+    int GetTileSize() const { return (int)m_header.TileSize; }
+
+    int GetNumTiles() const { return (int)m_header.NumTiles; }
+
+    float GetMinHeight() const { return m_header.MinHeight; }
+
+    float GetMaxHeight() const { return m_header.MaxHeight; }
+
+    const CompressedTileDesc& GetTileDesc(int TileX, int TileZ) const { return m_tiles[(size_t)TileZ * m_header.NumTiles + TileX]; }
+
+    //
+    // Decodes a tile into pDst, which has Pitch floats between the rows. The clipped tiles
+    // on the edges write only their points. Can be called by several threads at once.
+    // Returns false if the tile data is corrupt.
+    //
+    bool DecodeTile(int TileX, int TileZ, float* pDst, int Pitch) const;
+
+    // Decodes every tile in parallel. Returns false if any tile is corrupt.
+    bool DecodeAll(Array2D<float>& HeightMap) const;
+
+ private:
+
+    CompressedHeightMapHeader m_header;
+    std::vector<CompressedTileDesc> m_tiles;
+    std::vector<u8> m_data;
+};
+
+#endif
@@ -0,0 +1,418 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+
+#include "height_map_pager.h"
+
+
+static size_t CalcTilesOffset(int NumTiles)
+{
+    size_t Size = sizeof(TiledHeightMapHeader) + (size_t)NumTiles * NumTiles * 2 * sizeof(float);
+    return (Size + TILED_HEIGHT_MAP_ALIGNMENT - 1) / TILED_HEIGHT_MAP_ALIGNMENT * TILED_HEIGHT_MAP_ALIGNMENT;
+}
+
+
+HeightMapPager::~HeightMapPager()
+{
+    Close();
+}
+
+
+bool HeightMapPager::Open(const char* pFilename, int CacheSize)
+{
+    Close();
+
+    if (!m_file.Open(pFilename)) {
+        printf("%s:%d - unable to map '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    m_pData = m_file.GetData();
+    m_dataSize = m_file.GetSize();
+
+    if (m_dataSize < sizeof(TiledHeightMapHeader)) {
+        printf("%s:%d - '%s' is too small for a tiled height map\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    memcpy(&m_header, m_pData, sizeof(m_header));
+
+    if ((m_header.Magic != TILED_HEIGHT_MAP_MAGIC) || (m_header.Version != TILED_HEIGHT_MAP_VERSION) ||
+        (m_header.Format > TILED_HEIGHT_MAP_U16) || (m_header.TileSize < 2) || (m_header.TerrainSize < 2) ||
+        (m_header.NumTiles != (m_header.TerrainSize + m_header.TileSize - 1) / m_header.TileSize)) {
+        printf("%s:%d - '%s' is not a valid tiled height map\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    int NumTiles = (int)m_header.NumTiles;
+    int TileSize = (int)m_header.TileSize;
+    size_t SampleSize = (m_header.Format == TILED_HEIGHT_MAP_U16) ? sizeof(u16) : sizeof(float);
+
+    m_tileSizeInBytes = (size_t)TileSize * TileSize * SampleSize;
+    m_tilesOffset = CalcTilesOffset(NumTiles);
+
+    if (m_dataSize < m_tilesOffset + (size_t)NumTiles * NumTiles * m_tileSizeInBytes) {
+        printf("%s:%d - '%s' is truncated\n", __FILE__, __LINE__, pFilename);
+        Close();
+        return false;
+    }
+
+    std::vector<float> TileMinMax((size_t)NumTiles * NumTiles * 2);
+    memcpy(&TileMinMax[0], m_pData + sizeof(TiledHeightMapHeader), TileMinMax.size() * sizeof(float));
+    BuildMinMaxPyramid(&TileMinMax[0]);
+
+    CacheSize = std::max(CacheSize, 1);
+    m_cacheData.resize((size_t)CacheSize * TileSize * TileSize);
+    m_slots.assign(CacheSize, CacheSlot());
+    m_tileToSlot.assign((size_t)NumTiles * NumTiles, -1);
+    m_useCounter = 0;
+    m_numTileLoads = 0;
+
+    printf("Tiled height map '%s': %d points, %dx%d tiles of %d, %s, cache %d tiles\n", pFilename,
+           m_header.TerrainSize, NumTiles, NumTiles, TileSize,
+           (m_header.Format == TILED_HEIGHT_MAP_U16) ? "16 bit" : "float", CacheSize);
+
+    return true;
+}
+
+
+void HeightMapPager::Close()
+{
+    m_file.Close();
+    m_pData = NULL;
+    m_dataSize = 0;
+    m_header = TiledHeightMapHeader();
+    m_cacheData.clear();
+    m_slots.clear();
+    m_tileToSlot.clear();
+    m_minMaxLevels.clear();
+    m_levelSizes.clear();
+}
+
+
+bool HeightMapPager::WriteTiledFile(const char* pFilename, const Array2D<float>& HeightMap, int TerrainSize,
+                                    int TileSize, bool Quantize)
+{
+    if ((TileSize < 2) || (TerrainSize < 2)) {
+        printf("%s:%d - invalid tile size %d or terrain size %d\n", __FILE__, __LINE__, TileSize, TerrainSize);
+        return false;
+    }
+
+    FILE* f = fopen(pFilename, "wb");
+
+    if (!f) {
+        printf("%s:%d - unable to create '%s'\n", __FILE__, __LINE__, pFilename);
+        return false;
+    }
+
+    TiledHeightMapHeader Header;
+    Header.TerrainSize = TerrainSize;
+    Header.TileSize = TileSize;
+    Header.NumTiles = (TerrainSize + TileSize - 1) / TileSize;
+    Header.Format = Quantize ? TILED_HEIGHT_MAP_U16 : TILED_HEIGHT_MAP_FLOAT;
+
+    int NumTiles = (int)Header.NumTiles;
+
+    // Tiles on the far edges repeat the last row/column
+    auto GetSample = [&](int TileX, int TileZ, int x, int z) {
+        int SrcX = std::min(TileX * TileSize + x, TerrainSize - 1);
+        int SrcZ = std::min(TileZ * TileSize + z, TerrainSize - 1);
+        return HeightMap.Get(SrcX, SrcZ);
+    };
+
+    std::vector<float> TileMinMax((size_t)NumTiles * NumTiles * 2);
+    Header.MinHeight = FLT_MAX;
+    Header.MaxHeight = -FLT_MAX;
+
+    for (int TileZ = 0 ; TileZ < NumTiles ; TileZ++) {
+        for (int TileX = 0 ; TileX < NumTiles ; TileX++) {
+            float Min = FLT_MAX;
+            float Max = -FLT_MAX;
+
+            for (int z = 0 ; z < TileSize ; z++) {
+                for (int x = 0 ; x < TileSize ; x++) {
+                    float Height = GetSample(TileX, TileZ, x, z);
+                    Min = std::min(Min, Height);
+                    Max = std::max(Max, Height);
+                }
+            }
+
+            size_t Tile = (size_t)TileZ * NumTiles + TileX;
+            TileMinMax[Tile * 2] = Min;
+            TileMinMax[Tile * 2 + 1] = Max;
+            Header.MinHeight = std::min(Header.MinHeight, Min);
+            Header.MaxHeight = std::max(Header.MaxHeight, Max);
+        }
+    }
+
+    fwrite(&Header, sizeof(Header), 1, f);
+    fwrite(&TileMinMax[0], sizeof(float), TileMinMax.size(), f);
+
+    std::vector<u8> Padding(CalcTilesOffset(NumTiles) - sizeof(Header) - TileMinMax.size() * sizeof(float), 0);
+
+    if (!Padding.empty()) {
+        fwrite(&Padding[0], 1, Padding.size(), f);
+    }
+
+    float Range = Header.MaxHeight - Header.MinHeight;
+    float Scale = (Range > 0.0f) ? 65535.0f / Range : 0.0f;
+
+    std::vector<float> FloatRow(TileSize);
+    std::vector<u16> U16Row(TileSize);
+
+    for (int TileZ = 0 ; TileZ < NumTiles ; TileZ++) {
+        for (int TileX = 0 ; TileX < NumTiles ; TileX++) {
+            for (int z = 0 ; z < TileSize ; z++) {
+                for (int x = 0 ; x < TileSize ; x++) {
+                    float Height = GetSample(TileX, TileZ, x, z);
+
+                    if (Quantize) {
+                        U16Row[x] = (u16)std::min(roundf((Height - Header.MinHeight) * Scale), 65535.0f);
+                    } else {
+                        FloatRow[x] = Height;
+                    }
+                }
+
+                if (Quantize) {
+                    fwrite(&U16Row[0], sizeof(u16), TileSize, f);
+                } else {
+                    fwrite(&FloatRow[0], sizeof(float), TileSize, f);
+                }
+            }
+        }
+    }
+
+    bool Success = (ferror(f) == 0);
+
+    fclose(f);
+
+    if (!Success) {
+        printf("%s:%d - error writing '%s'\n", __FILE__, __LINE__, pFilename);
+    }
+
+    return Success;
+}
+
+
+void HeightMapPager::BuildMinMaxPyramid(const float* pTileMinMax)
+{
+    int LevelSize = (int)m_header.NumTiles;
+
+    while (true) {
+        m_levelSizes.push_back(LevelSize);
+
+        if (LevelSize == 1) {
+            break;
+        }
+
+        LevelSize = (LevelSize + 1) / 2;
+    }
+
+    m_minMaxLevels.resize(m_levelSizes.size());
+
+    m_minMaxLevels[0].resize((size_t)m_levelSizes[0] * m_levelSizes[0]);
+
+    for (size_t i = 0 ; i < m_minMaxLevels[0].size() ; i++) {
+        m_minMaxLevels[0][i].Min = pTileMinMax[i * 2];
+        m_minMaxLevels[0][i].Max = pTileMinMax[i * 2 + 1];
+    }
+
+    for (int Level = 1 ; Level < (int)m_levelSizes.size() ; Level++) {
+        int Size = m_levelSizes[Level];
+        int PrevSize = m_levelSizes[Level - 1];
+        m_minMaxLevels[Level].resize((size_t)Size * Size);
+
+        for (int z = 0 ; z < Size ; z++) {
+            for (int x = 0 ; x < Size ; x++) {
+                MinMax Node = m_minMaxLevels[Level - 1][(size_t)(z * 2) * PrevSize + x * 2];
+
+                for (int i = 1 ; i < 4 ; i++) {
+                    int ChildX = x * 2 + (i & 1);
+                    int ChildZ = z * 2 + (i >> 1);
+
+                    if ((ChildX < PrevSize) && (ChildZ < PrevSize)) {
+                        const MinMax& Child = m_minMaxLevels[Level - 1][(size_t)ChildZ * PrevSize + ChildX];
+                        Node.Min = std::min(Node.Min, Child.Min);
+                        Node.Max = std::max(Node.Max, Child.Max);
+                    }
+                }
+
+                m_minMaxLevels[Level][(size_t)z * Size + x] = Node;
+            }
+        }
+    }
+}
+
+
+//
+// The tile range is covered by at most 2x2 nodes of the first level where it spans no
+// more than two nodes on each axis. The nodes may extend beyond the range so the
+// result is conservative.
+//
+void HeightMapPager::GetMinMax(int x0, int z0, int x1, int z1, float& Min, float& Max) const
+{
+    int TileSize = (int)m_header.TileSize;
+    int Last = (int)m_header.TerrainSize - 1;
+
+    int TileX0 = std::min(std::max(x0, 0), Last) / TileSize;
+    int TileZ0 = std::min(std::max(z0, 0), Last) / TileSize;
+    int TileX1 = std::min(std::max(x1, 0), Last) / TileSize;
+    int TileZ1 = std::min(std::max(z1, 0), Last) / TileSize;
+
+    int Level = 0;
+
+    while (((TileX1 >> Level) - (TileX0 >> Level) > 1) || ((TileZ1 >> Level) - (TileZ0 >> Level) > 1)) {
+        Level++;
+    }
+
+    Min = FLT_MAX;
+    Max = -FLT_MAX;
+
+    int Size = m_levelSizes[Level];
+
+    for (int z = TileZ0 >> Level ; z <= (TileZ1 >> Level) ; z++) {
+        for (int x = TileX0 >> Level ; x <= (TileX1 >> Level) ; x++) {
+            const MinMax& Node = m_minMaxLevels[Level][(size_t)z * Size + x];
+            Min = std::min(Min, Node.Min);
+            Max = std::max(Max, Node.Max);
+        }
+    }
+}
+
+
+int HeightMapPager::LoadTile(int Tile) const
+{
+    // A free slot or the least recently used one
+    int Slot = 0;
+
+    for (int i = 0 ; i < (int)m_slots.size() ; i++) {
+        if (m_slots[i].Tile < 0) {
+            Slot = i;
+            break;
+        }
+
+        if (m_slots[i].LastUse < m_slots[Slot].LastUse) {
+            Slot = i;
+        }
+    }
+
+    if (m_slots[Slot].Tile >= 0) {
+        m_tileToSlot[m_slots[Slot].Tile] = -1;
+    }
+
+    m_slots[Slot].Tile = Tile;
+    m_slots[Slot].LastUse = ++m_useCounter;
+    m_tileToSlot[Tile] = Slot;
+
+    int NumSamples = (int)(m_header.TileSize * m_header.TileSize);
+    float* pDst = &m_cacheData[(size_t)Slot * NumSamples];
+    const u8* pSrc = m_pData + m_tilesOffset + (size_t)Tile * m_tileSizeInBytes;
+
+    if (m_header.Format == TILED_HEIGHT_MAP_U16) {
+        float Scale = (m_header.MaxHeight - m_header.MinHeight) / 65535.0f;
+        const u16* pSamples = (const u16*)pSrc;
+
+        for (int i = 0 ; i < NumSamples ; i++) {
+            pDst[i] = m_header.MinHeight + (float)pSamples[i] * Scale;
+        }
+    } else {
+        memcpy(pDst, pSrc, NumSamples * sizeof(float));
+    }
+
+    m_numTileLoads++;
+
+    return Slot;
+}
+
+
+void HeightMapPager::Update(float x, float z, float Radius)
+{
+    int TileSize = (int)m_header.TileSize;
+    int NumTiles = (int)m_header.NumTiles;
+
+    int CenterX = (int)floorf(x / TileSize);
+    int CenterZ = (int)floorf(z / TileSize);
+    int TileRadius = (int)ceilf(Radius / TileSize);
+
+    // Never ask for more tiles than the cache can hold
+    while ((TileRadius > 0) && ((2 * TileRadius + 1) * (2 * TileRadius + 1) > (int)m_slots.size())) {
+        TileRadius--;
+    }
+
+    int TileX0 = std::max(CenterX - TileRadius, 0);
+    int TileZ0 = std::max(CenterZ - TileRadius, 0);
+    int TileX1 = std::min(CenterX + TileRadius, NumTiles - 1);
+    int TileZ1 = std::min(CenterZ + TileRadius, NumTiles - 1);
+
+    for (int TileZ = TileZ0 ; TileZ <= TileZ1 ; TileZ++) {
+        for (int TileX = TileX0 ; TileX <= TileX1 ; TileX++) {
+            int Tile = TileZ * NumTiles + TileX;
+            int Slot = m_tileToSlot[Tile];
+
+            if (Slot < 0) {
+                Slot = LoadTile(Tile);
+            }
+
+            m_slots[Slot].LastUse = ++m_useCounter;
+        }
+    }
+}
+
+
+float HeightMapPager::GetHeight(int x, int z) const
+{
+    int Last = (int)m_header.TerrainSize - 1;
+    x = std::min(std::max(x, 0), Last);
+    z = std::min(std::max(z, 0), Last);
+
+    int TileSize = (int)m_header.TileSize;
+    int Tile = (z / TileSize) * (int)m_header.NumTiles + x / TileSize;
+    int Slot = m_tileToSlot[Tile];
+
+    if (Slot < 0) {
+        Slot = LoadTile(Tile);
+    }
+
+    m_slots[Slot].LastUse = ++m_useCounter;
+
+    return m_cacheData[(size_t)Slot * TileSize * TileSize + (z % TileSize) * TileSize + (x % TileSize)];
+}
+
+
+const float* HeightMapPager::GetTile(int TileX, int TileZ) const
+{
+    int Tile = TileZ * (int)m_header.NumTiles + TileX;
+    int Slot = m_tileToSlot[Tile];
+
+    if (Slot < 0) {
+        Slot = LoadTile(Tile);
+    }
+
+    m_slots[Slot].LastUse = ++m_useCounter;
+
+    return &m_cacheData[(size_t)Slot * m_header.TileSize * m_header.TileSize];
+}
@@ -0,0 +1,141 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HEIGHT_MAP_PAGER_H
+#define HEIGHT_MAP_PAGER_H
+
+#include <vector>
+
+#include "ogldev_types.h"
+#include "ogldev_array_2d.h"
+#include "mapped_file.h"
+
+//
+// Tiled height map file:
+//
+//   TiledHeightMapHeader
+//   min/max height of every tile (2 floats per tile, row major)
+//   padding up to TILED_HEIGHT_MAP_ALIGNMENT
+//   the tiles (row major), each one TileSize x TileSize samples. The samples are
+//   floats or 16 bit values between the min and the max height of the header.
+//
+// Tiles on the far edges are padded by repeating the last row/column.
+//
+#define TILED_HEIGHT_MAP_MAGIC     0x4d485430      // "0THM"
+#define TILED_HEIGHT_MAP_VERSION   1
+#define TILED_HEIGHT_MAP_ALIGNMENT 4096
+
+enum TILED_HEIGHT_MAP_FORMAT {
+    TILED_HEIGHT_MAP_FLOAT = 0,
+    TILED_HEIGHT_MAP_U16 = 1
+};
+
+struct TiledHeightMapHeader {
+    u32 Magic = TILED_HEIGHT_MAP_MAGIC;
+    u32 Version = TILED_HEIGHT_MAP_VERSION;
+    u32 TerrainSize = 0;        // points per side
+    u32 TileSize = 0;           // points per tile side
+    u32 NumTiles = 0;           // per side
+    u32 Format = TILED_HEIGHT_MAP_FLOAT;
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+};
+
+//
+// The file is memory mapped and the tiles are decoded on demand into a cache with a
+// fixed number of slots. Opening a file costs the same regardless of its size and
+// memory use is bounded by the cache (the mapped pages are managed by the OS).
+//
+class HeightMapPager {
+ public:
+    HeightMapPager() {}
+
+    ~HeightMapPager();
+
+    // CacheSize is the max number of decoded tiles in memory
+    bool Open(const char* pFilename, int CacheSize);
+
+    void Close();
+
+    bool IsOpen() const { return m_pData != NULL; }
+
+    static bool WriteTiledFile(const char* pFilename, const Array2D<float>& HeightMap, int TerrainSize,
+                               int TileSize, bool Quantize);
+
+    int GetTerrainSize() const { return (int)m_header.TerrainSize; }
+
+    int GetTileSize() const { return (int)m_header.TileSize; }
+
+    int GetNumTiles() const { return (int)m_header.NumTiles; }
+
+    float GetMinHeight() const { return m_header.MinHeight; }
+
+    float GetMaxHeight() const { return m_header.MaxHeight; }
+
+    // Loads the missing tiles within Radius of (x, z) - all in height map units
+    void Update(float x, float z, float Radius);
+
+    // Out of range points are clamped to the edges. A miss loads the tile.
+    float GetHeight(int x, int z) const;
+
+    // TileSize x TileSize decoded samples. Valid until the next tile is loaded.
+    const float* GetTile(int TileX, int TileZ) const;
+
+    // Conservative min/max height of the points in [x0, x1] x [z0, z1]. Doesn't load tiles.
+    void GetMinMax(int x0, int z0, int x1, int z1, float& Min, float& Max) const;
+
+    int GetNumTileLoads() const { return m_numTileLoads; }
+
+ private:
+
+    int LoadTile(int Tile) const;
+
+    void BuildMinMaxPyramid(const float* pTileMinMax);
+
+    struct CacheSlot {
+        int Tile = -1;
+        uint64_t LastUse = 0;
+    };
+
+    struct MinMax {
+        float Min = 0.0f;
+        float Max = 0.0f;
+    };
+
+    TiledHeightMapHeader m_header;
+    const u8* m_pData = NULL;           // the mapping of m_file
+    size_t m_dataSize = 0;
+    size_t m_tilesOffset = 0;
+    size_t m_tileSizeInBytes = 0;
+
+    MappedFile m_file;
+
+    // The cache is updated by the const height queries
+    mutable std::vector<float> m_cacheData;
+    mutable std::vector<CacheSlot> m_slots;
+    mutable std::vector<int> m_tileToSlot;
+    mutable uint64_t m_useCounter = 0;
+    mutable int m_numTileLoads = 0;
+
+    // Level zero has one node per tile
+    std::vector<std::vector<MinMax>> m_minMaxLevels;
+    std::vector<int> m_levelSizes;
+};
+
+#endif
@@ -0,0 +1,424 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "ogldev_parallel.h"
+#include "height_quadtree.h"
+
+
+void HeightQuadtree::Build(const Array2D<float>& HeightMap, int TerrainSize)
+{
+    Destroy();
+
+    if (TerrainSize < 2) {
+        printf("%s:%d - terrain size must be at least 2 (%d)\n", __FILE__, __LINE__, TerrainSize);
+        exit(0);
+    }
+
+    m_pHeightMap = &HeightMap;
+    m_terrainSize = TerrainSize;
+    m_numQuads = TerrainSize - 1;
+
+    int LevelSize = m_numQuads;
+
+    while (true) {
+        m_levelSizes.push_back(LevelSize);
+
+        if (LevelSize == 1) {
+            break;
+        }
+
+        LevelSize = (LevelSize + 1) / 2;
+    }
+
+    m_levels.resize(m_levelSizes.size());
+
+    // Level zero - the four corners of each quad
+    m_levels[0].resize((size_t)m_numQuads * m_numQuads);
+
+    ParallelFor(0, m_numQuads, [&](int StartZ, int EndZ) {
+        for (int z = StartZ ; z < EndZ ; z++) {
+            const float* pRow = HeightMap.GetRow(z);
+            const float* pNextRow = HeightMap.GetRow(z + 1);
+            MinMax* pNode = &m_levels[0][(size_t)z * m_numQuads];
+
+            for (int x = 0 ; x < m_numQuads ; x++) {
+                float h00 = pRow[x];
+                float h10 = pRow[x + 1];
+                float h01 = pNextRow[x];
+                float h11 = pNextRow[x + 1];
+
+                pNode[x].Min = std::min(std::min(h00, h10), std::min(h01, h11));
+                pNode[x].Max = std::max(std::max(h00, h10), std::max(h01, h11));
+            }
+        }
+    }, 64);
+
+    // Every other level merges up to four nodes from the level below
+    for (int Level = 1 ; Level < (int)m_levels.size() ; Level++) {
+        int Size = m_levelSizes[Level];
+        int PrevSize = m_levelSizes[Level - 1];
+        m_levels[Level].resize((size_t)Size * Size);
+
+        ParallelFor(0, Size, [&](int StartZ, int EndZ) {
+            for (int z = StartZ ; z < EndZ ; z++) {
+                for (int x = 0 ; x < Size ; x++) {
+                    MinMax Node = GetNode(Level - 1, x * 2, z * 2);
+
+                    for (int i = 1 ; i < 4 ; i++) {
+                        int ChildX = x * 2 + (i & 1);
+                        int ChildZ = z * 2 + (i >> 1);
+
+                        if ((ChildX < PrevSize) && (ChildZ < PrevSize)) {
+                            const MinMax& Child = GetNode(Level - 1, ChildX, ChildZ);
+                            Node.Min = std::min(Node.Min, Child.Min);
+                            Node.Max = std::max(Node.Max, Child.Max);
+                        }
+                    }
+
+                    m_levels[Level][(size_t)z * Size + x] = Node;
+                }
+            }
+        }, 64);
+    }
+}
+
+
+void HeightQuadtree::Destroy()
+{
+    m_levels.clear();
+    m_levelSizes.clear();
+    m_pHeightMap = NULL;
+    m_terrainSize = 0;
+    m_numQuads = 0;
+}
+
+
+void HeightQuadtree::GetNodeMinMax(int Level, int NodeX, int NodeZ, float& Min, float& Max) const
+{
+    const MinMax& Node = GetNode(Level, NodeX, NodeZ);
+    Min = Node.Min;
+    Max = Node.Max;
+}
+
+
+void HeightQuadtree::GetNodeRange(int Level, int NodeX, int NodeZ, int& x0, int& z0, int& x1, int& z1) const
+{
+    int NodeSize = 1 << Level;
+
+    x0 = NodeX * NodeSize;
+    z0 = NodeZ * NodeSize;
+    x1 = std::min(x0 + NodeSize, m_numQuads);
+    z1 = std::min(z0 + NodeSize, m_numQuads);
+}
+
+
+void HeightQuadtree::GetMinMax(int x0, int z0, int x1, int z1, float& Min, float& Max) const
+{
+    Min = FLT_MAX;
+    Max = -FLT_MAX;
+
+    // points --> quads
+    int QuadX1 = std::max(x1 - 1, x0);
+    int QuadZ1 = std::max(z1 - 1, z0);
+
+    int TopLevel = GetNumLevels() - 1;
+
+    GetMinMaxNode(TopLevel, 0, 0, x0, z0, QuadX1, QuadZ1, Min, Max);
+}
+
+
+void HeightQuadtree::GetMinMaxNode(int Level, int NodeX, int NodeZ, int x0, int z0, int x1, int z1, float& Min, float& Max) const
+{
+    int NodeX0, NodeZ0, NodeX1, NodeZ1;
+    GetNodeRange(Level, NodeX, NodeZ, NodeX0, NodeZ0, NodeX1, NodeZ1);
+
+    // from points to (inclusive) quads
+    NodeX1--;
+    NodeZ1--;
+
+    if ((NodeX0 > x1) || (NodeX1 < x0) || (NodeZ0 > z1) || (NodeZ1 < z0)) {
+        return;
+    }
+
+    if ((NodeX0 >= x0) && (NodeX1 <= x1) && (NodeZ0 >= z0) && (NodeZ1 <= z1)) {
+        const MinMax& Node = GetNode(Level, NodeX, NodeZ);
+        Min = std::min(Min, Node.Min);
+        Max = std::max(Max, Node.Max);
+        return;
+    }
+
+    int ChildSize = m_levelSizes[Level - 1];
+
+    for (int i = 0 ; i < 4 ; i++) {
+        int ChildX = NodeX * 2 + (i & 1);
+        int ChildZ = NodeZ * 2 + (i >> 1);
+
+        if ((ChildX < ChildSize) && (ChildZ < ChildSize)) {
+            GetMinMaxNode(Level - 1, ChildX, ChildZ, x0, z0, x1, z1, Min, Max);
+        }
+    }
+}
+
+
+void HeightQuadtree::GetVisibleNodes(const FrustumCulling& FC, float WorldScale, int Level, std::vector<Vector2i>& Nodes) const
+{
+    Nodes.clear();
+
+    if (m_levels.empty()) {
+        return;
+    }
+
+    int TopLevel = GetNumLevels() - 1;
+
+    GetVisibleNodesInternal(FC, WorldScale, Level, TopLevel, 0, 0, false, Nodes);
+}
+
+
+void HeightQuadtree::GetVisibleNodesInternal(const FrustumCulling& FC, float WorldScale, int TargetLevel,
+                                             int Level, int NodeX, int NodeZ, bool FullyInside,
+                                             std::vector<Vector2i>& Nodes) const
+{
+    if (!FullyInside) {
+        int x0, z0, x1, z1;
+        GetNodeRange(Level, NodeX, NodeZ, x0, z0, x1, z1);
+
+        const MinMax& Node = GetNode(Level, NodeX, NodeZ);
+        Vector3f Min(x0 * WorldScale, Node.Min, z0 * WorldScale);
+        Vector3f Max(x1 * WorldScale, Node.Max, z1 * WorldScale);
+
+        if (!FC.IsAABBInsideViewFrustum(Min, Max)) {
+            return;
+        }
+
+        FullyInside = FC.IsAABBFullyInsideViewFrustum(Min, Max);
+    }
+
+    if (Level == TargetLevel) {
+        Vector2i n = { NodeX, NodeZ };
+        Nodes.push_back(n);
+        return;
+    }
+
+    if (FullyInside) {
+        AddSubtreeNodes(TargetLevel, Level, NodeX, NodeZ, Nodes);
+        return;
+    }
+
+    int ChildSize = m_levelSizes[Level - 1];
+
+    for (int i = 0 ; i < 4 ; i++) {
+        int ChildX = NodeX * 2 + (i & 1);
+        int ChildZ = NodeZ * 2 + (i >> 1);
+
+        if ((ChildX < ChildSize) && (ChildZ < ChildSize)) {
+            GetVisibleNodesInternal(FC, WorldScale, TargetLevel, Level - 1, ChildX, ChildZ, false, Nodes);
+        }
+    }
+}
+
+
+void HeightQuadtree::AddSubtreeNodes(int TargetLevel, int Level, int NodeX, int NodeZ, std::vector<Vector2i>& Nodes) const
+{
+    int Shift = Level - TargetLevel;
+    int TargetSize = m_levelSizes[TargetLevel];
+
+    int StartX = NodeX << Shift;
+    int StartZ = NodeZ << Shift;
+    int EndX = std::min((NodeX + 1) << Shift, TargetSize);
+    int EndZ = std::min((NodeZ + 1) << Shift, TargetSize);
+
+    for (int z = StartZ ; z < EndZ ; z++) {
+        for (int x = StartX ; x < EndX ; x++) {
+            Vector2i n = { x, z };
+            Nodes.push_back(n);
+        }
+    }
+}
+
+
+bool HeightQuadtree::RayIntersect(const Vector3f& Origin, const Vector3f& Dir, float WorldScale, float MaxT, float& t) const
+{
+    if (m_levels.empty()) {
+        return false;
+    }
+
+    // Move the ray into height map space. A linear mapping keeps 't' unchanged.
+    Vector3f o(Origin.x / WorldScale, Origin.y, Origin.z / WorldScale);
+    Vector3f d(Dir.x / WorldScale, Dir.y, Dir.z / WorldScale);
+
+    const float Tiny = 1e-20f;
+    Vector3f InvDir(1.0f / (fabsf(d.x) > Tiny ? d.x : Tiny),
+                    1.0f / (fabsf(d.y) > Tiny ? d.y : Tiny),
+                    1.0f / (fabsf(d.z) > Tiny ? d.z : Tiny));
+
+    float BestT = MaxT;
+    int TopLevel = GetNumLevels() - 1;
+
+    if (!RayIntersectNode(o, d, InvDir, TopLevel, 0, 0, BestT)) {
+        return false;
+    }
+
+    t = BestT;
+
+    return true;
+}
+
+
+bool HeightQuadtree::RayIntersectNodeBox(const Vector3f& Origin, const Vector3f& InvDir, int Level, int NodeX, int NodeZ,
+                                         float& tEnter, float& tExit) const
+{
+    int x0, z0, x1, z1;
+    GetNodeRange(Level, NodeX, NodeZ, x0, z0, x1, z1);
+
+    const MinMax& Node = GetNode(Level, NodeX, NodeZ);
+
+    float tx0 = ((float)x0 - Origin.x) * InvDir.x;
+    float tx1 = ((float)x1 - Origin.x) * InvDir.x;
+    float ty0 = (Node.Min - Origin.y) * InvDir.y;
+    float ty1 = (Node.Max - Origin.y) * InvDir.y;
+    float tz0 = ((float)z0 - Origin.z) * InvDir.z;
+    float tz1 = ((float)z1 - Origin.z) * InvDir.z;
+
+    tEnter = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::min(tz0, tz1));
+    tExit  = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1));
+
+    return (tEnter <= tExit) && (tExit >= 0.0f);
+}
+
+
+//
+// Children are visited in the order the ray enters them so that once a hit is
+// found the remaining children can usually be skipped.
+//
+bool HeightQuadtree::RayIntersectNode(const Vector3f& Origin, const Vector3f& Dir, const Vector3f& InvDir,
+                                      int Level, int NodeX, int NodeZ, float& BestT) const
+{
+    float tEnter, tExit;
+
+    if (!RayIntersectNodeBox(Origin, InvDir, Level, NodeX, NodeZ, tEnter, tExit) || (tEnter > BestT)) {
+        return false;
+    }
+
+    if (Level == 0) {
+        return RayIntersectQuad(Origin, Dir, NodeX, NodeZ, BestT);
+    }
+
+    struct Child {
+        int x;
+        int z;
+        float tEnter;
+    };
+
+    Child Children[4];
+    int NumChildren = 0;
+    int ChildSize = m_levelSizes[Level - 1];
+
+    for (int i = 0 ; i < 4 ; i++) {
+        int ChildX = NodeX * 2 + (i & 1);
+        int ChildZ = NodeZ * 2 + (i >> 1);
+
+        if ((ChildX < ChildSize) && (ChildZ < ChildSize)) {
+            float ChildEnter, ChildExit;
+
+            if (RayIntersectNodeBox(Origin, InvDir, Level - 1, ChildX, ChildZ, ChildEnter, ChildExit)) {
+                Children[NumChildren].x = ChildX;
+                Children[NumChildren].z = ChildZ;
+                Children[NumChildren].tEnter = ChildEnter;
+                NumChildren++;
+            }
+        }
+    }
+
+    std::sort(Children, Children + NumChildren, [](const Child& a, const Child& b) { return a.tEnter < b.tEnter; });
+
+    bool Hit = false;
+
+    for (int i = 0 ; i < NumChildren ; i++) {
+        if (Children[i].tEnter > BestT) {
+            break;
+        }
+
+        if (RayIntersectNode(Origin, Dir, InvDir, Level - 1, Children[i].x, Children[i].z, BestT)) {
+            Hit = true;
+        }
+    }
+
+    return Hit;
+}
+
+
+static bool RayIntersectTriangle(const Vector3f& Origin, const Vector3f& Dir,
+                                 const Vector3f& v0, const Vector3f& v1, const Vector3f& v2, float& t)
+{
+    // Moller-Trumbore
+    Vector3f Edge1 = v1 - v0;
+    Vector3f Edge2 = v2 - v0;
+    Vector3f P = Dir.Cross(Edge2);
+    float Det = Edge1.Dot(P);
+
+    if (fabsf(Det) < 1e-12f) {
+        return false;
+    }
+
+    float InvDet = 1.0f / Det;
+    Vector3f T = Origin - v0;
+    float u = T.Dot(P) * InvDet;
+
+    if ((u < 0.0f) || (u > 1.0f)) {
+        return false;
+    }
+
+    Vector3f Q = T.Cross(Edge1);
+    float v = Dir.Dot(Q) * InvDet;
+
+    if ((v < 0.0f) || (u + v > 1.0f)) {
+        return false;
+    }
+
+    t = Edge2.Dot(Q) * InvDet;
+
+    return (t >= 0.0f);
+}
+
+
+bool HeightQuadtree::RayIntersectQuad(const Vector3f& Origin, const Vector3f& Dir, int x, int z, float& BestT) const
+{
+    Vector3f v00((float)x,       m_pHeightMap->Get(x, z),         (float)z);
+    Vector3f v10((float)(x + 1), m_pHeightMap->Get(x + 1, z),     (float)z);
+    Vector3f v01((float)x,       m_pHeightMap->Get(x, z + 1),     (float)(z + 1));
+    Vector3f v11((float)(x + 1), m_pHeightMap->Get(x + 1, z + 1), (float)(z + 1));
+
+    bool Hit = false;
+    float t;
+
+    if (RayIntersectTriangle(Origin, Dir, v00, v10, v11, t) && (t < BestT)) {
+        BestT = t;
+        Hit = true;
+    }
+
+    if (RayIntersectTriangle(Origin, Dir, v00, v11, v01, t) && (t < BestT)) {
+        BestT = t;
+        Hit = true;
+    }
+
+    return Hit;
+}
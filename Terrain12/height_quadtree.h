@@ -0,0 +1,100 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HEIGHT_QUADTREE_H
+#define HEIGHT_QUADTREE_H
+
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_array_2d.h"
+
+//
+// A min/max mip pyramid over the height map. A node at level L covers a square of
+// 2^L x 2^L quads (a quad is the space between four adjacent height map points) so
+// level zero has one node per quad and the top level has a single node for the entire
+// terrain. Unless stated otherwise coordinates are in height map units (x and z are
+// indices into the height map, y is the height itself).
+//
+class HeightQuadtree {
+ public:
+    HeightQuadtree() {}
+
+    void Build(const Array2D<float>& HeightMap, int TerrainSize);
+
+    void Destroy();
+
+    int GetNumLevels() const { return (int)m_levels.size(); }
+
+    int GetLevelSize(int Level) const { return m_levelSizes[Level]; }
+
+    // Node coordinates are in units of the node size for the level
+    void GetNodeMinMax(int Level, int NodeX, int NodeZ, float& Min, float& Max) const;
+
+    // Min/max height of the points in [x0, x1] x [z0, z1]
+    void GetMinMax(int x0, int z0, int x1, int z1, float& Min, float& Max) const;
+
+    // Height map x/z range of a node (the second point is inclusive)
+    void GetNodeRange(int Level, int NodeX, int NodeZ, int& x0, int& z0, int& x1, int& z1) const;
+
+    //
+    // Collects the nodes of 'Level' whose world space box intersects the frustum.
+    // Entire subtrees are rejected (or accepted) with a single test.
+    //
+    void GetVisibleNodes(const FrustumCulling& FC, float WorldScale, int Level, std::vector<Vector2i>& Nodes) const;
+
+    //
+    // The ray is in world space. On a hit 't' is the distance along Dir (in units of the
+    // length of Dir) of the first intersection with the terrain surface.
+    //
+    bool RayIntersect(const Vector3f& Origin, const Vector3f& Dir, float WorldScale, float MaxT, float& t) const;
+
+ private:
+
+    struct MinMax {
+        float Min = 0.0f;
+        float Max = 0.0f;
+    };
+
+    void GetMinMaxNode(int Level, int NodeX, int NodeZ, int x0, int z0, int x1, int z1, float& Min, float& Max) const;
+
+    void GetVisibleNodesInternal(const FrustumCulling& FC, float WorldScale, int TargetLevel,
+                                 int Level, int NodeX, int NodeZ, bool FullyInside,
+                                 std::vector<Vector2i>& Nodes) const;
+
+    void AddSubtreeNodes(int TargetLevel, int Level, int NodeX, int NodeZ, std::vector<Vector2i>& Nodes) const;
+
+    bool RayIntersectNode(const Vector3f& Origin, const Vector3f& Dir, const Vector3f& InvDir,
+                          int Level, int NodeX, int NodeZ, float& BestT) const;
+
+    bool RayIntersectNodeBox(const Vector3f& Origin, const Vector3f& InvDir, int Level, int NodeX, int NodeZ,
+                             float& tEnter, float& tExit) const;
+
+    bool RayIntersectQuad(const Vector3f& Origin, const Vector3f& Dir, int x, int z, float& BestT) const;
+
+    const MinMax& GetNode(int Level, int NodeX, int NodeZ) const { return m_levels[Level][NodeZ * m_levelSizes[Level] + NodeX]; }
+
+    std::vector<std::vector<MinMax>> m_levels;
+    std::vector<int> m_levelSizes;
+    const Array2D<float>* m_pHeightMap = NULL;
+    int m_terrainSize = 0;
+    int m_numQuads = 0;
+};
+
+#endif
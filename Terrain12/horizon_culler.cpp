@@ -0,0 +1,206 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "horizon_culler.h"
+
+#define PSEUDO_ANGLE_RANGE 4.0f
+
+
+//
+// Increases with the angle of (x, z) like atan2(z, x) but without the trigonometry.
+// The range is (-2, 2]. The sectors are uniform in the pseudo angle rather than the angle.
+//
+static float CalcPseudoAngle(float x, float z)
+{
+    float p = x / (fabsf(x) + fabsf(z));
+    return (z < 0.0f) ? p - 1.0f : 1.0f - p;
+}
+
+
+void HorizonCuller::Init(int NumSectors)
+{
+    m_sectors.resize(NumSectors);
+    m_sectorsPerUnit = (float)NumSectors / PSEUDO_ANGLE_RANGE;
+}
+
+
+void HorizonCuller::Begin(const Vector3f& CameraPos)
+{
+    m_cameraPos = CameraPos;
+
+    for (std::vector<HorizonPoint>& Sector : m_sectors) {
+        Sector.clear();
+    }
+
+    while (!m_pending.empty()) {
+        m_pending.pop();
+    }
+}
+
+
+int HorizonCuller::WrapSector(int Sector) const
+{
+    int NumSectors = (int)m_sectors.size();
+    return ((Sector % NumSectors) + NumSectors) % NumSectors;
+}
+
+
+float HorizonCuller::GetMinDistance(float x0, float z0, float x1, float z1) const
+{
+    float dx = std::min(std::max(m_cameraPos.x, x0), x1) - m_cameraPos.x;
+    float dz = std::min(std::max(m_cameraPos.z, z0), z1) - m_cameraPos.z;
+
+    return sqrtf(dx * dx + dz * dz);
+}
+
+
+// Returns false if the camera is above the rectangle
+bool HorizonCuller::CalcAngularRange(float x0, float z0, float x1, float z1, float& Start, float& End,
+                                     float& MinDistance, float& MaxDistance) const
+{
+    MinDistance = GetMinDistance(x0, z0, x1, z1);
+
+    if (MinDistance <= 0.0f) {
+        return false;
+    }
+
+    float CenterX = (x0 + x1) * 0.5f - m_cameraPos.x;
+    float CenterZ = (z0 + z1) * 0.5f - m_cameraPos.z;
+    float Center = CalcPseudoAngle(CenterX, CenterZ);
+
+    float Corners[4][2] = { { x0, z0 }, { x1, z0 }, { x0, z1 }, { x1, z1 } };
+    float MinDelta = 0.0f;
+    float MaxDelta = 0.0f;
+    float MaxDistance2 = 0.0f;
+
+    // The rectangle is convex and doesn't contain the camera so it spans less than half a circle around the center
+    for (int i = 0 ; i < 4 ; i++) {
+        float dx = Corners[i][0] - m_cameraPos.x;
+        float dz = Corners[i][1] - m_cameraPos.z;
+
+        float Delta = CalcPseudoAngle(dx, dz) - Center;
+
+        if (Delta > PSEUDO_ANGLE_RANGE * 0.5f) {
+            Delta -= PSEUDO_ANGLE_RANGE;
+        } else if (Delta < -PSEUDO_ANGLE_RANGE * 0.5f) {
+            Delta += PSEUDO_ANGLE_RANGE;
+        }
+
+        MinDelta = std::min(MinDelta, Delta);
+        MaxDelta = std::max(MaxDelta, Delta);
+        MaxDistance2 = std::max(MaxDistance2, dx * dx + dz * dz);
+    }
+
+    Start = Center + MinDelta;
+    End = Center + MaxDelta;
+    MaxDistance = sqrtf(MaxDistance2);
+
+    return true;
+}
+
+
+void HorizonCuller::AddOccluder(float x0, float z0, float x1, float z1, float MinHeight)
+{
+    Occluder o;
+    float MinDistance = 0.0f;
+
+    if (!CalcAngularRange(x0, z0, x1, z1, o.Start, o.End, MinDistance, o.MaxDistance)) {
+        return;
+    }
+
+    // The line of sight can cross the rectangle anywhere between the two distances
+    float Height = MinHeight - m_cameraPos.y;
+    o.Elevation = Height / ((Height > 0.0f) ? o.MaxDistance : MinDistance);
+
+    m_pending.push(o);
+}
+
+
+void HorizonCuller::CommitOccluders(float Distance)
+{
+    while (!m_pending.empty() && (m_pending.top().MaxDistance <= Distance)) {
+        Occluder o = m_pending.top();
+        m_pending.pop();
+
+        // Only the sectors that are completely inside the range are blocked
+        int First = (int)ceilf((o.Start + PSEUDO_ANGLE_RANGE * 0.5f) * m_sectorsPerUnit);
+        int Last = (int)floorf((o.End + PSEUDO_ANGLE_RANGE * 0.5f) * m_sectorsPerUnit) - 1;
+
+        for (int s = First ; s <= Last ; s++) {
+            std::vector<HorizonPoint>& Horizon = m_sectors[WrapSector(s)];
+
+            if (Horizon.empty()) {
+                Horizon.push_back({ o.MaxDistance, o.Elevation });
+                continue;
+            }
+
+            HorizonPoint& Back = Horizon.back();
+
+            if (o.Elevation <= Back.Elevation) {
+                continue;
+            }
+
+            // Keeps the step function sorted. Moving the occluder further away is conservative.
+            if (o.MaxDistance <= Back.Distance) {
+                Back.Elevation = o.Elevation;
+            } else {
+                Horizon.push_back({ o.MaxDistance, o.Elevation });
+            }
+        }
+    }
+}
+
+
+float HorizonCuller::GetHorizon(int Sector, float Distance) const
+{
+    const std::vector<HorizonPoint>& Horizon = m_sectors[Sector];
+
+    // The elevations increase with the distance so the last point up to the distance is the highest
+    auto it = std::upper_bound(Horizon.begin(), Horizon.end(), Distance,
+                               [](float d, const HorizonPoint& p) { return d < p.Distance; });
+
+    return (it == Horizon.begin()) ? -FLT_MAX : (it - 1)->Elevation;
+}
+
+
+bool HorizonCuller::IsOccluded(const Vector3f& Min, const Vector3f& Max) const
+{
+    float Start, End, MinDistance, MaxDistance;
+
+    if (m_sectors.empty() || !CalcAngularRange(Min.x, Min.z, Max.x, Max.z, Start, End, MinDistance, MaxDistance)) {
+        return false;
+    }
+
+    // The highest elevation of any point in the box
+    float Height = Max.y - m_cameraPos.y;
+    float Elevation = Height / ((Height > 0.0f) ? MinDistance : MaxDistance);
+
+    int First = (int)floorf((Start + PSEUDO_ANGLE_RANGE * 0.5f) * m_sectorsPerUnit);
+    int Last = (int)floorf((End + PSEUDO_ANGLE_RANGE * 0.5f) * m_sectorsPerUnit);
+
+    for (int s = First ; s <= Last ; s++) {
+        if (GetHorizon(WrapSector(s), MinDistance) <= Elevation) {
+            return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,99 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HORIZON_CULLER_H
+#define HORIZON_CULLER_H
+
+#include <vector>
+#include <queue>
+
+#include "ogldev_math_3d.h"
+
+//
+// Occlusion culling against the horizon of the terrain as seen from the camera. The
+// directions around the camera are split into angular sectors and every sector keeps
+// the elevation of its horizon (height above the camera divided by the horizontal
+// distance) as a step function of the distance.
+//
+// An occluder is a rectangle of terrain (world space x/z) whose surface is at least
+// MinHeight everywhere, so every line of sight through a sector that the rectangle
+// covers completely is blocked below the lowest elevation the rectangle can have. A box
+// is occluded if in every sector that it touches its highest possible elevation is below
+// the horizon of the occluders that are closer than the box.
+//
+// The occluders must be committed in the order of their max distance for the horizon to
+// be tight. This is the case when the terrain is processed front to back and every patch
+// commits the pending occluders that are closer than itself before it is tested (see
+// CommitOccluders). Once everything is committed the boxes can be tested in any order,
+// so objects on the terrain can be culled with the horizon of the frame.
+//
+class HorizonCuller {
+ public:
+    HorizonCuller() {}
+
+    void Init(int NumSectors);
+
+    // Starts a new frame with an empty horizon
+    void Begin(const Vector3f& CameraPos);
+
+    // The occluder is pending until it is committed
+    void AddOccluder(float x0, float z0, float x1, float z1, float MinHeight);
+
+    // Adds the pending occluders whose max distance from the camera is up to 'Distance' to the horizon
+    void CommitOccluders(float Distance);
+
+    void CommitAllOccluders() { CommitOccluders(FLT_MAX); }
+
+    // Horizontal distance between the camera and the nearest point of the rectangle
+    float GetMinDistance(float x0, float z0, float x1, float z1) const;
+
+    bool IsOccluded(const Vector3f& Min, const Vector3f& Max) const;
+
+    int GetNumSectors() const { return (int)m_sectors.size(); }
+
+ private:
+
+    struct HorizonPoint {
+        float Distance;     // the horizon is at least 'Elevation' beyond this distance
+        float Elevation;
+    };
+
+    struct Occluder {
+        float MaxDistance;
+        float Start;        // pseudo angle range
+        float End;
+        float Elevation;
+
+        bool operator>(const Occluder& o) const { return MaxDistance > o.MaxDistance; }
+    };
+
+    bool CalcAngularRange(float x0, float z0, float x1, float z1, float& Start, float& End,
+                          float& MinDistance, float& MaxDistance) const;
+
+    float GetHorizon(int Sector, float Distance) const;
+
+    int WrapSector(int Sector) const;
+
+    Vector3f m_cameraPos;
+    float m_sectorsPerUnit = 0.0f;      // sectors per unit of pseudo angle
+    std::vector<std::vector<HorizonPoint>> m_sectors;
+    std::priority_queue<Occluder, std::vector<Occluder>, std::greater<Occluder>> m_pending;
+};
+
+#endif
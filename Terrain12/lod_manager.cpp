@@ -1,5 +1,8 @@
 #include <stdio.h>
+#include <algorithm>
+#include <float.h>
 
+#include "ogldev_parallel.h"
 #include "lod_manager.h"
 #include "demo_config.h"
 
@@ -20,6 +23,13 @@ int LodManager::InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ,
 
     CalcLodRegions();
 
+    int NumPatches = NumPatchesX * NumPatchesZ;
+    m_isDirty.assign(NumPatches, 0);
+    m_dirtyPatches.clear();
+    m_hysteresis = 0.05f;
+    m_minCameraMove = 0.25f * WorldScale;
+    m_needFullUpdate = true;
+
     return m_maxLOD;
 }
 
@@ -41,89 +51,537 @@ void LodManager::CalcMaxLOD()
 }
 
 
+void LodManager::SetScreenSpaceErrorMode(const PersProjInfo& ProjInfo, float PixelTolerance)
+{
+    if (m_geometricErrors.empty()) {
+        printf("%s:%d - geometric errors were not calculated\n", __FILE__, __LINE__);
+        exit(0);
+    }
+
+    float ProjScale = ProjInfo.Height / (2.0f * tanf(ToRadian(ProjInfo.FOV / 2.0f)));
+    PixelTolerance = std::max(PixelTolerance, 0.01f);
+
+    // This is called every frame so only a real change restarts the LOD selection
+    if (!m_useScreenSpaceError || (m_pixelTolerance != PixelTolerance) || (m_projScale != ProjScale)) {
+        m_useScreenSpaceError = true;
+        m_pixelTolerance = PixelTolerance;
+        m_projScale = ProjScale;
+        m_needFullUpdate = true;
+    }
+}
+
+
+void LodManager::SetDistanceMode()
+{
+    if (m_useScreenSpaceError) {
+        m_useScreenSpaceError = false;
+        m_needFullUpdate = true;
+    }
+}
+
+
+void LodManager::SetHysteresis(float Fraction)
+{
+    m_hysteresis = std::max(Fraction, 0.0f);
+    m_needFullUpdate = true;
+}
+
+
 void LodManager::Update(const Vector3f& CameraPos)
 {
-    UpdateLodMapPass1(CameraPos);
-    UpdateLodMapPass2(CameraPos);
+    for (int Patch : m_dirtyPatches) {
+        m_isDirty[Patch] = 0;
+    }
+
+    m_dirtyPatches.clear();
+
+    if (m_needFullUpdate) {
+        FullUpdate(CameraPos);
+        return;
+    }
+
+    if (CameraPos.Distance(m_lastCameraPos) < m_minCameraMove) {
+        return;
+    }
+
+    IncrementalUpdate(CameraPos);
 }
 
 
-void LodManager::UpdateLodMapPass1(const Vector3f& CameraPos)
+void LodManager::FullUpdate(const Vector3f& CameraPos)
 {
-    int CenterStep = m_patchSize / 2;
+    m_needFullUpdate = false;
+    m_lastCameraPos = CameraPos;
+    m_travel = 0.0;
+
+    m_recheckTemp.clear();
 
     for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
         for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
-            int x = LodMapX * (m_patchSize - 1) + CenterStep;
-            int z = LodMapZ * (m_patchSize - 1) + CenterStep;
+            int Patch = LodMapZ * m_numPatchesX + LodMapX;
+
+            float Distance = CalcPatchDistance(LodMapX, LodMapZ, CameraPos);
 
-            Vector3f PatchCenter = Vector3f(x * (float)m_worldScale, 0.0f, z * (float)m_worldScale);
+            // No previous LOD to stick to (-1 is never inside the hysteresis range)
+            int Lod = SelectLod(LodMapX, LodMapZ, Distance, -1);
 
-            float DistanceToCamera = CameraPos.Distance(PatchCenter);
+            PatchLod& plod = m_map.At(LodMapX, LodMapZ);
+            plod.Core = Lod;
+            plod.Left = plod.Right = plod.Top = plod.Bottom = 0;
 
-            int CoreLod = DistanceToLod(DistanceToCamera);
+            RecheckEntry Entry;
+            Entry.Travel = CalcSlack(LodMapX, LodMapZ, Distance, Lod);
+            Entry.Patch = Patch;
+            m_recheckTemp.push_back(Entry);
+        }
+    }
 
-            PatchLod* pPatchLOD = m_map.GetAddr(LodMapX, LodMapZ);
-            pPatchLOD->Core = CoreLod;
+    // Building the heap in one go is linear
+    m_recheckQueue = std::priority_queue<RecheckEntry, std::vector<RecheckEntry>, std::greater<RecheckEntry>>(
+        std::greater<RecheckEntry>(), std::move(m_recheckTemp));
+    m_recheckTemp.clear();
+
+    for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
+        for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
+            UpdateNeighborLodsSinglePatch(LodMapX, LodMapZ);
+            AddDirtyPatch(LodMapZ * m_numPatchesX + LodMapX);
         }
     }
 }
 
 
-void LodManager::UpdateLodMapPass2(const Vector3f& CameraPos)
+void LodManager::IncrementalUpdate(const Vector3f& CameraPos)
 {
-    int Step = m_patchSize / 2;
+    m_travel += CameraPos.Distance(m_lastCameraPos);
+    m_lastCameraPos = CameraPos;
 
-    for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
-        for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
-            int CoreLod = m_map.Get(LodMapX, LodMapZ).Core;
+    m_changedTemp.clear();
+    m_recheckTemp.clear();
 
-            int IndexLeft   = LodMapX;
-            int IndexRight  = LodMapX;
-            int IndexTop    = LodMapZ;
-            int IndexBottom = LodMapZ;
+    while (!m_recheckQueue.empty() && (m_recheckQueue.top().Travel <= m_travel)) {
+        RecheckEntry Entry = m_recheckQueue.top();
+        m_recheckQueue.pop();
 
-            if (LodMapX > 0) {
-                IndexLeft--;
+        int LodMapX = Entry.Patch % m_numPatchesX;
+        int LodMapZ = Entry.Patch / m_numPatchesX;
 
-                if (m_map.Get(IndexLeft, LodMapZ).Core > CoreLod) {
-                    m_map.At(LodMapX, LodMapZ).Left = 1;
-                } else {
-                    m_map.At(LodMapX, LodMapZ).Left = 0;
-                }
+        float Distance = CalcPatchDistance(LodMapX, LodMapZ, CameraPos);
+
+        PatchLod& plod = m_map.At(LodMapX, LodMapZ);
+
+        int Lod = SelectLod(LodMapX, LodMapZ, Distance, plod.Core);
+
+        if (Lod != plod.Core) {
+            plod.Core = Lod;
+            m_changedTemp.push_back(Entry.Patch);
+        }
+
+        // Pushed after the loop so that a zero slack doesn't bring the patch back immediately
+        Entry.Travel = m_travel + CalcSlack(LodMapX, LodMapZ, Distance, Lod);
+        m_recheckTemp.push_back(Entry);
+    }
+
+    for (const RecheckEntry& Entry : m_recheckTemp) {
+        m_recheckQueue.push(Entry);
+    }
+
+    if (m_changedTemp.empty()) {
+        return;
+    }
+
+    UpdateNeighborLods(m_changedTemp);
+}
+
+
+float LodManager::CalcPatchDistance(int PatchX, int PatchZ, const Vector3f& CameraPos) const
+{
+    if (m_useScreenSpaceError) {
+        // Closest point of the patch bounding box
+        const PatchHeightRange& Range = m_patchHeights[PatchZ * m_numPatchesX + PatchX];
+
+        float PatchWorldSize = (m_patchSize - 1) * m_worldScale;
+        float MinX = PatchX * PatchWorldSize;
+        float MinZ = PatchZ * PatchWorldSize;
+
+        float dx = std::max(std::max(MinX - CameraPos.x, CameraPos.x - (MinX + PatchWorldSize)), 0.0f);
+        float dy = std::max(std::max(Range.Min - CameraPos.y, CameraPos.y - Range.Max), 0.0f);
+        float dz = std::max(std::max(MinZ - CameraPos.z, CameraPos.z - (MinZ + PatchWorldSize)), 0.0f);
+
+        return std::max(sqrtf(dx * dx + dy * dy + dz * dz), 1.0f);
+    } else {
+        int CenterStep = m_patchSize / 2;
+        int x = PatchX * (m_patchSize - 1) + CenterStep;
+        int z = PatchZ * (m_patchSize - 1) + CenterStep;
+
+        Vector3f PatchCenter = Vector3f(x * (float)m_worldScale, 0.0f, z * (float)m_worldScale);
+
+        return CameraPos.Distance(PatchCenter);
+    }
+}
+
+
+//
+// The projected size in pixels of an error E at distance D is E * m_projScale / D so
+// in the screen space error mode a LOD can be used once the distance to the patch
+// bounding box is at least E * m_projScale / m_pixelTolerance. Both modes are
+// monotonic in the LOD.
+//
+float LodManager::GetLodMinDistance(int PatchX, int PatchZ, int Lod) const
+{
+    if (Lod <= 0) {
+        return 0.0f;
+    }
+
+    if (m_useScreenSpaceError) {
+        return GetGeometricError(PatchX, PatchZ, Lod) * m_projScale / m_pixelTolerance;
+    } else {
+        return (float)m_regions[Lod - 1];
+    }
+}
+
+
+int LodManager::SelectLod(int PatchX, int PatchZ, float Distance, int CurLod) const
+{
+    // Stay with the current LOD while inside its range extended by the hysteresis
+    if ((CurLod >= 0) && (CurLod <= m_maxLOD)) {
+        bool AboveMin = (CurLod == 0) ||
+                        (Distance >= GetLodMinDistance(PatchX, PatchZ, CurLod) * (1.0f - m_hysteresis));
+        bool BelowMax = (CurLod == m_maxLOD) ||
+                        (Distance < GetLodMinDistance(PatchX, PatchZ, CurLod + 1) * (1.0f + m_hysteresis));
+
+        if (AboveMin && BelowMax) {
+            return CurLod;
+        }
+    }
+
+    // The coarsest LOD which is allowed at this distance
+    for (int Lod = m_maxLOD ; Lod > 0 ; Lod--) {
+        if (Distance >= GetLodMinDistance(PatchX, PatchZ, Lod)) {
+            return Lod;
+        }
+    }
+
+    return 0;
+}
+
+
+float LodManager::CalcSlack(int PatchX, int PatchZ, float Distance, int Lod) const
+{
+    float Slack = FLT_MAX;
+
+    if (Lod > 0) {
+        Slack = Distance - GetLodMinDistance(PatchX, PatchZ, Lod) * (1.0f - m_hysteresis);
+    }
+
+    if (Lod < m_maxLOD) {
+        Slack = std::min(Slack, GetLodMinDistance(PatchX, PatchZ, Lod + 1) * (1.0f + m_hysteresis) - Distance);
+    }
+
+    return std::max(Slack, 0.0f);
+}
+
+
+// The neighbor LODs of a patch depend on the core LODs of its neighbors so the
+// neighbors of every changed patch are refreshed as well
+void LodManager::UpdateNeighborLods(const std::vector<int>& ChangedPatches)
+{
+    static const int Offsets[5][2] = { { 0, 0 }, { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+
+    for (int Patch : ChangedPatches) {
+        int LodMapX = Patch % m_numPatchesX;
+        int LodMapZ = Patch / m_numPatchesX;
+
+        AddDirtyPatch(Patch);
+
+        for (int i = 1 ; i < 5 ; i++) {
+            int x = LodMapX + Offsets[i][0];
+            int z = LodMapZ + Offsets[i][1];
+
+            if ((x < 0) || (x >= m_numPatchesX) || (z < 0) || (z >= m_numPatchesZ)) {
+                continue;
             }
 
-            if (LodMapX < m_numPatchesX - 1) {
-                IndexRight++;
+            if (UpdateNeighborLodsSinglePatch(x, z)) {
+                AddDirtyPatch(z * m_numPatchesX + x);
+            }
+        }
+
+        UpdateNeighborLodsSinglePatch(LodMapX, LodMapZ);
+    }
+}
+
+
+bool LodManager::UpdateNeighborLodsSinglePatch(int LodMapX, int LodMapZ)
+{
+    PatchLod& plod = m_map.At(LodMapX, LodMapZ);
+    PatchLod Prev = plod;
+
+    int CoreLod = plod.Core;
+
+    if (LodMapX > 0) {
+        plod.Left = std::max(m_map.Get(LodMapX - 1, LodMapZ).Core - CoreLod, 0);
+    }
+
+    if (LodMapX < m_numPatchesX - 1) {
+        plod.Right = std::max(m_map.Get(LodMapX + 1, LodMapZ).Core - CoreLod, 0);
+    }
 
-                if (m_map.Get(IndexRight, LodMapZ).Core > CoreLod) {
-                    m_map.At(LodMapX, LodMapZ).Right = 1;
-                } else {
-                    m_map.At(LodMapX, LodMapZ).Right = 0;
+    if (LodMapZ > 0) {
+        plod.Bottom = std::max(m_map.Get(LodMapX, LodMapZ - 1).Core - CoreLod, 0);
+    }
+
+    if (LodMapZ < m_numPatchesZ - 1) {
+        plod.Top = std::max(m_map.Get(LodMapX, LodMapZ + 1).Core - CoreLod, 0);
+    }
+
+    return (plod.Left != Prev.Left) || (plod.Right != Prev.Right) ||
+           (plod.Top != Prev.Top) || (plod.Bottom != Prev.Bottom);
+}
+
+
+void LodManager::AddDirtyPatch(int Patch)
+{
+    if (!m_isDirty[Patch]) {
+        m_isDirty[Patch] = 1;
+        m_dirtyPatches.push_back(Patch);
+    }
+}
+
+
+void LodManager::CalcGeometricErrors(const Array2D<float>& HeightMap)
+{
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
+
+    m_geometricErrors.assign((size_t)NumPatches * (m_maxLOD + 1), 0.0f);
+    m_patchHeights.resize(NumPatches);
+
+    m_needFullUpdate = true;
+
+    ParallelFor(0, NumPatches, [&](int Start, int End) {
+        for (int i = Start ; i < End ; i++) {
+            int PatchX = i % m_numPatchesX;
+            int PatchZ = i / m_numPatchesX;
+
+            int x0 = PatchX * (m_patchSize - 1);
+            int z0 = PatchZ * (m_patchSize - 1);
+
+            PatchHeightRange& Range = m_patchHeights[i];
+            Range.Min = HeightMap.Get(x0, z0);
+            Range.Max = Range.Min;
+
+            for (int z = z0 ; z < z0 + m_patchSize ; z++) {
+                for (int x = x0 ; x < x0 + m_patchSize ; x++) {
+                    float Height = HeightMap.Get(x, z);
+                    Range.Min = std::min(Range.Min, Height);
+                    Range.Max = std::max(Range.Max, Height);
                 }
             }
 
-            if (LodMapZ > 0) {
-                IndexBottom--;
+            float* pErrors = &m_geometricErrors[(size_t)i * (m_maxLOD + 1)];
 
-                if (m_map.Get(LodMapX, IndexBottom).Core > CoreLod) {
-                    m_map.At(LodMapX, LodMapZ).Bottom = 1;
-                } else {
-                    m_map.At(LodMapX, LodMapZ).Bottom = 0;
-                }
+            // LOD zero uses all the vertices. The max with the previous level keeps
+            // the error monotonic so that a coarser LOD is never considered more accurate.
+            pErrors[0] = 0.0f;
+
+            for (int Lod = 1 ; Lod <= m_maxLOD ; Lod++) {
+                pErrors[Lod] = std::max(CalcPatchError(HeightMap, PatchX, PatchZ, Lod), pErrors[Lod - 1]);
             }
+        }
+    }, 16);
+}
+
+
+void LodManager::SetGeometricErrors(const float* pErrors, const float* pPatchHeights)
+{
+    int NumPatches = m_numPatchesX * m_numPatchesZ;
 
-            if (LodMapZ < m_numPatchesZ - 1) {
-                IndexTop++;
+    m_geometricErrors.assign(pErrors, pErrors + (size_t)NumPatches * (m_maxLOD + 1));
+    m_patchHeights.resize(NumPatches);
 
-                if (m_map.Get(LodMapX, IndexTop).Core > CoreLod) {
-                    m_map.At(LodMapX, LodMapZ).Top = 1;
-                } else {
-                    m_map.At(LodMapX, LodMapZ).Top = 0;
+    for (int i = 0 ; i < NumPatches ; i++) {
+        m_patchHeights[i].Min = pPatchHeights[i * 2];
+        m_patchHeights[i].Max = pPatchHeights[i * 2 + 1];
+    }
+
+    m_needFullUpdate = true;
+}
+
+
+void LodManager::GetPatchHeights(std::vector<float>& PatchHeights) const
+{
+    PatchHeights.resize(m_patchHeights.size() * 2);
+
+    for (size_t i = 0 ; i < m_patchHeights.size() ; i++) {
+        PatchHeights[i * 2] = m_patchHeights[i].Min;
+        PatchHeights[i * 2 + 1] = m_patchHeights[i].Max;
+    }
+}
+
+
+static float InterpolateTriangle(float u, float v,
+                                 float u0, float v0, float h0,
+                                 float u1, float v1, float h1,
+                                 float u2, float v2, float h2)
+{
+    float Det = (v1 - v2) * (u0 - u2) + (u2 - u1) * (v0 - v2);
+    float b0 = ((v1 - v2) * (u - u2) + (u2 - u1) * (v - v2)) / Det;
+    float b1 = ((v2 - v0) * (u - u2) + (u0 - u2) * (v - v2)) / Det;
+    float b2 = 1.0f - b0 - b1;
+    return b0 * h0 + b1 * h1 + b2 * h2;
+}
+
+
+//
+// Every block of 2*Step x 2*Step quads is rendered as a fan of eight triangles around
+// its center (see PatchIndexCache::BuildIndices). Returns the height of the fan triangle
+// which covers the point (u, v) relative to the block origin (bx, bz).
+//
+static float CalcFanHeight(const Array2D<float>& HeightMap, int bx, int bz, int Step, int u, int v)
+{
+    int BlockSize = Step * 2;
+
+    // Edge point on the side of the fan that covers (u, v) and the next one
+    // along that side (both relative to the block origin)
+    int ua, va, ub, vb;
+
+    if ((u <= v) && (u <= BlockSize - v)) {          // left side
+        ua = 0; va = (v < Step) ? 0 : Step;
+        ub = 0; vb = va + Step;
+    } else if ((v >= u) && (v >= BlockSize - u)) {   // top side
+        va = BlockSize; ua = (u < Step) ? 0 : Step;
+        vb = BlockSize; ub = ua + Step;
+    } else if ((u >= v) && (u >= BlockSize - v)) {   // right side
+        ua = BlockSize; va = (v < Step) ? 0 : Step;
+        ub = BlockSize; vb = va + Step;
+    } else {                                         // bottom side
+        va = 0; ua = (u < Step) ? 0 : Step;
+        vb = 0; ub = ua + Step;
+    }
+
+    float hc = HeightMap.Get(bx + Step, bz + Step);
+    float ha = HeightMap.Get(bx + ua, bz + va);
+    float hb = HeightMap.Get(bx + ub, bz + vb);
+
+    return InterpolateTriangle((float)u, (float)v,
+                               (float)Step, (float)Step, hc,
+                               (float)ua, (float)va, ha,
+                               (float)ub, (float)vb, hb);
+}
+
+
+//
+// The blocks of all the patches are aligned to multiples of the block size because
+// the patch size minus one is a power of two. A point on the boundary between two
+// blocks gets the same height from both of them so the block before it is used
+// (this keeps the last row and column of the height map inside a block).
+//
+float LodManager::CalcLodHeight(const Array2D<float>& HeightMap, int x, int z, int Lod)
+{
+    int Step = powi(2, Lod);
+    int BlockSize = Step * 2;
+
+    int bx = (x / BlockSize) * BlockSize;
+    int bz = (z / BlockSize) * BlockSize;
+
+    if ((bx == x) && (x > 0)) {
+        bx -= BlockSize;
+    }
+
+    if ((bz == z) && (z > 0)) {
+        bz -= BlockSize;
+    }
+
+    return CalcFanHeight(HeightMap, bx, bz, Step, x - bx, z - bz);
+}
+
+
+// Max vertical distance between the full resolution patch and the patch at 'Lod'
+float LodManager::CalcPatchError(const Array2D<float>& HeightMap, int PatchX, int PatchZ, int Lod) const
+{
+    int Step = powi(2, Lod);
+    int BlockSize = Step * 2;
+
+    int x0 = PatchX * (m_patchSize - 1);
+    int z0 = PatchZ * (m_patchSize - 1);
+
+    float MaxError = 0.0f;
+
+    for (int bz = z0 ; bz < z0 + m_patchSize - 1 ; bz += BlockSize) {
+        for (int bx = x0 ; bx < x0 + m_patchSize - 1 ; bx += BlockSize) {
+            for (int v = 0 ; v <= BlockSize ; v++) {
+                for (int u = 0 ; u <= BlockSize ; u++) {
+                    float Approx = CalcFanHeight(HeightMap, bx, bz, Step, u, v);
+                    float Error = fabsf(HeightMap.Get(bx + u, bz + v) - Approx);
+                    MaxError = std::max(MaxError, Error);
                 }
             }
         }
     }
+
+    return MaxError;
+}
+
+
+//
+// A patch may switch to the coarser LOD once it is beyond the threshold distance of
+// that LOD minus the hysteresis (see SelectLod) so the morph must be complete by then.
+// This also makes the morph of a patch that has just switched to a finer LOD start at one.
+//
+float LodManager::CalcMorphFactor(int PatchX, int PatchZ, int Lod, const Vector3f& CameraPos) const
+{
+    if ((m_morphRegion <= 0.0f) || (Lod >= m_maxLOD)) {
+        return 0.0f;
+    }
+
+    float Distance = CalcPatchDistance(PatchX, PatchZ, CameraPos);
+
+    float End = GetLodMinDistance(PatchX, PatchZ, Lod + 1) * (1.0f - m_hysteresis);
+    float Start = End - m_morphRegion * (End - GetLodMinDistance(PatchX, PatchZ, Lod));
+
+    if (Distance >= End) {
+        return 1.0f;
+    }
+
+    if (Distance <= Start) {
+        return 0.0f;
+    }
+
+    return (Distance - Start) / (End - Start);
+}
+
+
+void LodManager::CalcPatchMorph(int PatchX, int PatchZ, const Vector3f& CameraPos, PatchMorph& Morph) const
+{
+    // Left, right, top, bottom
+    static const int Offsets[4][2] = { { -1, 0 }, { 1, 0 }, { 0, 1 }, { 0, -1 } };
+
+    int Core = m_map.Get(PatchX, PatchZ).Core;
+
+    Morph.CoreLod = (float)Core;
+    Morph.CoreMorph = CalcMorphFactor(PatchX, PatchZ, Core, CameraPos);
+
+    for (int Side = 0 ; Side < 4 ; Side++) {
+        Morph.SideLods[Side] = (float)Core;
+        Morph.SideMorphs[Side] = Morph.CoreMorph;
+
+        int x = PatchX + Offsets[Side][0];
+        int z = PatchZ + Offsets[Side][1];
+
+        if ((x < 0) || (x >= m_numPatchesX) || (z < 0) || (z >= m_numPatchesZ)) {
+            continue;
+        }
+
+        int NeighborCore = m_map.Get(x, z).Core;
+
+        // The edge has the vertices of the coarser patch. When the LODs are equal
+        // both sides must pick the same value so they take the max.
+        if (NeighborCore > Core) {
+            Morph.SideLods[Side] = (float)NeighborCore;
+            Morph.SideMorphs[Side] = CalcMorphFactor(x, z, NeighborCore, CameraPos);
+        } else if (NeighborCore == Core) {
+            Morph.SideMorphs[Side] = std::max(Morph.CoreMorph, CalcMorphFactor(x, z, Core, CameraPos));
+        }
+    }
 }
 
 
@@ -139,24 +597,22 @@ void LodManager::PrintLodMap()
 }
 
 
-int LodManager::DistanceToLod(float Distance)
+const LodManager::PatchLod& LodManager::GetPatchLod(int PatchX, int PatchZ) const
 {
-    int Lod = m_maxLOD;
-
-    for (int i = 0 ; i <= m_maxLOD ; i++) {
-        if (Distance < m_regions[i]) {
-            Lod = i;
-            break;
-        }
-    }
-
-    return Lod;
+    return m_map.Get(PatchX, PatchZ);
 }
 
 
-const LodManager::PatchLod& LodManager::GetPatchLod(int PatchX, int PatchZ) const
+void LodManager::CalcReferenceLods(const Vector3f& CameraPos, std::vector<int>& Lods) const
 {
-    return m_map.Get(PatchX, PatchZ);
+    Lods.resize(m_numPatchesX * m_numPatchesZ);
+
+    for (int LodMapZ = 0 ; LodMapZ < m_numPatchesZ ; LodMapZ++) {
+        for (int LodMapX = 0 ; LodMapX < m_numPatchesX ; LodMapX++) {
+            float Distance = CalcPatchDistance(LodMapX, LodMapZ, CameraPos);
+            Lods[LodMapZ * m_numPatchesX + LodMapX] = SelectLod(LodMapX, LodMapZ, Distance, -1);
+        }
+    }
 }
 
 
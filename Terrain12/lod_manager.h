@@ -2,6 +2,8 @@
 #define LOD_REGIONS_H
 
 #include <vector>
+#include <queue>
+#include <algorithm>
 
 #include "ogldev_math_3d.h"
 #include "ogldev_array_2d.h"
@@ -11,8 +13,45 @@ class LodManager {
 
     int InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale);
 
+    // Must be called after InitLodManager for the screen space error mode
+    void CalcGeometricErrors(const Array2D<float>& HeightMap);
+
+    //
+    // The tables of CalcGeometricErrors from a previous run (see GeomipCache) - (MaxLOD + 1)
+    // errors per patch and the min and max height of every patch. Replaces CalcGeometricErrors.
+    //
+    void SetGeometricErrors(const float* pErrors, const float* pPatchHeights);
+
+    // Min and max height of every patch, in the layout of SetGeometricErrors
+    void GetPatchHeights(std::vector<float>& PatchHeights) const;
+
+    // Pick the coarsest LOD whose projected geometric error is below PixelTolerance
+    void SetScreenSpaceErrorMode(const PersProjInfo& ProjInfo, float PixelTolerance);
+
+    // The default mode - fixed distance regions
+    void SetDistanceMode();
+
+    //
+    // A patch leaves its LOD only after it is deeper than Fraction (of the threshold
+    // distance) beyond the threshold. This stops patches near a threshold from
+    // switching back and forth.
+    //
+    void SetHysteresis(float Fraction);
+
+    // Camera movements shorter than this are accumulated until the total is large enough
+    void SetMinCameraMove(float Distance) { m_minCameraMove = Distance; }
+
+    //
+    // Only the patches whose distance could have crossed a threshold since they were
+    // last evaluated are processed. Patches whose LOD or neighbor LODs changed are
+    // reported by GetDirtyPatches.
+    //
     void Update(const Vector3f& CameraPos);
 
+    // Patch indices (PatchZ * NumPatchesX + PatchX) that changed in the last call to Update
+    const std::vector<int>& GetDirtyPatches() const { return m_dirtyPatches; }
+
+    // The side values are the number of levels by which the neighbor is coarser (zero if it isn't)
     struct PatchLod {
         int Core   = 0;
         int Left   = 0;
@@ -23,15 +62,74 @@ class LodManager {
 
     const PatchLod& GetPatchLod(int PatchX, int PatchZ) const;
 
+    //
+    // Geomorphing. A patch blends its vertices towards the next coarser LOD over the last
+    // Fraction of the distance band of its LOD so that the switch itself doesn't change
+    // the surface. Zero disables the morphing.
+    //
+    void SetMorphRegion(float Fraction) { m_morphRegion = std::min(std::max(Fraction, 0.0f), 1.0f); }
+
+    float GetMorphRegion() const { return m_morphRegion; }
+
+    //
+    // Per patch input of terrain.vs. A vertex morphs only if the last LOD that has it
+    // matches the LOD of its slot - the core for the interior and the side for the
+    // vertices on the patch edges. The side values are shared with the neighbor so
+    // that both patches move their common vertices together.
+    //
+    struct PatchMorph {
+        float SideLods[4] = { 0.0f, 0.0f, 0.0f, 0.0f };       // left, right, top, bottom
+        float SideMorphs[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        float CoreLod = 0.0f;
+        float CoreMorph = 0.0f;
+    };
+
+    void CalcPatchMorph(int PatchX, int PatchZ, const Vector3f& CameraPos, PatchMorph& Morph) const;
+
+    // Height at (x, z) of the surface which is rendered at 'Lod' (height map coordinates)
+    static float CalcLodHeight(const Array2D<float>& HeightMap, int x, int z, int Lod);
+
+    // Selects the LOD of every patch from scratch (no hysteresis) without changing the state
+    void CalcReferenceLods(const Vector3f& CameraPos, std::vector<int>& Lods) const;
+
+    // The selection parameters, used by the GPU version of the LOD selection
+    bool IsScreenSpaceErrorMode() const { return m_useScreenSpaceError; }
+    const std::vector<int>& GetRegions() const { return m_regions; }
+    const std::vector<float>& GetGeometricErrors() const { return m_geometricErrors; }
+    float GetProjScale() const { return m_projScale; }
+    float GetPixelTolerance() const { return m_pixelTolerance; }
+    float GetHysteresis() const { return m_hysteresis; }
+
     void PrintLodMap();
 
  private:
     void CalcLodRegions();
     void CalcMaxLOD();
-    void UpdateLodMapPass1(const Vector3f& CameraPos);
-    void UpdateLodMapPass2(const Vector3f& CameraPos);
+    void FullUpdate(const Vector3f& CameraPos);
+    void IncrementalUpdate(const Vector3f& CameraPos);
+    void UpdateNeighborLods(const std::vector<int>& ChangedPatches);
+    bool UpdateNeighborLodsSinglePatch(int PatchX, int PatchZ);
+
+    float CalcPatchDistance(int PatchX, int PatchZ, const Vector3f& CameraPos) const;
+
+    // The distance from which the patch is allowed to use 'Lod'
+    float GetLodMinDistance(int PatchX, int PatchZ, int Lod) const;
+
+    int SelectLod(int PatchX, int PatchZ, float Distance, int CurLod) const;
+
+    // How far the patch can get closer or further away before its LOD must be reconsidered
+    float CalcSlack(int PatchX, int PatchZ, float Distance, int Lod) const;
+
+    void AddDirtyPatch(int Patch);
+
+    float CalcMorphFactor(int PatchX, int PatchZ, int Lod, const Vector3f& CameraPos) const;
+
+    float CalcPatchError(const Array2D<float>& HeightMap, int PatchX, int PatchZ, int Lod) const;
 
-    int DistanceToLod(float Distance);
+    float GetGeometricError(int PatchX, int PatchZ, int Lod) const
+    {
+        return m_geometricErrors[((size_t)PatchZ * m_numPatchesX + PatchX) * (m_maxLOD + 1) + Lod];
+    }
 
     int m_maxLOD = 0;
     int m_patchSize = 0;
@@ -41,6 +139,42 @@ class LodManager {
 
     Array2D<PatchLod> m_map;
     std::vector<int> m_regions;
+
+    struct PatchHeightRange {
+        float Min = 0.0f;
+        float Max = 0.0f;
+    };
+
+    bool m_useScreenSpaceError = false;
+    float m_pixelTolerance = 2.0f;
+    float m_projScale = 1.0f;                       // screen height / (2 * tan(FOV / 2))
+    std::vector<float> m_geometricErrors;           // (m_maxLOD + 1) values per patch
+    std::vector<PatchHeightRange> m_patchHeights;
+
+    //
+    // Camera distance is 1-Lipschitz in the camera position so a patch cannot cross a
+    // threshold before the camera travels at least the slack of that patch. Every patch
+    // has exactly one entry in the queue with the total travel at which it must be
+    // evaluated again.
+    //
+    struct RecheckEntry {
+        double Travel = 0.0;
+        int Patch = 0;
+
+        bool operator>(const RecheckEntry& e) const { return Travel > e.Travel; }
+    };
+
+    std::priority_queue<RecheckEntry, std::vector<RecheckEntry>, std::greater<RecheckEntry>> m_recheckQueue;
+    std::vector<RecheckEntry> m_recheckTemp;
+    double m_travel = 0.0;
+    Vector3f m_lastCameraPos;
+    bool m_needFullUpdate = true;
+    float m_hysteresis = 0.05f;
+    float m_minCameraMove = 1.0f;
+    float m_morphRegion = 0.3f;
+    std::vector<int> m_dirtyPatches;
+    std::vector<char> m_isDirty;
+    std::vector<int> m_changedTemp;
 };
 
 
@@ -0,0 +1,118 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+
+bool MappedFile::Open(const char* pFilename)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE File = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (File == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER FileSize;
+
+    if (!GetFileSizeEx(File, &FileSize) || (FileSize.QuadPart == 0)) {
+        CloseHandle(File);
+        return false;
+    }
+
+    HANDLE Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+    void* p = Mapping ? MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+
+    if (!p) {
+        if (Mapping) {
+            CloseHandle(Mapping);
+        }
+        CloseHandle(File);
+        return false;
+    }
+
+    m_file = File;
+    m_mapping = Mapping;
+    m_size = (size_t)FileSize.QuadPart;
+#else
+    int fd = open(pFilename, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // The mapping stays valid after the file is closed
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_size = (size_t)st.st_size;
+#endif
+
+    m_pData = (const u8*)p;
+
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (m_pData) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_pData);
+        CloseHandle((HANDLE)m_mapping);
+        CloseHandle((HANDLE)m_file);
+        m_mapping = NULL;
+        m_file = NULL;
+#else
+        munmap((void*)m_pData, m_size);
+#endif
+        m_pData = NULL;
+    }
+
+    m_size = 0;
+}
@@ -0,0 +1,63 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <stddef.h>
+
+#include "ogldev_types.h"
+
+//
+// Read only memory mapping of a whole file. The pages are loaded by the OS on first
+// access so opening a file costs the same regardless of its size.
+//
+class MappedFile {
+ public:
+    MappedFile() {}
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Returns false without printing anything if the file doesn't exist, is empty
+    // or cannot be mapped. The caller decides if that is an error.
+    bool Open(const char* pFilename);
+
+    void Close();
+
+    bool IsOpen() const { return m_pData != NULL; }
+
+    const u8* GetData() const { return m_pData; }
+
+    size_t GetSize() const { return m_size; }
+
+ private:
+
+    const u8* m_pData = NULL;
+    size_t m_size = 0;
+
+#ifdef _WIN32
+    void* m_file = NULL;
+    void* m_mapping = NULL;
+#endif
+};
+
+#endif
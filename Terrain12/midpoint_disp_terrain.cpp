@@ -16,9 +16,18 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <string.h>
+
+#include "ogldev_parallel.h"
+#include "ogldev_simd.h"
+#include "ogldev_hash_random.h"
 #include "midpoint_disp_terrain.h"
 
-void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchSize, float Roughness, float MinHeight, float MaxHeight)
+// Don't bother spreading a pass over threads if it has fewer points than this
+#define MIN_POINTS_PER_THREAD 16384
+
+
+void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchSize, float Roughness, float MinHeight, float MaxHeight, uint Seed)
 {
     if (Roughness < 0.0f) {
         printf("%s: roughness must be positive - %f\n", __FUNCTION__, Roughness);
@@ -32,7 +41,11 @@ void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchS
 
     m_heightMap.InitArray2D(TerrainSize, TerrainSize, 0.0f);
 
-    CreateMidpointDisplacementF32(Roughness);
+    long long StartTime = GetCurrentTimeMillis();
+
+    CreateMidpointDisplacementF32(Roughness, Seed);
+
+    printf("Midpoint displacement %dx%d (seed %u): %lld ms\n", TerrainSize, TerrainSize, Seed, GetCurrentTimeMillis() - StartTime);
 
     m_heightMap.Normalize(MinHeight, MaxHeight);
 
@@ -40,93 +53,201 @@ void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchS
 }
 
 
-void MidpointDispTerrain::CreateMidpointDisplacementF32(float Roughness)
+//
+// Every point is written exactly once and its random displacement is a hash of
+// (seed, level, x, y). Within a pass the points only read values from the previous
+// passes so the rows of a pass can be processed in any order and on any number of
+// threads with bit identical results.
+//
+void MidpointDispTerrain::CreateMidpointDisplacementF32(float Roughness, uint Seed)
 {
-    int RectSize = CalcNextPowerOfTwo(m_terrainSize);
+    // The algorithm needs a grid of 2^n + 1 points. If the terrain size doesn't
+    // match we generate the next size up and crop it.
+    int GridSize = CalcNextPowerOfTwo(m_terrainSize - 1) + 1;
+
+    Array2D<float> TempGrid;
+    Array2D<float>* pGrid = &m_heightMap;
+
+    if (GridSize != m_terrainSize) {
+        TempGrid.InitArray2D(GridSize, GridSize, 0.0f);
+        pGrid = &TempGrid;
+    }
+
+    int RectSize = GridSize - 1;
     float CurHeight = (float)RectSize / 2.0f;
-    float HeightReduce = pow(2.0f, -Roughness);
+    float HeightReduce = powf(2.0f, -Roughness);
+    int Level = 0;
 
-    while (RectSize > 0) {
+    while (RectSize > 1) {
 
-        DiamondStep(RectSize, CurHeight);
+        DiamondStep(*pGrid, GridSize, RectSize, CurHeight, Seed, Level);
 
-        SquareStep(RectSize, CurHeight);
+        SquareStep(*pGrid, GridSize, RectSize, CurHeight, Seed, Level);
 
         RectSize /= 2;
         CurHeight *= HeightReduce;
+        Level++;
+    }
+
+    if (pGrid != &m_heightMap) {
+        for (int z = 0 ; z < m_terrainSize ; z++) {
+            memcpy(m_heightMap.GetRow(z), TempGrid.GetRow(z), m_terrainSize * sizeof(float));
+        }
     }
 }
 
 
-void MidpointDispTerrain::DiamondStep(int RectSize, float CurHeight)
+//
+// The center of each rectangle gets the average of its four corners plus a random value
+//
+void MidpointDispTerrain::DiamondStep(Array2D<float>& Grid, int GridSize, int RectSize, float CurHeight, uint Seed, int Level)
 {
     int HalfRectSize = RectSize / 2;
+    int NumRects = (GridSize - 1) / RectSize;
+    int MinRowsPerThread = std::max(1, MIN_POINTS_PER_THREAD / NumRects);
 
-    for (int y = 0 ; y < m_terrainSize ; y += RectSize) {
-        for (int x = 0 ; x < m_terrainSize ; x += RectSize) {
-            int next_x = (x + RectSize) % m_terrainSize;
-            int next_y = (y + RectSize) % m_terrainSize;
+    ParallelFor(0, NumRects, [&](int StartRect, int EndRect) {
+        for (int RectZ = StartRect ; RectZ < EndRect ; RectZ++) {
+            int y = RectZ * RectSize + HalfRectSize;
+            const float* pTop = Grid.GetRow(y - HalfRectSize);
+            const float* pBottom = Grid.GetRow(y + HalfRectSize);
+            float* pMid = Grid.GetRow(y);
 
-            if (next_x < x) {
-                next_x = m_terrainSize - 1;
-            }
+            int RectX = 0;
+
+#ifdef OGLDEV_SSE2
+            __m128 CurHeight4 = _mm_set1_ps(CurHeight);
+            __m128 Quarter4 = _mm_set1_ps(0.25f);
+
+            for ( ; RectX + 4 <= NumRects ; RectX += 4) {
+                const float* t = pTop + RectX * RectSize;
+                const float* b = pBottom + RectX * RectSize;
+                int s = RectSize;
+
+                __m128 TopLeft     = _mm_setr_ps(t[0], t[s], t[2 * s], t[3 * s]);
+                __m128 TopRight    = _mm_setr_ps(t[s], t[2 * s], t[3 * s], t[4 * s]);
+                __m128 BottomLeft  = _mm_setr_ps(b[0], b[s], b[2 * s], b[3 * s]);
+                __m128 BottomRight = _mm_setr_ps(b[s], b[2 * s], b[3 * s], b[4 * s]);
 
-            if (next_y < y) {
-                next_y = m_terrainSize - 1;
+                __m128 MidPoint = _mm_mul_ps(_mm_add_ps(_mm_add_ps(TopLeft, TopRight), _mm_add_ps(BottomLeft, BottomRight)), Quarter4);
+
+                int x = RectX * RectSize + HalfRectSize;
+                __m128i X = _mm_setr_epi32(x, x + s, x + 2 * s, x + 3 * s);
+                __m128 RandValue = _mm_mul_ps(HashToFloatSigned_SSE2(HashCoords_SSE2(Seed, Level, X, y)), CurHeight4);
+
+                float Result[4];
+                _mm_storeu_ps(Result, _mm_add_ps(MidPoint, RandValue));
+
+                for (int i = 0 ; i < 4 ; i++) {
+                    pMid[x + i * s] = Result[i];
+                }
             }
+#endif
 
-            float TopLeft     = m_heightMap.Get(x, y);
-            float TopRight    = m_heightMap.Get(next_x, y);
-            float BottomLeft  = m_heightMap.Get(x, next_y);
-            float BottomRight = m_heightMap.Get(next_x, next_y);
+            for ( ; RectX < NumRects ; RectX++) {
+                int x0 = RectX * RectSize;
+                int x1 = x0 + RectSize;
 
-            int mid_x = (x + HalfRectSize) % m_terrainSize;
-            int mid_y = (y + HalfRectSize) % m_terrainSize;
+                float MidPoint = ((pTop[x0] + pTop[x1]) + (pBottom[x0] + pBottom[x1])) * 0.25f;
 
-            float RandValue = RandomFloatRange(CurHeight, -CurHeight);
-            float MidPoint = (TopLeft + TopRight + BottomLeft + BottomRight) / 4.0f;
+                int x = x0 + HalfRectSize;
+                float RandValue = HashToFloatSigned(HashCoords(Seed, Level, x, y)) * CurHeight;
 
-            m_heightMap.Set(mid_x, mid_y, MidPoint + RandValue);
+                pMid[x] = MidPoint + RandValue;
+            }
         }
-    }
+    }, MinRowsPerThread);
 }
 
 
-void MidpointDispTerrain::SquareStep(int RectSize, float CurHeight)
+//
+// The points between the corners get the average of their four neighbors (the two
+// corners and the two centers from the diamond step) plus a random value. Points on
+// the edges of the grid only have three neighbors.
+//
+void MidpointDispTerrain::SquareStep(Array2D<float>& Grid, int GridSize, int RectSize, float CurHeight, uint Seed, int Level)
 {
     int HalfRectSize = RectSize / 2;
-
-    for (int y = 0 ; y < m_terrainSize ; y += RectSize) {
-        for (int x = 0 ; x < m_terrainSize ; x += RectSize) {
-            int next_x = (x + RectSize) % m_terrainSize;
-            int next_y = (y + RectSize) % m_terrainSize;
-
-            if (next_x < x) {
-                next_x = m_terrainSize - 1;
+    int LastPos = GridSize - 1;
+    int NumRows = LastPos / HalfRectSize + 1;
+    int MinRowsPerThread = std::max(1, MIN_POINTS_PER_THREAD / NumRows);
+
+    ParallelFor(0, NumRows, [&](int StartRow, int EndRow) {
+        for (int Row = StartRow ; Row < EndRow ; Row++) {
+            int y = Row * HalfRectSize;
+
+            // Rows of corners have the new points between the corners. Rows
+            // of centers have the new points right below/above the corners.
+            int StartX = (Row % 2 == 0) ? HalfRectSize : 0;
+
+            float* pRow = Grid.GetRow(y);
+            const float* pPrev = (y > 0) ? Grid.GetRow(y - HalfRectSize) : NULL;
+            const float* pNext = (y < LastPos) ? Grid.GetRow(y + HalfRectSize) : NULL;
+
+            int x = StartX;
+
+            auto EdgePoint = [&](int EdgeX) {
+                float Sum = 0.0f;
+                int Count = 0;
+
+                if (EdgeX > 0)       { Sum += pRow[EdgeX - HalfRectSize]; Count++; }
+                if (EdgeX < LastPos) { Sum += pRow[EdgeX + HalfRectSize]; Count++; }
+                if (pPrev)           { Sum += pPrev[EdgeX]; Count++; }
+                if (pNext)           { Sum += pNext[EdgeX]; Count++; }
+
+                float RandValue = HashToFloatSigned(HashCoords(Seed, Level, EdgeX, y)) * CurHeight;
+                pRow[EdgeX] = Sum / (float)Count + RandValue;
+            };
+
+            if (!pPrev || !pNext) {
+                for ( ; x <= LastPos ; x += RectSize) {
+                    EdgePoint(x);
+                }
+                continue;
             }
 
-            if (next_y < y) {
-                next_y = m_terrainSize - 1;
+            if (x == 0) {
+                EdgePoint(x);
+                x += RectSize;
             }
 
-            int mid_x = (x + HalfRectSize) % m_terrainSize;
-            int mid_y = (y + HalfRectSize) % m_terrainSize;
-              
-            int prev_mid_x = (x - HalfRectSize + m_terrainSize) % m_terrainSize;
-            int prev_mid_y = (y - HalfRectSize + m_terrainSize) % m_terrainSize;
+            int EndX = LastPos - HalfRectSize;    // last point with a right neighbor
+
+#ifdef OGLDEV_SSE2
+            __m128 CurHeight4 = _mm_set1_ps(CurHeight);
+            __m128 Quarter4 = _mm_set1_ps(0.25f);
+            int s = RectSize;
+            int h = HalfRectSize;
 
-            float CurTopLeft  = m_heightMap.Get(x, y);
-            float CurTopRight = m_heightMap.Get(next_x, y);
-            float CurCenter   = m_heightMap.Get(mid_x, mid_y);
-            float PrevYCenter = m_heightMap.Get(mid_x, prev_mid_y);
-            float CurBotLeft  = m_heightMap.Get(x, next_y);
-            float PrevXCenter = m_heightMap.Get(prev_mid_x, mid_y);
+            for ( ; x + 3 * s <= EndX ; x += 4 * s) {
+                __m128 Left  = _mm_setr_ps(pRow[x - h], pRow[x + s - h], pRow[x + 2 * s - h], pRow[x + 3 * s - h]);
+                __m128 Right = _mm_setr_ps(pRow[x + h], pRow[x + s + h], pRow[x + 2 * s + h], pRow[x + 3 * s + h]);
+                __m128 Up    = _mm_setr_ps(pPrev[x], pPrev[x + s], pPrev[x + 2 * s], pPrev[x + 3 * s]);
+                __m128 Down  = _mm_setr_ps(pNext[x], pNext[x + s], pNext[x + 2 * s], pNext[x + 3 * s]);
 
-            float CurLeftMid = (CurTopLeft + CurCenter + CurBotLeft + PrevXCenter) / 4.0f + RandomFloatRange(-CurHeight, CurHeight);
-            float CurTopMid  = (CurTopLeft + CurCenter + CurTopRight + PrevYCenter) / 4.0f + RandomFloatRange(-CurHeight, CurHeight);
+                __m128 Avg = _mm_mul_ps(_mm_add_ps(_mm_add_ps(Left, Right), _mm_add_ps(Up, Down)), Quarter4);
 
-            m_heightMap.Set(mid_x, y, CurTopMid);
-            m_heightMap.Set(x, mid_y, CurLeftMid);
+                __m128i X = _mm_setr_epi32(x, x + s, x + 2 * s, x + 3 * s);
+                __m128 RandValue = _mm_mul_ps(HashToFloatSigned_SSE2(HashCoords_SSE2(Seed, Level, X, y)), CurHeight4);
+
+                float Result[4];
+                _mm_storeu_ps(Result, _mm_add_ps(Avg, RandValue));
+
+                for (int i = 0 ; i < 4 ; i++) {
+                    pRow[x + i * s] = Result[i];
+                }
+            }
+#endif
+
+            for ( ; x <= EndX ; x += RectSize) {
+                float Avg = ((pRow[x - HalfRectSize] + pRow[x + HalfRectSize]) + (pPrev[x] + pNext[x])) * 0.25f;
+                float RandValue = HashToFloatSigned(HashCoords(Seed, Level, x, y)) * CurHeight;
+                pRow[x] = Avg + RandValue;
+            }
+
+            if (x == LastPos) {
+                EdgePoint(x);
+            }
         }
-    }
+    }, MinRowsPerThread);
 }
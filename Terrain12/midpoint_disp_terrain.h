@@ -27,12 +27,13 @@ class MidpointDispTerrain : public BaseTerrain {
  public:
     MidpointDispTerrain() {}
 
-    void CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight);
+    // The same seed always generates the same terrain, regardless of the number of threads
+    void CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight, uint Seed);
 
  private:
-    void CreateMidpointDisplacementF32(float Roughness);
-    void DiamondStep(int RectSize, float CurHeight);
-    void SquareStep(int RectSize, float CurHeight);
+    void CreateMidpointDisplacementF32(float Roughness, uint Seed);
+    void DiamondStep(Array2D<float>& Grid, int GridSize, int RectSize, float CurHeight, uint Seed, int Level);
+    void SquareStep(Array2D<float>& Grid, int GridSize, int RectSize, float CurHeight, uint Seed, int Level);
 };
 
 #endif
@@ -0,0 +1,272 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+
+#include "ogldev_math_3d.h"
+#include "patch_index_cache.h"
+
+#define LEFT   0
+#define RIGHT  1
+#define TOP    2
+#define BOTTOM 3
+
+
+PatchIndexCache::~PatchIndexCache()
+{
+    Destroy();
+}
+
+
+void PatchIndexCache::Destroy()
+{
+    if (m_ib > 0) {
+        glDeleteBuffers(1, &m_ib);
+        m_ib = 0;
+    }
+
+    m_ranges.clear();
+    m_indices.clear();
+    m_capacity = 0;
+    m_numUploaded = 0;
+}
+
+
+const PatchIndexCache::IndexRange& PatchIndexCache::GetIndices(int PatchSize, int LodCore, int LodLeft, int LodRight, int LodTop, int LodBottom)
+{
+    LodLeft   = std::max(LodLeft, LodCore);
+    LodRight  = std::max(LodRight, LodCore);
+    LodTop    = std::max(LodTop, LodCore);
+    LodBottom = std::max(LodBottom, LodCore);
+
+    uint64_t Key = ((uint64_t)PatchSize << 40) | ((uint64_t)LodCore << 32) |
+                   ((uint64_t)LodLeft << 24) | ((uint64_t)LodRight << 16) | ((uint64_t)LodTop << 8) | (uint64_t)LodBottom;
+
+    std::unordered_map<uint64_t, IndexRange>::iterator it = m_ranges.find(Key);
+
+    if (it != m_ranges.end()) {
+        return it->second;
+    }
+
+    IndexRange Range;
+    Range.Start = (int)m_indices.size();
+    BuildIndices(PatchSize, LodCore, LodLeft, LodRight, LodTop, LodBottom, m_indices);
+    Range.Count = (int)m_indices.size() - Range.Start;
+
+    return m_ranges[Key] = Range;
+}
+
+
+void PatchIndexCache::GetIndexSets(std::vector<uint64_t>& Keys, std::vector<IndexRange>& Ranges) const
+{
+    Keys.clear();
+    Ranges.clear();
+
+    for (const std::pair<const uint64_t, IndexRange>& p : m_ranges) {
+        Keys.push_back(p.first);
+        Ranges.push_back(p.second);
+    }
+}
+
+
+void PatchIndexCache::LoadIndexSets(const uint64_t* pKeys, const IndexRange* pRanges, int NumSets, const u16* pIndices, int NumIndices)
+{
+    m_ranges.clear();
+    m_ranges.reserve(NumSets);
+
+    for (int i = 0 ; i < NumSets ; i++) {
+        m_ranges[pKeys[i]] = pRanges[i];
+    }
+
+    m_indices.assign(pIndices, pIndices + NumIndices);
+    m_numUploaded = 0;
+
+    UpdateIndexBuffer();
+}
+
+
+GLuint PatchIndexCache::GetIndexBuffer()
+{
+    if (m_ib == 0) {
+        glGenBuffers(1, &m_ib);
+    }
+
+    return m_ib;
+}
+
+
+void PatchIndexCache::UpdateIndexBuffer()
+{
+    if (m_numUploaded == m_indices.size()) {
+        return;
+    }
+
+    // The copy target is not part of the VAO state so this doesn't disturb the current VAO
+    glBindBuffer(GL_COPY_WRITE_BUFFER, GetIndexBuffer());
+
+    if (m_indices.size() > m_capacity) {
+        m_capacity = std::max(m_indices.size(), m_capacity * 2);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_capacity * sizeof(u16), NULL, GL_STATIC_DRAW);
+        m_numUploaded = 0;
+    }
+
+    glBufferSubData(GL_COPY_WRITE_BUFFER, m_numUploaded * sizeof(u16),
+                    (m_indices.size() - m_numUploaded) * sizeof(u16), &m_indices[m_numUploaded]);
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+    m_numUploaded = m_indices.size();
+}
+
+
+//
+// The patch is made of blocks of 2*Step x 2*Step quads (Step = 2^LodCore) and every block
+// is a fan of eight triangles around its center, two for each side of the block.
+//
+// A patch side whose neighbor is coarser uses the neighbor's vertices only, at multiples
+// of SideStep = 2^SideLod. The two triangles of every block side that lies on that patch
+// side are removed and so are the triangles that touch the patch side at a point that
+// the neighbor doesn't have. What is left uncovered is a strip of width Step along the
+// patch side. For every segment [c0, c1] of the neighbor it is a trapezoid whose inner
+// edge runs through the block centers and the midpoints between them. It is covered by
+// a fan from c0 over the first half of the inner edge, a fan from c1 over the second half
+// and a triangle between c0, c1 and the middle of the inner edge. This works for any
+// difference between the LODs and reproduces the single triangle of the classic
+// stitching when the difference is one.
+//
+void PatchIndexCache::BuildIndices(int PatchSize, int LodCore, int LodLeft, int LodRight, int LodTop, int LodBottom,
+                                   std::vector<u16>& Indices)
+{
+    if (PatchSize * PatchSize > 65536) {
+        printf("%s:%d - patch size %d is too large for 16 bit indices\n", __FILE__, __LINE__, PatchSize);
+        exit(0);
+    }
+
+    int Last = PatchSize - 1;
+    int Step = powi(2, LodCore);
+    int BlockSize = Step * 2;
+
+    int SideLods[4];
+    SideLods[LEFT]   = LodLeft;
+    SideLods[RIGHT]  = LodRight;
+    SideLods[TOP]    = LodTop;
+    SideLods[BOTTOM] = LodBottom;
+
+    bool Stitched[4];
+    int SideSteps[4];
+
+    for (int Side = 0 ; Side < 4 ; Side++) {
+        Stitched[Side] = SideLods[Side] > LodCore;
+        SideSteps[Side] = powi(2, SideLods[Side]);
+    }
+
+    // True for a point on a stitched patch side which the coarser neighbor doesn't have
+    auto IsHangingPoint = [&](int x, int z) {
+        return (Stitched[LEFT]   && (x == 0)    && (z % SideSteps[LEFT] != 0)) ||
+               (Stitched[RIGHT]  && (x == Last) && (z % SideSteps[RIGHT] != 0)) ||
+               (Stitched[BOTTOM] && (z == 0)    && (x % SideSteps[BOTTOM] != 0)) ||
+               (Stitched[TOP]    && (z == Last) && (x % SideSteps[TOP] != 0));
+    };
+
+    // All the triangles are emitted with the same winding as the original fans
+    auto AddTriangle = [&](int x0, int z0, int x1, int z1, int x2, int z2) {
+        int Cross = (x1 - x0) * (z2 - z0) - (z1 - z0) * (x2 - x0);
+
+        if (Cross > 0) {
+            std::swap(x1, x2);
+            std::swap(z1, z2);
+        }
+
+        Indices.push_back((u16)(z0 * PatchSize + x0));
+        Indices.push_back((u16)(z1 * PatchSize + x1));
+        Indices.push_back((u16)(z2 * PatchSize + x2));
+    };
+
+    // Fan triangle from the center to an edge segment of the block
+    auto AddFanTriangle = [&](int cx, int cz, int x1, int z1, int x2, int z2) {
+        if (!IsHangingPoint(x1, z1) && !IsHangingPoint(x2, z2)) {
+            AddTriangle(cx, cz, x1, z1, x2, z2);
+        }
+    };
+
+    for (int z = 0 ; z < Last ; z += BlockSize) {
+        for (int x = 0 ; x < Last ; x += BlockSize) {
+            int cx = x + Step;
+            int cz = z + Step;
+
+            if (!((x == 0) && Stitched[LEFT])) {
+                AddFanTriangle(cx, cz, x, z, x, z + Step);
+                AddFanTriangle(cx, cz, x, z + Step, x, z + BlockSize);
+            }
+
+            if (!((z + BlockSize == Last) && Stitched[TOP])) {
+                AddFanTriangle(cx, cz, x, z + BlockSize, x + Step, z + BlockSize);
+                AddFanTriangle(cx, cz, x + Step, z + BlockSize, x + BlockSize, z + BlockSize);
+            }
+
+            if (!((x + BlockSize == Last) && Stitched[RIGHT])) {
+                AddFanTriangle(cx, cz, x + BlockSize, z + BlockSize, x + BlockSize, z + Step);
+                AddFanTriangle(cx, cz, x + BlockSize, z + Step, x + BlockSize, z);
+            }
+
+            if (!((z == 0) && Stitched[BOTTOM])) {
+                AddFanTriangle(cx, cz, x + BlockSize, z, x + Step, z);
+                AddFanTriangle(cx, cz, x + Step, z, x, z);
+            }
+        }
+    }
+
+    for (int Side = 0 ; Side < 4 ; Side++) {
+        if (!Stitched[Side]) {
+            continue;
+        }
+
+        // 't' runs along the patch side and 'd' is the distance from it into the patch
+        auto ToX = [&](int t, int d) {
+            return (Side == LEFT) ? d : ((Side == RIGHT) ? Last - d : t);
+        };
+
+        auto ToZ = [&](int t, int d) {
+            return (Side == BOTTOM) ? d : ((Side == TOP) ? Last - d : t);
+        };
+
+        auto AddSideTriangle = [&](int t0, int d0, int t1, int d1, int t2, int d2) {
+            AddTriangle(ToX(t0, d0), ToZ(t0, d0), ToX(t1, d1), ToZ(t1, d1), ToX(t2, d2), ToZ(t2, d2));
+        };
+
+        int SideStep = SideSteps[Side];
+
+        for (int c0 = 0 ; c0 < Last ; c0 += SideStep) {
+            int c1 = c0 + SideStep;
+            int Mid = c0 + SideStep / 2;
+
+            for (int t = c0 + Step ; t < Mid ; t += Step) {
+                AddSideTriangle(c0, 0, t, Step, t + Step, Step);
+            }
+
+            AddSideTriangle(c0, 0, Mid, Step, c1, 0);
+
+            for (int t = Mid ; t < c1 - Step ; t += Step) {
+                AddSideTriangle(c1, 0, t, Step, t + Step, Step);
+            }
+        }
+    }
+}
@@ -0,0 +1,85 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PATCH_INDEX_CACHE_H
+#define PATCH_INDEX_CACHE_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <unordered_map>
+
+#include "ogldev_types.h"
+
+//
+// Index sets of a single patch. The indices are local to the patch (z * PatchSize + x)
+// so they fit in 16 bits and every patch reuses them through the base vertex of the
+// draw call. A set is built the first time a combination of patch size, core LOD and
+// side LODs is requested and all the sets share a single index buffer.
+//
+class PatchIndexCache {
+ public:
+    PatchIndexCache() {}
+
+    ~PatchIndexCache();
+
+    void Destroy();
+
+    struct IndexRange {
+        int Start = 0;     // in indices
+        int Count = 0;
+    };
+
+    //
+    // The side LODs are the LODs of the neighbors (the patch edges are stitched to them).
+    // A side LOD which is finer than the core LOD is treated as equal to it because
+    // the finer patch is the one that does the stitching.
+    //
+    const IndexRange& GetIndices(int PatchSize, int LodCore, int LodLeft, int LodRight, int LodTop, int LodBottom);
+
+    const u16* GetIndexData(const IndexRange& Range) const { return &m_indices[Range.Start]; }
+
+    // Created on first use
+    GLuint GetIndexBuffer();
+
+    // Uploads the index sets that were added since the last call
+    void UpdateIndexBuffer();
+
+    int GetNumIndexSets() const { return (int)m_ranges.size(); }
+
+    // Every set that was built so far, to be saved by the geometry cache (see GeomipCache)
+    void GetIndexSets(std::vector<uint64_t>& Keys, std::vector<IndexRange>& Ranges) const;
+
+    const std::vector<u16>& GetAllIndices() const { return m_indices; }
+
+    // Replaces the sets with the output of GetIndexSets and GetAllIndices and uploads them
+    void LoadIndexSets(const uint64_t* pKeys, const IndexRange* pRanges, int NumSets, const u16* pIndices, int NumIndices);
+
+    static void BuildIndices(int PatchSize, int LodCore, int LodLeft, int LodRight, int LodTop, int LodBottom,
+                             std::vector<u16>& Indices);
+
+ private:
+
+    std::unordered_map<uint64_t, IndexRange> m_ranges;
+    std::vector<u16> m_indices;
+    GLuint m_ib = 0;
+    size_t m_capacity = 0;       // in indices
+    size_t m_numUploaded = 0;
+};
+
+#endif
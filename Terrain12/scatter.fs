@@ -0,0 +1,89 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#version 430
+
+layout(location = 0) out vec4 FragColor;
+
+in vec3 Color;
+in vec3 Normal;
+in vec2 Tex;
+flat in int Layer;
+
+uniform bool gBillboard;
+uniform int gShapes[8];                         // SCATTER_MESH of the layer
+uniform vec3 gLayerColors[8];
+uniform vec3 gReversedLightDir;
+
+
+//
+// Silhouette and colors of the meshes of TerrainScatter on the billboard quad. x is the
+// distance from the center line in units of the half width and y is the height in units
+// of the height of the mesh.
+//
+vec3 CalcBillboardColor(int Shape)
+{
+    float x = abs(Tex.x - 0.5) * 2.0;
+    float y = Tex.y;
+
+    if (Shape == 0) {
+        // See CreateGrassMesh
+        float Blade = abs(fract(Tex.x * 3.0) - 0.5) * 2.0;
+
+        if (Blade > 1.0 - y) {
+            discard;
+        }
+
+        return mix(vec3(0.15, 0.35, 0.08), vec3(0.45, 0.65, 0.2), y);
+    } else if (Shape == 1) {
+        // See CreateRockMesh
+        float dy = (y * 0.9 - 0.4) / 0.5;
+
+        if (x * x + dy * dy > 1.0) {
+            discard;
+        }
+
+        return vec3(0.45, 0.43, 0.4);
+    } else {
+        // See CreateTreeMesh
+        if (y < 0.25) {
+            if (x > 0.04 / 0.3) {
+                discard;
+            }
+
+            return vec3(0.35, 0.22, 0.1);
+        }
+
+        if (x > (1.0 - y) / 0.75) {
+            discard;
+        }
+
+        return mix(vec3(0.1, 0.35, 0.1), vec3(0.2, 0.5, 0.15), (y - 0.25) / 0.75);
+    }
+}
+
+
+void main()
+{
+    vec3 Color_ = gBillboard ? CalcBillboardColor(gShapes[Layer]) * gLayerColors[Layer] : Color;
+
+    float Diffuse = dot(normalize(Normal), gReversedLightDir);
+
+    Diffuse = max(0.3f, Diffuse);
+
+    FragColor = vec4(Color_ * Diffuse, 1.0);
+}
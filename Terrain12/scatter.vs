@@ -0,0 +1,66 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#version 430
+
+layout (location = 0) in vec3 Position;
+layout (location = 1) in vec3 InNormal;
+layout (location = 2) in vec3 InColor;
+layout (location = 3) in vec4 InPosScale;       // per instance - position on the ground, height
+layout (location = 4) in vec4 InParams;         // per instance - cos and sin of the rotation, layer
+
+uniform mat4 gVP;
+uniform vec3 gCameraPos;
+uniform bool gBillboard;
+uniform vec3 gLayerColors[8];                   // see SCATTER_MAX_LAYERS
+uniform vec2 gBillboardSizes[8];                // width and height at scale one
+
+out vec3 Color;
+out vec3 Normal;
+out vec2 Tex;
+flat out int Layer;
+
+void main()
+{
+    Layer = int(InParams.z);
+    float Scale = InPosScale.w;
+    vec3 WorldPos;
+
+    if (gBillboard) {
+        // The quad is [-0.5, 0.5] x [0, 1] in the XY plane and turns around the Y axis only
+        vec3 ToCamera = gCameraPos - InPosScale.xyz;
+        vec3 Right = vec3(ToCamera.z, 0.0, -ToCamera.x);
+        float Length = length(Right);
+        Right = (Length > 0.0001) ? Right / Length : vec3(1.0, 0.0, 0.0);
+
+        vec2 Size = gBillboardSizes[Layer] * Scale;
+        WorldPos = InPosScale.xyz + Right * (Position.x * Size.x) + vec3(0.0, Position.y * Size.y, 0.0);
+        Normal = vec3(0.0, 1.0, 0.0);
+        Tex = vec2(Position.x + 0.5, Position.y);
+    } else {
+        float c = InParams.x;
+        float s = InParams.y;
+        vec3 p = Position * Scale;
+        WorldPos = InPosScale.xyz + vec3(p.x * c - p.z * s, p.y, p.x * s + p.z * c);
+        Normal = vec3(InNormal.x * c - InNormal.z * s, InNormal.y, InNormal.x * s + InNormal.z * c);
+        Tex = vec2(0.0);
+    }
+
+    Color = InColor * gLayerColors[Layer];
+
+    gl_Position = gVP * vec4(WorldPos, 1.0);
+}
@@ -0,0 +1,145 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// Culling and LOD selection of the instances of TerrainScatter. Pass 0 runs a workgroup
+// per piece (a range of up to 64 instances of a single layer in a visible tile). Every
+// instance is tested against the frustum and the max distance of its layer and appended
+// to the region of the mesh or the billboard draw command of its layer. The workgroup
+// counts its instances in shared memory first so each command takes one global atomic
+// per workgroup. Pass 1 is a single workgroup that clamps the instance counts to the
+// capacity of the regions.
+//
+
+#version 430
+
+layout (local_size_x = 64) in;
+
+#define MAX_LAYERS 8            // see SCATTER_MAX_LAYERS
+#define MAX_COMMANDS 16
+
+struct DrawElementsIndirectCommand {
+    uint Count;
+    uint InstanceCount;
+    uint FirstIndex;
+    int BaseVertex;
+    uint BaseInstance;
+};
+
+// See TerrainScatter::Instance
+struct Instance {
+    vec4 PosScale;
+    vec4 Params;
+};
+
+layout (std430, binding = 0) readonly buffer Instances { Instance gInstances[]; };
+layout (std430, binding = 1) readonly buffer Pieces { uvec2 gPieces[]; };                // first instance, count
+layout (std430, binding = 2) writeonly buffer VisibleInstances { Instance gVisible[]; };
+layout (std430, binding = 3) buffer DrawCommands { DrawElementsIndirectCommand gCommands[]; };
+
+uniform int gPass;
+uniform vec3 gCameraPos;
+uniform vec4 gFrustumPlanes[6];             // normalized, the inside is where the dot product is non-negative
+uniform int gNumPieces;
+uniform int gNumLayers;
+uniform vec4 gLayerBounds[MAX_LAYERS];      // sphere center height and radius at scale one, billboard distance, max distance
+uniform uint gCapacities[MAX_COMMANDS];
+
+shared uint LocalCounts[MAX_COMMANDS];
+shared uint LocalBases[MAX_COMMANDS];
+
+
+bool IsSphereInsideViewFrustum(vec3 Center, float Radius)
+{
+    for (int i = 0 ; i < 6 ; i++) {
+        if (dot(gFrustumPlanes[i], vec4(Center, 1.0)) < -Radius) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+void CullInstances()
+{
+    uint Piece = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+    uint Local = gl_LocalInvocationIndex;
+    uint NumCommands = uint(gNumLayers * 2);
+
+    if (Local < NumCommands) {
+        LocalCounts[Local] = 0u;
+    }
+
+    barrier();
+
+    int Command = -1;
+    uint Slot = 0;
+    Instance Inst;
+
+    if ((Piece < uint(gNumPieces)) && (Local < gPieces[Piece].y)) {
+        Inst = gInstances[gPieces[Piece].x + Local];
+
+        int Layer = int(Inst.Params.z);
+        vec4 Bounds = gLayerBounds[Layer];
+        float Scale = Inst.PosScale.w;
+        vec3 Center = Inst.PosScale.xyz + vec3(0.0, Bounds.x * Scale, 0.0);
+        float Distance = distance(Center, gCameraPos);
+
+        if ((Distance < Bounds.w) && IsSphereInsideViewFrustum(Center, Bounds.y * Scale)) {
+            Command = (Distance < Bounds.z) ? Layer : gNumLayers + Layer;
+            Slot = atomicAdd(LocalCounts[Command], 1u);
+        }
+    }
+
+    barrier();
+
+    if ((Local < NumCommands) && (LocalCounts[Local] > 0)) {
+        LocalBases[Local] = atomicAdd(gCommands[Local].InstanceCount, LocalCounts[Local]);
+    }
+
+    barrier();
+
+    if (Command >= 0) {
+        uint Index = LocalBases[Command] + Slot;
+
+        // The region is full. Pass 1 takes the extra instances out of the count.
+        if (Index < gCapacities[Command]) {
+            gVisible[gCommands[Command].BaseInstance + Index] = Inst;
+        }
+    }
+}
+
+
+void ClampInstanceCounts()
+{
+    uint c = gl_LocalInvocationIndex;
+
+    if (c < uint(gNumLayers * 2)) {
+        gCommands[c].InstanceCount = min(gCommands[c].InstanceCount, gCapacities[c]);
+    }
+}
+
+
+void main()
+{
+    if (gPass == 0) {
+        CullInstances();
+    } else {
+        ClampInstanceCounts();
+    }
+}
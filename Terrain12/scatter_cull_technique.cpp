@@ -0,0 +1,108 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ogldev_util.h"
+#include "scatter_cull_technique.h"
+
+
+ScatterCullTechnique::ScatterCullTechnique()
+{
+}
+
+bool ScatterCullTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_COMPUTE_SHADER, "scatter_cull.cs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_passLoc = GetUniformLocation("gPass");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_frustumPlanesLoc = GetUniformLocation("gFrustumPlanes");
+    m_numPiecesLoc = GetUniformLocation("gNumPieces");
+    m_numLayersLoc = GetUniformLocation("gNumLayers");
+    m_layerBoundsLoc = GetUniformLocation("gLayerBounds");
+    m_capacitiesLoc = GetUniformLocation("gCapacities");
+
+    if (m_passLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_frustumPlanesLoc == INVALID_UNIFORM_LOCATION ||
+        m_numPiecesLoc == INVALID_UNIFORM_LOCATION ||
+        m_numLayersLoc == INVALID_UNIFORM_LOCATION ||
+        m_layerBoundsLoc == INVALID_UNIFORM_LOCATION ||
+        m_capacitiesLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void ScatterCullTechnique::SetPass(int Pass)
+{
+    glUniform1i(m_passLoc, Pass);
+}
+
+
+void ScatterCullTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void ScatterCullTechnique::SetFrustumPlanes(const Matrix4f& ViewProj)
+{
+    Vector4f l, r, b, t, n, f;
+    ViewProj.CalcClipPlanes(l, r, b, t, n, f);
+
+    // The right, top and far planes are flipped so that the inside is always on the positive side
+    Vector4f Planes[6] = { l, r * -1.0f, b, t * -1.0f, n, f * -1.0f };
+
+    // The spheres are tested against the distance from the plane
+    for (int i = 0 ; i < 6 ; i++) {
+        float Length = sqrtf(Planes[i].x * Planes[i].x + Planes[i].y * Planes[i].y + Planes[i].z * Planes[i].z);
+        Planes[i] = Planes[i] * (1.0f / Length);
+    }
+
+    glUniform4fv(m_frustumPlanesLoc, 6, (const GLfloat*)Planes);
+}
+
+
+void ScatterCullTechnique::SetNumPieces(int NumPieces)
+{
+    glUniform1i(m_numPiecesLoc, NumPieces);
+}
+
+
+void ScatterCullTechnique::SetLayerBounds(int NumLayers, const Vector4f* pBounds)
+{
+    glUniform1i(m_numLayersLoc, NumLayers);
+    glUniform4fv(m_layerBoundsLoc, NumLayers, (const GLfloat*)pBounds);
+}
+
+
+void ScatterCullTechnique::SetCapacities(int NumCommands, const GLuint* pCapacities)
+{
+    glUniform1uiv(m_capacitiesLoc, NumCommands, pCapacities);
+}
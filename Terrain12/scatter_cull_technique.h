@@ -0,0 +1,60 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SCATTER_CULL_TECHNIQUE_H
+#define SCATTER_CULL_TECHNIQUE_H
+
+#include "technique.h"
+#include "ogldev_math_3d.h"
+#include "scatter_technique.h"
+
+#define SCATTER_CULL_GROUP_SIZE 64
+
+class ScatterCullTechnique : public Technique
+{
+public:
+
+    ScatterCullTechnique();
+
+    virtual bool Init();
+
+    void SetPass(int Pass);
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    // Normalized so that the distance of a point from a plane is the dot product
+    void SetFrustumPlanes(const Matrix4f& ViewProj);
+
+    void SetNumPieces(int NumPieces);
+
+    // Per layer: center height and radius of the bounding sphere at scale one, billboard distance, max distance
+    void SetLayerBounds(int NumLayers, const Vector4f* pBounds);
+
+    // Per draw command (two per layer)
+    void SetCapacities(int NumCommands, const GLuint* pCapacities);
+
+private:
+    GLuint m_passLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_frustumPlanesLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_numPiecesLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_numLayersLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_layerBoundsLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_capacitiesLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* SCATTER_CULL_TECHNIQUE_H */
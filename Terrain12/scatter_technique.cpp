@@ -0,0 +1,97 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "ogldev_util.h"
+#include "scatter_technique.h"
+
+
+ScatterTechnique::ScatterTechnique()
+{
+}
+
+bool ScatterTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_VERTEX_SHADER, "scatter.vs")) {
+        return false;
+    }
+
+    if (!AddShader(GL_FRAGMENT_SHADER, "scatter.fs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_VPLoc = GetUniformLocation("gVP");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
+    m_billboardLoc = GetUniformLocation("gBillboard");
+    m_layerColorsLoc = GetUniformLocation("gLayerColors");
+    m_billboardSizesLoc = GetUniformLocation("gBillboardSizes");
+    m_shapesLoc = GetUniformLocation("gShapes");
+
+    if (m_VPLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION ||
+        m_billboardLoc == INVALID_UNIFORM_LOCATION ||
+        m_layerColorsLoc == INVALID_UNIFORM_LOCATION ||
+        m_billboardSizesLoc == INVALID_UNIFORM_LOCATION ||
+        m_shapesLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void ScatterTechnique::SetVP(const Matrix4f& VP)
+{
+    glUniformMatrix4fv(m_VPLoc, 1, GL_TRUE, (const GLfloat*)VP.m);
+}
+
+
+void ScatterTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void ScatterTechnique::SetLightDir(const Vector3f& Dir)
+{
+    Vector3f ReversedLightDir = Dir * -1.0f;
+    ReversedLightDir = ReversedLightDir.Normalize();
+    glUniform3f(m_reversedLightDirLoc, ReversedLightDir.x, ReversedLightDir.y, ReversedLightDir.z);
+}
+
+
+void ScatterTechnique::SetBillboard(bool Billboard)
+{
+    glUniform1i(m_billboardLoc, Billboard ? 1 : 0);
+}
+
+
+void ScatterTechnique::SetLayerParams(int NumLayers, const Vector3f* pColors, const Vector2f* pBillboardSizes, const int* pShapes)
+{
+    glUniform3fv(m_layerColorsLoc, NumLayers, (const GLfloat*)pColors);
+    glUniform2fv(m_billboardSizesLoc, NumLayers, (const GLfloat*)pBillboardSizes);
+    glUniform1iv(m_shapesLoc, NumLayers, pShapes);
+}
@@ -0,0 +1,59 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef SCATTER_TECHNIQUE_H
+#define SCATTER_TECHNIQUE_H
+
+#include "technique.h"
+#include "ogldev_math_3d.h"
+
+#define SCATTER_MAX_LAYERS 8
+
+//
+// Draws the instances of TerrainScatter. The instance attributes come from the output of
+// the culling pass. In billboard mode the mesh is a unit quad that is turned around the
+// Y axis towards the camera and the fragment shader cuts out the silhouette of the mesh.
+//
+class ScatterTechnique : public Technique
+{
+public:
+
+    ScatterTechnique();
+
+    virtual bool Init();
+
+    void SetVP(const Matrix4f& VP);
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    void SetLightDir(const Vector3f& Dir);
+
+    void SetBillboard(bool Billboard);
+
+    void SetLayerParams(int NumLayers, const Vector3f* pColors, const Vector2f* pBillboardSizes, const int* pShapes);
+
+private:
+    GLuint m_VPLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_reversedLightDirLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_billboardLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_layerColorsLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_billboardSizesLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_shapesLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* SCATTER_TECHNIQUE_H */
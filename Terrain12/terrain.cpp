@@ -26,10 +26,17 @@
 
 #include "terrain.h"
 #include "texture_config.h"
+#include "demo_config.h"
+#include "terrain_normals.h"
+#include "terrain_height_query.h"
+#include "ogldev_parallel.h"
 #include "3rdparty/stb_image_write.h"
 
 //#define DEBUG_PRINT
 
+#define SNAP_BLOCK_SIZE            256
+#define SNAP_MIN_POINTS_PER_THREAD 16384
+
 BaseTerrain::~BaseTerrain()
 {
     Destroy();
@@ -38,8 +45,18 @@ BaseTerrain::~BaseTerrain()
 
 void BaseTerrain::Destroy()
 {
+    m_heightQuadtree.Destroy();
     m_heightMap.Destroy();
     m_geomipGrid.Destroy();
+    m_cdlodGrid.Destroy();
+    m_chunkedTerrain.Destroy();
+    m_scatter.Destroy();
+    m_pager.Close();
+
+    if (m_normalMapTexture > 0) {
+        glDeleteTextures(1, &m_normalMapTexture);
+        m_normalMapTexture = 0;
+    }
 }
 
 
@@ -51,6 +68,16 @@ void BaseTerrain::InitTerrain(float WorldScale, float TextureScale, const std::v
         exit(0);
     }
 
+    if (!m_cdlodTech.Init()) {
+        printf("Error initializing CDLOD tech\n");
+        exit(0);
+    }
+
+    if (!m_compactTech.Init()) {
+        printf("Error initializing compact geomip tech\n");
+        exit(0);
+    }
+
     if (TextureFilenames.size() != ARRAY_SIZE_IN_ELEMENTS(m_pTextures)) {
         printf("%s:%d - number of provided textures (%lud) is not equal to the size of the texture array (%lud)\n",
                __FILE__, __LINE__, TextureFilenames.size(), ARRAY_SIZE_IN_ELEMENTS(m_pTextures));
@@ -72,7 +99,96 @@ void BaseTerrain::InitTerrain(float WorldScale, float TextureScale, const std::v
 
 void BaseTerrain::Finalize()
 {
-    m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
+    m_heightQuadtree.Build(m_heightMap, m_terrainSize);
+
+    if (m_useCdlod) {
+        m_cdlodGrid.CreateCdlodGrid(this, CDLOD_GRID_SIZE);
+    } else {
+        m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
+    }
+
+    if (m_useNormalMap) {
+        m_normalMapTexture = CreateNormalMapTexture(m_heightMap, m_terrainSize, m_worldScale);
+    }
+
+    if (m_useScatter && !m_scatter.CreateScatter(this, m_scatterLayers, m_scatterSeed)) {
+        m_useScatter = false;
+    }
+}
+
+
+void BaseTerrain::SetNormalMap(bool Enable)
+{
+    if (Enable && (IsPaged() || IsInfinite())) {
+        printf("A paged or infinite terrain doesn't have a normal map\n");
+        return;
+    }
+
+    m_useNormalMap = Enable;
+
+    if (m_useNormalMap && (m_normalMapTexture == 0) && (m_terrainSize > 0)) {
+        m_normalMapTexture = CreateNormalMapTexture(m_heightMap, m_terrainSize, m_worldScale);
+    }
+}
+
+
+void BaseTerrain::SetNormalMapParams(TerrainTechnique& Tech)
+{
+    Tech.SetNormalMap(m_useNormalMap, m_worldScale, m_terrainSize);
+
+    if (m_useNormalMap) {
+        glActiveTexture(NORMAL_MAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_normalMapTexture);
+    }
+}
+
+
+bool BaseTerrain::SetScatter(bool Enable, const std::vector<ScatterLayer>& Layers, u32 Seed)
+{
+    if (Enable && (IsPaged() || IsInfinite())) {
+        printf("A paged or infinite terrain can't be scattered\n");
+        return false;
+    }
+
+    m_scatter.Destroy();
+    m_useScatter = false;
+
+    if (!Enable) {
+        return true;
+    }
+
+    m_scatterLayers = Layers;
+    m_scatterSeed = Seed;
+
+    if ((m_terrainSize > 0) && !m_scatter.CreateScatter(this, m_scatterLayers, m_scatterSeed)) {
+        return false;
+    }
+
+    m_useScatter = true;
+
+    return true;
+}
+
+
+void BaseTerrain::SetCdlodRenderer(bool Enable)
+{
+    if (!Enable && IsPaged()) {
+        printf("A paged terrain can only use the CDLOD renderer\n");
+        return;
+    }
+
+    m_useCdlod = Enable;
+
+    // The other renderer is created on first use
+    if (m_terrainSize == 0) {
+        return;
+    }
+
+    if (m_useCdlod && !m_cdlodGrid.IsCreated()) {
+        m_cdlodGrid.CreateCdlodGrid(this, CDLOD_GRID_SIZE);
+    } else if (!m_useCdlod && !m_geomipGrid.IsCreated()) {
+        m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
+    }
 }
 
 
@@ -108,7 +224,103 @@ void BaseTerrain::LoadFromFile(const char* pFilename)
     // how do we know the patch size at this point?
     assert(0);
 
-    m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
+    Finalize();
+}
+
+
+bool BaseTerrain::LoadFromTiledFile(const char* pFilename, int CacheSizeInTiles)
+{
+    Destroy();
+
+    if (!m_pager.Open(pFilename, CacheSizeInTiles)) {
+        return false;
+    }
+
+    m_terrainSize = m_pager.GetTerrainSize();
+
+    SetMinMaxHeight(m_pager.GetMinHeight(), m_pager.GetMaxHeight());
+
+    m_useCdlod = true;
+    m_useNormalMap = false;
+    m_useScatter = false;
+    m_cdlodGrid.CreateCdlodGrid(this, CDLOD_GRID_SIZE);
+
+    return true;
+}
+
+
+void BaseTerrain::CreateInfiniteTerrain(const ChunkedTerrainParams& Params, const TerrainNoiseParams& NoiseParams)
+{
+    Destroy();
+
+    m_terrainSize = 0;
+    m_worldScale = Params.WorldScale;
+    m_useNormalMap = false;
+    m_useScatter = false;
+
+    m_chunkedTerrain.CreateChunkedTerrain(Params, NoiseParams);
+
+    SetMinMaxHeight(NoiseParams.MinHeight, NoiseParams.MaxHeight);
+}
+
+
+bool BaseTerrain::SaveToTiledFile(const char* pFilename, int TileSize, bool Quantize) const
+{
+    if (IsPaged()) {
+        printf("%s:%d - the terrain is already paged\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    return HeightMapPager::WriteTiledFile(pFilename, m_heightMap, m_terrainSize, TileSize, Quantize);
+}
+
+
+bool BaseTerrain::LoadFromCompressedFile(const char* pFilename)
+{
+    CompressedHeightMap File;
+
+    if (!File.Open(pFilename)) {
+        return false;
+    }
+
+    int TerrainSize = File.GetTerrainSize();
+
+    if (!m_useCdlod && ((m_patchSize < 3) || ((TerrainSize - 1) % (m_patchSize - 1) != 0))) {
+        printf("%s:%d - terrain size %d doesn't match the patch size %d\n", __FILE__, __LINE__, TerrainSize, m_patchSize);
+        return false;
+    }
+
+    long long StartTime = GetCurrentTimeMillis();
+
+    Array2D<float> HeightMap;
+
+    if (!File.DecodeAll(HeightMap)) {
+        return false;
+    }
+
+    printf("Decoded '%s' (%dx%d): %lld ms\n", pFilename, TerrainSize, TerrainSize, GetCurrentTimeMillis() - StartTime);
+
+    Destroy();
+
+    m_terrainSize = TerrainSize;
+    m_heightMap = std::move(HeightMap);
+
+    SetMinMaxHeight(File.GetMinHeight(), File.GetMaxHeight());
+
+    Finalize();
+
+    return true;
+}
+
+
+bool BaseTerrain::SaveToCompressedFile(const char* pFilename, int TileSize, float MaxError) const
+{
+    if (IsPaged() || IsInfinite() || (m_terrainSize == 0)) {
+        printf("%s:%d - only a terrain with a height map can be saved\n", __FILE__, __LINE__);
+        return false;
+    }
+
+    return CompressedHeightMap::WriteFile(pFilename, m_heightMap, m_terrainSize, TileSize, MaxError);
 }
 
 
@@ -159,20 +371,113 @@ void BaseTerrain::Render(const BasicCamera& Camera)
     Matrix4f VP = Camera.GetViewProjMatrix();
     Matrix4f View = Camera.GetMatrix();
 
-    m_terrainTech.Enable();
-    m_terrainTech.SetVP(VP);
+    if (IsInfinite()) {
+        m_chunkedTerrain.Update(Camera.GetPos());
 
-    for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(m_pTextures); i++) {
+        m_terrainTech.Enable();
+        m_terrainTech.SetVP(VP);
+        m_terrainTech.SetLightDir(m_lightDir);
+        SetNormalMapParams(m_terrainTech);
+
+        BindTextures();
+
+        m_chunkedTerrain.Render(Camera.GetPos(), VP);
+
+        m_pSkydome->Render(Camera);
+        return;
+    }
+
+    // Keeps the tiles under the camera in the cache for the height queries
+    if (IsPaged()) {
+        Vector3f Pos = Camera.GetPos();
+        m_pager.Update(Pos.x / m_worldScale, Pos.z / m_worldScale, PAGER_UPDATE_RADIUS);
+    }
+
+    if (m_useCdlod) {
+        m_cdlodTech.Enable();
+        m_cdlodTech.SetVP(VP);
+        m_cdlodTech.SetLightDir(m_lightDir);
+        SetNormalMapParams(m_cdlodTech);
+
+        BindTextures();
+
+        m_cdlodGrid.Render(Camera.GetPos(), VP, m_cdlodTech);
+
+        m_scatter.Render(this, Camera.GetPos(), VP, m_lightDir);
+
+        m_pSkydome->Render(Camera);
+        return;
+    }
+
+    // Refreshed every frame so that changes to the projection are picked up
+    if (m_screenSpaceErrorLod) {
+        m_geomipGrid.SetScreenSpaceErrorLod(Camera.GetPersProjInfo(), m_pixelTolerance);
+    } else {
+        m_geomipGrid.SetDistanceLod();
+    }
+
+    m_geomipGrid.PrepareRender(Camera.GetPos(), VP);
+
+    bool Compact = (m_geomipGrid.GetVertexFormat() != GEOMIP_VERTEX_FULL);
+    TerrainTechnique* pTech = Compact ? (TerrainTechnique*)&m_compactTech : &m_terrainTech;
+
+    pTech->Enable();
+    pTech->SetVP(VP);
+
+    if (Compact) {
+        m_geomipGrid.SetCompactParams(m_compactTech);
+    }
+
+    BindTextures();
+
+    pTech->SetLightDir(m_lightDir);
+    SetNormalMapParams(*pTech);
+
+    m_geomipGrid.Render(Camera.GetPos(), VP);
+
+    // After the terrain so that the horizon of the frame is ready for the tiles
+    m_scatter.Render(this, Camera.GetPos(), VP, m_lightDir);
+
+    m_pSkydome->Render(Camera);
+}
+
+
+void BaseTerrain::BindTextures()
+{
+    for (int i = 0 ; i < (int)ARRAY_SIZE_IN_ELEMENTS(m_pTextures) ; i++) {
         if (m_pTextures[i]) {
             m_pTextures[i]->Bind(COLOR_TEXTURE_UNIT_0 + i);
         }
     }
-	
-    m_terrainTech.SetLightDir(m_lightDir);
+}
 
-    m_geomipGrid.Render(Camera.GetPos(), VP);
 
-    m_pSkydome->Render(Camera);
+bool BaseTerrain::RunGpuSelfCheck(const BasicCamera& Camera)
+{
+    if (!m_geomipGrid.IsCreated()) {
+        printf("GPU self check: the geomip grid was not created\n");
+        return false;
+    }
+
+    return m_geomipGrid.RunGpuSelfCheck(Camera.GetPos(), Camera.GetViewProjMatrix());
+}
+
+
+bool BaseTerrain::IsOccludedByTerrain(const Vector3f& Min, const Vector3f& Max) const
+{
+    if (m_useCdlod || IsInfinite() || !m_geomipGrid.IsCreated() || m_geomipGrid.IsGpuDriven() ||
+        !m_geomipGrid.IsHorizonCulling()) {
+        return false;
+    }
+
+    return m_geomipGrid.GetHorizonCuller().IsOccluded(Min, Max);
+}
+
+
+void BaseTerrain::SetScreenSpaceErrorLod(bool Enable, float PixelTolerance)
+{
+    m_screenSpaceErrorLod = Enable;
+    m_pixelTolerance = PixelTolerance;
 }
 
 
@@ -183,12 +488,25 @@ void BaseTerrain::SetMinMaxHeight(float MinHeight, float MaxHeight)
 
     m_terrainTech.Enable();
     m_terrainTech.SetMinMaxHeight(MinHeight, MaxHeight);
+
+    m_cdlodTech.Enable();
+    m_cdlodTech.SetMinMaxHeight(MinHeight, MaxHeight);
+
+    m_compactTech.Enable();
+    m_compactTech.SetMinMaxHeight(MinHeight, MaxHeight);
 }
 
 
 void BaseTerrain::SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height)
 {
+    m_terrainTech.Enable();
     m_terrainTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height); 
+
+    m_cdlodTech.Enable();
+    m_cdlodTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height);
+
+    m_compactTech.Enable();
+    m_compactTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height);
 }
 
 
@@ -205,6 +523,11 @@ Vector3f BaseTerrain::ConstrainCameraPosToTerrain(const Vector3f& CameraPos)
 {
     Vector3f NewCameraPos = CameraPos;
 
+    if (IsInfinite()) {
+        SnapToGround(&NewCameraPos, 1, m_cameraHeight);
+        return NewCameraPos;
+    }
+
     // Make sure camera doesn't go outside of the terrain bounds
     if (CameraPos.x < 0.0f) {
         NewCameraPos.x = 0.0f;
@@ -222,7 +545,7 @@ Vector3f BaseTerrain::ConstrainCameraPosToTerrain(const Vector3f& CameraPos)
         NewCameraPos.z = GetWorldSize() - 0.5f;
     }
 
-    NewCameraPos.y = GetWorldHeight(CameraPos.x, CameraPos.z) + m_cameraHeight;
+    SnapToGround(&NewCameraPos, 1, m_cameraHeight);
 
     float f = sinf(CameraPos.x * 4.0f) + cosf(CameraPos.z * 4.0f);    
     f /= 35.0f; 
@@ -231,3 +554,104 @@ Vector3f BaseTerrain::ConstrainCameraPosToTerrain(const Vector3f& CameraPos)
 
     return NewCameraPos;
 }
+
+
+void BaseTerrain::GetWorldHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals) const
+{
+    if (IsInfinite()) {
+        m_chunkedTerrain.GetWorldHeights(pX, pZ, Count, pHeights, pNormals);
+        return;
+    }
+
+    if (!m_pager.IsOpen()) {
+        QueryTerrainHeights(m_heightMap, m_terrainSize, m_worldScale, pX, pZ, Count, pHeights, pNormals);
+        return;
+    }
+
+    // The tile cache of the pager is not thread safe so this runs one point at a time
+    float Last = (float)(m_terrainSize - 1);
+
+    for (int i = 0 ; i < Count ; i++) {
+        float x = std::min(std::max(pX[i] / m_worldScale, 0.0f), Last);
+        float z = std::min(std::max(pZ[i] / m_worldScale, 0.0f), Last);
+        int x0 = std::min((int)x, m_terrainSize - 2);
+        int z0 = std::min((int)z, m_terrainSize - 2);
+        float fx = x - (float)x0;
+        float fz = z - (float)z0;
+
+        float h00 = GetHeight(x0, z0);
+        float h10 = GetHeight(x0 + 1, z0);
+        float h01 = GetHeight(x0, z0 + 1);
+        float h11 = GetHeight(x0 + 1, z0 + 1);
+
+        float Bottom = h00 + (h10 - h00) * fx;
+        float Top    = h01 + (h11 - h01) * fx;
+        pHeights[i] = Bottom + (Top - Bottom) * fz;
+
+        if (pNormals) {
+            float dx = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) / m_worldScale;
+            float dz = ((h01 - h00) + ((h11 - h10) - (h01 - h00)) * fx) / m_worldScale;
+            pNormals[i] = Vector3f(-dx, 1.0f, -dz);
+            pNormals[i].Normalize();
+        }
+    }
+}
+
+
+void BaseTerrain::SnapToGround(Vector3f* pPositions, int Count, float HeightAboveGround) const
+{
+    int MinPointsPerThread = m_pager.IsOpen() ? Count : SNAP_MIN_POINTS_PER_THREAD;
+
+    // Each thread copies its points into small SoA blocks for the batched query
+    ParallelFor(0, Count, [&](int Start, int End) {
+        float x[SNAP_BLOCK_SIZE];
+        float z[SNAP_BLOCK_SIZE];
+        float Heights[SNAP_BLOCK_SIZE];
+
+        for (int BlockStart = Start ; BlockStart < End ; BlockStart += SNAP_BLOCK_SIZE) {
+            int BlockSize = std::min(SNAP_BLOCK_SIZE, End - BlockStart);
+
+            for (int i = 0 ; i < BlockSize ; i++) {
+                x[i] = pPositions[BlockStart + i].x;
+                z[i] = pPositions[BlockStart + i].z;
+            }
+
+            GetWorldHeights(x, z, BlockSize, Heights);
+
+            for (int i = 0 ; i < BlockSize ; i++) {
+                pPositions[BlockStart + i].y = Heights[i] + HeightAboveGround;
+            }
+        }
+    }, MinPointsPerThread);
+}
+
+
+bool BaseTerrain::IntersectRay(const Vector3f& Origin, const Vector3f& Dir, float MaxDistance, Vector3f& HitPoint) const
+{
+    float DirLength = Dir.Length();
+
+    if (DirLength == 0.0f) {
+        return false;
+    }
+
+    float t = 0.0f;
+
+    if (!m_heightQuadtree.RayIntersect(Origin, Dir, m_worldScale, MaxDistance / DirLength, t)) {
+        return false;
+    }
+
+    HitPoint = Origin + Dir * t;
+
+    return true;
+}
+
+
+bool BaseTerrain::IsLineOfSightClear(const Vector3f& From, const Vector3f& To) const
+{
+    float t = 0.0f;
+
+    // 't' is relative to the segment so anything below 1 is a hit before reaching 'To'
+    bool Hit = m_heightQuadtree.RayIntersect(From, To - From, m_worldScale, 1.0f, t);
+
+    return !Hit;
+}
@@ -19,6 +19,23 @@ uniform float gHeight3 = 280.0;
 
 uniform vec3 gReversedLightDir;
 
+uniform bool gUseNormalMap = false;
+uniform sampler2D gNormalMap;           // octahedral, one texel per height map point
+uniform vec2 gNormalMapParams;          // 1 / world scale, 1 / terrain size
+
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+
+    if (n.y < 0.0) {
+        vec2 Sign = vec2((n.x >= 0.0) ? 1.0 : -1.0, (n.z >= 0.0) ? 1.0 : -1.0);
+        n.xz = (1.0 - abs(n.zx)) * Sign;
+    }
+
+    return normalize(n);
+}
+
+
 vec4 CalcTexColor()
 {
     vec4 TexColor;
@@ -57,7 +74,14 @@ void main()
 {
     vec4 TexColor = CalcTexColor();
 
-    vec3 Normal_ = normalize(Normal);
+    vec3 Normal_;
+
+    if (gUseNormalMap) {
+        vec2 NormalMapTex = (WorldPos.xz * gNormalMapParams.x + 0.5) * gNormalMapParams.y;
+        Normal_ = DecodeOctahedral(texture(gNormalMap, NormalMapTex).rg);
+    } else {
+        Normal_ = normalize(Normal);
+    }
 
     float Diffuse = dot(Normal_, gReversedLightDir);
 
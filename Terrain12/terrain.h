@@ -25,6 +25,12 @@
 #include "ogldev_texture.h"
 
 #include "geomip_grid.h"
+#include "cdlod_grid.h"
+#include "height_quadtree.h"
+#include "height_map_pager.h"
+#include "height_map_codec.h"
+#include "chunked_terrain.h"
+#include "terrain_scatter.h"
 #include "terrain_technique.h"
 #include "ogldev_skydome.h"
 
@@ -45,7 +51,32 @@ class BaseTerrain
 
     void SaveToFile(const char* pFilename);
 
-	float GetHeight(int x, int z) const { return m_heightMap.Get(x, z); }
+    //
+    // A paged terrain reads the heights through a cache of tiles from a memory mapped
+    // tiled file (see HeightMapPager) instead of loading the whole height map. It is
+    // always rendered by the CDLOD renderer and it doesn't have a height quadtree, so
+    // ray queries don't hit it.
+    //
+    bool LoadFromTiledFile(const char* pFilename, int CacheSizeInTiles);
+
+    bool SaveToTiledFile(const char* pFilename, int TileSize, bool Quantize) const;
+
+    bool IsPaged() const { return m_pager.IsOpen(); }
+
+    //
+    // Compact height map file (see CompressedHeightMap) with a bounded error per point.
+    // Loading decodes the tiles on all the threads and keeps the current patch size
+    // and renderer. Returns false on failure and then the terrain is not changed.
+    //
+    bool LoadFromCompressedFile(const char* pFilename);
+
+    bool SaveToCompressedFile(const char* pFilename, int TileSize, float MaxError) const;
+
+    const HeightMapPager& GetPager() const { return m_pager; }
+
+	float GetHeight(int x, int z) const { return m_pager.IsOpen() ? m_pager.GetHeight(x, z) : m_heightMap.Get(x, z); }
+
+    const Array2D<float>& GetHeightMap() const { return m_heightMap; }
 	
     float GetHeightInterpolated(float x, float z) const;
 
@@ -67,6 +98,82 @@ class BaseTerrain
 
     Vector3f ConstrainCameraPosToTerrain(const Vector3f& CameraPos);
 
+    // Batched ground queries for world space points (see QueryTerrainHeights). pNormals can be NULL.
+    void GetWorldHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals = NULL) const;
+
+    // Sets the height of the points to HeightAboveGround over the terrain. x and z are not changed.
+    void SnapToGround(Vector3f* pPositions, int Count, float HeightAboveGround) const;
+
+    const HeightQuadtree& GetHeightQuadtree() const { return m_heightQuadtree; }
+
+    // World space picking. Dir doesn't have to be normalized.
+    bool IntersectRay(const Vector3f& Origin, const Vector3f& Dir, float MaxDistance, Vector3f& HitPoint) const;
+
+    bool IsLineOfSightClear(const Vector3f& From, const Vector3f& To) const;
+
+    // Select the LOD of each patch by its projected geometric error instead of the distance regions
+    void SetScreenSpaceErrorLod(bool Enable, float PixelTolerance);
+
+    // Fraction of each LOD band over which the patches morph into the next LOD (zero disables geomorphing)
+    void SetMorphRegion(float Fraction) { m_geomipGrid.SetMorphRegion(Fraction); }
+
+    // Per pixel lighting from an octahedral normal map that is baked on first use
+    void SetNormalMap(bool Enable);
+
+    // Vertex format of the geomip grid (see GEOMIP_VERTEX_FORMAT)
+    void SetGeomipVertexFormat(GEOMIP_VERTEX_FORMAT Format) { m_geomipGrid.SetVertexFormat(Format); }
+
+    // Binary cache of the generated geomip geometry (see GeomipCache). NULL disables it.
+    void SetGeomipCacheFile(const char* pFilename) { m_geomipGrid.SetCacheFile(pFilename); }
+
+    // Culling, LOD selection and draw command generation on the GPU. Returns false if not supported.
+    bool SetGpuDriven(bool Enable) { return m_geomipGrid.IsCreated() && m_geomipGrid.SetGpuDriven(Enable); }
+
+    bool IsGpuDriven() const { return m_geomipGrid.IsGpuDriven(); }
+
+    // Skip the geomip patches that are hidden behind the terrain (the CPU path of the geomip grid)
+    void SetHorizonCulling(bool Enable) { m_geomipGrid.SetHorizonCulling(Enable); }
+
+    int GetNumOccludedPatches() const { return m_geomipGrid.GetNumOccludedPatches(); }
+
+    // World space box against the horizon of the last frame. False if horizon culling was not used.
+    bool IsOccludedByTerrain(const Vector3f& Min, const Vector3f& Max) const;
+
+    bool RunGpuSelfCheck(const BasicCamera& Camera);
+
+    //
+    // Render with a single instanced grid and a height map texture instead of the geomip
+    // grid. Enabling it before the terrain is created skips the geomip grid entirely.
+    //
+    void SetCdlodRenderer(bool Enable);
+
+    bool IsCdlodRenderer() const { return m_useCdlod; }
+
+    void SetCdlodDetailDistance(float Distance) { m_cdlodGrid.SetDetailDistance(Distance); }
+
+    //
+    // Procedural terrain without bounds that is generated in chunks around the camera (see
+    // ChunkedTerrain). It replaces the height map until Destroy is called and only the
+    // height queries and the camera constraint work on it.
+    //
+    void CreateInfiniteTerrain(const ChunkedTerrainParams& Params, const TerrainNoiseParams& NoiseParams);
+
+    bool IsInfinite() const { return m_chunkedTerrain.IsCreated(); }
+
+    const ChunkedTerrain& GetChunkedTerrain() const { return m_chunkedTerrain; }
+
+    //
+    // Vegetation and rocks that are scattered over the terrain by the height and slope of
+    // every layer and drawn with GPU culling and indirect instancing (see TerrainScatter).
+    // The layers are kept so the scatter follows the terrain when it is generated again.
+    // Not available for the paged and the infinite terrain. Returns false on failure.
+    //
+    bool SetScatter(bool Enable, const std::vector<ScatterLayer>& Layers, u32 Seed);
+
+    bool IsScatterEnabled() const { return m_scatter.IsCreated(); }
+
+    const ScatterStats& GetScatterStats() const { return m_scatter.GetStats(); }
+
  protected:
 
 	void LoadHeightMapFile(const char* pFilename);
@@ -77,21 +184,41 @@ class BaseTerrain
 
     float GetWorldHeight(float x, float z) const;
 
+    void SetNormalMapParams(TerrainTechnique& Tech);
+
+    // The color textures of every renderer
+    void BindTextures();
+
     int m_terrainSize = 0;
     int m_patchSize = 0;
 	float m_worldScale = 1.0f;
     Array2D<float> m_heightMap;
+    HeightQuadtree m_heightQuadtree;
     Texture* m_pTextures[4] = { 0 };
     float m_textureScale = 1.0f;
 
 private:
     GeomipGrid m_geomipGrid;
+    CdlodGrid m_cdlodGrid;
+    ChunkedTerrain m_chunkedTerrain;
+    TerrainScatter m_scatter;
+    std::vector<ScatterLayer> m_scatterLayers;
+    u32 m_scatterSeed = 0;
+    bool m_useScatter = false;
+    HeightMapPager m_pager;
     float m_minHeight = 0.0f;
     float m_maxHeight = 0.0f;
     TerrainTechnique m_terrainTech;
+    CdlodTechnique m_cdlodTech;
+    GeomipCompactTechnique m_compactTech;
+    bool m_useCdlod = false;
+    bool m_useNormalMap = false;
+    GLuint m_normalMapTexture = 0;
     Vector3f m_lightDir;
     float m_cameraHeight = 2.0f;
     Skydome* m_pSkydome = NULL;
+    bool m_screenSpaceErrorLod = false;
+    float m_pixelTolerance = 2.0f;
 };
 
 #endif
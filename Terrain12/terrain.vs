@@ -20,6 +20,10 @@
 layout (location = 0) in vec3 Position;
 layout (location = 1) in vec2 InTex;
 layout (location = 2) in vec3 InNormal;
+layout (location = 3) in vec3 InMorph;          // height at the next coarser LOD, last LOD that has the vertex, patch side
+layout (location = 4) in vec4 InSideLods;       // per patch - left, right, top, bottom
+layout (location = 5) in vec4 InSideMorphs;
+layout (location = 6) in vec2 InCore;           // per patch - LOD, morph
 
 uniform mat4 gVP;
 uniform float gMinHeight;
@@ -32,11 +36,22 @@ out vec3 Normal;
 
 void main()
 {
-    gl_Position = gVP * vec4(Position, 1.0);
+    // Interior vertices follow the patch and edge vertices follow the side they are on
+    int Side = int(InMorph.z);
+    float Lod = (Side == 0) ? InCore.x : InSideLods[Side - 1];
+    float Morph = (Side == 0) ? InCore.y : InSideMorphs[Side - 1];
+
+    if (abs(InMorph.y - Lod) > 0.5) {
+        Morph = 0.0;
+    }
+
+    vec3 Pos = vec3(Position.x, mix(Position.y, InMorph.x, Morph), Position.z);
+
+    gl_Position = gVP * vec4(Pos, 1.0);
 
     float DeltaHeight = gMaxHeight - gMinHeight;
 
-    float HeightRatio = (Position.y - gMinHeight) / DeltaHeight;
+    float HeightRatio = (Pos.y - gMinHeight) / DeltaHeight;
 
     float c = HeightRatio * 0.8 + 0.2;
 
@@ -44,7 +59,7 @@ void main()
 
     Tex = InTex;
     
-    WorldPos = Position;
+    WorldPos = Pos;
     
     Normal = InNormal;
 }
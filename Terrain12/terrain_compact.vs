@@ -0,0 +1,184 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#version 330
+
+layout (location = 0) in vec2 InHeights;        // height and height at the next coarser LOD, normalized over gHeightRange
+layout (location = 2) in vec2 InNormal;         // octahedral
+layout (location = 3) in vec2 InMorphInfo;      // last LOD that has the vertex, patch side
+layout (location = 4) in vec4 InSideLods;       // per patch - left, right, top, bottom
+layout (location = 5) in vec4 InSideMorphs;
+layout (location = 6) in vec2 InCore;           // per patch - LOD, morph
+
+uniform mat4 gVP;
+uniform float gMinHeight;
+uniform float gMaxHeight;
+uniform bool gVertexless;                       // everything comes from the height map
+uniform sampler2D gHeightMap;
+uniform int gPatchSize;
+uniform int gNumPatchesX;
+uniform int gTerrainSize;
+uniform int gMaxLod;
+uniform float gWorldScale;
+uniform float gTextureScale;
+uniform vec2 gHeightRange;                      // min, max - min
+
+out vec4 Color;
+out vec2 Tex;
+out vec3 WorldPos;
+out vec3 Normal;
+
+float GetHeight(ivec2 p)
+{
+    p = clamp(p, ivec2(0), ivec2(gTerrainSize - 1));
+    return texelFetch(gHeightMap, p, 0).r;
+}
+
+
+float InterpolateTriangle(vec2 p, vec2 p0, float h0, vec2 p1, float h1, vec2 p2, float h2)
+{
+    float Det = (p1.y - p2.y) * (p0.x - p2.x) + (p2.x - p1.x) * (p0.y - p2.y);
+    float b0 = ((p1.y - p2.y) * (p.x - p2.x) + (p2.x - p1.x) * (p.y - p2.y)) / Det;
+    float b1 = ((p2.y - p0.y) * (p.x - p2.x) + (p0.x - p2.x) * (p.y - p2.y)) / Det;
+    return b0 * h0 + b1 * h1 + (1.0 - b0 - b1) * h2;
+}
+
+
+// Same as LodManager::CalcLodHeight
+float CalcLodHeight(ivec2 p, int Lod)
+{
+    int Step = 1 << Lod;
+    int BlockSize = Step * 2;
+
+    ivec2 b = (p / BlockSize) * BlockSize;
+
+    if ((b.x == p.x) && (p.x > 0)) {
+        b.x -= BlockSize;
+    }
+
+    if ((b.y == p.y) && (p.y > 0)) {
+        b.y -= BlockSize;
+    }
+
+    int u = p.x - b.x;
+    int v = p.y - b.y;
+
+    ivec2 a, c;
+
+    if ((u <= v) && (u <= BlockSize - v)) {             // left side
+        a = ivec2(0, (v < Step) ? 0 : Step);
+        c = a + ivec2(0, Step);
+    } else if ((v >= u) && (v >= BlockSize - u)) {      // top side
+        a = ivec2((u < Step) ? 0 : Step, BlockSize);
+        c = a + ivec2(Step, 0);
+    } else if ((u >= v) && (u >= BlockSize - v)) {      // right side
+        a = ivec2(BlockSize, (v < Step) ? 0 : Step);
+        c = a + ivec2(0, Step);
+    } else {                                            // bottom side
+        a = ivec2((u < Step) ? 0 : Step, 0);
+        c = a + ivec2(Step, 0);
+    }
+
+    return InterpolateTriangle(vec2(u, v),
+                               vec2(Step, Step), GetHeight(b + ivec2(Step, Step)),
+                               vec2(a), GetHeight(b + a),
+                               vec2(c), GetHeight(b + c));
+}
+
+
+vec3 DecodeOctahedral(vec2 e)
+{
+    vec3 n = vec3(e.x, 1.0 - abs(e.x) - abs(e.y), e.y);
+
+    if (n.y < 0.0) {
+        vec2 Sign = vec2((n.x >= 0.0) ? 1.0 : -1.0, (n.z >= 0.0) ? 1.0 : -1.0);
+        n.xz = (1.0 - abs(n.zx)) * Sign;
+    }
+
+    return normalize(n);
+}
+
+
+void main()
+{
+    // The patches are stored one after the other (see GeomipGrid::InitPatchVertices)
+    int NumVerticesPerPatch = gPatchSize * gPatchSize;
+    int Patch = gl_VertexID / NumVerticesPerPatch;
+    int Local = gl_VertexID % NumVerticesPerPatch;
+    ivec2 LocalPos = ivec2(Local % gPatchSize, Local / gPatchSize);
+    ivec2 p = ivec2(Patch % gNumPatchesX, Patch / gNumPatchesX) * (gPatchSize - 1) + LocalPos;
+
+    float Height;
+    float MorphHeight;
+    int Level;
+    int Side;
+
+    if (gVertexless) {
+        Height = GetHeight(p);
+
+        Level = 0;
+
+        while ((Level < gMaxLod) && (p.x % (2 << Level) == 0) && (p.y % (2 << Level) == 0)) {
+            Level++;
+        }
+
+        MorphHeight = (Level < gMaxLod) ? CalcLodHeight(p, Level + 1) : Height;
+
+        // The side of the corners doesn't matter because they are never morphed
+        Side = (LocalPos.x == 0) ? 1 :
+               (LocalPos.x == gPatchSize - 1) ? 2 :
+               (LocalPos.y == gPatchSize - 1) ? 3 :
+               (LocalPos.y == 0) ? 4 : 0;
+
+        float HeightL = GetHeight(p - ivec2(1, 0));
+        float HeightR = GetHeight(p + ivec2(1, 0));
+        float HeightD = GetHeight(p - ivec2(0, 1));
+        float HeightU = GetHeight(p + ivec2(0, 1));
+
+        Normal = normalize(vec3(HeightL - HeightR, 2.0 * gWorldScale, HeightD - HeightU));
+    } else {
+        Height = gHeightRange.x + InHeights.x * gHeightRange.y;
+        MorphHeight = gHeightRange.x + InHeights.y * gHeightRange.y;
+        Level = int(InMorphInfo.x);
+        Side = int(InMorphInfo.y);
+        Normal = DecodeOctahedral(InNormal);
+    }
+
+    // Same as terrain.vs
+    float Lod = (Side == 0) ? InCore.x : InSideLods[Side - 1];
+    float Morph = (Side == 0) ? InCore.y : InSideMorphs[Side - 1];
+
+    if (abs(float(Level) - Lod) > 0.5) {
+        Morph = 0.0;
+    }
+
+    vec3 Pos = vec3(float(p.x) * gWorldScale, mix(Height, MorphHeight, Morph), float(p.y) * gWorldScale);
+
+    gl_Position = gVP * vec4(Pos, 1.0);
+
+    float DeltaHeight = gMaxHeight - gMinHeight;
+
+    float HeightRatio = (Pos.y - gMinHeight) / DeltaHeight;
+
+    float c = HeightRatio * 0.8 + 0.2;
+
+    Color = vec4(c, c, c, 1.0);
+
+    Tex = gTextureScale * vec2(p) / float(gTerrainSize);
+
+    WorldPos = Pos;
+}
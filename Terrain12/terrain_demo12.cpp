@@ -105,11 +105,119 @@ public:
                 ImGui::SliderFloat("Height2", &Height2, 128.0f, 192.0f);
                 ImGui::SliderFloat("Height3", &Height3, 192.0f, 256.0f);
 
+                bool LodChanged = ImGui::Checkbox("Screen space error LOD", &m_screenSpaceErrorLod);
+                LodChanged |= ImGui::SliderFloat("Pixel tolerance", &m_pixelTolerance, 0.5f, 16.0f);
+
+                if (LodChanged) {
+                    m_terrain.SetScreenSpaceErrorLod(m_screenSpaceErrorLod, m_pixelTolerance);
+                }
+
+                if (ImGui::SliderFloat("Morph region", &m_morphRegion, 0.0f, 1.0f)) {
+                    m_terrain.SetMorphRegion(m_morphRegion);
+                }
+
+                ImGui::Text("GPU driven: %s (G)", m_terrain.IsGpuDriven() ? "on" : "off");
+
+                if (ImGui::Checkbox("Horizon culling", &m_horizonCulling)) {
+                    m_terrain.SetHorizonCulling(m_horizonCulling);
+                }
+
+                if (m_horizonCulling) {
+                    ImGui::Text("Occluded patches %d", m_terrain.GetNumOccludedPatches());
+                }
+
+                if (ImGui::Checkbox("Vegetation", &m_scatter)) {
+                    if (!m_terrain.SetScatter(m_scatter, GetScatterLayers(), (u32)g_seed)) {
+                        m_scatter = false;
+                    }
+                }
+
+                if (m_terrain.IsScatterEnabled()) {
+                    const ScatterStats& Stats = m_terrain.GetScatterStats();
+                    ImGui::Text("Scatter: %d instances in %d tiles (generated in %.1f ms)",
+                                Stats.NumInstances, Stats.NumTiles, Stats.GenerateTime);
+                    ImGui::Text("Scatter: %d visible tiles, %d instances tested on the GPU",
+                                Stats.VisibleTiles, Stats.TestedInstances);
+                }
+
+                if (ImGui::Checkbox("Normal map", &m_normalMap)) {
+                    m_terrain.SetNormalMap(m_normalMap);
+                }
+
+                const char* VertexFormats[] = { "Full", "Compact", "None" };
+
+                if (ImGui::Combo("Geomip vertex format", &m_vertexFormat, VertexFormats, IM_ARRAYSIZE(VertexFormats))) {
+                    m_terrain.SetGeomipVertexFormat((GEOMIP_VERTEX_FORMAT)m_vertexFormat);
+                }
+
+                if (ImGui::Checkbox("CDLOD renderer", &m_cdlod)) {
+                    m_terrain.SetCdlodRenderer(m_cdlod);
+                }
+
+                if (ImGui::SliderFloat("CDLOD detail distance", &m_cdlodDetailDistance, 2.0f, 8.0f)) {
+                    m_terrain.SetCdlodDetailDistance(m_cdlodDetailDistance);
+                }
+
                 if (ImGui::Button("Generate")) {
                     m_terrain.Destroy();
-                    srand(g_seed);
-                    m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight);
+                    m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight, g_seed);
                     m_terrain.SetTextureHeights(Height0, Height1, Height2, Height3);
+                    m_infinite = false;
+                }
+
+                ImGui::Checkbox("16 bit tiles", &m_quantizeTiles);
+
+                if (ImGui::Button("Save tiled")) {
+                    m_terrain.SaveToTiledFile(TILED_HEIGHT_MAP_FILE, TILED_HEIGHT_MAP_TILE_SIZE, m_quantizeTiles);
+                }
+
+                ImGui::SameLine();
+
+                if (ImGui::Button("Load tiled")) {
+                    if (m_terrain.LoadFromTiledFile(TILED_HEIGHT_MAP_FILE, TILED_HEIGHT_MAP_CACHE_SIZE)) {
+                        m_terrain.SetTextureHeights(Height0, Height1, Height2, Height3);
+                        m_cdlod = true;
+                        m_normalMap = false;
+                        m_infinite = false;
+                        m_scatter = false;
+                    }
+                }
+
+                ImGui::SliderFloat("Compressed max error", &m_compressedMaxError, 0.0f, 1.0f);
+
+                if (ImGui::Button("Save compressed")) {
+                    m_terrain.SaveToCompressedFile(COMPRESSED_HEIGHT_MAP_FILE, COMPRESSED_HEIGHT_MAP_TILE_SIZE, m_compressedMaxError);
+                }
+
+                ImGui::SameLine();
+
+                if (ImGui::Button("Load compressed")) {
+                    if (m_terrain.LoadFromCompressedFile(COMPRESSED_HEIGHT_MAP_FILE)) {
+                        m_terrain.SetTextureHeights(Height0, Height1, Height2, Height3);
+                        m_infinite = false;
+                    }
+                }
+
+                if (ImGui::Checkbox("Infinite terrain", &m_infinite)) {
+                    if (m_infinite) {
+                        CreateInfiniteTerrain();
+                        m_scatter = false;
+                        m_constrainCamera = true;
+                        ConstrainCameraToTerrain();
+                    } else {
+                        m_terrain.Destroy();
+                        m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight, g_seed);
+                    }
+
+                    m_terrain.SetTextureHeights(Height0, Height1, Height2, Height3);
+                }
+
+                if (m_terrain.IsInfinite()) {
+                    const ChunkedTerrainStats& Stats = m_terrain.GetChunkedTerrain().GetStats();
+                    ImGui::Text("Chunks: %d resident, %d rendered, %d queued, %d uploading",
+                                Stats.ResidentChunks, Stats.RenderedChunks, Stats.QueuedChunks, Stats.UploadingChunks);
+                    ImGui::Text("Chunk update %.3f ms (max %.3f ms), uploaded %d KB",
+                                Stats.UpdateTime, Stats.MaxUpdateTime, Stats.UploadedBytes / 1024);
                 }
 
                 ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
@@ -205,6 +313,16 @@ public:
                 m_isPaused = !m_isPaused;
                 break;
 
+            case GLFW_KEY_G:
+                if (!m_terrain.SetGpuDriven(!m_terrain.IsGpuDriven())) {
+                    printf("GPU driven terrain is not supported\n");
+                }
+                break;
+
+            case GLFW_KEY_V:
+                m_terrain.RunGpuSelfCheck(*m_pGameCamera);
+                break;
+
             case GLFW_KEY_SPACE:
                 m_showGui = !m_showGui;
                 break;
@@ -293,7 +411,9 @@ private:
 
         m_terrain.InitTerrain(WorldScale, TextureScale, TextureFilenames);
 
-        m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight);
+        m_terrain.SetGeomipCacheFile(GEOMIP_CACHE_FILE);
+
+        m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight, g_seed);
 
         Vector3f LightDir(0.0f, -1.0f, 0.0f);
 
@@ -301,6 +421,59 @@ private:
     }
 
 
+    void CreateInfiniteTerrain()
+    {
+        ChunkedTerrainParams Params;
+        Params.WorldScale = m_terrain.GetWorldScale();
+
+        TerrainNoiseParams NoiseParams;
+        NoiseParams.Seed = (u32)g_seed;
+        NoiseParams.MinHeight = -400.0f;
+        NoiseParams.MaxHeight = 700.0f;
+
+        m_terrain.CreateInfiniteTerrain(Params, NoiseParams);
+    }
+
+
+    // Grass in the low lands, trees on the gentle slopes and rocks on the steep ones
+    std::vector<ScatterLayer> GetScatterLayers() const
+    {
+        std::vector<ScatterLayer> Layers(3);
+
+        ScatterLayer& Grass = Layers[0];
+        Grass.Mesh = SCATTER_MESH_GRASS;
+        Grass.Density = 0.5f;
+        Grass.HeightRegion = { 0.0f, 60.0f, 200.0f };
+        Grass.SlopeRegion = { 0.0f, 0.0f, 0.3f };
+        Grass.MinScale = 0.5f;
+        Grass.MaxScale = 1.2f;
+        Grass.BillboardDistance = 150.0f;
+        Grass.MaxDistance = 150.0f;
+
+        ScatterLayer& Trees = Layers[1];
+        Trees.Mesh = SCATTER_MESH_TREE;
+        Trees.Density = 0.02f;
+        Trees.HeightRegion = { 20.0f, 100.0f, 260.0f };
+        Trees.SlopeRegion = { 0.0f, 0.05f, 0.4f };
+        Trees.MinScale = 6.0f;
+        Trees.MaxScale = 14.0f;
+        Trees.BillboardDistance = 300.0f;
+        Trees.MaxDistance = 2500.0f;
+
+        ScatterLayer& Rocks = Layers[2];
+        Rocks.Mesh = SCATTER_MESH_ROCK;
+        Rocks.Density = 0.01f;
+        Rocks.HeightRegion = { 0.0f, 250.0f, 500.0f };
+        Rocks.SlopeRegion = { 0.1f, 0.4f, 1.0f };
+        Rocks.MinScale = 0.8f;
+        Rocks.MaxScale = 3.0f;
+        Rocks.BillboardDistance = 250.0f;
+        Rocks.MaxDistance = 800.0f;
+
+        return Layers;
+    }
+
+
     void InitGUI()
     {
         IMGUI_CHECKVERSION();
@@ -338,6 +511,18 @@ private:
     int m_patchSize = 17;
     float m_counter = 0.0f;
     bool m_constrainCamera = false;
+    bool m_screenSpaceErrorLod = false;
+    float m_pixelTolerance = 2.0f;
+    float m_morphRegion = 0.3f;
+    int m_vertexFormat = GEOMIP_VERTEX_FULL;
+    bool m_normalMap = false;
+    bool m_cdlod = false;
+    float m_cdlodDetailDistance = 3.0f;
+    bool m_quantizeTiles = false;
+    float m_compressedMaxError = 0.05f;     // world units
+    bool m_infinite = false;
+    bool m_horizonCulling = false;
+    bool m_scatter = false;
 };
 
 TerrainDemo12* app = NULL;
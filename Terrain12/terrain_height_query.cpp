@@ -0,0 +1,149 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <algorithm>
+
+#include "ogldev_simd.h"
+#include "ogldev_parallel.h"
+#include "terrain_height_query.h"
+
+#define MIN_QUERIES_PER_THREAD 16384
+
+
+static void QueryRange(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale,
+                       const float* pX, const float* pZ, int Start, int End, float* pHeights, Vector3f* pNormals)
+{
+    const float* pBase = HeightMap.GetBaseAddr();
+    float InvScale = 1.0f / WorldScale;
+    float Last = (float)(TerrainSize - 1);
+
+    auto QueryPoint = [&](int i) {
+        // NaN fails the comparison and goes to zero like in the SSE path (_mm_max_ps returns its second operand)
+        float x = pX[i] * InvScale;
+        float z = pZ[i] * InvScale;
+        x = (x > 0.0f) ? std::min(x, Last) : 0.0f;
+        z = (z > 0.0f) ? std::min(z, Last) : 0.0f;
+
+        // The last row/column uses the cell before it with a factor of one
+        float x0 = std::min(floorf(x), Last - 1.0f);
+        float z0 = std::min(floorf(z), Last - 1.0f);
+        float fx = x - x0;
+        float fz = z - z0;
+
+        const float* p = pBase + (int)z0 * TerrainSize + (int)x0;
+        float h00 = p[0];
+        float h10 = p[1];
+        float h01 = p[TerrainSize];
+        float h11 = p[TerrainSize + 1];
+
+        float Bottom = h00 + (h10 - h00) * fx;
+        float Top    = h01 + (h11 - h01) * fx;
+        pHeights[i] = Bottom + (Top - Bottom) * fz;
+
+        if (pNormals) {
+            float dx = ((h10 - h00) + ((h11 - h01) - (h10 - h00)) * fz) * InvScale;
+            float dz = ((h01 - h00) + ((h11 - h10) - (h01 - h00)) * fx) * InvScale;
+            pNormals[i] = Vector3f(-dx, 1.0f, -dz);
+            pNormals[i].Normalize();
+        }
+    };
+
+    int i = Start;
+
+#ifdef OGLDEV_SSE2
+    __m128 InvScale4 = _mm_set1_ps(InvScale);
+    __m128 Zero4 = _mm_setzero_ps();
+    __m128 One4 = _mm_set1_ps(1.0f);
+    __m128 Last4 = _mm_set1_ps(Last);
+    __m128 LastMinusOne4 = _mm_set1_ps(Last - 1.0f);
+
+    for ( ; i + 4 <= End ; i += 4) {
+        __m128 x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(pX + i), InvScale4), Zero4), Last4);
+        __m128 z = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(pZ + i), InvScale4), Zero4), Last4);
+
+        // The coordinates are not negative so truncation is the same as floor
+        __m128 x0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(x)), LastMinusOne4);
+        __m128 z0 = _mm_min_ps(_mm_cvtepi32_ps(_mm_cvttps_epi32(z)), LastMinusOne4);
+        __m128 fx = _mm_sub_ps(x, x0);
+        __m128 fz = _mm_sub_ps(z, z0);
+
+        int Cols[4];
+        int Rows[4];
+        _mm_storeu_si128((__m128i*)Cols, _mm_cvttps_epi32(x0));
+        _mm_storeu_si128((__m128i*)Rows, _mm_cvttps_epi32(z0));
+
+        const float* p0 = pBase + Rows[0] * TerrainSize + Cols[0];
+        const float* p1 = pBase + Rows[1] * TerrainSize + Cols[1];
+        const float* p2 = pBase + Rows[2] * TerrainSize + Cols[2];
+        const float* p3 = pBase + Rows[3] * TerrainSize + Cols[3];
+
+        // (h00, h10) of two points in each register, first for the lower row and then for the upper row
+        __m128 Low01  = _mm_loadh_pi(_mm_loadl_pi(Zero4, (const __m64*)p0), (const __m64*)p1);
+        __m128 Low23  = _mm_loadh_pi(_mm_loadl_pi(Zero4, (const __m64*)p2), (const __m64*)p3);
+        __m128 High01 = _mm_loadh_pi(_mm_loadl_pi(Zero4, (const __m64*)(p0 + TerrainSize)), (const __m64*)(p1 + TerrainSize));
+        __m128 High23 = _mm_loadh_pi(_mm_loadl_pi(Zero4, (const __m64*)(p2 + TerrainSize)), (const __m64*)(p3 + TerrainSize));
+
+        __m128 h00 = _mm_shuffle_ps(Low01, Low23, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 h10 = _mm_shuffle_ps(Low01, Low23, _MM_SHUFFLE(3, 1, 3, 1));
+        __m128 h01 = _mm_shuffle_ps(High01, High23, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 h11 = _mm_shuffle_ps(High01, High23, _MM_SHUFFLE(3, 1, 3, 1));
+
+        __m128 DeltaBottom = _mm_sub_ps(h10, h00);
+        __m128 DeltaTop    = _mm_sub_ps(h11, h01);
+        __m128 Bottom = _mm_add_ps(h00, _mm_mul_ps(DeltaBottom, fx));
+        __m128 Top    = _mm_add_ps(h01, _mm_mul_ps(DeltaTop, fx));
+
+        _mm_storeu_ps(pHeights + i, _mm_add_ps(Bottom, _mm_mul_ps(_mm_sub_ps(Top, Bottom), fz)));
+
+        if (pNormals) {
+            __m128 DeltaLeft  = _mm_sub_ps(h01, h00);
+            __m128 DeltaRight = _mm_sub_ps(h11, h10);
+            __m128 dx = _mm_mul_ps(_mm_add_ps(DeltaBottom, _mm_mul_ps(_mm_sub_ps(DeltaTop, DeltaBottom), fz)), InvScale4);
+            __m128 dz = _mm_mul_ps(_mm_add_ps(DeltaLeft, _mm_mul_ps(_mm_sub_ps(DeltaRight, DeltaLeft), fx)), InvScale4);
+
+            __m128 LengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)), One4);
+            __m128 InvLength = _mm_div_ps(One4, _mm_sqrt_ps(LengthSquared));
+
+            float nx[4];
+            float ny[4];
+            float nz[4];
+            _mm_storeu_ps(nx, _mm_mul_ps(_mm_sub_ps(Zero4, dx), InvLength));
+            _mm_storeu_ps(ny, InvLength);
+            _mm_storeu_ps(nz, _mm_mul_ps(_mm_sub_ps(Zero4, dz), InvLength));
+
+            for (int j = 0 ; j < 4 ; j++) {
+                pNormals[i + j] = Vector3f(nx[j], ny[j], nz[j]);
+            }
+        }
+    }
+#endif
+
+    for ( ; i < End ; i++) {
+        QueryPoint(i);
+    }
+}
+
+
+void QueryTerrainHeights(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale,
+                         const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals)
+{
+    ParallelFor(0, Count, [&](int Start, int End) {
+        QueryRange(HeightMap, TerrainSize, WorldScale, pX, pZ, Start, End, pHeights, pNormals);
+    }, MIN_QUERIES_PER_THREAD);
+}
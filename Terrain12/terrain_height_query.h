@@ -0,0 +1,36 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TERRAIN_HEIGHT_QUERY_H
+#define TERRAIN_HEIGHT_QUERY_H
+
+#include "ogldev_math_3d.h"
+#include "ogldev_array_2d.h"
+
+//
+// Bilinear height (and optionally normal) of Count world space points given as separate
+// x and z arrays. The points are clamped to the edges of the height map. Four points are
+// interpolated together with SSE2 - the two corners of each row are adjacent in memory so
+// every point needs two 64 bit loads and no gathers. Large batches are split between threads.
+//
+// pNormals can be NULL. The normals are those of the bilinear surface at the point.
+//
+void QueryTerrainHeights(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale,
+                         const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals = NULL);
+
+#endif
@@ -0,0 +1,239 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "ogldev_simd.h"
+#include "terrain_noise.h"
+
+#define HASH_PRIME_X    0x8da6b343u
+#define HASH_PRIME_Z    0xd8163841u
+#define HASH_PRIME_SEED 0xcb1ab31fu
+#define HASH_MIX        0x5bd1e995u
+#define GRADIENT_SCALE  (2.0f / 65535.0f)
+
+
+static inline u32 HashLatticePoint(int ix, int iz, u32 Seed)
+{
+    u32 h = ((u32)ix * HASH_PRIME_X) ^ ((u32)iz * HASH_PRIME_Z) ^ (Seed * HASH_PRIME_SEED);
+    h ^= h >> 13;
+    h *= HASH_MIX;
+    h ^= h >> 15;
+    return h;
+}
+
+
+// Dot product of the gradient of the lattice point and the offset from it
+static inline float CalcGradientDot(u32 h, float dx, float dz)
+{
+    float gx = (float)(h & 0xffff) * GRADIENT_SCALE - 1.0f;
+    float gz = (float)(h >> 16) * GRADIENT_SCALE - 1.0f;
+    return gx * dx + gz * dz;
+}
+
+
+static inline float Fade(float t)
+{
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+
+static float GradientNoise(float x, float z, u32 Seed)
+{
+    float x0 = floorf(x);
+    float z0 = floorf(z);
+    int ix = (int)x0;
+    int iz = (int)z0;
+    float fx = x - x0;
+    float fz = z - z0;
+
+    float n00 = CalcGradientDot(HashLatticePoint(ix, iz, Seed), fx, fz);
+    float n10 = CalcGradientDot(HashLatticePoint(ix + 1, iz, Seed), fx - 1.0f, fz);
+    float n01 = CalcGradientDot(HashLatticePoint(ix, iz + 1, Seed), fx, fz - 1.0f);
+    float n11 = CalcGradientDot(HashLatticePoint(ix + 1, iz + 1, Seed), fx - 1.0f, fz - 1.0f);
+
+    float u = Fade(fx);
+    float v = Fade(fz);
+    float Bottom = n00 + (n10 - n00) * u;
+    float Top = n01 + (n11 - n01) * u;
+
+    return Bottom + (Top - Bottom) * v;
+}
+
+
+void TerrainNoise::Init(const TerrainNoiseParams& Params)
+{
+    m_params = Params;
+
+    float Sum = 0.0f;
+    float Amplitude = 1.0f;
+
+    for (int i = 0 ; i < m_params.NumOctaves ; i++) {
+        Sum += Amplitude;
+        Amplitude *= m_params.Gain;
+    }
+
+    m_invAmplitudeSum = (Sum > 0.0f) ? 1.0f / Sum : 0.0f;
+}
+
+
+float TerrainNoise::GetHeight(float x, float z) const
+{
+    float Frequency = m_params.Frequency;
+    float Amplitude = 1.0f;
+    float Sum = 0.0f;
+
+    for (int i = 0 ; i < m_params.NumOctaves ; i++) {
+        float n = GradientNoise(x * Frequency, z * Frequency, m_params.Seed + (u32)i);
+        float FBm = n * 0.5f + 0.5f;
+        float Ridge = 1.0f - fabsf(n);
+        Ridge = Ridge * Ridge;
+
+        Sum += Amplitude * (FBm + (Ridge - FBm) * m_params.Ridged);
+
+        Frequency *= m_params.Lacunarity;
+        Amplitude *= m_params.Gain;
+    }
+
+    return m_params.MinHeight + (m_params.MaxHeight - m_params.MinHeight) * Sum * m_invAmplitudeSum;
+}
+
+
+#ifdef OGLDEV_SSE2
+
+// Low 32 bits of the four products (SSE2 has only the 32x32->64 bit multiply of two lanes)
+static inline __m128i MulLo32(__m128i a, __m128i b)
+{
+    __m128i Even = _mm_mul_epu32(a, b);
+    __m128i Odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+    return _mm_unpacklo_epi32(_mm_shuffle_epi32(Even, _MM_SHUFFLE(0, 0, 2, 0)),
+                              _mm_shuffle_epi32(Odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+static inline __m128i HashLatticePoint4(__m128i ix, __m128i iz, __m128i SeedHash)
+{
+    __m128i h = _mm_xor_si128(_mm_xor_si128(MulLo32(ix, _mm_set1_epi32((int)HASH_PRIME_X)),
+                                            MulLo32(iz, _mm_set1_epi32((int)HASH_PRIME_Z))), SeedHash);
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+    h = MulLo32(h, _mm_set1_epi32((int)HASH_MIX));
+    h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+    return h;
+}
+
+
+static inline __m128 CalcGradientDot4(__m128i h, __m128 dx, __m128 dz)
+{
+    __m128 Scale = _mm_set1_ps(GRADIENT_SCALE);
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 gx = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(h, _mm_set1_epi32(0xffff))), Scale), One);
+    __m128 gz = _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(h, 16)), Scale), One);
+    return _mm_add_ps(_mm_mul_ps(gx, dx), _mm_mul_ps(gz, dz));
+}
+
+
+static inline __m128 Fade4(__m128 t)
+{
+    __m128 t3 = _mm_mul_ps(_mm_mul_ps(t, t), t);
+    __m128 Poly = _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+    return _mm_mul_ps(t3, Poly);
+}
+
+
+static inline __m128 Floor4(__m128 x)
+{
+    // Truncation rounds the negative values up
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(x));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, x), _mm_set1_ps(1.0f)));
+}
+
+
+static __m128 GradientNoise4(__m128 x, __m128 z, u32 Seed)
+{
+    __m128 x0 = Floor4(x);
+    __m128 z0 = Floor4(z);
+    __m128i ix = _mm_cvttps_epi32(x0);
+    __m128i iz = _mm_cvttps_epi32(z0);
+    __m128i ix1 = _mm_add_epi32(ix, _mm_set1_epi32(1));
+    __m128i iz1 = _mm_add_epi32(iz, _mm_set1_epi32(1));
+    __m128 fx = _mm_sub_ps(x, x0);
+    __m128 fz = _mm_sub_ps(z, z0);
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 fx1 = _mm_sub_ps(fx, One);
+    __m128 fz1 = _mm_sub_ps(fz, One);
+    __m128i SeedHash = _mm_set1_epi32((int)(Seed * HASH_PRIME_SEED));
+
+    __m128 n00 = CalcGradientDot4(HashLatticePoint4(ix, iz, SeedHash), fx, fz);
+    __m128 n10 = CalcGradientDot4(HashLatticePoint4(ix1, iz, SeedHash), fx1, fz);
+    __m128 n01 = CalcGradientDot4(HashLatticePoint4(ix, iz1, SeedHash), fx, fz1);
+    __m128 n11 = CalcGradientDot4(HashLatticePoint4(ix1, iz1, SeedHash), fx1, fz1);
+
+    __m128 u = Fade4(fx);
+    __m128 v = Fade4(fz);
+    __m128 Bottom = _mm_add_ps(n00, _mm_mul_ps(_mm_sub_ps(n10, n00), u));
+    __m128 Top = _mm_add_ps(n01, _mm_mul_ps(_mm_sub_ps(n11, n01), u));
+
+    return _mm_add_ps(Bottom, _mm_mul_ps(_mm_sub_ps(Top, Bottom), v));
+}
+
+#endif
+
+
+void TerrainNoise::GetHeights(float x, float z, float Step, int Count, float* pHeights) const
+{
+    int i = 0;
+
+#ifdef OGLDEV_SSE2
+    __m128 Half = _mm_set1_ps(0.5f);
+    __m128 One = _mm_set1_ps(1.0f);
+    __m128 AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    __m128 Ridged = _mm_set1_ps(m_params.Ridged);
+    __m128 z4 = _mm_set1_ps(z);
+
+    for ( ; i + 4 <= Count ; i += 4) {
+        __m128 Index = _mm_setr_ps((float)i, (float)(i + 1), (float)(i + 2), (float)(i + 3));
+        __m128 x4 = _mm_add_ps(_mm_set1_ps(x), _mm_mul_ps(Index, _mm_set1_ps(Step)));
+
+        float Frequency = m_params.Frequency;
+        float Amplitude = 1.0f;
+        __m128 Sum = _mm_setzero_ps();
+
+        for (int Octave = 0 ; Octave < m_params.NumOctaves ; Octave++) {
+            __m128 Freq4 = _mm_set1_ps(Frequency);
+            __m128 n = GradientNoise4(_mm_mul_ps(x4, Freq4), _mm_mul_ps(z4, Freq4), m_params.Seed + (u32)Octave);
+            __m128 FBm = _mm_add_ps(_mm_mul_ps(n, Half), Half);
+            __m128 Ridge = _mm_sub_ps(One, _mm_and_ps(n, AbsMask));
+            Ridge = _mm_mul_ps(Ridge, Ridge);
+
+            __m128 Value = _mm_add_ps(FBm, _mm_mul_ps(_mm_sub_ps(Ridge, FBm), Ridged));
+            Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_set1_ps(Amplitude), Value));
+
+            Frequency *= m_params.Lacunarity;
+            Amplitude *= m_params.Gain;
+        }
+
+        __m128 Range = _mm_set1_ps(m_params.MaxHeight - m_params.MinHeight);
+        __m128 Height = _mm_add_ps(_mm_set1_ps(m_params.MinHeight), _mm_mul_ps(_mm_mul_ps(Range, Sum), _mm_set1_ps(m_invAmplitudeSum)));
+        _mm_storeu_ps(pHeights + i, Height);
+    }
+#endif
+
+    for ( ; i < Count ; i++) {
+        pHeights[i] = GetHeight(x + (float)i * Step, z);
+    }
+}
@@ -0,0 +1,64 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TERRAIN_NOISE_H
+#define TERRAIN_NOISE_H
+
+#include "ogldev_types.h"
+
+struct TerrainNoiseParams {
+    u32 Seed = 1;
+    int NumOctaves = 8;
+    float Frequency = 1.0f / 1024.0f;   // of the first octave, in cycles per world unit
+    float Lacunarity = 2.0f;            // frequency ratio between octaves
+    float Gain = 0.5f;                  // amplitude ratio between octaves
+    float Ridged = 0.5f;                // blend between fBm (0) and ridged noise (1)
+    float MinHeight = 0.0f;
+    float MaxHeight = 256.0f;
+};
+
+//
+// Height function of the infinite terrain - octaves of 2D gradient noise summed as fBm
+// and as ridged noise (one minus the absolute value, squared) and blended. The gradients
+// come from an integer hash of the lattice point and the seed instead of a permutation
+// table so every octave gets its own seed and there are no gathers in the SSE2 version.
+//
+// The height is a pure function of the world position so chunks that are built
+// separately (and on different threads) agree on their shared edges. GetHeights gives
+// exactly the same results as GetHeight.
+//
+class TerrainNoise {
+ public:
+    TerrainNoise() {}
+
+    void Init(const TerrainNoiseParams& Params);
+
+    const TerrainNoiseParams& GetParams() const { return m_params; }
+
+    float GetHeight(float x, float z) const;
+
+    // Count heights at (x + i * Step, z). Four at a time with SSE2.
+    void GetHeights(float x, float z, float Step, int Count, float* pHeights) const;
+
+ private:
+
+    TerrainNoiseParams m_params;
+    float m_invAmplitudeSum = 1.0f;
+};
+
+#endif
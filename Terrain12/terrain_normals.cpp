@@ -0,0 +1,158 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "ogldev_simd.h"
+#include "ogldev_parallel.h"
+#include "terrain_normals.h"
+
+#define MIN_ROWS_PER_THREAD 32
+
+
+//
+// Normals of row z in SoA form. The edge points use one sided differences. Interior
+// points get (hL - hR, 2 * WorldScale, hD - hU) / 2 before the normalization.
+//
+static void CalcNormalRow(const Array2D<float>& HeightMap, int Size, float WorldScale, int z,
+                          float* pX, float* pY, float* pZ)
+{
+    const float* pRow = HeightMap.GetRow(z);
+    const float* pPrev = HeightMap.GetRow(std::max(z - 1, 0));
+    const float* pNext = HeightMap.GetRow(std::min(z + 1, Size - 1));
+
+    float InvDeltaZ = 1.0f / (float)(std::min(z + 1, Size - 1) - std::max(z - 1, 0));
+
+    auto CalcPoint = [&](int x) {
+        int x0 = std::max(x - 1, 0);
+        int x1 = std::min(x + 1, Size - 1);
+
+        float nx = (pRow[x0] - pRow[x1]) / (float)(x1 - x0);
+        float nz = (pPrev[x] - pNext[x]) * InvDeltaZ;
+        float InvLength = 1.0f / sqrtf(nx * nx + WorldScale * WorldScale + nz * nz);
+
+        pX[x] = nx * InvLength;
+        pY[x] = WorldScale * InvLength;
+        pZ[x] = nz * InvLength;
+    };
+
+    CalcPoint(0);
+
+    int x = 1;
+
+#ifdef OGLDEV_SSE2
+    __m128 Half4 = _mm_set1_ps(0.5f);
+    __m128 InvDeltaZ4 = _mm_set1_ps(InvDeltaZ);
+    __m128 Scale4 = _mm_set1_ps(WorldScale);
+    __m128 ScaleSquared4 = _mm_set1_ps(WorldScale * WorldScale);
+    __m128 One4 = _mm_set1_ps(1.0f);
+
+    for ( ; x + 4 <= Size - 1 ; x += 4) {
+        __m128 Left  = _mm_loadu_ps(pRow + x - 1);
+        __m128 Right = _mm_loadu_ps(pRow + x + 1);
+        __m128 Down  = _mm_loadu_ps(pPrev + x);
+        __m128 Up    = _mm_loadu_ps(pNext + x);
+
+        __m128 nx = _mm_mul_ps(_mm_sub_ps(Left, Right), Half4);
+        __m128 nz = _mm_mul_ps(_mm_sub_ps(Down, Up), InvDeltaZ4);
+
+        __m128 LengthSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(nz, nz)), ScaleSquared4);
+        __m128 InvLength = _mm_div_ps(One4, _mm_sqrt_ps(LengthSquared));
+
+        _mm_storeu_ps(pX + x, _mm_mul_ps(nx, InvLength));
+        _mm_storeu_ps(pY + x, _mm_mul_ps(Scale4, InvLength));
+        _mm_storeu_ps(pZ + x, _mm_mul_ps(nz, InvLength));
+    }
+#endif
+
+    for ( ; x < Size ; x++) {
+        CalcPoint(x);
+    }
+}
+
+
+void CalcTerrainNormals(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale, Array2D<Vector3f>& Normals)
+{
+    Normals.InitArray2D(TerrainSize, TerrainSize);
+
+    ParallelFor(0, TerrainSize, [&](int StartZ, int EndZ) {
+        std::vector<float> Row(TerrainSize * 3);
+        float* pX = &Row[0];
+        float* pY = pX + TerrainSize;
+        float* pZ = pY + TerrainSize;
+
+        for (int z = StartZ ; z < EndZ ; z++) {
+            CalcNormalRow(HeightMap, TerrainSize, WorldScale, z, pX, pY, pZ);
+
+            Vector3f* pDst = Normals.GetRow(z);
+
+            for (int x = 0 ; x < TerrainSize ; x++) {
+                pDst[x] = Vector3f(pX[x], pY[x], pZ[x]);
+            }
+        }
+    }, MIN_ROWS_PER_THREAD);
+}
+
+
+void BakeOctahedralNormalMap(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale, std::vector<i16>& NormalMap)
+{
+    NormalMap.resize((size_t)TerrainSize * TerrainSize * 2);
+
+    ParallelFor(0, TerrainSize, [&](int StartZ, int EndZ) {
+        std::vector<float> Row(TerrainSize * 3);
+        float* pX = &Row[0];
+        float* pY = pX + TerrainSize;
+        float* pZ = pY + TerrainSize;
+
+        for (int z = StartZ ; z < EndZ ; z++) {
+            CalcNormalRow(HeightMap, TerrainSize, WorldScale, z, pX, pY, pZ);
+
+            i16* pDst = &NormalMap[(size_t)z * TerrainSize * 2];
+
+            for (int x = 0 ; x < TerrainSize ; x++) {
+                EncodeOctahedral(pX[x], pY[x], pZ[x], pDst + x * 2);
+            }
+        }
+    }, MIN_ROWS_PER_THREAD);
+}
+
+
+GLuint CreateNormalMapTexture(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale)
+{
+    std::vector<i16> NormalMap;
+    BakeOctahedralNormalMap(HeightMap, TerrainSize, WorldScale, NormalMap);
+
+    GLuint Texture = 0;
+    glGenTextures(1, &Texture);
+    glBindTexture(GL_TEXTURE_2D, Texture);
+
+    // The rows are 4 byte aligned anyway
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16_SNORM, TerrainSize, TerrainSize, 0, GL_RG, GL_SHORT, &NormalMap[0]);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return Texture;
+}
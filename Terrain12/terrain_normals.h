@@ -0,0 +1,70 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TERRAIN_NORMALS_H
+#define TERRAIN_NORMALS_H
+
+#include <GL/glew.h>
+#include <math.h>
+#include <vector>
+#include <limits>
+
+#include "ogldev_types.h"
+#include "ogldev_math_3d.h"
+#include "ogldev_array_2d.h"
+
+//
+// Normals from the central differences of the height map. They depend only on the
+// height map (not on the triangles of any LOD) so every renderer can share them. The
+// rows are processed in parallel and the interior of every row with SSE2.
+//
+
+void CalcTerrainNormals(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale, Array2D<Vector3f>& Normals);
+
+//
+// Octahedral mapping of a unit normal around the up axis into two signed normalized
+// values. Used by the normal map (i16) and the compact geomip vertices (i8). The
+// inverse is in terrain_compact.vs.
+//
+template<typename T>
+inline void EncodeOctahedral(float x, float y, float z, T* pOut)
+{
+    float Sum = fabsf(x) + fabsf(y) + fabsf(z);
+    float u = x / Sum;
+    float v = z / Sum;
+
+    if (y < 0.0f) {
+        float OrigU = u;
+        u = (1.0f - fabsf(v)) * ((OrigU >= 0.0f) ? 1.0f : -1.0f);
+        v = (1.0f - fabsf(OrigU)) * ((v >= 0.0f) ? 1.0f : -1.0f);
+    }
+
+    float Scale = (float)std::numeric_limits<T>::max();
+
+    pOut[0] = (T)roundf(u * Scale);
+    pOut[1] = (T)roundf(v * Scale);
+}
+
+// Octahedral encoded normals - two signed 16 bit values per point (GL_RG16_SNORM)
+void BakeOctahedralNormalMap(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale, std::vector<i16>& NormalMap);
+
+// RG16_SNORM texture with one texel per height map point and linear filtering
+GLuint CreateNormalMapTexture(const Array2D<float>& HeightMap, int TerrainSize, float WorldScale);
+
+#endif
@@ -0,0 +1,769 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stddef.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+
+#include "ogldev_util.h"
+#include "ogldev_parallel.h"
+#include "terrain_scatter.h"
+#include "terrain.h"
+
+#define POSITION_LOC        0
+#define NORMAL_LOC          1
+#define COLOR_LOC           2
+#define INSTANCE_POS_LOC    3
+#define INSTANCE_PARAMS_LOC 4
+
+#define SCATTER_TILE_SIZE   32          // quads on the side of a tile
+#define MAX_GROUPS_X        65535       // workgroups in the first dimension of a dispatch
+
+#define HASH_PRIME_X    0x9e3779b1u
+#define HASH_PRIME_Z    0x85ebca77u
+#define HASH_PRIME_SEED 0xc2b2ae3du
+#define HASH_MIX        0x27d4eb2fu
+
+// Dimensions of the procedural meshes. The billboard silhouettes in scatter.fs follow them.
+#define GRASS_BOTTOM_HALF_WIDTH 0.25f
+#define GRASS_TOP_HALF_WIDTH    0.1f
+#define ROCK_CENTER_HEIGHT      0.4f
+#define ROCK_RADIUS_X           0.7f
+#define ROCK_RADIUS_Y           0.5f
+#define ROCK_RADIUS_Z           0.6f
+#define TREE_TRUNK_RADIUS       0.04f
+#define TREE_TRUNK_HEIGHT       0.3f
+#define TREE_CROWN_BASE         0.25f
+#define TREE_CROWN_RADIUS       0.3f
+
+#define GRASS_BASE_COLOR    Vector3f(0.15f, 0.35f, 0.08f)
+#define GRASS_TIP_COLOR     Vector3f(0.45f, 0.65f, 0.2f)
+#define ROCK_COLOR          Vector3f(0.45f, 0.43f, 0.4f)
+#define TRUNK_COLOR         Vector3f(0.35f, 0.22f, 0.1f)
+#define CROWN_BASE_COLOR    Vector3f(0.1f, 0.35f, 0.1f)
+#define CROWN_TIP_COLOR     Vector3f(0.2f, 0.5f, 0.15f)
+
+
+static inline u32 HashCell(int x, int z, u32 Seed)
+{
+    u32 h = ((u32)x * HASH_PRIME_X) ^ ((u32)z * HASH_PRIME_Z) ^ (Seed * HASH_PRIME_SEED);
+    h ^= h >> 15;
+    h *= HASH_MIX;
+    h ^= h >> 13;
+    return h;
+}
+
+
+// Advances the state of the cell and returns a number in [0, 1)
+static inline float NextRandom(u32& h)
+{
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return (float)(h >> 8) * (1.0f / 16777216.0f);
+}
+
+
+static float CalcRegionPercent(const ScatterRegion& Region, float Value)
+{
+    if ((Value < Region.Low) || (Value > Region.High)) {
+        return 0.0f;
+    }
+
+    if (Value <= Region.Optimal) {
+        return (Region.Optimal > Region.Low) ? (Value - Region.Low) / (Region.Optimal - Region.Low) : 1.0f;
+    }
+
+    return (Region.High > Region.Optimal) ? (Region.High - Value) / (Region.High - Region.Optimal) : 1.0f;
+}
+
+
+TerrainScatter::~TerrainScatter()
+{
+    Destroy();
+}
+
+
+void TerrainScatter::Destroy()
+{
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+
+    GLuint* Buffers[] = { &m_vb, &m_ib, &m_instanceBuffer, &m_pieceBuffer, &m_visibleBuffer, &m_commandBuffer };
+
+    for (int i = 0 ; i < (int)ARRAY_SIZE_IN_ELEMENTS(Buffers) ; i++) {
+        if (*Buffers[i] > 0) {
+            glDeleteBuffers(1, Buffers[i]);
+            *Buffers[i] = 0;
+        }
+    }
+
+    m_pieceBufferSize = 0;
+    m_layers.clear();
+    m_instances.clear();
+    m_pieces.clear();
+    m_tiles.clear();
+    m_visiblePieces.clear();
+    m_vertices.clear();
+    m_indices.clear();
+    m_commands.clear();
+    m_capacities.clear();
+    m_stats = ScatterStats();
+}
+
+
+bool TerrainScatter::CreateScatter(const BaseTerrain* pTerrain, const std::vector<ScatterLayer>& Layers, u32 Seed)
+{
+    if (!GLEW_VERSION_4_3) {
+        printf("Terrain scatter requires OpenGL 4.3\n");
+        return false;
+    }
+
+    if (Layers.empty() || (Layers.size() > SCATTER_MAX_LAYERS)) {
+        printf("Terrain scatter supports 1 to %d layers (%d)\n", SCATTER_MAX_LAYERS, (int)Layers.size());
+        return false;
+    }
+
+    if (!m_techInitialized) {
+        if (!m_tech.Init() || !m_cullTech.Init()) {
+            printf("Error initializing the scatter techniques\n");
+            return false;
+        }
+
+        m_techInitialized = true;
+    }
+
+    Destroy();
+
+    m_layers = Layers;
+
+    CreateMeshes();
+
+    auto StartTime = std::chrono::steady_clock::now();
+
+    PlaceInstances(pTerrain, Seed);
+
+    auto EndTime = std::chrono::steady_clock::now();
+    m_stats.GenerateTime = std::chrono::duration<float, std::milli>(EndTime - StartTime).count();
+    m_stats.NumInstances = (int)m_instances.size();
+    m_stats.NumTiles = (int)m_tiles.size();
+
+    CreateDrawCommands();
+
+    CreateGLState();
+
+    return true;
+}
+
+
+void TerrainScatter::PlaceInstances(const BaseTerrain* pTerrain, u32 Seed)
+{
+    int NumQuads = pTerrain->GetSize() - 1;
+    m_numTilesX = (NumQuads + SCATTER_TILE_SIZE - 1) / SCATTER_TILE_SIZE;
+    m_numTilesZ = m_numTilesX;
+    m_tileWorldSize = (float)SCATTER_TILE_SIZE * pTerrain->GetWorldScale();
+
+    int NumTiles = m_numTilesX * m_numTilesZ;
+    std::vector<std::vector<Instance>> TileInstances(NumTiles);
+
+    ParallelFor(0, NumTiles, [&](int Start, int End) {
+        for (int t = Start ; t < End ; t++) {
+            PlaceTile(pTerrain, t % m_numTilesX, t / m_numTilesX, Seed, TileInstances[t]);
+        }
+    });
+
+    int NumLayers = (int)m_layers.size();
+    m_tiles.resize(NumTiles);
+
+    for (int t = 0 ; t < NumTiles ; t++) {
+        const std::vector<Instance>& Instances = TileInstances[t];
+        Tile& tile = m_tiles[t];
+
+        tile.Min = Vector3f(FLT_MAX, FLT_MAX, FLT_MAX);
+        tile.Max = Vector3f(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+
+        int First = (int)m_instances.size();
+        int i = 0;
+
+        // The instances of the tile are sorted by layer
+        for (int Layer = 0 ; Layer < NumLayers ; Layer++) {
+            tile.FirstPiece[Layer] = (int)m_pieces.size();
+
+            int LayerStart = i;
+
+            for ( ; (i < (int)Instances.size()) && ((int)Instances[i].Params.z == Layer) ; i++) {
+                const MeshRange& Mesh = m_meshes[m_layers[Layer].Mesh];
+                const Vector4f& p = Instances[i].PosScale;
+                float Radius = Mesh.Radius * p.w;
+                Vector3f Center(p.x, p.y + Mesh.CenterHeight * p.w, p.z);
+
+                tile.Min.x = std::min(tile.Min.x, Center.x - Radius);
+                tile.Min.y = std::min(tile.Min.y, Center.y - Radius);
+                tile.Min.z = std::min(tile.Min.z, Center.z - Radius);
+                tile.Max.x = std::max(tile.Max.x, Center.x + Radius);
+                tile.Max.y = std::max(tile.Max.y, Center.y + Radius);
+                tile.Max.z = std::max(tile.Max.z, Center.z + Radius);
+            }
+
+            for (int Start = LayerStart ; Start < i ; Start += SCATTER_CULL_GROUP_SIZE) {
+                int Count = std::min(i - Start, SCATTER_CULL_GROUP_SIZE);
+                m_pieces.push_back({ First + Start, Count });
+            }
+        }
+
+        tile.FirstPiece[NumLayers] = (int)m_pieces.size();
+
+        m_instances.insert(m_instances.end(), Instances.begin(), Instances.end());
+    }
+}
+
+
+void TerrainScatter::PlaceTile(const BaseTerrain* pTerrain, int TileX, int TileZ, u32 Seed, std::vector<Instance>& Instances) const
+{
+    float WorldSize = (float)(pTerrain->GetSize() - 1) * pTerrain->GetWorldScale();
+    float x0 = (float)TileX * m_tileWorldSize;
+    float z0 = (float)TileZ * m_tileWorldSize;
+    float x1 = std::min(x0 + m_tileWorldSize, WorldSize);
+    float z1 = std::min(z0 + m_tileWorldSize, WorldSize);
+
+    std::vector<float> X, Z, Heights;
+    std::vector<Vector3f> Normals;
+    std::vector<u32> States;
+
+    for (int Layer = 0 ; Layer < (int)m_layers.size() ; Layer++) {
+        const ScatterLayer& Desc = m_layers[Layer];
+
+        if (Desc.Density <= 0.0f) {
+            continue;
+        }
+
+        // A cell belongs to the tile that contains its corner
+        float CellSize = 1.0f / sqrtf(Desc.Density);
+        int CellX0 = (int)ceilf(x0 / CellSize);
+        int CellZ0 = (int)ceilf(z0 / CellSize);
+        int CellX1 = (int)ceilf(x1 / CellSize);
+        int CellZ1 = (int)ceilf(z1 / CellSize);
+
+        X.clear();
+        Z.clear();
+        States.clear();
+
+        for (int CellZ = CellZ0 ; CellZ < CellZ1 ; CellZ++) {
+            for (int CellX = CellX0 ; CellX < CellX1 ; CellX++) {
+                u32 h = HashCell(CellX, CellZ, Seed + (u32)Layer);
+                float x = ((float)CellX + NextRandom(h)) * CellSize;
+                float z = ((float)CellZ + NextRandom(h)) * CellSize;
+
+                if ((x < WorldSize) && (z < WorldSize)) {
+                    X.push_back(x);
+                    Z.push_back(z);
+                    States.push_back(h);
+                }
+            }
+        }
+
+        int Count = (int)X.size();
+        Heights.resize(Count);
+        Normals.resize(Count);
+
+        pTerrain->GetWorldHeights(X.data(), Z.data(), Count, Heights.data(), Normals.data());
+
+        for (int i = 0 ; i < Count ; i++) {
+            float Density = CalcRegionPercent(Desc.HeightRegion, Heights[i]) *
+                            CalcRegionPercent(Desc.SlopeRegion, 1.0f - Normals[i].y);
+
+            u32 h = States[i];
+
+            if (NextRandom(h) >= Density) {
+                continue;
+            }
+
+            float Scale = Desc.MinScale + (Desc.MaxScale - Desc.MinScale) * NextRandom(h);
+            float Angle = NextRandom(h) * 2.0f * (float)M_PI;
+
+            Instance Inst;
+            Inst.PosScale = Vector4f(X[i], Heights[i], Z[i], Scale);
+            Inst.Params = Vector4f(cosf(Angle), sinf(Angle), (float)Layer, 0.0f);
+            Instances.push_back(Inst);
+        }
+    }
+}
+
+
+// The normal of the face points away from 'Inside'
+static void AddTriangle(std::vector<TerrainScatter::Vertex>& Vertices, std::vector<GLuint>& Indices,
+                        const Vector3f& Inside, const Vector3f* pPos, const Vector3f* pColors)
+{
+    Vector3f Normal = (pPos[1] - pPos[0]).Cross(pPos[2] - pPos[0]);
+    Normal.Normalize();
+
+    Vector3f Center = (pPos[0] + pPos[1] + pPos[2]) / 3.0f;
+
+    if (Normal.Dot(Center - Inside) < 0.0f) {
+        Normal = Normal * -1.0f;
+    }
+
+    for (int i = 0 ; i < 3 ; i++) {
+        Indices.push_back((GLuint)Vertices.size());
+        Vertices.push_back({ pPos[i], Normal, pColors[i] });
+    }
+}
+
+
+// Three crossed quads that are lit like the ground under them
+static void CreateGrassMesh(std::vector<TerrainScatter::Vertex>& Vertices, std::vector<GLuint>& Indices)
+{
+    Vector3f Up(0.0f, 1.0f, 0.0f);
+
+    for (int i = 0 ; i < 3 ; i++) {
+        float Angle = (float)i * (float)M_PI / 3.0f;
+        float dx = cosf(Angle);
+        float dz = sinf(Angle);
+
+        GLuint Base = (GLuint)Vertices.size();
+
+        Vertices.push_back({ Vector3f(-dx * GRASS_BOTTOM_HALF_WIDTH, 0.0f, -dz * GRASS_BOTTOM_HALF_WIDTH), Up, GRASS_BASE_COLOR });
+        Vertices.push_back({ Vector3f(dx * GRASS_BOTTOM_HALF_WIDTH, 0.0f, dz * GRASS_BOTTOM_HALF_WIDTH), Up, GRASS_BASE_COLOR });
+        Vertices.push_back({ Vector3f(dx * GRASS_TOP_HALF_WIDTH, 1.0f, dz * GRASS_TOP_HALF_WIDTH), Up, GRASS_TIP_COLOR });
+        Vertices.push_back({ Vector3f(-dx * GRASS_TOP_HALF_WIDTH, 1.0f, -dz * GRASS_TOP_HALF_WIDTH), Up, GRASS_TIP_COLOR });
+
+        GLuint QuadIndices[6] = { 0, 1, 2, 0, 2, 3 };
+
+        for (int j = 0 ; j < 6 ; j++) {
+            Indices.push_back(Base + QuadIndices[j]);
+        }
+    }
+}
+
+
+// A low poly ellipsoid with flat faces whose vertices are pushed in by up to 15%
+static void CreateRockMesh(std::vector<TerrainScatter::Vertex>& Vertices, std::vector<GLuint>& Indices)
+{
+    const int NumRings = 5;
+    const int NumSegments = 8;
+
+    Vector3f Center(0.0f, ROCK_CENTER_HEIGHT, 0.0f);
+    Vector3f Points[NumRings + 1][NumSegments];
+
+    for (int Ring = 0 ; Ring <= NumRings ; Ring++) {
+        float Theta = (float)Ring * (float)M_PI / (float)NumRings;
+
+        for (int Segment = 0 ; Segment < NumSegments ; Segment++) {
+            float Phi = (float)Segment * 2.0f * (float)M_PI / (float)NumSegments;
+
+            // The poles are a single point
+            bool Pole = (Ring == 0) || (Ring == NumRings);
+            u32 h = HashCell(Pole ? 0 : Segment, Ring, 0);
+            float Dent = 1.0f - 0.15f * NextRandom(h);
+
+            Points[Ring][Segment] = Center + Vector3f(sinf(Theta) * cosf(Phi) * ROCK_RADIUS_X,
+                                                      cosf(Theta) * ROCK_RADIUS_Y,
+                                                      sinf(Theta) * sinf(Phi) * ROCK_RADIUS_Z) * Dent;
+        }
+    }
+
+    for (int Ring = 0 ; Ring < NumRings ; Ring++) {
+        for (int Segment = 0 ; Segment < NumSegments ; Segment++) {
+            int Next = (Segment + 1) % NumSegments;
+
+            Vector3f Quad[4] = { Points[Ring][Segment], Points[Ring][Next], Points[Ring + 1][Next], Points[Ring + 1][Segment] };
+            Vector3f Colors[4];
+
+            // Darker towards the ground
+            for (int i = 0 ; i < 4 ; i++) {
+                Colors[i] = ROCK_COLOR * (0.7f + 0.3f * Quad[i].y / (ROCK_CENTER_HEIGHT + ROCK_RADIUS_Y));
+            }
+
+            if (Ring > 0) {
+                Vector3f Pos[3] = { Quad[0], Quad[1], Quad[2] };
+                Vector3f Col[3] = { Colors[0], Colors[1], Colors[2] };
+                AddTriangle(Vertices, Indices, Center, Pos, Col);
+            }
+
+            if (Ring < NumRings - 1) {
+                Vector3f Pos[3] = { Quad[0], Quad[2], Quad[3] };
+                Vector3f Col[3] = { Colors[0], Colors[2], Colors[3] };
+                AddTriangle(Vertices, Indices, Center, Pos, Col);
+            }
+        }
+    }
+}
+
+
+// A hexagonal trunk under a cone
+static void CreateTreeMesh(std::vector<TerrainScatter::Vertex>& Vertices, std::vector<GLuint>& Indices)
+{
+    const int NumTrunkSides = 6;
+    const int NumCrownSides = 8;
+
+    Vector3f TrunkColors[3] = { TRUNK_COLOR, TRUNK_COLOR, TRUNK_COLOR };
+    Vector3f TrunkInside(0.0f, TREE_TRUNK_HEIGHT * 0.5f, 0.0f);
+
+    for (int i = 0 ; i < NumTrunkSides ; i++) {
+        float a0 = (float)i * 2.0f * (float)M_PI / (float)NumTrunkSides;
+        float a1 = (float)(i + 1) * 2.0f * (float)M_PI / (float)NumTrunkSides;
+
+        Vector3f b0(cosf(a0) * TREE_TRUNK_RADIUS, 0.0f, sinf(a0) * TREE_TRUNK_RADIUS);
+        Vector3f b1(cosf(a1) * TREE_TRUNK_RADIUS, 0.0f, sinf(a1) * TREE_TRUNK_RADIUS);
+        Vector3f t0 = b0 + Vector3f(0.0f, TREE_TRUNK_HEIGHT, 0.0f);
+        Vector3f t1 = b1 + Vector3f(0.0f, TREE_TRUNK_HEIGHT, 0.0f);
+
+        Vector3f Tri0[3] = { b0, b1, t1 };
+        Vector3f Tri1[3] = { b0, t1, t0 };
+        AddTriangle(Vertices, Indices, TrunkInside, Tri0, TrunkColors);
+        AddTriangle(Vertices, Indices, TrunkInside, Tri1, TrunkColors);
+    }
+
+    Vector3f Apex(0.0f, 1.0f, 0.0f);
+    Vector3f BaseCenter(0.0f, TREE_CROWN_BASE, 0.0f);
+    Vector3f CrownInside(0.0f, TREE_CROWN_BASE + 0.15f, 0.0f);
+    Vector3f SideColors[3] = { CROWN_BASE_COLOR, CROWN_BASE_COLOR, CROWN_TIP_COLOR };
+    Vector3f BaseColors[3] = { CROWN_BASE_COLOR, CROWN_BASE_COLOR, CROWN_BASE_COLOR };
+
+    for (int i = 0 ; i < NumCrownSides ; i++) {
+        float a0 = (float)i * 2.0f * (float)M_PI / (float)NumCrownSides;
+        float a1 = (float)(i + 1) * 2.0f * (float)M_PI / (float)NumCrownSides;
+
+        Vector3f p0(cosf(a0) * TREE_CROWN_RADIUS, TREE_CROWN_BASE, sinf(a0) * TREE_CROWN_RADIUS);
+        Vector3f p1(cosf(a1) * TREE_CROWN_RADIUS, TREE_CROWN_BASE, sinf(a1) * TREE_CROWN_RADIUS);
+
+        Vector3f Side[3] = { p0, p1, Apex };
+        Vector3f Base[3] = { p1, p0, BaseCenter };
+        AddTriangle(Vertices, Indices, CrownInside, Side, SideColors);
+        AddTriangle(Vertices, Indices, CrownInside, Base, BaseColors);
+    }
+}
+
+
+void TerrainScatter::AddMesh(MeshRange& Range, const std::vector<Vertex>& Vertices, const std::vector<GLuint>& Indices)
+{
+    Range.FirstIndex = (int)m_indices.size();
+    Range.NumIndices = (int)Indices.size();
+    Range.BaseVertex = (int)m_vertices.size();
+
+    float MinY = FLT_MAX;
+    float MaxY = -FLT_MAX;
+
+    for (const Vertex& v : Vertices) {
+        MinY = std::min(MinY, v.Pos.y);
+        MaxY = std::max(MaxY, v.Pos.y);
+    }
+
+    Range.CenterHeight = (MinY + MaxY) * 0.5f;
+    Range.Radius = 0.0f;
+
+    for (const Vertex& v : Vertices) {
+        Vector3f d = v.Pos - Vector3f(0.0f, Range.CenterHeight, 0.0f);
+        Range.Radius = std::max(Range.Radius, d.Length());
+    }
+
+    m_vertices.insert(m_vertices.end(), Vertices.begin(), Vertices.end());
+    m_indices.insert(m_indices.end(), Indices.begin(), Indices.end());
+}
+
+
+void TerrainScatter::CreateMeshes()
+{
+    m_vertices.clear();
+    m_indices.clear();
+
+    for (int Mesh = 0 ; Mesh < SCATTER_NUM_MESHES ; Mesh++) {
+        std::vector<Vertex> Vertices;
+        std::vector<GLuint> Indices;
+
+        switch (Mesh) {
+        case SCATTER_MESH_GRASS:
+            CreateGrassMesh(Vertices, Indices);
+            m_meshes[Mesh].BillboardSize = Vector2f(GRASS_BOTTOM_HALF_WIDTH * 2.0f, 1.0f);
+            break;
+
+        case SCATTER_MESH_ROCK:
+            CreateRockMesh(Vertices, Indices);
+            m_meshes[Mesh].BillboardSize = Vector2f(ROCK_RADIUS_X * 2.0f, ROCK_CENTER_HEIGHT + ROCK_RADIUS_Y);
+            break;
+
+        case SCATTER_MESH_TREE:
+            CreateTreeMesh(Vertices, Indices);
+            m_meshes[Mesh].BillboardSize = Vector2f(TREE_CROWN_RADIUS * 2.0f, 1.0f);
+            break;
+        }
+
+        AddMesh(m_meshes[Mesh], Vertices, Indices);
+    }
+
+    // Turned towards the camera by the vertex shader
+    std::vector<Vertex> Quad = {
+        { Vector3f(-0.5f, 0.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f) },
+        { Vector3f(0.5f, 0.0f, 0.0f),  Vector3f(0.0f, 1.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f) },
+        { Vector3f(0.5f, 1.0f, 0.0f),  Vector3f(0.0f, 1.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f) },
+        { Vector3f(-0.5f, 1.0f, 0.0f), Vector3f(0.0f, 1.0f, 0.0f), Vector3f(1.0f, 1.0f, 1.0f) }
+    };
+
+    std::vector<GLuint> QuadIndices = { 0, 1, 2, 0, 2, 3 };
+
+    AddMesh(m_billboard, Quad, QuadIndices);
+}
+
+
+//
+// Every draw command has its own region in the buffer of the visible instances. A region
+// only has to hold the instances that can be within the draw distance of the command. A
+// jittered grid has at most one instance per cell so that is bounded by the number of
+// cells that touch a circle of that radius.
+//
+void TerrainScatter::CreateDrawCommands()
+{
+    int NumLayers = (int)m_layers.size();
+
+    std::vector<GLuint> LayerCounts(NumLayers, 0);
+
+    for (const Instance& Inst : m_instances) {
+        LayerCounts[(int)Inst.Params.z]++;
+    }
+
+    m_commands.resize(NumLayers * 2);
+    m_capacities.resize(NumLayers * 2);
+
+    GLuint Base = 0;
+
+    for (int Layer = 0 ; Layer < NumLayers ; Layer++) {
+        const ScatterLayer& Desc = m_layers[Layer];
+        const MeshRange& Mesh = m_meshes[Desc.Mesh];
+
+        GLuint MeshCapacity = 0;
+        GLuint BillboardCapacity = 0;
+
+        if (Desc.Density > 0.0f) {
+            float Margin = sqrtf(2.0f / Desc.Density);
+            float MeshDistance = std::min(Desc.BillboardDistance, Desc.MaxDistance) + Margin;
+            float MaxDistance = Desc.MaxDistance + Margin;
+
+            MeshCapacity = (GLuint)std::min((double)LayerCounts[Layer], ceil(M_PI * MeshDistance * MeshDistance * Desc.Density));
+
+            if (Desc.BillboardDistance < Desc.MaxDistance) {
+                BillboardCapacity = (GLuint)std::min((double)LayerCounts[Layer], ceil(M_PI * MaxDistance * MaxDistance * Desc.Density));
+            }
+        }
+
+        m_commands[Layer] = { (GLuint)Mesh.NumIndices, 0, (GLuint)Mesh.FirstIndex, Mesh.BaseVertex, Base };
+        m_capacities[Layer] = MeshCapacity;
+        Base += MeshCapacity;
+
+        m_commands[NumLayers + Layer] = { (GLuint)m_billboard.NumIndices, 0, (GLuint)m_billboard.FirstIndex, m_billboard.BaseVertex, Base };
+        m_capacities[NumLayers + Layer] = BillboardCapacity;
+        Base += BillboardCapacity;
+
+        m_layerBounds[Layer] = Vector4f(Mesh.CenterHeight, Mesh.Radius, Desc.BillboardDistance, Desc.MaxDistance);
+        m_layerColors[Layer] = Desc.Color;
+        m_billboardSizes[Layer] = Mesh.BillboardSize;
+        m_shapes[Layer] = Desc.Mesh;
+    }
+}
+
+
+void TerrainScatter::CreateGLState()
+{
+    glGenVertexArrays(1, &m_vao);
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * m_vertices.size(), m_vertices.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(POSITION_LOC);
+    glVertexAttribPointer(POSITION_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Pos));
+
+    glEnableVertexAttribArray(NORMAL_LOC);
+    glVertexAttribPointer(NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Normal));
+
+    glEnableVertexAttribArray(COLOR_LOC);
+    glVertexAttribPointer(COLOR_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, Color));
+
+    glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint) * m_indices.size(), m_indices.data(), GL_STATIC_DRAW);
+
+    // The base instance of a draw command selects its region of the visible instances
+    GLuint NumVisible = m_capacities.empty() ? 0 : m_commands.back().BaseInstance + m_capacities.back();
+
+    glGenBuffers(1, &m_visibleBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_visibleBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * std::max(NumVisible, 1u), NULL, GL_DYNAMIC_COPY);
+
+    glEnableVertexAttribArray(INSTANCE_POS_LOC);
+    glVertexAttribPointer(INSTANCE_POS_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const void*)offsetof(Instance, PosScale));
+    glVertexAttribDivisor(INSTANCE_POS_LOC, 1);
+
+    glEnableVertexAttribArray(INSTANCE_PARAMS_LOC);
+    glVertexAttribPointer(INSTANCE_PARAMS_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(Instance), (const void*)offsetof(Instance, Params));
+    glVertexAttribDivisor(INSTANCE_PARAMS_LOC, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &m_instanceBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_instanceBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Instance) * std::max(m_instances.size(), (size_t)1), m_instances.data(), GL_STATIC_DRAW);
+
+    glGenBuffers(1, &m_commandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawElementsIndirectCommand) * m_commands.size(), m_commands.data(), GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &m_pieceBuffer);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+void TerrainScatter::CollectPieces(const BaseTerrain* pTerrain, const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    FrustumCulling FC(ViewProj);
+    int NumLayers = (int)m_layers.size();
+
+    m_visiblePieces.clear();
+    m_stats.VisibleTiles = 0;
+    m_stats.TestedInstances = 0;
+
+    for (const Tile& tile : m_tiles) {
+        if (tile.FirstPiece[0] == tile.FirstPiece[NumLayers]) {
+            continue;
+        }
+
+        if (!FC.IsAABBInsideViewFrustum(tile.Min, tile.Max) || pTerrain->IsOccludedByTerrain(tile.Min, tile.Max)) {
+            continue;
+        }
+
+        float dx = std::max(std::max(tile.Min.x - CameraPos.x, CameraPos.x - tile.Max.x), 0.0f);
+        float dy = std::max(std::max(tile.Min.y - CameraPos.y, CameraPos.y - tile.Max.y), 0.0f);
+        float dz = std::max(std::max(tile.Min.z - CameraPos.z, CameraPos.z - tile.Max.z), 0.0f);
+        float Distance = sqrtf(dx * dx + dy * dy + dz * dz);
+
+        bool Visible = false;
+
+        for (int Layer = 0 ; Layer < NumLayers ; Layer++) {
+            if (Distance >= m_layers[Layer].MaxDistance) {
+                continue;
+            }
+
+            for (int Piece = tile.FirstPiece[Layer] ; Piece < tile.FirstPiece[Layer + 1] ; Piece++) {
+                m_visiblePieces.push_back(m_pieces[Piece]);
+                m_stats.TestedInstances += m_pieces[Piece].y;
+                Visible = true;
+            }
+        }
+
+        if (Visible) {
+            m_stats.VisibleTiles++;
+        }
+    }
+}
+
+
+void TerrainScatter::UploadPieces()
+{
+    int NumPieces = (int)m_visiblePieces.size();
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_pieceBuffer);
+
+    if (NumPieces > m_pieceBufferSize) {
+        m_pieceBufferSize = NumPieces * 2;
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(Vector2i) * m_pieceBufferSize, NULL, GL_STREAM_DRAW);
+    }
+
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Vector2i) * NumPieces, m_visiblePieces.data());
+
+    // The instance counts start from zero every frame
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DrawElementsIndirectCommand) * m_commands.size(), m_commands.data());
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+
+void TerrainScatter::Render(const BaseTerrain* pTerrain, const Vector3f& CameraPos, const Matrix4f& ViewProj, const Vector3f& LightDir)
+{
+    if (!IsCreated()) {
+        return;
+    }
+
+    CollectPieces(pTerrain, CameraPos, ViewProj);
+
+    int NumPieces = (int)m_visiblePieces.size();
+
+    if (NumPieces == 0) {
+        return;
+    }
+
+    UploadPieces();
+
+    int NumLayers = (int)m_layers.size();
+
+    m_cullTech.Enable();
+    m_cullTech.SetPass(0);
+    m_cullTech.SetCameraPos(CameraPos);
+    m_cullTech.SetFrustumPlanes(ViewProj);
+    m_cullTech.SetNumPieces(NumPieces);
+    m_cullTech.SetLayerBounds(NumLayers, m_layerBounds);
+    m_cullTech.SetCapacities(NumLayers * 2, m_capacities.data());
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_instanceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_pieceBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_visibleBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_commandBuffer);
+
+    int NumGroupsX = std::min(NumPieces, MAX_GROUPS_X);
+    int NumGroupsY = (NumPieces + NumGroupsX - 1) / NumGroupsX;
+
+    glDispatchCompute(NumGroupsX, NumGroupsY, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    m_cullTech.SetPass(1);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+    m_tech.Enable();
+    m_tech.SetVP(ViewProj);
+    m_tech.SetCameraPos(CameraPos);
+    m_tech.SetLightDir(LightDir);
+    m_tech.SetLayerParams(NumLayers, m_layerColors, m_billboardSizes, m_shapes);
+
+    // The grass quads and the billboards are seen from both sides
+    glDisable(GL_CULL_FACE);
+
+    glBindVertexArray(m_vao);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+
+    m_tech.SetBillboard(false);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, NULL, NumLayers, 0);
+
+    m_tech.SetBillboard(true);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                                (const void*)(NumLayers * sizeof(DrawElementsIndirectCommand)), NumLayers, 0);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    glBindVertexArray(0);
+
+    glEnable(GL_CULL_FACE);
+}
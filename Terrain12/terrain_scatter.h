@@ -0,0 +1,195 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TERRAIN_SCATTER_H
+#define TERRAIN_SCATTER_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "ogldev_types.h"
+#include "ogldev_math_3d.h"
+#include "scatter_technique.h"
+#include "scatter_cull_technique.h"
+
+class BaseTerrain;
+
+enum SCATTER_MESH {
+    SCATTER_MESH_GRASS,     // three crossed quads
+    SCATTER_MESH_ROCK,      // a flattened and dented ball
+    SCATTER_MESH_TREE,      // a cone on a thin trunk
+    SCATTER_NUM_MESHES
+};
+
+// Triangular region like TextureHeightDesc of the texture generator - zero at Low and High, one at Optimal
+struct ScatterRegion {
+    float Low = 0.0f;
+    float Optimal = 0.0f;
+    float High = 0.0f;
+};
+
+struct ScatterLayer {
+    SCATTER_MESH Mesh = SCATTER_MESH_GRASS;
+    float Density = 0.1f;               // instances per square world unit where the density map is one
+    ScatterRegion HeightRegion;         // world units
+    ScatterRegion SlopeRegion;          // 1 - normal.y (zero is flat, one is vertical)
+    float MinScale = 1.0f;              // height of the instance in world units
+    float MaxScale = 1.0f;
+    float BillboardDistance = 0.0f;     // instances beyond it are drawn as billboards
+    float MaxDistance = 0.0f;           // and beyond this they are not drawn at all
+    Vector3f Color = Vector3f(1.0f, 1.0f, 1.0f);    // tint of the mesh colors
+};
+
+struct ScatterStats {
+    int NumInstances = 0;
+    int NumTiles = 0;
+    int VisibleTiles = 0;               // passed the frustum, distance and horizon tests
+    int TestedInstances = 0;            // sent to the culling pass in the last frame
+    float GenerateTime = 0.0f;          // milliseconds
+};
+
+//
+// Vegetation and small objects scattered over the terrain and drawn with GPU instancing.
+//
+// The instances are placed once per terrain tile on a jittered grid whose cell size comes
+// from the density of the layer. A cell keeps its instance with the probability of the
+// density map at its point, which is the product of the height region and the slope region
+// of the layer (the same kind of region that the texture generator blends the textures
+// with). The grid is global so the result doesn't depend on the tile size.
+//
+// Every frame the tiles are tested on the CPU against the frustum, the draw distance of
+// each layer and the horizon of the terrain, and the instance ranges of the visible ones
+// are handed to a compute pass. It culls every instance against the frustum, selects the
+// mesh or the billboard by the distance and appends the instance to the region of its draw
+// command. Each layer is then drawn with a single indirect instanced draw for the meshes
+// and another for the billboards, so the CPU work per frame depends only on the number of
+// tiles.
+//
+class TerrainScatter {
+ public:
+    TerrainScatter() {}
+
+    ~TerrainScatter();
+
+    // Returns false if the GPU doesn't support the compute pass or there are too many layers
+    bool CreateScatter(const BaseTerrain* pTerrain, const std::vector<ScatterLayer>& Layers, u32 Seed);
+
+    void Destroy();
+
+    bool IsCreated() const { return m_vao != 0; }
+
+    void Render(const BaseTerrain* pTerrain, const Vector3f& CameraPos, const Matrix4f& ViewProj, const Vector3f& LightDir);
+
+    const ScatterStats& GetStats() const { return m_stats; }
+
+    // Of the procedural meshes
+    struct Vertex {
+        Vector3f Pos;
+        Vector3f Normal;
+        Vector3f Color;
+    };
+
+ private:
+
+    // Matches the instance struct of scatter_cull.cs
+    struct Instance {
+        Vector4f PosScale;      // position on the ground and height
+        Vector4f Params;        // cos and sin of the rotation around the Y axis, layer
+    };
+
+    struct DrawElementsIndirectCommand {
+        GLuint Count;
+        GLuint InstanceCount;
+        GLuint FirstIndex;
+        GLint BaseVertex;
+        GLuint BaseInstance;
+    };
+
+    struct MeshRange {
+        int FirstIndex = 0;
+        int NumIndices = 0;
+        int BaseVertex = 0;
+        float CenterHeight = 0.0f;      // bounding sphere at scale one
+        float Radius = 0.0f;
+        Vector2f BillboardSize;
+    };
+
+    struct Tile {
+        Vector3f Min;
+        Vector3f Max;
+        int FirstPiece[SCATTER_MAX_LAYERS + 1];     // of every layer and then the end
+    };
+
+    void PlaceInstances(const BaseTerrain* pTerrain, u32 Seed);
+
+    void PlaceTile(const BaseTerrain* pTerrain, int TileX, int TileZ, u32 Seed, std::vector<Instance>& Instances) const;
+
+    void CreateMeshes();
+
+    void AddMesh(MeshRange& Range, const std::vector<Vertex>& Vertices, const std::vector<GLuint>& Indices);
+
+    void CreateGLState();
+
+    void CreateDrawCommands();
+
+    void CollectPieces(const BaseTerrain* pTerrain, const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    void UploadPieces();
+
+    std::vector<ScatterLayer> m_layers;
+    int m_numTilesX = 0;
+    int m_numTilesZ = 0;
+    float m_tileWorldSize = 0.0f;
+
+    std::vector<Instance> m_instances;          // by tile and then by layer
+    std::vector<Vector2i> m_pieces;             // first instance and count, up to a cull workgroup each
+    std::vector<Tile> m_tiles;
+    std::vector<Vector2i> m_visiblePieces;      // uploaded every frame
+
+    std::vector<Vertex> m_vertices;
+    std::vector<GLuint> m_indices;
+    MeshRange m_meshes[SCATTER_NUM_MESHES];
+    MeshRange m_billboard;
+
+    std::vector<DrawElementsIndirectCommand> m_commands;    // mesh commands of the layers and then the billboards
+    std::vector<GLuint> m_capacities;                       // of the region of every command
+
+    // Uniforms of the techniques per layer
+    Vector4f m_layerBounds[SCATTER_MAX_LAYERS];
+    Vector3f m_layerColors[SCATTER_MAX_LAYERS];
+    Vector2f m_billboardSizes[SCATTER_MAX_LAYERS];
+    int m_shapes[SCATTER_MAX_LAYERS] = { 0 };
+
+    ScatterTechnique m_tech;
+    ScatterCullTechnique m_cullTech;
+    bool m_techInitialized = false;
+
+    GLuint m_vao = 0;
+    GLuint m_vb = 0;
+    GLuint m_ib = 0;
+    GLuint m_instanceBuffer = 0;
+    GLuint m_pieceBuffer = 0;
+    GLuint m_visibleBuffer = 0;
+    GLuint m_commandBuffer = 0;
+    int m_pieceBufferSize = 0;                  // in pieces
+
+    ScatterStats m_stats;
+};
+
+#endif
@@ -20,8 +20,9 @@
 #include "texture_config.h"
 
 
-TerrainTechnique::TerrainTechnique()
+TerrainTechnique::TerrainTechnique(const char* pVSFilename)
 {
+    m_pVSFilename = pVSFilename;
 }
 
 bool TerrainTechnique::Init()
@@ -30,7 +31,7 @@ bool TerrainTechnique::Init()
         return false;
     }
 
-    if (!AddShader(GL_VERTEX_SHADER, "terrain.vs")) {
+    if (!AddShader(GL_VERTEX_SHADER, m_pVSFilename)) {
         return false;
     }
 
@@ -54,6 +55,9 @@ bool TerrainTechnique::Init()
     m_tex2HeightLoc = GetUniformLocation("gHeight2");
     m_tex3HeightLoc = GetUniformLocation("gHeight3");
     m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
+    m_useNormalMapLoc = GetUniformLocation("gUseNormalMap");
+    m_normalMapLoc = GetUniformLocation("gNormalMap");
+    m_normalMapParamsLoc = GetUniformLocation("gNormalMapParams");
 
     if (m_VPLoc == INVALID_UNIFORM_LOCATION||
         m_minHeightLoc == INVALID_UNIFORM_LOCATION ||
@@ -66,7 +70,10 @@ bool TerrainTechnique::Init()
         m_tex1HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_tex2HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_tex3HeightLoc == INVALID_UNIFORM_LOCATION ||
-        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION) {
+        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION ||
+        m_useNormalMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapParamsLoc == INVALID_UNIFORM_LOCATION) {
         return false;
     }
 
@@ -76,6 +83,7 @@ bool TerrainTechnique::Init()
     glUniform1i(m_tex1UnitLoc, COLOR_TEXTURE_UNIT_INDEX_1);
     glUniform1i(m_tex2UnitLoc, COLOR_TEXTURE_UNIT_INDEX_2);
     glUniform1i(m_tex3UnitLoc, COLOR_TEXTURE_UNIT_INDEX_3);
+    glUniform1i(m_normalMapLoc, NORMAL_MAP_TEXTURE_UNIT_INDEX);
 
     glUseProgram(0);
 
@@ -112,3 +120,9 @@ void TerrainTechnique::SetLightDir(const Vector3f& Dir)
     glUniform3f(m_reversedLightDirLoc, ReversedLightDir.x, ReversedLightDir.y, ReversedLightDir.z);
 }
 
+
+void TerrainTechnique::SetNormalMap(bool Enable, float WorldScale, int TerrainSize)
+{
+    glUniform1i(m_useNormalMapLoc, Enable ? 1 : 0);
+    glUniform2f(m_normalMapParamsLoc, 1.0f / WorldScale, 1.0f / (float)TerrainSize);
+}
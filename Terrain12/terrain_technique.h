@@ -25,7 +25,8 @@ class TerrainTechnique : public Technique
 {
 public:
 
-    TerrainTechnique();
+    // The vertex shader can be replaced as long as it has the outputs that terrain.fs expects
+    TerrainTechnique(const char* pVSFilename = "terrain.vs");
 
     virtual bool Init();
 
@@ -36,8 +37,12 @@ public:
     void SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height);
 	
     void SetLightDir(const Vector3f& Dir);
+
+    // Per pixel normals from the normal map instead of the normals of the vertex shader
+    void SetNormalMap(bool Enable, float WorldScale, int TerrainSize);
 	
 private:
+    const char* m_pVSFilename = NULL;
     GLuint m_VPLoc = -1;
     GLuint m_minHeightLoc = -1;
     GLuint m_maxHeightLoc = -1;
@@ -50,6 +55,9 @@ private:
     GLuint m_tex2UnitLoc = -1;
     GLuint m_tex3UnitLoc = -1;
     GLuint m_reversedLightDirLoc = -1;
+    GLuint m_useNormalMapLoc = -1;
+    GLuint m_normalMapLoc = -1;
+    GLuint m_normalMapParamsLoc = -1;
 };
 
 #endif  /* TERRAIN_TECHNIQUE_H */
@@ -0,0 +1,91 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "adaptive_tess_technique.h"
+#include "texture_config.h"
+
+
+AdaptiveTessTechnique::AdaptiveTessTechnique() : TerrainTechnique("terrain_adaptive.tcs")
+{
+}
+
+
+bool AdaptiveTessTechnique::Init()
+{
+    if (!TerrainTechnique::Init()) {
+        return false;
+    }
+
+    m_patchDataLoc = GetUniformLocation("gPatchData");
+    m_frustumPlanesLoc = GetUniformLocation("gFrustumPlanes");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_projScaleLoc = GetUniformLocation("gProjScale");
+    m_targetEdgeLengthLoc = GetUniformLocation("gTargetEdgeLength");
+    m_maxTessLevelLoc = GetUniformLocation("gMaxTessLevel");
+    m_backfaceCullingLoc = GetUniformLocation("gBackfaceCulling");
+
+    if (m_patchDataLoc == INVALID_UNIFORM_LOCATION ||
+        m_frustumPlanesLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_projScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_targetEdgeLengthLoc == INVALID_UNIFORM_LOCATION ||
+        m_maxTessLevelLoc == INVALID_UNIFORM_LOCATION ||
+        m_backfaceCullingLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    Enable();
+
+    glUniform1i(m_patchDataLoc, PATCH_DATA_TEXTURE_UNIT_INDEX);
+
+    glUseProgram(0);
+
+    return true;
+}
+
+
+void AdaptiveTessTechnique::SetFrustumPlanes(const Matrix4f& ViewProj)
+{
+    Vector4f l, r, b, t, n, f;
+    ViewProj.CalcClipPlanes(l, r, b, t, n, f);
+
+    // The right, top and far planes are flipped so that the inside is always on the positive side
+    Vector4f Planes[6] = { l, r * -1.0f, b, t * -1.0f, n, f * -1.0f };
+
+    glUniform4fv(m_frustumPlanesLoc, 6, (const GLfloat*)Planes);
+}
+
+
+void AdaptiveTessTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void AdaptiveTessTechnique::SetTessParams(float ProjScale, float TargetEdgeLength, float MaxTessLevel)
+{
+    glUniform1f(m_projScaleLoc, ProjScale);
+    glUniform1f(m_targetEdgeLengthLoc, TargetEdgeLength);
+    glUniform1f(m_maxTessLevelLoc, MaxTessLevel);
+}
+
+
+void AdaptiveTessTechnique::SetBackfaceCulling(bool Enable)
+{
+    glUniform1i(m_backfaceCullingLoc, Enable ? 1 : 0);
+}
@@ -0,0 +1,53 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADAPTIVE_TESS_TECHNIQUE_H
+#define ADAPTIVE_TESS_TECHNIQUE_H
+
+#include "terrain_technique.h"
+
+//
+// Same as TerrainTechnique with terrain_adaptive.tcs which culls the patches and
+// sets the tessellation levels from the projected length of the edges.
+//
+class AdaptiveTessTechnique : public TerrainTechnique
+{
+public:
+
+    AdaptiveTessTechnique();
+
+    virtual bool Init();
+
+    void SetFrustumPlanes(const Matrix4f& ViewProj);
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    void SetTessParams(float ProjScale, float TargetEdgeLength, float MaxTessLevel);
+
+    void SetBackfaceCulling(bool Enable);
+
+private:
+    GLuint m_patchDataLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_frustumPlanesLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_projScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_targetEdgeLengthLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_maxTessLevelLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_backfaceCullingLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* ADAPTIVE_TESS_TECHNIQUE_H */
@@ -0,0 +1,335 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#include "ogldev_parallel.h"
+#include "adaptive_tessellation.h"
+
+#define CONE_ANGLE_EPSILON 0.01f        // radians, covers the rounding of the texture filtering
+
+
+AdaptiveTessellation::~AdaptiveTessellation()
+{
+    Destroy();
+}
+
+
+void AdaptiveTessellation::Destroy()
+{
+    if (m_patchTexture > 0) {
+        glDeleteTextures(1, &m_patchTexture);
+        m_patchTexture = 0;
+    }
+
+    if (m_patchBuffer > 0) {
+        glDeleteBuffers(1, &m_patchBuffer);
+        m_patchBuffer = 0;
+    }
+
+    if (m_queries[0] > 0) {
+        glDeleteQueries(2, m_queries);
+        m_queries[0] = m_queries[1] = 0;
+    }
+
+    m_queryIssued[0] = m_queryIssued[1] = false;
+    m_patches.clear();
+    m_cornerHeights.clear();
+    m_stats = TessellationStats();
+}
+
+
+// Same as a GL_LINEAR lookup of the R32F height map texture with GL_REPEAT
+float AdaptiveTessellation::SampleHeightMap(const Array2D<float>& HeightMap, float u, float v) const
+{
+    auto Wrap = [&](int i) {
+        i %= m_terrainSize;
+        return (i < 0) ? i + m_terrainSize : i;
+    };
+
+    float s = u * (float)m_terrainSize - 0.5f;
+    float t = v * (float)m_terrainSize - 0.5f;
+    int s0 = (int)floorf(s);
+    int t0 = (int)floorf(t);
+    float fs = s - (float)s0;
+    float ft = t - (float)t0;
+
+    float h00 = HeightMap.Get(Wrap(s0), Wrap(t0));
+    float h10 = HeightMap.Get(Wrap(s0 + 1), Wrap(t0));
+    float h01 = HeightMap.Get(Wrap(s0), Wrap(t0 + 1));
+    float h11 = HeightMap.Get(Wrap(s0 + 1), Wrap(t0 + 1));
+
+    float Bottom = h00 + (h10 - h00) * fs;
+    float Top    = h01 + (h11 - h01) * fs;
+
+    return Bottom + (Top - Bottom) * ft;
+}
+
+
+void AdaptiveTessellation::CreatePatchData(const Array2D<float>& HeightMap, int TerrainSize, int NumVertsX,
+                                           float WorldScale, float TextureScale)
+{
+    Destroy();
+
+    m_terrainSize = TerrainSize;
+    m_numVertsX = NumVertsX;
+    m_worldScale = WorldScale;
+    m_textureScale = TextureScale;
+
+    // See QuadList::Vertex::InitVertex for the texture coordinates
+    m_cornerHeights.resize(NumVertsX * NumVertsX);
+
+    for (int z = 0 ; z < NumVertsX ; z++) {
+        for (int x = 0 ; x < NumVertsX ; x++) {
+            float u = TextureScale * (float)x / (float)NumVertsX;
+            float v = TextureScale * (float)z / (float)NumVertsX;
+            m_cornerHeights[z * NumVertsX + x] = SampleHeightMap(HeightMap, u, v);
+        }
+    }
+
+    int NumPatchesX = NumVertsX - 1;
+    m_patches.resize(NumPatchesX * NumPatchesX);
+
+    ParallelFor(0, NumPatchesX, [&](int StartZ, int EndZ) {
+        for (int z = StartZ ; z < EndZ ; z++) {
+            for (int x = 0 ; x < NumPatchesX ; x++) {
+                CalcPatch(HeightMap, x, z, m_patches[z * NumPatchesX + x]);
+            }
+        }
+    });
+
+    static_assert(sizeof(PatchData) == 8 * sizeof(float), "PatchData must be two RGBA32F texels");
+
+    glGenBuffers(1, &m_patchBuffer);
+    glBindBuffer(GL_TEXTURE_BUFFER, m_patchBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, m_patches.size() * sizeof(PatchData), &m_patches[0], GL_STATIC_DRAW);
+
+    glGenTextures(1, &m_patchTexture);
+    glBindTexture(GL_TEXTURE_BUFFER, m_patchTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_patchBuffer);
+
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    m_stats.NumPatches = (int)m_patches.size();
+}
+
+
+//
+// The height range covers all the texels that the linear filtering reads inside the patch.
+// The tessellated surface is made of the bilinear cells between these texels and the
+// gradients of a cell are between the differences along its edges, so the normals of the
+// four combinations of the edge differences of every cell bound all the normals of the patch.
+//
+void AdaptiveTessellation::CalcPatch(const Array2D<float>& HeightMap, int PatchX, int PatchZ, PatchData& Patch) const
+{
+    auto Wrap = [&](int i) {
+        i %= m_terrainSize;
+        return (i < 0) ? i + m_terrainSize : i;
+    };
+
+    auto GetTexel = [&](int s, int t) {
+        return HeightMap.Get(Wrap(s), Wrap(t));
+    };
+
+    float TexelsPerPatch = (float)m_terrainSize * m_textureScale / (float)m_numVertsX;
+    int s0 = (int)floorf((float)PatchX * TexelsPerPatch - 0.5f);
+    int s1 = (int)floorf((float)(PatchX + 1) * TexelsPerPatch - 0.5f) + 1;
+    int t0 = (int)floorf((float)PatchZ * TexelsPerPatch - 0.5f);
+    int t1 = (int)floorf((float)(PatchZ + 1) * TexelsPerPatch - 0.5f) + 1;
+
+    Patch.MinHeight = GetTexel(s0, t0);
+    Patch.MaxHeight = Patch.MinHeight;
+
+    for (int t = t0 ; t <= t1 ; t++) {
+        for (int s = s0 ; s <= s1 ; s++) {
+            float h = GetTexel(s, t);
+            Patch.MinHeight = std::min(Patch.MinHeight, h);
+            Patch.MaxHeight = std::max(Patch.MaxHeight, h);
+        }
+    }
+
+    float InvTexelSize = TexelsPerPatch / m_worldScale;
+
+    // Visits the four extreme normals of every cell
+    auto ForEachNormal = [&](auto f) {
+        for (int t = t0 ; t < t1 ; t++) {
+            for (int s = s0 ; s < s1 ; s++) {
+                float h00 = GetTexel(s, t);
+                float h10 = GetTexel(s + 1, t);
+                float h01 = GetTexel(s, t + 1);
+                float h11 = GetTexel(s + 1, t + 1);
+
+                float dx[2] = { (h10 - h00) * InvTexelSize, (h11 - h01) * InvTexelSize };
+                float dz[2] = { (h01 - h00) * InvTexelSize, (h11 - h10) * InvTexelSize };
+
+                for (int i = 0 ; i < 4 ; i++) {
+                    Vector3f Normal(-dx[i & 1], 1.0f, -dz[i >> 1]);
+                    f(Normal.Normalize());
+                }
+            }
+        }
+    };
+
+    Vector3f Sum(0.0f, 0.0f, 0.0f);
+    ForEachNormal([&](const Vector3f& Normal) { Sum += Normal; });
+    Patch.ConeAxis = Sum.Normalize();
+
+    float MinCos = 1.0f;
+    ForEachNormal([&](const Vector3f& Normal) { MinCos = std::min(MinCos, Patch.ConeAxis.Dot(Normal)); });
+    Patch.ConeAngle = acosf(std::max(std::min(MinCos, 1.0f), -1.0f)) + CONE_ANGLE_EPSILON;
+}
+
+
+void AdaptiveTessellation::BindPatchData(GLenum TextureUnit)
+{
+    glActiveTexture(TextureUnit);
+    glBindTexture(GL_TEXTURE_BUFFER, m_patchTexture);
+}
+
+
+float AdaptiveTessellation::CalcProjScale(const BasicCamera& Camera)
+{
+    const PersProjInfo& ProjInfo = Camera.GetPersProjInfo();
+
+    return ProjInfo.Height / (2.0f * tanf(ToRadian(ProjInfo.FOV / 2.0f)));
+}
+
+
+Vector3f AdaptiveTessellation::GetCornerPos(int x, int z) const
+{
+    return Vector3f((float)x * m_worldScale, m_cornerHeights[z * m_numVertsX + x], (float)z * m_worldScale);
+}
+
+
+// Same as IsBackFacing in terrain_adaptive.tcs
+bool AdaptiveTessellation::IsBackFacing(const Vector3f& Min, const Vector3f& Max, const PatchData& Patch,
+                                        const Vector3f& CameraPos) const
+{
+    Vector3f Center = (Min + Max) * 0.5f;
+    float Radius = (Max - Min).Length() * 0.5f;
+    Vector3f ToCamera = CameraPos - Center;
+    float Distance = ToCamera.Length();
+
+    if (Distance <= Radius) {
+        return false;
+    }
+
+    float Angle = acosf(std::max(std::min(Patch.ConeAxis.Dot(ToCamera) / Distance, 1.0f), -1.0f));
+
+    return Angle - asinf(Radius / Distance) - Patch.ConeAngle > (float)M_PI / 2.0f;
+}
+
+
+void AdaptiveTessellation::CalcStats(const BasicCamera& Camera, const AdaptiveTessParams& Params)
+{
+    FrustumCulling fc(Camera.GetViewProjMatrix());
+    Vector3f CameraPos = Camera.GetPos();
+    float ProjScale = CalcProjScale(Camera);
+
+    // Same as CalcEdgeTessLevel in terrain_adaptive.tcs
+    auto CalcEdgeTessLevel = [&](const Vector3f& p0, const Vector3f& p1) {
+        Vector3f Center = (p0 + p1) * 0.5f;
+        float Distance = std::max((Center - CameraPos).Length(), 0.001f);
+        float Pixels = (p1 - p0).Length() * ProjScale / Distance;
+        return std::min(std::max(Pixels / Params.TargetEdgeLength, 1.0f), Params.MaxTessLevel);
+    };
+
+    // fractional_odd_spacing rounds the level up to an odd number of segments
+    auto NumSegments = [](float Level) {
+        int n = (int)ceilf(Level);
+        return (n % 2 == 0) ? n + 1 : n;
+    };
+
+    m_stats.NumFrustumCulled = 0;
+    m_stats.NumBackfaceCulled = 0;
+    m_stats.NumVisible = 0;
+    m_stats.NumEstimatedTriangles = 0;
+
+    double SumLevels = 0.0;
+    int NumPatchesX = m_numVertsX - 1;
+
+    for (int z = 0 ; z < NumPatchesX ; z++) {
+        for (int x = 0 ; x < NumPatchesX ; x++) {
+            const PatchData& Patch = m_patches[z * NumPatchesX + x];
+
+            Vector3f p00 = GetCornerPos(x, z);
+            Vector3f p01 = GetCornerPos(x + 1, z);
+            Vector3f p10 = GetCornerPos(x, z + 1);
+            Vector3f p11 = GetCornerPos(x + 1, z + 1);
+
+            Vector3f Min(p00.x, Patch.MinHeight, p00.z);
+            Vector3f Max(p11.x, Patch.MaxHeight, p11.z);
+
+            if (!fc.IsAABBInsideViewFrustum(Min, Max)) {
+                m_stats.NumFrustumCulled++;
+                continue;
+            }
+
+            if (Params.BackfaceCulling && IsBackFacing(Min, Max, Patch, CameraPos)) {
+                m_stats.NumBackfaceCulled++;
+                continue;
+            }
+
+            float Outer[4] = { CalcEdgeTessLevel(p00, p10), CalcEdgeTessLevel(p00, p01),
+                               CalcEdgeTessLevel(p01, p11), CalcEdgeTessLevel(p10, p11) };
+
+            float Inner0 = std::max(Outer[1], Outer[3]);
+            float Inner1 = std::max(Outer[0], Outer[2]);
+
+            SumLevels += Outer[0] + Outer[1] + Outer[2] + Outer[3];
+            m_stats.NumEstimatedTriangles += 2 * NumSegments(Inner0) * NumSegments(Inner1);
+            m_stats.NumVisible++;
+        }
+    }
+
+    m_stats.AvgTessLevel = (m_stats.NumVisible > 0) ? (float)(SumLevels / (4.0 * m_stats.NumVisible)) : 0.0f;
+}
+
+
+void AdaptiveTessellation::BeginQuery()
+{
+    if (m_queries[0] == 0) {
+        glGenQueries(2, m_queries);
+    }
+
+    glBeginQuery(GL_PRIMITIVES_GENERATED, m_queries[m_curQuery]);
+}
+
+
+void AdaptiveTessellation::EndQuery()
+{
+    glEndQuery(GL_PRIMITIVES_GENERATED);
+
+    m_queryIssued[m_curQuery] = true;
+    m_curQuery = 1 - m_curQuery;
+
+    // The other query is from the previous frame so reading it doesn't stall unless the GPU is behind
+    if (m_queryIssued[m_curQuery]) {
+        GLint Available = 0;
+        glGetQueryObjectiv(m_queries[m_curQuery], GL_QUERY_RESULT_AVAILABLE, &Available);
+
+        if (Available) {
+            GLuint NumPrimitives = 0;
+            glGetQueryObjectuiv(m_queries[m_curQuery], GL_QUERY_RESULT, &NumPrimitives);
+            m_stats.NumTriangles = (int)NumPrimitives;
+            m_queryIssued[m_curQuery] = false;
+        }
+    }
+}
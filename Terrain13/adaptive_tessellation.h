@@ -0,0 +1,111 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef ADAPTIVE_TESSELLATION_H
+#define ADAPTIVE_TESSELLATION_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_array_2d.h"
+#include "ogldev_basic_glfw_camera.h"
+
+struct AdaptiveTessParams {
+    float TargetEdgeLength = 16.0f;     // pixels per tessellated edge
+    float MaxTessLevel = 64.0f;
+    bool BackfaceCulling = true;
+};
+
+struct TessellationStats {
+    int NumPatches = 0;
+    int NumFrustumCulled = 0;
+    int NumBackfaceCulled = 0;
+    int NumVisible = 0;
+    float AvgTessLevel = 0.0f;          // of the outer edges of the visible patches
+    int NumEstimatedTriangles = 0;      // from the tessellation levels on the CPU
+    int NumTriangles = -1;              // generated by the tessellator (a frame or two behind, -1 until available)
+};
+
+//
+// Per patch data for terrain_adaptive.tcs - the height range and a cone that contains all
+// the normals of the patch - in a buffer texture indexed by gl_PrimitiveID. The patches
+// are the cells of the QuadList in the same order. CalcStats runs the culling and the edge
+// tessellation levels of the shader on the CPU.
+//
+class AdaptiveTessellation {
+ public:
+    AdaptiveTessellation() {}
+
+    ~AdaptiveTessellation();
+
+    void Destroy();
+
+    // NumVertsX is the number of vertices on each side of the QuadList
+    void CreatePatchData(const Array2D<float>& HeightMap, int TerrainSize, int NumVertsX, float WorldScale, float TextureScale);
+
+    void BindPatchData(GLenum TextureUnit);
+
+    void CalcStats(const BasicCamera& Camera, const AdaptiveTessParams& Params);
+
+    // Wrap the draw call to count the generated triangles
+    void BeginQuery();
+
+    void EndQuery();
+
+    const TessellationStats& GetStats() const { return m_stats; }
+
+    static float CalcProjScale(const BasicCamera& Camera);
+
+ private:
+
+    // Two RGBA32F texels
+    struct PatchData {
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        float Padding[2] = { 0.0f, 0.0f };
+        Vector3f ConeAxis;
+        float ConeAngle = 0.0f;
+    };
+
+    float SampleHeightMap(const Array2D<float>& HeightMap, float u, float v) const;
+
+    void CalcPatch(const Array2D<float>& HeightMap, int PatchX, int PatchZ, PatchData& Patch) const;
+
+    Vector3f GetCornerPos(int x, int z) const;
+
+    bool IsBackFacing(const Vector3f& Min, const Vector3f& Max, const PatchData& Patch, const Vector3f& CameraPos) const;
+
+    int m_terrainSize = 0;
+    int m_numVertsX = 0;
+    float m_worldScale = 1.0f;
+    float m_textureScale = 1.0f;
+
+    std::vector<PatchData> m_patches;
+    std::vector<float> m_cornerHeights;     // as sampled by the shader
+
+    GLuint m_patchBuffer = 0;
+    GLuint m_patchTexture = 0;
+
+    GLuint m_queries[2] = { 0, 0 };
+    bool m_queryIssued[2] = { false, false };
+    int m_curQuery = 0;
+
+    TessellationStats m_stats;
+};
+
+#endif
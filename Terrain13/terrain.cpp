@@ -40,6 +40,7 @@ void BaseTerrain::Destroy()
 {
     m_heightMap.Destroy();
     m_quadList.Destroy();
+    m_adaptiveTess.Destroy();
 }
 
 
@@ -51,6 +52,11 @@ void BaseTerrain::InitTerrain(float WorldScale, float TextureScale, const std::v
         exit(0);
     }
 
+    if (!m_adaptiveTech.Init()) {
+        printf("Error initializing adaptive tessellation tech\n");
+        exit(0);
+    }
+
     if (TextureFilenames.size() != ARRAY_SIZE_IN_ELEMENTS(m_pTextures)) {
         printf("%s:%d - number of provided textures (%lud) is not equal to the size of the texture array (%lud)\n",
                __FILE__, __LINE__, (unsigned long)TextureFilenames.size(), (unsigned long)ARRAY_SIZE_IN_ELEMENTS(m_pTextures));
@@ -76,6 +82,8 @@ void BaseTerrain::Finalize()
   //  m_heightMap.PrintFloat();
 
     m_heightMapTexture.LoadF32(m_terrainSize, m_terrainSize, m_heightMap.GetBaseAddr());
+
+    m_adaptiveTess.CreatePatchData(m_heightMap, m_terrainSize, m_numPatches, m_worldScale, m_textureScale);
 }
 
 
@@ -162,9 +170,11 @@ void BaseTerrain::Render(const BasicCamera& Camera)
     Matrix4f VP = Camera.GetViewProjMatrix();
     Matrix4f View = Camera.GetMatrix();
 
-    m_terrainTech.Enable();
-    m_terrainTech.SetViewMatrix(View);
-    m_terrainTech.SetVP(VP);
+    TerrainTechnique& Tech = m_adaptive ? m_adaptiveTech : m_terrainTech;
+
+    Tech.Enable();
+    Tech.SetViewMatrix(View);
+    Tech.SetVP(VP);
 
     for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(m_pTextures); i++) {
         if (m_pTextures[i]) {
@@ -174,11 +184,30 @@ void BaseTerrain::Render(const BasicCamera& Camera)
 
     m_heightMapTexture.Bind(HEIGHT_MAP_TEXTURE_UNIT);
 	
-    m_terrainTech.SetLightDir(m_lightDir);
+    Tech.SetLightDir(m_lightDir);
+
+    if (m_adaptive) {
+        m_adaptiveTech.SetFrustumPlanes(VP);
+        m_adaptiveTech.SetCameraPos(Camera.GetPos());
+        m_adaptiveTech.SetTessParams(AdaptiveTessellation::CalcProjScale(Camera), m_tessParams.TargetEdgeLength, m_tessParams.MaxTessLevel);
+        m_adaptiveTech.SetBackfaceCulling(m_tessParams.BackfaceCulling);
+        m_adaptiveTess.BindPatchData(PATCH_DATA_TEXTURE_UNIT);
+    }
+
+    bool CollectStats = m_adaptive && m_collectTessStats;
+
+    if (CollectStats) {
+        m_adaptiveTess.CalcStats(Camera, m_tessParams);
+        m_adaptiveTess.BeginQuery();
+    }
 
     glFrontFace(GL_CCW);
     m_quadList.Render();
 
+    if (CollectStats) {
+        m_adaptiveTess.EndQuery();
+    }
+
     glFrontFace(GL_CW); // hack....
     m_pSkydome->Render(Camera);
 }
@@ -191,12 +220,19 @@ void BaseTerrain::SetMinMaxHeight(float MinHeight, float MaxHeight)
 
     m_terrainTech.Enable();
     m_terrainTech.SetMinMaxHeight(MinHeight, MaxHeight);
+
+    m_adaptiveTech.Enable();
+    m_adaptiveTech.SetMinMaxHeight(MinHeight, MaxHeight);
 }
 
 
 void BaseTerrain::SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height)
 {
+    m_terrainTech.Enable();
     m_terrainTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height); 
+
+    m_adaptiveTech.Enable();
+    m_adaptiveTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height);
 }
 
 
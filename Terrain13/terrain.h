@@ -26,6 +26,8 @@
 
 #include "quad_list.h"
 #include "terrain_technique.h"
+#include "adaptive_tess_technique.h"
+#include "adaptive_tessellation.h"
 #include "ogldev_skydome.h"
 
 class BaseTerrain
@@ -67,6 +69,16 @@ class BaseTerrain
 
     Vector3f ConstrainCameraPosToTerrain(const Vector3f& CameraPos);
 
+    // Culls the patches on the GPU and tessellates the edges by their size on the screen
+    void SetAdaptiveTessellation(bool Enable) { m_adaptive = Enable; }
+
+    void SetTessParams(const AdaptiveTessParams& Params) { m_tessParams = Params; }
+
+    // The stats are updated by Render only when they are enabled
+    void SetCollectTessStats(bool Enable) { m_collectTessStats = Enable; }
+
+    const TessellationStats& GetTessStats() const { return m_adaptiveTess.GetStats(); }
+
  protected:
 
 	void LoadHeightMapFile(const char* pFilename);
@@ -90,6 +102,11 @@ private:
     float m_minHeight = 0.0f;
     float m_maxHeight = 0.0f;
     TerrainTechnique m_terrainTech;
+    AdaptiveTessTechnique m_adaptiveTech;
+    AdaptiveTessellation m_adaptiveTess;
+    bool m_adaptive = false;
+    AdaptiveTessParams m_tessParams;
+    bool m_collectTessStats = false;
     Vector3f m_lightDir;
     float m_cameraHeight = 2.0f;
     Skydome* m_pSkydome = NULL;
@@ -102,6 +102,28 @@ public:
                 ImGui::SliderFloat("Height1", &Height1, 64.0f, 128.0f);
                 ImGui::SliderFloat("Height2", &Height2, 128.0f, 192.0f);
                 ImGui::SliderFloat("Height3", &Height3, 192.0f, 256.0f);
+                ImGui::SliderInt("Patches per side", &this->m_numPatches, 2, 256);
+
+                if (ImGui::Checkbox("Adaptive tessellation", &this->m_adaptive)) {
+                    m_terrain.SetAdaptiveTessellation(m_adaptive);
+                    m_terrain.SetCollectTessStats(m_adaptive);
+                }
+
+                if (m_adaptive) {
+                    bool ParamsChanged = ImGui::SliderFloat("Target edge length (pixels)", &m_tessParams.TargetEdgeLength, 2.0f, 64.0f);
+                    ParamsChanged |= ImGui::SliderFloat("Max tessellation level", &m_tessParams.MaxTessLevel, 1.0f, 64.0f);
+                    ParamsChanged |= ImGui::Checkbox("Backface culling", &m_tessParams.BackfaceCulling);
+
+                    if (ParamsChanged) {
+                        m_terrain.SetTessParams(m_tessParams);
+                    }
+
+                    const TessellationStats& Stats = m_terrain.GetTessStats();
+                    ImGui::Text("Patches %d, frustum culled %d, backface culled %d, visible %d",
+                                Stats.NumPatches, Stats.NumFrustumCulled, Stats.NumBackfaceCulled, Stats.NumVisible);
+                    ImGui::Text("Average tessellation level %.2f", Stats.AvgTessLevel);
+                    ImGui::Text("Triangles %d (estimated %d)", Stats.NumTriangles, Stats.NumEstimatedTriangles);
+                }
 
                 if (ImGui::Button("Generate")) {
                     m_terrain.Destroy();
@@ -322,6 +344,8 @@ private:
     float m_minHeight = 0.0f;
     float m_maxHeight = 500.0f;
     int m_numPatches = 64;
+    bool m_adaptive = false;
+    AdaptiveTessParams m_tessParams;
     float m_counter = 0.0f;
     bool m_constrainCamera = false;
 };
@@ -20,8 +20,9 @@
 #include "texture_config.h"
 
 
-TerrainTechnique::TerrainTechnique()
+TerrainTechnique::TerrainTechnique(const char* pTCSFilename)
 {
+    m_pTCSFilename = pTCSFilename;
 }
 
 bool TerrainTechnique::Init()
@@ -34,7 +35,7 @@ bool TerrainTechnique::Init()
         return false;
     }
 
-    if (!AddShader(GL_TESS_CONTROL_SHADER, "terrain.tcs")) {
+    if (!AddShader(GL_TESS_CONTROL_SHADER, m_pTCSFilename)) {
         return false;
     }
 
@@ -92,7 +93,7 @@ bool TerrainTechnique::Init()
 
     glUseProgram(0);
 
- //   return true;
+    return true;
 }
 
 
@@ -25,7 +25,7 @@ class TerrainTechnique : public Technique
 {
 public:
 
-    TerrainTechnique();
+    TerrainTechnique(const char* pTCSFilename = "terrain.tcs");
 
     virtual bool Init();
 
@@ -54,6 +54,7 @@ private:
     GLuint m_tex3UnitLoc = -1;
     GLuint m_reversedLightDirLoc = -1;
     GLuint m_heightMapLoc = -1;
+    const char* m_pTCSFilename = NULL;
 };
 
 #endif  /* TERRAIN_TECHNIQUE_H */
@@ -11,5 +11,7 @@
 #define COLOR_TEXTURE_UNIT_INDEX_3 3
 #define HEIGHT_MAP_TEXTURE_UNIT       GL_TEXTURE4
 #define HEIGHT_MAP_TEXTURE_UNIT_INDEX 4
+#define PATCH_DATA_TEXTURE_UNIT       GL_TEXTURE5
+#define PATCH_DATA_TEXTURE_UNIT_INDEX 5
 
 #endif
@@ -16,8 +16,16 @@
 */
 
 
+#include <algorithm>
+
+#include "ogldev_parallel.h"
+#include "ogldev_simd.h"
 #include "fault_formation_terrain.h"
 
+#define MIN_ROWS_PER_THREAD 16
+#define MIN_COLUMNS_PER_THREAD 64
+
+
 void FaultFormationTerrain::CreateFaultFormation(int TerrainSize, int Iterations, float MinHeight, float MaxHeight, float Filter)
 {  
     m_terrainSize = TerrainSize;
@@ -41,78 +49,220 @@ void FaultFormationTerrain::CreateFaultFormationInternal(int Iterations, float M
 {
     float DeltaHeight = MaxHeight - MinHeight;
 
+    // The random lines are generated up front (in the same order as before) so that
+    // the rows of the height map can be processed in parallel
+    std::vector<FaultLine> Faults(Iterations);
+
     for (int CurIter = 0 ; CurIter < Iterations ; CurIter++) {
         float IterationRatio = ((float)CurIter / (float)Iterations);
-        float Height = MaxHeight - IterationRatio * DeltaHeight;
+        Faults[CurIter].Height = MaxHeight - IterationRatio * DeltaHeight;
 
-        TerrainPoint p1, p2;
+        TerrainPoint p2;
+
+        GenRandomTerrainPoints(Faults[CurIter].p1, p2);
+
+        Faults[CurIter].DirX = p2.x - Faults[CurIter].p1.x;
+        Faults[CurIter].DirZ = p2.z - Faults[CurIter].p1.z;
+    }
 
-        GenRandomTerrainPoints(p1, p2);
+    ParallelFor(0, m_terrainSize, [&](int StartZ, int EndZ) {
+                    ApplyFaultsToRows(Faults, StartZ, EndZ);
+                }, MIN_ROWS_PER_THREAD);
 
-        int DirX = p2.x - p1.x;
-        int DirZ = p2.z - p1.z;
+    ApplyFIRFilter(Filter);
+}
 
-        for (int z = 0 ; z < m_terrainSize ; z++) {
-            for (int x = 0 ; x < m_terrainSize ; x++) {
-                int DirX_in = x - p1.x;
-                int DirZ_in = z - p1.z;
 
-                int CrossProduct = DirX_in * DirZ - DirX * DirZ_in;
+static long long FloorDiv(long long a, long long b)
+{
+    long long q = a / b;
 
-                if (CrossProduct > 0) {
-                    float CurHeight = m_heightMap.Get(x, z);
-                    m_heightMap.Set(x, z, CurHeight + Height);
-                }
-            }
-        }        
+    if ((a % b != 0) && ((a < 0) != (b < 0))) {
+        q--;
+    }
+
+    return q;
+}
+
+
+//
+// A point is raised if it is to the right of the line, i.e. if the cross product
+// (x - p1.x) * DirZ - DirX * (z - p1.z) is positive. For a given row this is linear
+// in x so the raised points form a single span that touches one of the edges:
+// [StartX, m_terrainSize) when DirZ is positive and [0, EndX) when it is negative.
+//
+void FaultFormationTerrain::CalcFaultSpan(const FaultLine& Fault, int z, int& StartX, int& EndX) const
+{
+    long long C = (long long)Fault.DirX * (long long)(z - Fault.p1.z);
+
+    long long TerrainSize = m_terrainSize;
+
+    if (Fault.DirZ > 0) {
+        // (x - p1.x) > C / DirZ
+        StartX = (int)std::min(std::max(Fault.p1.x + FloorDiv(C, Fault.DirZ) + 1, 0LL), TerrainSize);
+        EndX = m_terrainSize;
+    } else if (Fault.DirZ < 0) {
+        // (x - p1.x) < C / DirZ
+        StartX = 0;
+        EndX = (int)std::min(std::max(Fault.p1.x - FloorDiv(C, -Fault.DirZ), 0LL), TerrainSize);
+    } else {
+        // horizontal line - the whole row is either in or out
+        StartX = 0;
+        EndX = (C < 0) ? m_terrainSize : 0;
+    }
+
+    if (StartX > EndX) {
+        StartX = EndX;
+    }
+}
+
+
+//
+// Instead of adding the height of every fault to every point of its span we only add
+// it at the start of the span and subtract it at the end. A running sum over the row
+// then gives the final heights, so each row costs O(Iterations + TerrainSize).
+//
+void FaultFormationTerrain::ApplyFaultsToRows(const std::vector<FaultLine>& Faults, int StartZ, int EndZ)
+{
+    std::vector<double> Delta(m_terrainSize + 1);
+
+    for (int z = StartZ ; z < EndZ ; z++) {
+        std::fill(Delta.begin(), Delta.end(), 0.0);
+
+        for (size_t i = 0 ; i < Faults.size() ; i++) {
+            int StartX, EndX;
+            CalcFaultSpan(Faults[i], z, StartX, EndX);
+
+            Delta[StartX] += Faults[i].Height;
+            Delta[EndX] -= Faults[i].Height;
+        }
+
+        float* pRow = m_heightMap.GetRow(z);
+        double Height = 0.0;
+
+        for (int x = 0 ; x < m_terrainSize ; x++) {
+            Height += Delta[x];
+            pRow[x] += (float)Height;
+        }
     }
-	
-    ApplyFIRFilter(Filter);
 }
 
 
+//
+// The filter is a recurrence along each row (and then each column) so a single row is
+// inherently serial, but the rows are independent of each other. The row passes work
+// on four rows at a time (one per SIMD lane). The column passes don't walk down the
+// columns - every thread takes a strip of columns and sweeps it one row span at a time,
+// blending each row with the previous one, so the memory is read in the row major
+// order. The per point math is the same as the scalar version so the result doesn't
+// depend on the number of threads.
+//
 void FaultFormationTerrain::ApplyFIRFilter(float Filter)
 {
-    // left to right
-    for (int z = 0 ; z < m_terrainSize ; z++) {
-        float PrevVal = m_heightMap.Get(0, z);
+    // left to right and right to left
+    ParallelFor(0, m_terrainSize, [&](int StartZ, int EndZ) {
+                    FIRFilterRows(StartZ, EndZ, Filter);
+                }, MIN_ROWS_PER_THREAD);
+
+    // bottom to top and top to bottom
+    ParallelFor(0, m_terrainSize, [&](int StartX, int EndX) {
+                    FIRFilterColumns(StartX, EndX, Filter);
+                }, MIN_COLUMNS_PER_THREAD);
+}
+
+
+void FaultFormationTerrain::FIRFilterRows(int StartZ, int EndZ, float Filter)
+{
+    float OneMinusFilter = 1.0f - Filter;
+    int z = StartZ;
+
+#ifdef OGLDEV_SSE2
+    __m128 Filter4 = _mm_set1_ps(Filter);
+    __m128 OneMinusFilter4 = _mm_set1_ps(OneMinusFilter);
+
+    for ( ; z + 4 <= EndZ ; z += 4) {
+        float* r0 = m_heightMap.GetRow(z);
+        float* r1 = m_heightMap.GetRow(z + 1);
+        float* r2 = m_heightMap.GetRow(z + 2);
+        float* r3 = m_heightMap.GetRow(z + 3);
+        float Result[4];
+
+        // left to right
+        __m128 PrevVal = _mm_setr_ps(r0[0], r1[0], r2[0], r3[0]);
+
         for (int x = 1 ; x < m_terrainSize ; x++) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, Filter);
+            __m128 CurVal = _mm_setr_ps(r0[x], r1[x], r2[x], r3[x]);
+            PrevVal = _mm_add_ps(_mm_mul_ps(Filter4, PrevVal), _mm_mul_ps(OneMinusFilter4, CurVal));
+            _mm_storeu_ps(Result, PrevVal);
+            r0[x] = Result[0]; r1[x] = Result[1]; r2[x] = Result[2]; r3[x] = Result[3];
         }
-    }
 
-    // right to left
-    for (int z = 0 ; z < m_terrainSize ; z++) {
-        float PrevVal = m_heightMap.Get(m_terrainSize - 1, z);
+        // right to left
+        int Last = m_terrainSize - 1;
+        PrevVal = _mm_setr_ps(r0[Last], r1[Last], r2[Last], r3[Last]);
+
         for (int x = m_terrainSize - 2 ; x >= 0 ; x--) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, Filter);
+            __m128 CurVal = _mm_setr_ps(r0[x], r1[x], r2[x], r3[x]);
+            PrevVal = _mm_add_ps(_mm_mul_ps(Filter4, PrevVal), _mm_mul_ps(OneMinusFilter4, CurVal));
+            _mm_storeu_ps(Result, PrevVal);
+            r0[x] = Result[0]; r1[x] = Result[1]; r2[x] = Result[2]; r3[x] = Result[3];
         }
     }
+#endif
 
-    // bottom to top
-    for (int x = 0 ; x < m_terrainSize ; x++) {
-        float PrevVal = m_heightMap.Get(x, 0);
-        for (int z = 1 ; z < m_terrainSize ; z++) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, Filter);
+    for ( ; z < EndZ ; z++) {
+        float* pRow = m_heightMap.GetRow(z);
+
+        float PrevVal = pRow[0];
+        for (int x = 1 ; x < m_terrainSize ; x++) {
+            PrevVal = Filter * PrevVal + OneMinusFilter * pRow[x];
+            pRow[x] = PrevVal;
         }
-    }
 
-    // top to bottom
-    for (int x = 0 ; x < m_terrainSize ; x++) {
-        float PrevVal = m_heightMap.Get(x, m_terrainSize - 1);
-        for (int z = m_terrainSize - 2 ; z >= 0 ; z--) {
-            PrevVal = FIRFilterSinglePoint(x, z, PrevVal, Filter);
+        PrevVal = pRow[m_terrainSize - 1];
+        for (int x = m_terrainSize - 2 ; x >= 0 ; x--) {
+            PrevVal = Filter * PrevVal + OneMinusFilter * pRow[x];
+            pRow[x] = PrevVal;
         }
     }
 }
 
 
-float FaultFormationTerrain::FIRFilterSinglePoint(int x, int z, float PrevVal, float Filter)
+void FaultFormationTerrain::FIRFilterColumns(int StartX, int EndX, float Filter)
 {
-    float CurVal = m_heightMap.Get(x, z);
-    float NewVal = Filter * PrevVal + (1 - Filter) * CurVal;
-    m_heightMap.Set(x, z, NewVal);
-    return NewVal;
+    float OneMinusFilter = 1.0f - Filter;
+
+    // Row z of the strip becomes Filter * (row z - Dir) + (1 - Filter) * (row z)
+    auto BlendRow = [&](int z, int Dir) {
+        const float* pPrev = m_heightMap.GetRow(z - Dir);
+        float* pRow = m_heightMap.GetRow(z);
+        int x = StartX;
+
+#ifdef OGLDEV_SSE2
+        __m128 Filter4 = _mm_set1_ps(Filter);
+        __m128 OneMinusFilter4 = _mm_set1_ps(OneMinusFilter);
+
+        for ( ; x + 4 <= EndX ; x += 4) {
+            __m128 PrevVal = _mm_loadu_ps(pPrev + x);
+            __m128 CurVal = _mm_loadu_ps(pRow + x);
+            _mm_storeu_ps(pRow + x, _mm_add_ps(_mm_mul_ps(Filter4, PrevVal), _mm_mul_ps(OneMinusFilter4, CurVal)));
+        }
+#endif
+
+        for ( ; x < EndX ; x++) {
+            pRow[x] = Filter * pPrev[x] + OneMinusFilter * pRow[x];
+        }
+    };
+
+    // bottom to top
+    for (int z = 1 ; z < m_terrainSize ; z++) {
+        BlendRow(z, 1);
+    }
+
+    // top to bottom
+    for (int z = m_terrainSize - 2 ; z >= 0 ; z--) {
+        BlendRow(z, -1);
+    }
 }
 
 
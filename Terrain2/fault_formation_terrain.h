@@ -19,6 +19,8 @@
 #ifndef FAULT_FORMATION_TERRAIN_H
 #define FAULT_FORMATION_TERRAIN_H
 
+#include <vector>
+
 #include "terrain.h"
 
 class FaultFormationTerrain : public BaseTerrain {
@@ -45,10 +47,20 @@ class FaultFormationTerrain : public BaseTerrain {
          }
      };
 
+     struct FaultLine {
+         TerrainPoint p1;
+         int DirX = 0;
+         int DirZ = 0;
+         float Height = 0.0f;
+     };
+
     void CreateFaultFormationInternal(int Iterations, float MinHeight, float MaxHeight, float Filter);
     void GenRandomTerrainPoints(TerrainPoint& p1, TerrainPoint& p2);
+    void CalcFaultSpan(const FaultLine& Fault, int z, int& StartX, int& EndX) const;
+    void ApplyFaultsToRows(const std::vector<FaultLine>& Faults, int StartZ, int EndZ);
     void ApplyFIRFilter(float Filter);
-    float FIRFilterSinglePoint(int x, int z, float PrevFractalVal, float Filter);
+    void FIRFilterRows(int StartZ, int EndZ, float Filter);
+    void FIRFilterColumns(int StartX, int EndX, float Filter);
 };
 
 #endif
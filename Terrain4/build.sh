@@ -5,7 +5,7 @@ CC=g++
 CPPFLAGS=`pkg-config --cflags glew glfw3`
 CPPFLAGS="$CPPFLAGS -I$OGLDEV_DIR/Include -I$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW -ggdb3"
 LDFLAGS=`pkg-config --libs glew glfw3`
-LDFLAGS="$LDFLAGS -lX11 -ldl"
+LDFLAGS="$LDFLAGS -lX11 -ldl -pthread"
 SOURCES="terrain_demo4.cpp \
 	single_tex_terrain_technique.cpp \
 	texture_generator.cpp terrain.cpp \
@@ -19,10 +19,14 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <vector>
+#include <algorithm>
 
 #include "texture_generator.h"
 #include "terrain.h"
 #include "ogldev_stb_image.h"
+#include "ogldev_parallel.h"
+#include "ogldev_simd.h"
 
 #include "3rdparty/stb_image_write.h"
 
@@ -30,6 +34,13 @@ TextureGenerator::TextureGenerator()
 {
 }
 
+
+TextureGenerator::~TextureGenerator()
+{
+    WaitForDump();
+}
+
+
 void TextureGenerator::LoadTile(const char* pFilename)
 {
     if (m_numTextureTiles == MAX_TEXTURE_TILES) {
@@ -51,57 +62,202 @@ Texture* TextureGenerator::GenerateTexture(int TextureSize, BaseTerrain* pTerrai
 
     CalculateTextureRegions(MinHeight, MaxHeight);
 
+    long long StartTime = GetCurrentTimeMillis();
+
     int BPP = 3;
     int TextureBytes = TextureSize * TextureSize * BPP;
     unsigned char* pTextureData = (unsigned char*)malloc(TextureBytes);
-    unsigned char* p = pTextureData;
 
+    // Each thread gets a band of rows. A band is at least a few rows long
+    // so that tiny textures don't pay for the thread creation.
+    const int MinRowsPerThread = 16;
+
+    ParallelFor(0, TextureSize, [&](int StartY, int EndY) {
+                    GenerateRows(StartY, EndY, TextureSize, pTerrain, pTextureData);
+                }, MinRowsPerThread);
+
+    printf("Generated a %dx%d texture in %lld ms\n", TextureSize, TextureSize, GetCurrentTimeMillis() - StartTime);
+
+    Texture* pTexture = new Texture(GL_TEXTURE_2D);
+
+    pTexture->LoadRaw(TextureSize, TextureSize, BPP, pTextureData);
+
+    if (m_pDumpFilename) {
+        // the dump thread takes ownership of the texture data
+        DumpTexture(TextureSize, BPP, pTextureData);
+    } else {
+        free(pTextureData);
+    }
+
+    return pTexture;
+}
+
+
+void TextureGenerator::GenerateRows(int StartY, int EndY, int TextureSize, const BaseTerrain* pTerrain, unsigned char* pTextureData) const
+{
     float HeightMapToTextureRatio = (float)pTerrain->GetSize() / (float)TextureSize;
 
-    printf("Height map to texture ratio: %f\n", HeightMapToTextureRatio);
+    // The column part of the interpolation is the same for all the rows
+    std::vector<int> ColIndex(TextureSize);
+    std::vector<float> ColFactor(TextureSize);
 
-    for (int y = 0 ; y < TextureSize ; y++) {
-        for (int x = 0 ; x < TextureSize ; x++) {
+    for (int x = 0 ; x < TextureSize ; x++) {
+        float HeightMapX = (float)x * HeightMapToTextureRatio;
+        ColIndex[x] = (int)HeightMapX;
+        ColFactor[x] = HeightMapX - floorf(HeightMapX);
+    }
 
-            float InterpolatedHeight = pTerrain->GetHeightInterpolated((float)x * HeightMapToTextureRatio, 
-                                                                       (float)y * HeightMapToTextureRatio);
+    std::vector<float> Heights(TextureSize);
+    std::vector<float> Percent(TextureSize);
+    std::vector<float> Color(TextureSize * 3);
 
-            float Red = 0.0f;
-            float Green = 0.0f;
-            float Blue = 0.0f;
+    for (int y = StartY ; y < EndY ; y++) {
+        CalcRowHeights(y, TextureSize, pTerrain, &ColIndex[0], &ColFactor[0], &Heights[0]);
 
-            for (int Tile = 0 ; Tile < m_numTextureTiles ; Tile++) {
-                Vector3f Color = m_textureTiles[Tile].Image.GetColor(x, y);
+        for (int i = 0 ; i < TextureSize * 3 ; i++) {
+            Color[i] = 0.0f;
+        }
 
-                float BlendFactor = RegionPercent(Tile, InterpolatedHeight);
+        for (int Tile = 0 ; Tile < m_numTextureTiles ; Tile++) {
+            CalcRowRegionPercent(Tile, TextureSize, &Heights[0], &Percent[0]);
 
-                Red   += BlendFactor * Color.r;
-                Green += BlendFactor * Color.g;
-                Blue  += BlendFactor * Color.b;
-            }
+            const STBImage& Image = m_textureTiles[Tile].Image;
+            const unsigned char* pRow = Image.m_imageData + (y % Image.m_height) * Image.m_width * Image.m_bpp;
+            int WrappedX = 0;
 
-            if (Red > 255.0f || Green > 255.0f || Blue > 255.0f) {
-                printf("%d:%d: %f %f %f\n", y, x, Red, Green, Blue);
-                exit(0);
+            for (int x = 0 ; x < TextureSize ; x++) {
+                const unsigned char* pTexel = pRow + WrappedX * Image.m_bpp;
+                float BlendFactor = Percent[x];
+
+                Color[x * 3]     += BlendFactor * (float)pTexel[0];
+                Color[x * 3 + 1] += BlendFactor * (float)pTexel[1];
+                Color[x * 3 + 2] += BlendFactor * (float)pTexel[2];
+
+                WrappedX++;
+                if (WrappedX == Image.m_width) {
+                    WrappedX = 0;
+                }
             }
+        }
 
-            p[0] = (unsigned char)Red;
-            p[1] = (unsigned char)Green;
-            p[2] = (unsigned char)Blue;
+        unsigned char* p = pTextureData + (size_t)y * TextureSize * 3;
 
-            p += 3;
+        for (int i = 0 ; i < TextureSize * 3 ; i++) {
+            p[i] = (unsigned char)std::min(Color[i], 255.0f);
         }
     }
+}
 
-    Texture* pTexture = new Texture(GL_TEXTURE_2D);
 
-    stbi_write_png("texture.png", TextureSize, TextureSize, BPP, pTextureData, TextureSize * BPP);
+//
+// Same as BaseTerrain::GetHeightInterpolated for a full row of texels. The heights are
+// gathered once into three arrays (base, next x, next z) and blended four at a time.
+//
+void TextureGenerator::CalcRowHeights(int y, int TextureSize, const BaseTerrain* pTerrain,
+                                      const int* pColIndex, const float* pColFactor, float* pHeights) const
+{
+    float HeightMapToTextureRatio = (float)pTerrain->GetSize() / (float)TextureSize;
+    int TerrainSize = pTerrain->GetSize();
+    const Array2D<float>& HeightMap = pTerrain->GetHeightMap();
+
+    float HeightMapZ = (float)y * HeightMapToTextureRatio;
+    int z = (int)HeightMapZ;
+    float RatioZ = HeightMapZ - floorf(HeightMapZ);
+    bool LastRow = (z + 1 >= TerrainSize);
+
+    const float* pRow = HeightMap.GetRow(z);
+    const float* pNextRow = LastRow ? pRow : HeightMap.GetRow(z + 1);
+
+    // Reuse the output as the base height array
+    float* pBase = pHeights;
+    std::vector<float> NextX(TextureSize);
+    std::vector<float> NextZ(TextureSize);
+
+    for (int x = 0 ; x < TextureSize ; x++) {
+        int Col = pColIndex[x];
+        pBase[x] = pRow[Col];
+
+        if (LastRow || (Col + 1 >= TerrainSize)) {
+            // on the far edges the base height is used as is
+            NextX[x] = pBase[x];
+            NextZ[x] = pBase[x];
+        } else {
+            NextX[x] = pRow[Col + 1];
+            NextZ[x] = pNextRow[Col];
+        }
+    }
+
+    int x = 0;
 
-    pTexture->LoadRaw(TextureSize, TextureSize, BPP, pTextureData);
+#ifdef OGLDEV_SSE2
+    __m128 RatioZ4 = _mm_set1_ps(RatioZ);
+    __m128 Half4 = _mm_set1_ps(0.5f);
 
-    free(pTextureData);
+    for ( ; x + 4 <= TextureSize ; x += 4) {
+        __m128 Base = _mm_loadu_ps(pBase + x);
+        __m128 InterpolatedX = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&NextX[x]), Base), _mm_loadu_ps(pColFactor + x)), Base);
+        __m128 InterpolatedZ = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&NextZ[x]), Base), RatioZ4), Base);
+        _mm_storeu_ps(pHeights + x, _mm_mul_ps(_mm_add_ps(InterpolatedX, InterpolatedZ), Half4));
+    }
+#endif
 
-    return pTexture;
+    for ( ; x < TextureSize ; x++) {
+        float Base = pBase[x];
+        float InterpolatedX = (NextX[x] - Base) * pColFactor[x] + Base;
+        float InterpolatedZ = (NextZ[x] - Base) * RatioZ + Base;
+        pHeights[x] = (InterpolatedX + InterpolatedZ) / 2.0f;
+    }
+}
+
+
+void TextureGenerator::CalcRowRegionPercent(int Tile, int TextureSize, const float* pHeights, float* pPercent) const
+{
+    const TextureHeightDesc& Desc = m_textureTiles[Tile].HeightDesc;
+
+    int x = 0;
+
+#ifdef OGLDEV_SSE2
+    __m128 Low4 = _mm_set1_ps(Desc.Low);
+    __m128 High4 = _mm_set1_ps(Desc.High);
+    __m128 InvRise4 = _mm_set1_ps(Desc.InvRise);
+    __m128 InvFall4 = _mm_set1_ps(Desc.InvFall);
+    __m128 Zero4 = _mm_setzero_ps();
+    __m128 One4 = _mm_set1_ps(1.0f);
+
+    for ( ; x + 4 <= TextureSize ; x += 4) {
+        __m128 Height = _mm_loadu_ps(pHeights + x);
+        __m128 Rise = _mm_mul_ps(_mm_sub_ps(Height, Low4), InvRise4);
+        __m128 Fall = _mm_mul_ps(_mm_sub_ps(High4, Height), InvFall4);
+        __m128 Percent = _mm_min_ps(_mm_max_ps(_mm_min_ps(Rise, Fall), Zero4), One4);
+        _mm_storeu_ps(pPercent + x, Percent);
+    }
+#endif
+
+    for ( ; x < TextureSize ; x++) {
+        pPercent[x] = RegionPercent(Tile, pHeights[x]);
+    }
+}
+
+
+void TextureGenerator::DumpTexture(int TextureSize, int BPP, unsigned char* pTextureData)
+{
+    // only one dump can be in flight
+    WaitForDump();
+
+    const char* pFilename = m_pDumpFilename;
+
+    m_dumpThread = std::thread([=]() {
+                                   stbi_write_png(pFilename, TextureSize, TextureSize, BPP, pTextureData, TextureSize * BPP);
+                                   free(pTextureData);
+                               });
+}
+
+
+void TextureGenerator::WaitForDump()
+{
+    if (m_dumpThread.joinable()) {
+        m_dumpThread.join();
+    }
 }
 
 
@@ -120,41 +276,32 @@ void TextureGenerator::CalculateTextureRegions(float MinHeight, float MaxHeight)
     float LastHeight = -1.0f;
 
     for (int i = 0 ; i < m_numTextureTiles ; i++) {
-        m_textureTiles[i].HeightDesc.Low = LastHeight + 1;
+        TextureHeightDesc& Desc = m_textureTiles[i].HeightDesc;
+        Desc.Low = LastHeight + 1;
         LastHeight += RangePerTile;
-        m_textureTiles[i].HeightDesc.Optimal = LastHeight;
-        m_textureTiles[i].HeightDesc.High = m_textureTiles[i].HeightDesc.Optimal + RangePerTile;
+        Desc.Optimal = LastHeight;
+        Desc.High = Desc.Optimal + RangePerTile;
+        Desc.InvRise = 1.0f / (Desc.Optimal - Desc.Low);
+        Desc.InvFall = 1.0f / (Desc.High - Desc.Optimal);
 
-        m_textureTiles[i].HeightDesc.Print(); printf("\n");
+        Desc.Print(); printf("\n");
     }
 }
 
 
-float TextureGenerator::RegionPercent(int Tile, float Height)
+//
+// The blend factor rises linearly from zero at Low to one at Optimal and then falls back
+// to zero at High. Taking the minimum of the two slopes and clamping it to [0, 1] covers
+// all the cases without branches.
+//
+float TextureGenerator::RegionPercent(int Tile, float Height) const
 {
-    float Percent = 0.0f;
-
-    if (Height < m_textureTiles[Tile].HeightDesc.Low) {
-        Percent = 0.0f;
-    } else if (Height > m_textureTiles[Tile].HeightDesc.High) {
-        Percent = 0.0f;
-    } else if (Height < m_textureTiles[Tile].HeightDesc.Optimal) {
-        float Nom = (float)Height - (float)m_textureTiles[Tile].HeightDesc.Low;
-        float Denom = (float)m_textureTiles[Tile].HeightDesc.Optimal - (float)m_textureTiles[Tile].HeightDesc.Low;
-        Percent = Nom / Denom;
-    } else if (Height >= m_textureTiles[Tile].HeightDesc.Optimal) {
-        float Nom = (float)m_textureTiles[Tile].HeightDesc.High - (float)Height;
-        float Denom = (float)m_textureTiles[Tile].HeightDesc.High - (float)m_textureTiles[Tile].HeightDesc.Optimal;
-        Percent = Nom / Denom;
-    } else {
-        printf("%s:%d - shouldn't get here! tile %d Height %f\n", __FILE__, __LINE__, Tile, Height);
-        exit(0);
-    }
+    const TextureHeightDesc& Desc = m_textureTiles[Tile].HeightDesc;
 
-    if ((Percent < 0.0f) || (Percent > 1.0f)) {
-        printf("%s:%d - Invalid percent %f\n", __FILE__, __LINE__, Percent);
-        exit(0);
-    }
+    float Rise = (Height - Desc.Low) * Desc.InvRise;
+    float Fall = (Desc.High - Height) * Desc.InvFall;
+
+    float Percent = std::min(std::max(std::min(Rise, Fall), 0.0f), 1.0f);
 
     return Percent;
 }
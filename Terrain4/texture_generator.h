@@ -21,6 +21,7 @@
 #define TEXTURE_GENERATOR_H
 
 #include <stdio.h>
+#include <thread>
 
 #include "ogldev_texture.h"
 #include "ogldev_stb_image.h"
@@ -29,6 +30,8 @@ struct TextureHeightDesc {
     float Low = 0.0f;
     float Optimal = 0.0f;
     float High = 0.0f;
+    float InvRise = 0.0f;   // 1 / (Optimal - Low)
+    float InvFall = 0.0f;   // 1 / (High - Optimal)
 
     void Print() const { printf("Low %f Optimal %f High %f", Low, Optimal, High); }
 };
@@ -46,20 +49,38 @@ class TextureGenerator {
  public:
     TextureGenerator();
 
+    ~TextureGenerator();
+
     void LoadTile(const char* Filename);
 
+    // If set, the generated texture is written to this file on a background thread
+    void SetDumpFilename(const char* pFilename) { m_pDumpFilename = pFilename; }
+
     Texture* GenerateTexture(int TextureSize, BaseTerrain* pTerrain, float MinHeight, float MaxHeight);
 
+    void WaitForDump();
+
  private:
 
     void CalculateTextureRegions(float MinHeight, float MaxHeight);
 
-    float RegionPercent(int Tile, float Height);
+    float RegionPercent(int Tile, float Height) const;
+
+    void GenerateRows(int StartY, int EndY, int TextureSize, const BaseTerrain* pTerrain, unsigned char* pTextureData) const;
+
+    void CalcRowHeights(int y, int TextureSize, const BaseTerrain* pTerrain,
+                        const int* pColIndex, const float* pColFactor, float* pHeights) const;
+
+    void CalcRowRegionPercent(int Tile, int TextureSize, const float* pHeights, float* pPercent) const;
+
+    void DumpTexture(int TextureSize, int BPP, unsigned char* pTextureData);
 
     #define MAX_TEXTURE_TILES 4
 
     TextureTile m_textureTiles[MAX_TEXTURE_TILES] = {};
     int m_numTextureTiles = 0;
+    const char* m_pDumpFilename = NULL;
+    std::thread m_dumpThread;
 };
 
 #endif
@@ -12,6 +12,9 @@ SOURCES="terrain_demo5.1.cpp \
 	midpoint_disp_terrain.cpp \
 	terrain.cpp \
 	slope_lighter.cpp \
+	horizon_lighter.cpp \
+	terrain_erosion.cpp \
+	erosion_technique.cpp \
 	$OGLDEV_DIR/Common/ogldev_util.cpp \
 	$OGLDEV_DIR/Common/math_3d.cpp \
 	$OGLDEV_DIR/Common/ogldev_basic_glfw_camera.cpp \
@@ -0,0 +1,238 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// GPU version of one iteration of TerrainErosion, one thread per point:
+//
+//   Pass 0 - CalcFlux: the outflow of water and the thermal scale
+//   Pass 1 - UpdateTerrain: water, velocity, erosion, deposition and thermal erosion
+//   Pass 2 - Transport: the sediment moves with the water and the water evaporates
+//
+// The points outside the map behave like the border of the CPU fields - the height is
+// the original height of the edge and there is no water, no flux and no material sliding in.
+//
+
+#version 430
+
+layout (local_size_x = 16, local_size_y = 16) in;
+
+layout (binding = 0, rgba32f) uniform image2D gTerrain;         // height, water, sediment, original height
+layout (binding = 1, rgba32f) uniform image2D gTerrainTemp;     // output of pass 1
+layout (binding = 2, rgba32f) uniform image2D gFlux;            // left, right, down (-z), up (+z)
+layout (binding = 3, rg32f) uniform image2D gVelocity;
+layout (binding = 4, r32f) uniform image2D gThermal;
+
+uniform int gPass;
+uniform float gTimeStep;
+uniform float gCellSize;
+uniform bool gHydraulic;
+uniform float gRainRate;
+uniform float gPipeArea;
+uniform float gCapacity;
+uniform float gDissolving;
+uniform float gDeposition;
+uniform float gEvaporation;
+uniform float gMinTilt;
+uniform float gErosionDepth;
+uniform bool gThermal;
+uniform float gTalusHeight;
+uniform float gThermalRate;
+
+const float GRAVITY = 9.81;
+const float MIN_WATER_DEPTH = 0.0001;
+
+ivec2 Size;
+
+
+bool IsInside(ivec2 p)
+{
+    return all(greaterThanEqual(p, ivec2(0))) && all(lessThan(p, Size));
+}
+
+
+float LoadHeight(ivec2 p)
+{
+    vec4 Terrain = imageLoad(gTerrain, clamp(p, ivec2(0), Size - 1));
+    return IsInside(p) ? Terrain.x : Terrain.w;
+}
+
+
+float LoadSurface(ivec2 p)
+{
+    vec4 Terrain = imageLoad(gTerrain, clamp(p, ivec2(0), Size - 1));
+    return IsInside(p) ? Terrain.x + Terrain.y : Terrain.w;
+}
+
+
+vec4 LoadFlux(ivec2 p)
+{
+    return IsInside(p) ? imageLoad(gFlux, p) : vec4(0.0);
+}
+
+
+float LoadThermal(ivec2 p)
+{
+    return IsInside(p) ? imageLoad(gThermal, p).x : 0.0;
+}
+
+
+vec4 CalcExcess(float h, vec4 Neighbours)
+{
+    return max(vec4(h) - Neighbours - vec4(gTalusHeight), vec4(0.0));
+}
+
+
+vec4 LoadNeighbourHeights(ivec2 p)
+{
+    return vec4(LoadHeight(p + ivec2(-1, 0)), LoadHeight(p + ivec2(1, 0)),
+                LoadHeight(p + ivec2(0, -1)), LoadHeight(p + ivec2(0, 1)));
+}
+
+
+void CalcFlux(ivec2 p)
+{
+    vec4 Terrain = imageLoad(gTerrain, p);
+
+    if (gHydraulic) {
+        float h = Terrain.x + Terrain.y;
+        vec4 Neighbours = vec4(LoadSurface(p + ivec2(-1, 0)), LoadSurface(p + ivec2(1, 0)),
+                               LoadSurface(p + ivec2(0, -1)), LoadSurface(p + ivec2(0, 1)));
+
+        float FluxFactor = gTimeStep * gPipeArea * GRAVITY / gCellSize;
+        vec4 Flux = max(imageLoad(gFlux, p) + FluxFactor * (vec4(h) - Neighbours), vec4(0.0));
+
+        float Sum = dot(Flux, vec4(1.0));
+        float Available = (Terrain.y + gTimeStep * gRainRate) * gCellSize * gCellSize / gTimeStep;
+        float K = (Sum > Available) ? Available / Sum : 1.0;
+
+        imageStore(gFlux, p, Flux * K);
+    }
+
+    if (gThermal) {
+        vec4 Excess = CalcExcess(Terrain.x, LoadNeighbourHeights(p));
+        float Sum = dot(Excess, vec4(1.0));
+        float Max = max(max(Excess.x, Excess.y), max(Excess.z, Excess.w));
+
+        imageStore(gThermal, p, vec4((Sum > 0.0) ? 0.5 * gThermalRate * gTimeStep * Max / Sum : 0.0));
+    }
+}
+
+
+void UpdateTerrain(ivec2 p)
+{
+    vec4 Terrain = imageLoad(gTerrain, p);
+    float h = Terrain.x;
+    vec4 Neighbours = LoadNeighbourHeights(p);
+    vec4 Result = Terrain;
+
+    if (gHydraulic) {
+        vec4 Flux = imageLoad(gFlux, p);
+        vec4 FluxLeft = LoadFlux(p + ivec2(-1, 0));
+        vec4 FluxRight = LoadFlux(p + ivec2(1, 0));
+        vec4 FluxDown = LoadFlux(p + ivec2(0, -1));
+        vec4 FluxUp = LoadFlux(p + ivec2(0, 1));
+
+        float Out = dot(Flux, vec4(1.0));
+        float In = FluxLeft.y + FluxRight.x + FluxDown.w + FluxUp.z;
+        float Depth = Terrain.y + gTimeStep * gRainRate;
+        float NewDepth = max(Depth + (In - Out) * gTimeStep / (gCellSize * gCellSize), 0.0);
+        float MeanDepth = 0.5 * (Depth + NewDepth);
+
+        float PassX = 0.5 * (FluxLeft.y - Flux.x + Flux.y - FluxRight.x);
+        float PassZ = 0.5 * (FluxDown.w - Flux.z + Flux.w - FluxUp.z);
+        float InvCrossSection = 1.0 / (gCellSize * max(MeanDepth, MIN_WATER_DEPTH));
+        vec2 Velocity = vec2(PassX, PassZ) * InvCrossSection;
+
+        vec2 Gradient = vec2(Neighbours.y - Neighbours.x, Neighbours.w - Neighbours.z) * (0.5 / gCellSize);
+        float Slope2 = dot(Gradient, Gradient);
+        float SinTilt = max(sqrt(Slope2 / (1.0 + Slope2)), gMinTilt);
+
+        float DepthFactor = min(MeanDepth / gErosionDepth, 1.0);
+        float SedimentCapacity = gCapacity * SinTilt * DepthFactor * length(Velocity);
+        float Missing = SedimentCapacity - Terrain.z;
+        float Dissolved = Missing * gTimeStep * ((Missing > 0.0) ? gDissolving : gDeposition);
+
+        Result.x -= Dissolved;
+        Result.y = NewDepth;
+        Result.z += Dissolved;
+
+        imageStore(gVelocity, p, vec4(Velocity, 0.0, 0.0));
+    }
+
+    if (gThermal) {
+        float Out = imageLoad(gThermal, p).x * dot(CalcExcess(h, Neighbours), vec4(1.0));
+
+        float In = LoadThermal(p + ivec2(-1, 0)) * max(Neighbours.x - h - gTalusHeight, 0.0) +
+                   LoadThermal(p + ivec2(1, 0))  * max(Neighbours.y - h - gTalusHeight, 0.0) +
+                   LoadThermal(p + ivec2(0, -1)) * max(Neighbours.z - h - gTalusHeight, 0.0) +
+                   LoadThermal(p + ivec2(0, 1))  * max(Neighbours.w - h - gTalusHeight, 0.0);
+
+        Result.x += In - Out;
+    }
+
+    imageStore(gTerrainTemp, p, Result);
+}
+
+
+float LoadSediment(ivec2 p)
+{
+    return imageLoad(gTerrainTemp, p).z;
+}
+
+
+void Transport(ivec2 p)
+{
+    vec4 Terrain = imageLoad(gTerrainTemp, p);
+
+    if (gHydraulic) {
+        vec2 Velocity = imageLoad(gVelocity, p).xy;
+        vec2 Last = vec2(Size - 1);
+
+        // The sediment comes from where the water was one time step ago
+        vec2 Pos = clamp(vec2(p) - Velocity * gTimeStep / gCellSize, vec2(0.0), Last);
+        vec2 Pos0 = min(floor(Pos), Last - 1.0);
+        vec2 f = Pos - Pos0;
+        ivec2 i0 = ivec2(Pos0);
+
+        float Bottom = mix(LoadSediment(i0), LoadSediment(i0 + ivec2(1, 0)), f.x);
+        float Top = mix(LoadSediment(i0 + ivec2(0, 1)), LoadSediment(i0 + ivec2(1, 1)), f.x);
+
+        Terrain.y *= max(1.0 - gEvaporation * gTimeStep, 0.0);
+        Terrain.z = mix(Bottom, Top, f.y);
+    }
+
+    imageStore(gTerrain, p, Terrain);
+}
+
+
+void main()
+{
+    Size = imageSize(gTerrain);
+    ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+
+    if (any(greaterThanEqual(p, Size))) {
+        return;
+    }
+
+    if (gPass == 0) {
+        CalcFlux(p);
+    } else if (gPass == 1) {
+        UpdateTerrain(p);
+    } else {
+        Transport(p);
+    }
+}
@@ -0,0 +1,104 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+
+#include "ogldev_math_3d.h"
+#include "erosion_technique.h"
+#include "terrain_erosion.h"
+
+
+ErosionTechnique::ErosionTechnique()
+{
+}
+
+
+bool ErosionTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_COMPUTE_SHADER, "erosion.cs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_passLoc = GetUniformLocation("gPass");
+    m_timeStepLoc = GetUniformLocation("gTimeStep");
+    m_cellSizeLoc = GetUniformLocation("gCellSize");
+    m_hydraulicLoc = GetUniformLocation("gHydraulic");
+    m_rainRateLoc = GetUniformLocation("gRainRate");
+    m_pipeAreaLoc = GetUniformLocation("gPipeArea");
+    m_capacityLoc = GetUniformLocation("gCapacity");
+    m_dissolvingLoc = GetUniformLocation("gDissolving");
+    m_depositionLoc = GetUniformLocation("gDeposition");
+    m_evaporationLoc = GetUniformLocation("gEvaporation");
+    m_minTiltLoc = GetUniformLocation("gMinTilt");
+    m_erosionDepthLoc = GetUniformLocation("gErosionDepth");
+    m_thermalLoc = GetUniformLocation("gThermal");
+    m_talusHeightLoc = GetUniformLocation("gTalusHeight");
+    m_thermalRateLoc = GetUniformLocation("gThermalRate");
+
+    if (m_passLoc == INVALID_UNIFORM_LOCATION ||
+        m_timeStepLoc == INVALID_UNIFORM_LOCATION ||
+        m_cellSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_hydraulicLoc == INVALID_UNIFORM_LOCATION ||
+        m_rainRateLoc == INVALID_UNIFORM_LOCATION ||
+        m_pipeAreaLoc == INVALID_UNIFORM_LOCATION ||
+        m_capacityLoc == INVALID_UNIFORM_LOCATION ||
+        m_dissolvingLoc == INVALID_UNIFORM_LOCATION ||
+        m_depositionLoc == INVALID_UNIFORM_LOCATION ||
+        m_evaporationLoc == INVALID_UNIFORM_LOCATION ||
+        m_minTiltLoc == INVALID_UNIFORM_LOCATION ||
+        m_erosionDepthLoc == INVALID_UNIFORM_LOCATION ||
+        m_thermalLoc == INVALID_UNIFORM_LOCATION ||
+        m_talusHeightLoc == INVALID_UNIFORM_LOCATION ||
+        m_thermalRateLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void ErosionTechnique::SetPass(int Pass)
+{
+    glUniform1i(m_passLoc, Pass);
+}
+
+
+void ErosionTechnique::SetParams(const ErosionParams& Params, float CellSize)
+{
+    glUniform1f(m_timeStepLoc, Params.TimeStep);
+    glUniform1f(m_cellSizeLoc, CellSize);
+    glUniform1i(m_hydraulicLoc, Params.Hydraulic ? 1 : 0);
+    glUniform1f(m_rainRateLoc, Params.RainRate);
+    glUniform1f(m_pipeAreaLoc, Params.PipeArea);
+    glUniform1f(m_capacityLoc, Params.Capacity);
+    glUniform1f(m_dissolvingLoc, Params.Dissolving);
+    glUniform1f(m_depositionLoc, Params.Deposition);
+    glUniform1f(m_evaporationLoc, Params.Evaporation);
+    glUniform1f(m_minTiltLoc, Params.MinTilt);
+    glUniform1f(m_erosionDepthLoc, Params.ErosionDepth);
+    glUniform1i(m_thermalLoc, Params.Thermal ? 1 : 0);
+    glUniform1f(m_talusHeightLoc, CellSize * tanf(ToRadian(Params.TalusAngle)));
+    glUniform1f(m_thermalRateLoc, Params.ThermalRate);
+}
@@ -0,0 +1,65 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef EROSION_TECHNIQUE_H
+#define EROSION_TECHNIQUE_H
+
+#include "ogldev_util.h"
+#include "technique.h"
+
+// Image units of erosion.cs
+#define EROSION_TERRAIN_IMAGE_UNIT          0
+#define EROSION_TERRAIN_TEMP_IMAGE_UNIT     1
+#define EROSION_FLUX_IMAGE_UNIT             2
+#define EROSION_VELOCITY_IMAGE_UNIT         3
+#define EROSION_THERMAL_IMAGE_UNIT          4
+
+#define EROSION_NUM_PASSES 3
+
+struct ErosionParams;
+
+class ErosionTechnique : public Technique
+{
+public:
+
+    ErosionTechnique();
+
+    virtual bool Init();
+
+    void SetPass(int Pass);
+
+    void SetParams(const ErosionParams& Params, float CellSize);
+
+private:
+    GLuint m_passLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_timeStepLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cellSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_hydraulicLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_rainRateLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_pipeAreaLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_capacityLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_dissolvingLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_depositionLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_evaporationLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_minTiltLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_erosionDepthLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_thermalLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_talusHeightLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_thermalRateLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* EROSION_TECHNIQUE_H */
@@ -0,0 +1,383 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "ogldev_parallel.h"
+#include "horizon_lighter.h"
+
+#define AO_NUM_DIRECTIONS    16
+#define LIGHT_MAP_TILE_SIZE  64
+#define SUN_PENUMBRA_ANGLE   ToRadian(4.0f)     // the sun fades over this range around the horizon
+#define MIN_LINES_PER_THREAD 16
+#define MIN_ROWS_PER_THREAD  32
+#define NO_HORIZON           -1e6f
+
+
+static u8 ToUnorm8(float f)
+{
+    return (u8)(std::min(std::max(f, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+
+//
+// Calls f(x, z, Weight, Tangent) with the tangent of the elevation angle of the horizon of
+// every point in the direction (DirX, DirZ). Points without a horizon get NO_HORIZON.
+//
+// The height map is covered by parallel lines that step one point along the major axis of
+// the direction. Each line starts at the edge that the direction points to and the angles
+// are found at the points where it crosses the columns (or rows) of the height map. A height
+// map point lies between two consecutive lines and receives the angles of both with weights
+// that sum to one. Lines k and k + 2 never share a point so the even and the odd lines are
+// processed in two parallel passes without any locking.
+//
+// The lines of the directions that are closer to the Z axis walk down the columns of the
+// height map so it is read from a tiled copy (and the results are usually accumulated into
+// tiled arrays) where the next point of a line is in the same tile most of the time.
+//
+template<typename Func>
+static void SweepHorizons(const TiledArray2D<float>& HeightMap, int TerrainSize, float WorldScale,
+                          float DirX, float DirZ, const Func& f)
+{
+    bool Transposed = fabsf(DirZ) > fabsf(DirX);
+    float DirMajor = Transposed ? DirZ : DirX;
+    float DirMinor = Transposed ? DirX : DirZ;
+
+    float Slope = DirMinor / DirMajor;
+    int Step = (DirMajor > 0.0f) ? 1 : -1;
+    int Last = TerrainSize - 1;
+    int First = (Step > 0) ? Last : 0;
+    float StepLen = sqrtf(1.0f + Slope * Slope) * WorldScale;
+
+    // minor = k + Slope * major
+    int MinK = (int)floorf(std::min(0.0f, -Slope * (float)Last)) - 1;
+    int MaxK = Last + (int)ceilf(std::max(0.0f, -Slope * (float)Last)) + 1;
+
+    auto GetHeight = [&](int Major, int Minor) {
+        return Transposed ? HeightMap.Get(Minor, Major) : HeightMap.Get(Major, Minor);
+    };
+
+    for (int Parity = 0 ; Parity < 2 ; Parity++) {
+        int NumLines = (MaxK - MinK - Parity) / 2 + 1;
+
+        ParallelFor(0, NumLines, [&](int StartLine, int EndLine) {
+            std::vector<float> HullT;
+            std::vector<float> HullH;
+            HullT.reserve(TerrainSize);
+            HullH.reserve(TerrainSize);
+
+            for (int Line = StartLine ; Line < EndLine ; Line++) {
+                float k = (float)(MinK + Parity + Line * 2);
+                HullT.clear();
+                HullH.clear();
+
+                for (int i = 0 ; i < TerrainSize ; i++) {
+                    int Major = First - i * Step;
+                    float Minor = k + Slope * (float)Major;
+
+                    if ((Minor <= -1.0f) || (Minor >= (float)TerrainSize)) {
+                        continue;
+                    }
+
+                    float Clamped = std::min(std::max(Minor, 0.0f), (float)Last);
+                    int Minor0 = std::min((int)Clamped, Last - 1);
+                    float Frac = Clamped - (float)Minor0;
+                    float h = GetHeight(Major, Minor0) * (1.0f - Frac) + GetHeight(Major, Minor0 + 1) * Frac;
+                    float t = (float)i * StepLen;
+
+                    // Pop the hull points that are below the line from this point to the one behind them.
+                    // The distances are positive so the slopes are compared without dividing.
+                    int n = (int)HullT.size();
+
+                    while ((n >= 2) &&
+                           ((HullH[n - 1] - h) * (t - HullT[n - 2]) <= (HullH[n - 2] - h) * (t - HullT[n - 1]))) {
+                        HullT.pop_back();
+                        HullH.pop_back();
+                        n--;
+                    }
+
+                    float Tangent = (n == 0) ? NO_HORIZON : (HullH[n - 1] - h) / (t - HullT[n - 1]);
+
+                    HullT.push_back(t);
+                    HullH.push_back(h);
+
+                    int Splat0 = (int)floorf(Minor);
+                    float Weight1 = Minor - (float)Splat0;
+
+                    for (int s = 0 ; s < 2 ; s++) {
+                        int Splat = Splat0 + s;
+                        float Weight = (s == 0) ? 1.0f - Weight1 : Weight1;
+
+                        if ((Splat >= 0) && (Splat <= Last) && (Weight > 0.0f)) {
+                            if (Transposed) {
+                                f(Splat, Major, Weight, Tangent);
+                            } else {
+                                f(Major, Splat, Weight, Tangent);
+                            }
+                        }
+                    }
+                }
+            }
+        }, MIN_LINES_PER_THREAD);
+    }
+}
+
+
+HorizonLighter::~HorizonLighter()
+{
+    Destroy();
+}
+
+
+void HorizonLighter::Destroy()
+{
+    if (m_lightMap > 0) {
+        glDeleteTextures(1, &m_lightMap);
+        m_lightMap = 0;
+    }
+
+    m_lightMapSize = 0;
+    m_terrainSize = 0;
+    m_texels.clear();
+    m_tiledHeightmap.Destroy();
+    m_horizon.Destroy();
+    m_dirtyTiles.clear();
+    m_hasSweepDir = false;
+}
+
+
+void HorizonLighter::InitLighter(int TerrainSize, float WorldScale)
+{
+    m_terrainSize = TerrainSize;
+    m_worldScale = WorldScale;
+    m_numTiles = (TerrainSize + LIGHT_MAP_TILE_SIZE - 1) / LIGHT_MAP_TILE_SIZE;
+
+    m_texels.assign(TerrainSize * TerrainSize * 4, 255);
+    m_horizon.InitArray2D(TerrainSize, TerrainSize, (float)-M_PI / 2.0f);
+    m_dirtyTiles.assign(m_numTiles * m_numTiles, 0);
+    m_hasSweepDir = false;
+    m_fullUpload = true;
+
+    m_tiledHeightmap.InitFromArray2D(*m_pHeightmap);
+
+    CalcNormals();
+
+    CalcAmbientOcclusion();
+}
+
+
+void HorizonLighter::CalcNormals()
+{
+    int Last = m_terrainSize - 1;
+
+    ParallelFor(0, m_terrainSize, [&](int StartRow, int EndRow) {
+        for (int z = StartRow ; z < EndRow ; z++) {
+            int z0 = std::max(z - 1, 0);
+            int z1 = std::min(z + 1, Last);
+
+            const float* pRow = m_pHeightmap->GetRow(z);
+            const float* pPrev = m_pHeightmap->GetRow(z0);
+            const float* pNext = m_pHeightmap->GetRow(z1);
+
+            for (int x = 0 ; x < m_terrainSize ; x++) {
+                int x0 = std::max(x - 1, 0);
+                int x1 = std::min(x + 1, Last);
+
+                float dx = (pRow[x1] - pRow[x0]) / ((float)(x1 - x0) * m_worldScale);
+                float dz = (pNext[x] - pPrev[x]) / ((float)(z1 - z0) * m_worldScale);
+
+                Vector3f Normal(-dx, 1.0f, -dz);
+                Normal.Normalize();
+
+                u8* pTexel = &m_texels[(z * m_terrainSize + x) * 4];
+                pTexel[2] = ToUnorm8(Normal.x * 0.5f + 0.5f);
+                pTexel[3] = ToUnorm8(Normal.z * 0.5f + 0.5f);
+            }
+        }
+    }, MIN_ROWS_PER_THREAD);
+}
+
+
+void HorizonLighter::CalcAmbientOcclusion()
+{
+    TiledArray2D<float> Occlusion;
+    Occlusion.InitArray2D(m_terrainSize, m_terrainSize, 0.0f);
+
+    for (int i = 0 ; i < AO_NUM_DIRECTIONS ; i++) {
+        float Angle = (float)i * 2.0f * (float)M_PI / (float)AO_NUM_DIRECTIONS;
+
+        SweepHorizons(m_tiledHeightmap, m_terrainSize, m_worldScale, cosf(Angle), sinf(Angle),
+                      [&](int x, int z, float Weight, float Tangent) {
+                          // sin(atan(t)) of the horizon above the horizontal plane
+                          Tangent = std::max(Tangent, 0.0f);
+                          Occlusion.At(x, z) += Weight * Tangent / sqrtf(1.0f + Tangent * Tangent);
+                      });
+    }
+
+    for (int z = 0 ; z < m_terrainSize ; z++) {
+        for (int x = 0 ; x < m_terrainSize ; x++) {
+            m_texels[(z * m_terrainSize + x) * 4 + 1] = ToUnorm8(1.0f - Occlusion.Get(x, z) / (float)AO_NUM_DIRECTIONS);
+        }
+    }
+}
+
+
+void HorizonLighter::SetLightDir(const Vector3f& LightDir)
+{
+    if (!IsInitialized()) {
+        printf("%s:%d - the lighter is not initialized\n", __FILE__, __LINE__);
+        exit(0);
+    }
+
+    Vector3f ReversedLightDir = LightDir * -1.0f;
+    float HorizontalLen = sqrtf(ReversedLightDir.x * ReversedLightDir.x + ReversedLightDir.z * ReversedLightDir.z);
+    float SunElevation = atan2f(ReversedLightDir.y, HorizontalLen);
+
+    if (HorizontalLen < 1e-6f) {
+        // The sun is straight up (or down) so every direction is the same
+        m_horizon.InitArray2D(m_terrainSize, m_terrainSize, (float)-M_PI / 2.0f);
+        m_hasSweepDir = false;
+    } else {
+        float DirX = ReversedLightDir.x / HorizontalLen;
+        float DirZ = ReversedLightDir.z / HorizontalLen;
+
+        bool SameAzimuth = m_hasSweepDir && (DirX * m_sweepDirX + DirZ * m_sweepDirZ > 0.999999f);
+
+        if (!SameAzimuth) {
+            m_horizon.InitArray2D(m_terrainSize, m_terrainSize, 0.0f);
+
+            SweepHorizons(m_tiledHeightmap, m_terrainSize, m_worldScale, DirX, DirZ,
+                          [&](int x, int z, float Weight, float Tangent) {
+                              m_horizon.At(x, z) += Weight * atanf(Tangent);
+                          });
+
+            m_hasSweepDir = true;
+            m_sweepDirX = DirX;
+            m_sweepDirZ = DirZ;
+        }
+    }
+
+    CalcSunVisibility(SunElevation);
+}
+
+
+void HorizonLighter::CalcSunVisibility(float SunElevation)
+{
+    ParallelFor(0, m_numTiles, [&](int StartTileRow, int EndTileRow) {
+        for (int TileZ = StartTileRow ; TileZ < EndTileRow ; TileZ++) {
+            int z0 = TileZ * LIGHT_MAP_TILE_SIZE;
+            int z1 = std::min(z0 + LIGHT_MAP_TILE_SIZE, m_terrainSize);
+
+            for (int TileX = 0 ; TileX < m_numTiles ; TileX++) {
+                int x0 = TileX * LIGHT_MAP_TILE_SIZE;
+                int x1 = std::min(x0 + LIGHT_MAP_TILE_SIZE, m_terrainSize);
+                bool Changed = false;
+
+                for (int z = z0 ; z < z1 ; z++) {
+                    for (int x = x0 ; x < x1 ; x++) {
+                        int Index = z * m_terrainSize + x;
+                        float Visibility = (SunElevation - m_horizon.Get(x, z)) / SUN_PENUMBRA_ANGLE + 0.5f;
+                        u8 Texel = ToUnorm8(Visibility);
+
+                        if (m_texels[Index * 4] != Texel) {
+                            m_texels[Index * 4] = Texel;
+                            Changed = true;
+                        }
+                    }
+                }
+
+                if (Changed) {
+                    m_dirtyTiles[TileZ * m_numTiles + TileX] = 1;
+                }
+            }
+        }
+    }, 1);
+}
+
+
+int HorizonLighter::GetNumDirtyTiles() const
+{
+    int NumDirty = 0;
+
+    for (int i = 0 ; i < (int)m_dirtyTiles.size() ; i++) {
+        NumDirty += m_dirtyTiles[i];
+    }
+
+    return NumDirty;
+}
+
+
+void HorizonLighter::UpdateLightMap()
+{
+    if (!IsInitialized()) {
+        return;
+    }
+
+    if (m_lightMapSize != m_terrainSize) {
+        if (m_lightMap > 0) {
+            glDeleteTextures(1, &m_lightMap);
+        }
+
+        glGenTextures(1, &m_lightMap);
+        glBindTexture(GL_TEXTURE_2D, m_lightMap);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_terrainSize, m_terrainSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        m_lightMapSize = m_terrainSize;
+        m_fullUpload = true;
+    } else {
+        glBindTexture(GL_TEXTURE_2D, m_lightMap);
+    }
+
+    if (m_fullUpload) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, m_terrainSize, m_terrainSize, GL_RGBA, GL_UNSIGNED_BYTE, &m_texels[0]);
+        std::fill(m_dirtyTiles.begin(), m_dirtyTiles.end(), 0);
+        m_fullUpload = false;
+    } else {
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, m_terrainSize);
+
+        for (int TileZ = 0 ; TileZ < m_numTiles ; TileZ++) {
+            for (int TileX = 0 ; TileX < m_numTiles ; TileX++) {
+                u8& Dirty = m_dirtyTiles[TileZ * m_numTiles + TileX];
+
+                if (!Dirty) {
+                    continue;
+                }
+
+                int x0 = TileX * LIGHT_MAP_TILE_SIZE;
+                int z0 = TileZ * LIGHT_MAP_TILE_SIZE;
+                int Width = std::min(LIGHT_MAP_TILE_SIZE, m_terrainSize - x0);
+                int Height = std::min(LIGHT_MAP_TILE_SIZE, m_terrainSize - z0);
+
+                glTexSubImage2D(GL_TEXTURE_2D, 0, x0, z0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE,
+                                &m_texels[(z0 * m_terrainSize + x0) * 4]);
+                Dirty = 0;
+                m_numTileUploads++;
+            }
+        }
+
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,107 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef HORIZON_LIGHTER_H
+#define HORIZON_LIGHTER_H
+
+#include <vector>
+#include <GL/glew.h>
+
+#include "ogldev_types.h"
+#include "ogldev_array_2d.h"
+#include "ogldev_tiled_array_2d.h"
+#include "ogldev_math_3d.h"
+
+//
+// Bakes the lighting of the terrain into an RGBA8 light map with one texel per height map point:
+//
+//   R - sun visibility (0 when the sun is below the horizon of the point)
+//   G - ambient occlusion
+//   B - normal.x * 0.5 + 0.5
+//   A - normal.z * 0.5 + 0.5
+//
+// The horizon of every point in a given direction is found by sweeping all the lines of the
+// height map in that direction while keeping the upper convex hull of the points that were
+// already visited, so a direction costs O(N^2) for the entire height map. The ambient
+// occlusion averages the horizons of AO_NUM_DIRECTIONS directions and is baked once. The sun
+// visibility compares the elevation of the sun with the horizon in its direction.
+//
+class HorizonLighter
+{
+public:
+    HorizonLighter(const Array2D<float>* pHeightmap) : m_pHeightmap(pHeightmap) {}
+
+    ~HorizonLighter();
+
+    void Destroy();
+
+    // Bakes the normals and the ambient occlusion. Must be called when the height map changes.
+    void InitLighter(int TerrainSize, float WorldScale);
+
+    bool IsInitialized() const { return m_terrainSize > 0; }
+
+    // Re-bakes the sun visibility. Only the tiles whose texels changed are marked
+    // for upload and the horizon sweep is skipped if the azimuth of the light is the same.
+    void SetLightDir(const Vector3f& LightDir);
+
+    // Creates the texture on the first call and then uploads only the dirty tiles
+    void UpdateLightMap();
+
+    GLuint GetLightMap() const { return m_lightMap; }
+
+    // In radians, in the direction of the light
+    float GetHorizonAngle(int x, int z) const { return m_horizon.Get(x, z); }
+
+    float GetSunVisibility(int x, int z) const { return (float)m_texels[(z * m_terrainSize + x) * 4] / 255.0f; }
+
+    float GetAmbientOcclusion(int x, int z) const { return (float)m_texels[(z * m_terrainSize + x) * 4 + 1] / 255.0f; }
+
+    int GetNumDirtyTiles() const;
+
+    int GetNumTileUploads() const { return m_numTileUploads; }
+
+private:
+
+    void CalcNormals();
+
+    void CalcAmbientOcclusion();
+
+    void CalcSunVisibility(float SunElevation);
+
+    const Array2D<float>* m_pHeightmap = NULL;
+    TiledArray2D<float> m_tiledHeightmap;       // read by the horizon sweeps
+
+    int m_terrainSize = 0;
+    float m_worldScale = 1.0f;
+    int m_numTiles = 0;                 // per side
+
+    std::vector<u8> m_texels;
+    TiledArray2D<float> m_horizon;
+    std::vector<u8> m_dirtyTiles;       // not vector<bool> - the tiles are updated by several threads
+    bool m_fullUpload = true;
+
+    bool m_hasSweepDir = false;
+    float m_sweepDirX = 0.0f;
+    float m_sweepDirZ = 0.0f;
+
+    GLuint m_lightMap = 0;
+    int m_lightMapSize = 0;
+    int m_numTileUploads = 0;
+};
+
+#endif
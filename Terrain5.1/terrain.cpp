@@ -40,6 +40,8 @@ void BaseTerrain::Destroy()
 {
     m_heightMap.Destroy();
     m_triangleList.Destroy();
+    m_horizonLighter.Destroy();
+    m_erosion.Destroy();
 }
 
 
@@ -151,6 +153,16 @@ void BaseTerrain::Render(const BasicCamera& Camera)
     m_terrainTech.Enable();
     m_terrainTech.SetVP(VP);
 
+    bool UseLightMap = m_bakedLighting && m_horizonLighter.IsInitialized();
+
+    if (UseLightMap) {
+        m_horizonLighter.UpdateLightMap();
+        glActiveTexture(LIGHT_MAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_horizonLighter.GetLightMap());
+    }
+
+    m_terrainTech.SetLightMap(UseLightMap, m_lightDir * -1.0f, m_worldScale, m_terrainSize);
+
     for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(m_pTextures); i++) {
         if (m_pTextures[i]) {
             m_pTextures[i]->Bind(COLOR_TEXTURE_UNIT_0 + i);
@@ -186,12 +198,26 @@ void BaseTerrain::SetLight(const Vector3f& LightDir, float Softness)
 {
     m_lightDir = LightDir;
     m_lightSoftness = Softness;
+
+    if (m_horizonLighter.IsInitialized()) {
+        m_horizonLighter.SetLightDir(m_lightDir);
+    }
+}
+
+
+void BaseTerrain::Erode(const ErosionParams& Params)
+{
+    m_erosion.Erode(m_heightMap, m_terrainSize, m_worldScale, Params);
+
+    FinalizeTerrain();
 }
 
 
 void BaseTerrain::FinalizeTerrain()
 {
     m_slopeLighter.InitLighter(m_lightDir, m_terrainSize, m_lightSoftness);
+    m_horizonLighter.InitLighter(m_terrainSize, m_worldScale);
+    m_horizonLighter.SetLightDir(m_lightDir);
     m_triangleList.CreateTriangleList(m_terrainSize, m_terrainSize, this);
 }
 
@@ -16,6 +16,14 @@ uniform float gHeight1 = 110.0;
 uniform float gHeight2 = 150.0;
 uniform float gHeight3 = 180.0;
 
+// See HorizonLighter for the layout of the light map
+uniform sampler2D gLightMap;
+uniform bool gUseLightMap = false;
+uniform vec3 gReversedLightDir;
+uniform vec2 gLightMapParams;     // 1 / world scale, 1 / terrain size
+
+const float AmbientLight = 0.4;
+
 vec4 CalcTexColor()
 {
     vec4 TexColor;
@@ -50,9 +58,29 @@ vec4 CalcTexColor()
 }
 
 
+float CalcBakedLighting()
+{
+    vec2 uv = (WorldPos.xz * gLightMapParams.x + 0.5) * gLightMapParams.y;
+    vec4 Texel = texture(gLightMap, uv);
+
+    vec3 Normal;
+    Normal.xz = Texel.ba * 2.0 - 1.0;
+    Normal.y = sqrt(max(1.0 - dot(Normal.xz, Normal.xz), 0.0));
+
+    float Diffuse = max(dot(normalize(Normal), gReversedLightDir), 0.0) * Texel.r;
+    float AO = Texel.g;
+
+    return AmbientLight * AO + (1.0 - AmbientLight) * Diffuse;
+}
+
+
 void main()
 {
     vec4 TexColor = CalcTexColor();
 
-    FragColor = TexColor * LightFactor;
+    if (gUseLightMap) {
+        FragColor = TexColor * CalcBakedLighting();
+    } else {
+        FragColor = TexColor * LightFactor;
+    }
 }
@@ -26,11 +26,13 @@
 #include "triangle_list.h"
 #include "terrain_technique.h"
 #include "slope_lighter.h"
+#include "horizon_lighter.h"
+#include "terrain_erosion.h"
 
 class BaseTerrain
 {
  public:
-    BaseTerrain() : m_slopeLighter(&m_heightMap) {}
+    BaseTerrain() : m_slopeLighter(&m_heightMap), m_horizonLighter(&m_heightMap) {}
 
     ~BaseTerrain();
 
@@ -60,8 +62,20 @@ class BaseTerrain
 	
     float GetSlopeLighting(int x, int z) const;
 
+    // Re-bakes the light map of the horizon lighter. The slope lighting is baked into
+    // the vertices and is updated only by FinalizeTerrain.
     void SetLight(const Vector3f& LightDir, float Softness);
 
+    // Selects between the light map of the horizon lighter and the slope lighting
+    void SetBakedLighting(bool Enabled) { m_bakedLighting = Enabled; }
+
+    const HorizonLighter& GetHorizonLighter() const { return m_horizonLighter; }
+
+    // Erodes the height map and re-bakes the lighting
+    void Erode(const ErosionParams& Params);
+
+    TerrainErosion& GetErosion() { return m_erosion; }
+
  protected:
 
 	void LoadHeightMapFile(const char* pFilename);
@@ -83,6 +97,9 @@ private:
     TerrainTechnique m_terrainTech;
     TriangleList m_triangleList;
     SlopeLighter m_slopeLighter; 
+    HorizonLighter m_horizonLighter;
+    TerrainErosion m_erosion;
+    bool m_bakedLighting = true;
     Vector3f m_lightDir;
     float m_lightSoftness = 0.0f;
 };
@@ -93,6 +93,20 @@ public:
                 ImGui::SliderFloat("Terrain roughness", &this->m_roughness, 0.0f, 5.0f);
                 ImGui::SliderFloat("Light Softness", &this->m_lightSoftness, 0.0f, 50.0f);
 
+                if (ImGui::Checkbox("Baked lighting", &m_bakedLighting)) {
+                    m_terrain.SetBakedLighting(m_bakedLighting);
+                }
+
+                bool SunChanged = ImGui::SliderFloat("Sun azimuth", &m_sunAzimuth, 0.0f, 360.0f);
+                SunChanged |= ImGui::SliderFloat("Sun elevation", &m_sunElevation, 0.0f, 90.0f);
+
+                if (SunChanged) {
+                    float Azimuth = ToRadian(m_sunAzimuth);
+                    float Elevation = ToRadian(m_sunElevation);
+                    m_lightDir = Vector3f(-cosf(Elevation) * sinf(Azimuth), -sinf(Elevation), -cosf(Elevation) * cosf(Azimuth));
+                    m_terrain.SetLight(m_lightDir, m_lightSoftness);
+                }
+
                 static float Height0 = 64.0f;
                 static float Height1 = 128.0f;
                 static float Height2 = 192.0f;
@@ -111,6 +125,24 @@ public:
                     m_terrain.SetTextureHeights(Height0, Height1, Height2, Height3);
                 }
 
+                ImGui::SliderInt("Erosion iterations", &m_erosionParams.NumIterations, 1, 2000);
+                ImGui::Checkbox("Hydraulic erosion", &m_erosionParams.Hydraulic);
+                ImGui::SliderFloat("Rain rate", &m_erosionParams.RainRate, 0.0f, 0.2f);
+                ImGui::SliderFloat("Sediment capacity", &m_erosionParams.Capacity, 0.0f, 2.0f);
+                ImGui::Checkbox("Thermal erosion", &m_erosionParams.Thermal);
+                ImGui::SliderFloat("Talus angle", &m_erosionParams.TalusAngle, 10.0f, 80.0f);
+
+                if (m_terrain.GetErosion().IsGPUSupported()) {
+                    ImGui::Checkbox("Erode on the GPU", &m_erosionParams.UseGPU);
+                }
+
+                if (ImGui::Button("Erode")) {
+                    m_terrain.Erode(m_erosionParams);
+                }
+
+                ImGui::Text("Erosion %.1f ms (%s)", m_terrain.GetErosion().GetLastRunTime(), m_terrain.GetErosion().LastRunUsedGPU() ? "GPU" : "CPU");
+
+                ImGui::Text("Light map tile uploads %d", m_terrain.GetHorizonLighter().GetNumTileUploads());
                 ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
                 ImGui::End();
 
@@ -298,6 +330,10 @@ private:
     float m_maxHeight = 256.0f;
     Vector3f m_lightDir = Vector3f(1.0f, -0.5f, 1.0f);
     float m_counter = 0.0f;
+    bool m_bakedLighting = true;
+    float m_sunAzimuth = 225.0f;        // degrees - matches the initial light direction
+    float m_sunElevation = 19.5f;
+    ErosionParams m_erosionParams;
 };
 
 TerrainDemo5_1* app = NULL;
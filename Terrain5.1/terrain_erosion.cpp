@@ -0,0 +1,477 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <math.h>
+#include <float.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_parallel.h"
+#include "terrain_erosion.h"
+
+#define GRAVITY 9.81f
+#define MIN_WATER_DEPTH 0.0001f         // limits the velocity of very shallow water
+#define MIN_ROWS_PER_THREAD 16
+#define EROSION_GROUP_SIZE 16           // local size of erosion.cs
+
+
+TerrainErosion::~TerrainErosion()
+{
+    Destroy();
+}
+
+
+void TerrainErosion::Destroy()
+{
+    for (int i = 0 ; i < 2 ; i++) {
+        m_height[i].Destroy();
+        m_sediment[i].Destroy();
+    }
+
+    m_water.Destroy();
+    m_fluxLeft.Destroy();
+    m_fluxRight.Destroy();
+    m_fluxDown.Destroy();
+    m_fluxUp.Destroy();
+    m_velocityX.Destroy();
+    m_velocityZ.Destroy();
+    m_thermalScale.Destroy();
+
+    m_terrainSize = 0;
+    m_pitch = 0;
+
+    DestroyGPUState();
+}
+
+
+void TerrainErosion::DestroyGPUState()
+{
+    if (m_terrainTex[0] != 0) {
+        glDeleteTextures(2, m_terrainTex);
+        glDeleteTextures(1, &m_fluxTex);
+        glDeleteTextures(1, &m_velocityTex);
+        glDeleteTextures(1, &m_thermalTex);
+
+        m_terrainTex[0] = m_terrainTex[1] = 0;
+        m_fluxTex = m_velocityTex = m_thermalTex = 0;
+    }
+}
+
+
+bool TerrainErosion::IsGPUSupported()
+{
+    if (m_gpuSupported < 0) {
+        m_gpuSupported = (GLEW_VERSION_4_3 && m_erosionTech.Init()) ? 1 : 0;
+    }
+
+    return m_gpuSupported == 1;
+}
+
+
+void TerrainErosion::Erode(Array2D<float>& HeightMap, int TerrainSize, float CellSize, const ErosionParams& Params)
+{
+    auto Start = std::chrono::steady_clock::now();
+
+    m_terrainSize = TerrainSize;
+    m_cellSize = CellSize;
+    m_params = Params;
+
+    m_lastRunUsedGPU = Params.UseGPU && IsGPUSupported();
+
+    if (m_lastRunUsedGPU) {
+        ErodeGPU(HeightMap);
+    } else {
+        InitFields(HeightMap);
+        ErodeCPU(Params.NumIterations);
+        CopyFieldsToHeightMap(HeightMap);
+    }
+
+    auto End = std::chrono::steady_clock::now();
+    m_lastRunTime = std::chrono::duration<float, std::milli>(End - Start).count();
+}
+
+
+void TerrainErosion::InitFields(const Array2D<float>& HeightMap)
+{
+    int Pitch = m_terrainSize + 2;
+
+    if (Pitch != m_pitch) {
+        m_pitch = Pitch;
+
+        for (int i = 0 ; i < 2 ; i++) {
+            m_height[i].InitArray2D(Pitch, Pitch);
+            m_sediment[i].InitArray2D(Pitch, Pitch);
+        }
+
+        m_water.InitArray2D(Pitch, Pitch);
+        m_fluxLeft.InitArray2D(Pitch, Pitch);
+        m_fluxRight.InitArray2D(Pitch, Pitch);
+        m_fluxDown.InitArray2D(Pitch, Pitch);
+        m_fluxUp.InitArray2D(Pitch, Pitch);
+        m_velocityX.InitArray2D(Pitch, Pitch);
+        m_velocityZ.InitArray2D(Pitch, Pitch);
+        m_thermalScale.InitArray2D(Pitch, Pitch);
+    }
+
+    size_t FieldSize = m_height[0].GetSizeInBytes();
+
+    for (int i = 0 ; i < 2 ; i++) {
+        memset(m_height[i].GetBaseAddr(), 0, FieldSize);
+        memset(m_sediment[i].GetBaseAddr(), 0, FieldSize);
+    }
+
+    memset(m_water.GetBaseAddr(), 0, FieldSize);
+    memset(m_fluxLeft.GetBaseAddr(), 0, FieldSize);
+    memset(m_fluxRight.GetBaseAddr(), 0, FieldSize);
+    memset(m_fluxDown.GetBaseAddr(), 0, FieldSize);
+    memset(m_fluxUp.GetBaseAddr(), 0, FieldSize);
+    memset(m_velocityX.GetBaseAddr(), 0, FieldSize);
+    memset(m_velocityZ.GetBaseAddr(), 0, FieldSize);
+    memset(m_thermalScale.GetBaseAddr(), 0, FieldSize);
+
+    m_cur = 0;
+
+    float* pHeights = m_height[0].GetBaseAddr();
+
+    for (int z = 0 ; z < m_terrainSize ; z++) {
+        memcpy(pHeights + (z + 1) * m_pitch + 1, HeightMap.GetRow(z), m_terrainSize * sizeof(float));
+    }
+
+    CopyEdgeToBorder(pHeights);
+
+    // The border is never written so both copies need it
+    memcpy(m_height[1].GetBaseAddr(), pHeights, FieldSize);
+}
+
+
+void TerrainErosion::CopyEdgeToBorder(float* pHeights)
+{
+    int Last = m_terrainSize + 1;
+
+    for (int z = 1 ; z < Last ; z++) {
+        float* pRow = pHeights + z * m_pitch;
+        pRow[0] = pRow[1];
+        pRow[Last] = pRow[Last - 1];
+    }
+
+    memcpy(pHeights, pHeights + m_pitch, m_pitch * sizeof(float));
+    memcpy(pHeights + Last * m_pitch, pHeights + (Last - 1) * m_pitch, m_pitch * sizeof(float));
+}
+
+
+void TerrainErosion::ErodeCPU(int NumIterations)
+{
+    for (int i = 0 ; i < NumIterations ; i++) {
+        ParallelFor(0, m_terrainSize, [&](int Start, int End) { CalcFlux(Start, End); }, MIN_ROWS_PER_THREAD);
+
+        ParallelFor(0, m_terrainSize, [&](int Start, int End) { UpdateTerrain(Start, End); }, MIN_ROWS_PER_THREAD);
+
+        if (m_params.Hydraulic) {
+            ParallelFor(0, m_terrainSize, [&](int Start, int End) { Transport(Start, End); }, MIN_ROWS_PER_THREAD);
+        }
+
+        m_cur = 1 - m_cur;
+    }
+}
+
+
+void TerrainErosion::CalcFlux(int StartRow, int EndRow)
+{
+    const float* pH = m_height[m_cur].GetBaseAddr();
+    const float* pW = m_water.GetBaseAddr();
+    float* pFL = m_fluxLeft.GetBaseAddr();
+    float* pFR = m_fluxRight.GetBaseAddr();
+    float* pFD = m_fluxDown.GetBaseAddr();
+    float* pFU = m_fluxUp.GetBaseAddr();
+    float* pThermal = m_thermalScale.GetBaseAddr();
+
+    int P = m_pitch;
+    float dt = m_params.TimeStep;
+    float FluxFactor = dt * m_params.PipeArea * GRAVITY / m_cellSize;
+    float Rain = dt * m_params.RainRate;
+    float AreaOverTime = m_cellSize * m_cellSize / dt;
+    float TalusHeight = m_cellSize * tanf(ToRadian(m_params.TalusAngle));
+    float HalfRate = 0.5f * m_params.ThermalRate * dt;
+
+    for (int z = StartRow ; z < EndRow ; z++) {
+        int RowStart = (z + 1) * P + 1;
+        int RowEnd = RowStart + m_terrainSize;
+
+        if (m_params.Hydraulic) {
+            for (int i = RowStart ; i < RowEnd ; i++) {
+                float h = pH[i] + pW[i];
+                float Left  = std::max(pFL[i] + FluxFactor * (h - pH[i - 1] - pW[i - 1]), 0.0f);
+                float Right = std::max(pFR[i] + FluxFactor * (h - pH[i + 1] - pW[i + 1]), 0.0f);
+                float Down  = std::max(pFD[i] + FluxFactor * (h - pH[i - P] - pW[i - P]), 0.0f);
+                float Up    = std::max(pFU[i] + FluxFactor * (h - pH[i + P] - pW[i + P]), 0.0f);
+
+                // Scale the outflow down so that it doesn't take more water than there is
+                float Sum = Left + Right + Down + Up;
+                float Available = (pW[i] + Rain) * AreaOverTime;
+                float K = std::min(Available / std::max(Sum, FLT_MIN), 1.0f);
+
+                pFL[i] = Left * K;
+                pFR[i] = Right * K;
+                pFD[i] = Down * K;
+                pFU[i] = Up * K;
+            }
+        }
+
+        if (m_params.Thermal) {
+            for (int i = RowStart ; i < RowEnd ; i++) {
+                float h = pH[i];
+                float Left  = std::max(h - pH[i - 1] - TalusHeight, 0.0f);
+                float Right = std::max(h - pH[i + 1] - TalusHeight, 0.0f);
+                float Down  = std::max(h - pH[i - P] - TalusHeight, 0.0f);
+                float Up    = std::max(h - pH[i + P] - TalusHeight, 0.0f);
+
+                // Moving half of the largest excess levels the steepest pair. It is split
+                // between the neighbours in proportion to their own excess.
+                float Sum = Left + Right + Down + Up;
+                float Max = std::max(std::max(Left, Right), std::max(Down, Up));
+
+                pThermal[i] = HalfRate * Max / std::max(Sum, FLT_MIN);
+            }
+        }
+    }
+}
+
+
+void TerrainErosion::UpdateTerrain(int StartRow, int EndRow)
+{
+    const float* pH = m_height[m_cur].GetBaseAddr();
+    float* pOutH = m_height[1 - m_cur].GetBaseAddr();
+    float* pS = m_sediment[m_cur].GetBaseAddr();
+    float* pW = m_water.GetBaseAddr();
+    const float* pFL = m_fluxLeft.GetBaseAddr();
+    const float* pFR = m_fluxRight.GetBaseAddr();
+    const float* pFD = m_fluxDown.GetBaseAddr();
+    const float* pFU = m_fluxUp.GetBaseAddr();
+    float* pVX = m_velocityX.GetBaseAddr();
+    float* pVZ = m_velocityZ.GetBaseAddr();
+    const float* pThermal = m_thermalScale.GetBaseAddr();
+
+    int P = m_pitch;
+    float dt = m_params.TimeStep;
+    float l = m_cellSize;
+    float Rain = dt * m_params.RainRate;
+    float TimeOverArea = dt / (l * l);
+    float InvTwoCellSize = 0.5f / l;
+    float Capacity = m_params.Capacity;
+    float Dissolving = dt * m_params.Dissolving;
+    float Deposition = dt * m_params.Deposition;
+    float MinTilt = m_params.MinTilt;
+    float InvErosionDepth = 1.0f / m_params.ErosionDepth;
+    float TalusHeight = l * tanf(ToRadian(m_params.TalusAngle));
+
+    // The loops have no branches and the parameters are in locals so that they can be vectorized
+    bool Hydraulic = m_params.Hydraulic;
+    bool Thermal = m_params.Thermal;
+
+    for (int z = StartRow ; z < EndRow ; z++) {
+        int RowStart = (z + 1) * P + 1;
+        int RowEnd = RowStart + m_terrainSize;
+
+        if (Hydraulic) {
+            for (int i = RowStart ; i < RowEnd ; i++) {
+                float Out = pFL[i] + pFR[i] + pFD[i] + pFU[i];
+                float In = pFR[i - 1] + pFL[i + 1] + pFU[i - P] + pFD[i + P];
+                float Depth = pW[i] + Rain;
+                float NewDepth = std::max(Depth + (In - Out) * TimeOverArea, 0.0f);
+                float MeanDepth = 0.5f * (Depth + NewDepth);
+
+                // The water that passes through the point per unit of time in each direction
+                float PassX = 0.5f * (pFR[i - 1] - pFL[i] + pFR[i] - pFL[i + 1]);
+                float PassZ = 0.5f * (pFU[i - P] - pFD[i] + pFU[i] - pFD[i + P]);
+                float InvCrossSection = 1.0f / (l * std::max(MeanDepth, MIN_WATER_DEPTH));
+                float vx = PassX * InvCrossSection;
+                float vz = PassZ * InvCrossSection;
+
+                float dx = (pH[i + 1] - pH[i - 1]) * InvTwoCellSize;
+                float dz = (pH[i + P] - pH[i - P]) * InvTwoCellSize;
+                float Slope2 = dx * dx + dz * dz;
+                float SinTilt = std::max(sqrtf(Slope2 / (1.0f + Slope2)), MinTilt);
+
+                float DepthFactor = std::min(MeanDepth * InvErosionDepth, 1.0f);
+                float SedimentCapacity = Capacity * SinTilt * DepthFactor * sqrtf(vx * vx + vz * vz);
+                float Sediment = pS[i];
+                float Missing = SedimentCapacity - Sediment;
+                float Dissolved = Missing * ((Missing > 0.0f) ? Dissolving : Deposition);
+
+                pOutH[i] = pH[i] - Dissolved;
+                pS[i] = Sediment + Dissolved;
+                pW[i] = NewDepth;
+                pVX[i] = vx;
+                pVZ[i] = vz;
+            }
+        } else {
+            memcpy(pOutH + RowStart, pH + RowStart, m_terrainSize * sizeof(float));
+        }
+
+        if (Thermal) {
+            for (int i = RowStart ; i < RowEnd ; i++) {
+                float h = pH[i];
+                float Left  = std::max(h - pH[i - 1] - TalusHeight, 0.0f);
+                float Right = std::max(h - pH[i + 1] - TalusHeight, 0.0f);
+                float Down  = std::max(h - pH[i - P] - TalusHeight, 0.0f);
+                float Up    = std::max(h - pH[i + P] - TalusHeight, 0.0f);
+                float Out = pThermal[i] * (Left + Right + Down + Up);
+
+                float In = pThermal[i - 1] * std::max(pH[i - 1] - h - TalusHeight, 0.0f) +
+                           pThermal[i + 1] * std::max(pH[i + 1] - h - TalusHeight, 0.0f) +
+                           pThermal[i - P] * std::max(pH[i - P] - h - TalusHeight, 0.0f) +
+                           pThermal[i + P] * std::max(pH[i + P] - h - TalusHeight, 0.0f);
+
+                pOutH[i] += In - Out;
+            }
+        }
+    }
+}
+
+
+void TerrainErosion::Transport(int StartRow, int EndRow)
+{
+    const float* pS = m_sediment[m_cur].GetBaseAddr();
+    float* pOutS = m_sediment[1 - m_cur].GetBaseAddr();
+    float* pW = m_water.GetBaseAddr();
+    const float* pVX = m_velocityX.GetBaseAddr();
+    const float* pVZ = m_velocityZ.GetBaseAddr();
+
+    int P = m_pitch;
+    float Steps = m_params.TimeStep / m_cellSize;
+    float Evaporation = std::max(1.0f - m_params.Evaporation * m_params.TimeStep, 0.0f);
+    float Last = (float)m_terrainSize;
+
+    for (int z = StartRow ; z < EndRow ; z++) {
+        int RowStart = (z + 1) * P + 1;
+
+        for (int x = 0 ; x < m_terrainSize ; x++) {
+            int i = RowStart + x;
+
+            // The sediment comes from where the water was one time step ago. Only the
+            // points inside the map (1..TerrainSize in the padded fields) are sampled.
+            float px = std::min(std::max((float)(x + 1) - pVX[i] * Steps, 1.0f), Last);
+            float pz = std::min(std::max((float)(z + 1) - pVZ[i] * Steps, 1.0f), Last);
+
+            float x0 = std::min(floorf(px), Last - 1.0f);
+            float z0 = std::min(floorf(pz), Last - 1.0f);
+            float fx = px - x0;
+            float fz = pz - z0;
+
+            const float* p = pS + (int)z0 * P + (int)x0;
+            float Bottom = p[0] + (p[1] - p[0]) * fx;
+            float Top = p[P] + (p[P + 1] - p[P]) * fx;
+
+            pOutS[i] = Bottom + (Top - Bottom) * fz;
+            pW[i] *= Evaporation;
+        }
+    }
+}
+
+
+void TerrainErosion::CopyFieldsToHeightMap(Array2D<float>& HeightMap)
+{
+    const float* pH = m_height[m_cur].GetBaseAddr();
+    const float* pS = m_sediment[m_cur].GetBaseAddr();
+
+    ParallelFor(0, m_terrainSize, [&](int Start, int End) {
+        for (int z = Start ; z < End ; z++) {
+            float* pDst = HeightMap.GetRow(z);
+            int RowStart = (z + 1) * m_pitch + 1;
+
+            for (int x = 0 ; x < m_terrainSize ; x++) {
+                pDst[x] = pH[RowStart + x] + pS[RowStart + x];
+            }
+        }
+    }, MIN_ROWS_PER_THREAD);
+}
+
+
+static GLuint CreateFieldTexture(GLenum InternalFormat, int Size, GLenum Format, const float* pData)
+{
+    GLuint Tex = 0;
+    glGenTextures(1, &Tex);
+    glBindTexture(GL_TEXTURE_2D, Tex);
+    glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat, Size, Size, 0, Format, GL_FLOAT, pData);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    return Tex;
+}
+
+
+void TerrainErosion::ErodeGPU(Array2D<float>& HeightMap)
+{
+    int Size = m_terrainSize;
+
+    DestroyGPUState();
+
+    // Water and sediment start at zero. The last channel keeps the original height for the border.
+    std::vector<float> Terrain(Size * Size * 4, 0.0f);
+    const float* pSrc = HeightMap.GetBaseAddr();
+
+    for (int i = 0 ; i < Size * Size ; i++) {
+        Terrain[i * 4] = pSrc[i];
+        Terrain[i * 4 + 3] = pSrc[i];
+    }
+
+    std::vector<float> Zeros(Size * Size * 4, 0.0f);
+    m_terrainTex[0] = CreateFieldTexture(GL_RGBA32F, Size, GL_RGBA, &Terrain[0]);
+    m_terrainTex[1] = CreateFieldTexture(GL_RGBA32F, Size, GL_RGBA, &Zeros[0]);
+    m_fluxTex = CreateFieldTexture(GL_RGBA32F, Size, GL_RGBA, &Zeros[0]);
+    m_velocityTex = CreateFieldTexture(GL_RG32F, Size, GL_RG, &Zeros[0]);
+    m_thermalTex = CreateFieldTexture(GL_R32F, Size, GL_RED, &Zeros[0]);
+
+    m_erosionTech.Enable();
+    m_erosionTech.SetParams(m_params, m_cellSize);
+
+    glBindImageTexture(EROSION_TERRAIN_IMAGE_UNIT, m_terrainTex[0], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(EROSION_TERRAIN_TEMP_IMAGE_UNIT, m_terrainTex[1], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(EROSION_FLUX_IMAGE_UNIT, m_fluxTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(EROSION_VELOCITY_IMAGE_UNIT, m_velocityTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RG32F);
+    glBindImageTexture(EROSION_THERMAL_IMAGE_UNIT, m_thermalTex, 0, GL_FALSE, 0, GL_READ_WRITE, GL_R32F);
+
+    int NumGroups = (Size + EROSION_GROUP_SIZE - 1) / EROSION_GROUP_SIZE;
+
+    for (int i = 0 ; i < m_params.NumIterations ; i++) {
+        for (int Pass = 0 ; Pass < EROSION_NUM_PASSES ; Pass++) {
+            m_erosionTech.SetPass(Pass);
+            glDispatchCompute(NumGroups, NumGroups, 1);
+            glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+        }
+    }
+
+    glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, m_terrainTex[0]);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &Terrain[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glUseProgram(0);
+
+    // Same as CopyFieldsToHeightMap - the sediment is deposited
+    float* pDst = HeightMap.GetBaseAddr();
+
+    for (int i = 0 ; i < Size * Size ; i++) {
+        pDst[i] = Terrain[i * 4] + Terrain[i * 4 + 2];
+    }
+
+    // The fields are needed only during the run
+    DestroyGPUState();
+}
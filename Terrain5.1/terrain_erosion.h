@@ -0,0 +1,144 @@
+/*
+
+        Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TERRAIN_EROSION_H
+#define TERRAIN_EROSION_H
+
+#include <GL/glew.h>
+
+#include "ogldev_array_2d.h"
+#include "erosion_technique.h"
+
+
+struct ErosionParams {
+    int NumIterations = 500;
+    float TimeStep = 0.02f;         // seconds per iteration
+
+    // Hydraulic erosion
+    bool Hydraulic = true;
+    float RainRate = 0.05f;         // water height added to every point per second
+    float PipeArea = 20.0f;         // cross section of the virtual pipes between neighbours
+    float Capacity = 0.3f;          // sediment carried by a unit of water per unit of speed and slope
+    float Dissolving = 0.5f;        // fraction of the missing sediment that is picked up per second
+    float Deposition = 1.0f;        // fraction of the excess sediment that is dropped per second
+    float Evaporation = 0.5f;       // fraction of the water that evaporates per second
+    float MinTilt = 0.05f;          // keeps flat areas under flowing water eroding slowly
+    float ErosionDepth = 1.0f;      // shallower water carries proportionally less sediment
+
+    // Thermal erosion
+    bool Thermal = true;
+    float TalusAngle = 45.0f;       // in degrees. Steeper slopes collapse.
+    float ThermalRate = 0.5f;       // fraction of the excess height that moves per second
+
+    bool UseGPU = false;
+};
+
+
+//
+// Grid based hydraulic erosion (the virtual pipe model of Mei et al) and thermal erosion.
+// Every point holds a terrain height, a water height, dissolved sediment, the outflow to
+// its four neighbours and a velocity, each in a separate Array2D. An iteration is:
+//
+//   CalcFlux      - rain, the outflow of water from the height differences and the amount
+//                   of material that slides down the slopes steeper than the talus angle
+//   UpdateTerrain - the water that moved, its velocity, erosion and deposition according
+//                   to the sediment capacity and the material that slid in and out
+//   Transport     - the sediment moves with the water (semi-Lagrangian) and evaporation
+//
+// Each step writes only the points it owns and reads the previous step from the others, so
+// the rows are split between threads and the result is the same for any number of threads.
+// The fields have a border of one point that swallows the water that flows over the edge of
+// the map. It holds no water and its height is that of the edge before the erosion so the
+// rivers can't cut below it.
+//
+// The semi-Lagrangian transport doesn't conserve the sediment exactly. Typically a few
+// percent of the material is lost over a long run.
+//
+// erosion.cs runs the same steps on the GPU when Params.UseGPU is set and compute shaders are
+// available. The GPU version is not bit exact with the CPU version.
+//
+class TerrainErosion {
+ public:
+
+    TerrainErosion() {}
+
+    ~TerrainErosion();
+
+    void Destroy();
+
+    // Runs Params.NumIterations on the height map. CellSize is the distance between two points.
+    // The sediment that is still in the water at the end is deposited where it is.
+    void Erode(Array2D<float>& HeightMap, int TerrainSize, float CellSize, const ErosionParams& Params);
+
+    // Requires a GL context
+    bool IsGPUSupported();
+
+    bool LastRunUsedGPU() const { return m_lastRunUsedGPU; }
+
+    // Wall clock of the last call to Erode in milliseconds
+    float GetLastRunTime() const { return m_lastRunTime; }
+
+ private:
+
+    void InitFields(const Array2D<float>& HeightMap);
+
+    void ErodeCPU(int NumIterations);
+
+    void CalcFlux(int StartRow, int EndRow);
+
+    void UpdateTerrain(int StartRow, int EndRow);
+
+    void Transport(int StartRow, int EndRow);
+
+    void CopyEdgeToBorder(float* pHeights);
+
+    void CopyFieldsToHeightMap(Array2D<float>& HeightMap);
+
+    void ErodeGPU(Array2D<float>& HeightMap);
+
+    void DestroyGPUState();
+
+    int m_terrainSize = 0;
+    int m_pitch = 0;                    // m_terrainSize + 2 for the border
+    float m_cellSize = 1.0f;
+    ErosionParams m_params;
+
+    int m_cur = 0;                      // index of the current heights and sediment
+    Array2D<float> m_height[2];
+    Array2D<float> m_sediment[2];
+    Array2D<float> m_water;
+    Array2D<float> m_fluxLeft;
+    Array2D<float> m_fluxRight;
+    Array2D<float> m_fluxDown;          // towards z - 1
+    Array2D<float> m_fluxUp;            // towards z + 1
+    Array2D<float> m_velocityX;
+    Array2D<float> m_velocityZ;
+    Array2D<float> m_thermalScale;      // material that slides to a neighbour per unit of excess height
+
+    int m_gpuSupported = -1;            // unknown until the first query
+    ErosionTechnique m_erosionTech;
+    GLuint m_terrainTex[2] = { 0, 0 };
+    GLuint m_fluxTex = 0;
+    GLuint m_velocityTex = 0;
+    GLuint m_thermalTex = 0;
+
+    bool m_lastRunUsedGPU = false;
+    float m_lastRunTime = 0.0f;
+};
+
+#endif
@@ -51,6 +51,10 @@ bool TerrainTechnique::Init()
     m_tex1HeightLoc = GetUniformLocation("gHeight1");
     m_tex2HeightLoc = GetUniformLocation("gHeight2");
     m_tex3HeightLoc = GetUniformLocation("gHeight3");
+    m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
+    m_lightMapUnitLoc = GetUniformLocation("gLightMap");
+    m_useLightMapLoc = GetUniformLocation("gUseLightMap");
+    m_lightMapParamsLoc = GetUniformLocation("gLightMapParams");
 
     if (m_VPLoc == INVALID_UNIFORM_LOCATION||
         m_tex0UnitLoc == INVALID_UNIFORM_LOCATION ||
@@ -60,7 +64,11 @@ bool TerrainTechnique::Init()
         m_tex0HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_tex1HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_tex2HeightLoc == INVALID_UNIFORM_LOCATION ||
-        m_tex3HeightLoc == INVALID_UNIFORM_LOCATION) {
+        m_tex3HeightLoc == INVALID_UNIFORM_LOCATION ||
+        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION ||
+        m_lightMapUnitLoc == INVALID_UNIFORM_LOCATION ||
+        m_useLightMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_lightMapParamsLoc == INVALID_UNIFORM_LOCATION) {
         return false;
     }
 
@@ -70,6 +78,7 @@ bool TerrainTechnique::Init()
     glUniform1i(m_tex1UnitLoc, COLOR_TEXTURE_UNIT_INDEX_1);
     glUniform1i(m_tex2UnitLoc, COLOR_TEXTURE_UNIT_INDEX_2);
     glUniform1i(m_tex3UnitLoc, COLOR_TEXTURE_UNIT_INDEX_3);
+    glUniform1i(m_lightMapUnitLoc, LIGHT_MAP_TEXTURE_UNIT_INDEX);
 
     glUseProgram(0);
 
@@ -92,4 +101,14 @@ void TerrainTechnique::SetTextureHeights(float Tex0Height, float Tex1Height, flo
 }
 
 
+void TerrainTechnique::SetLightMap(bool Enabled, const Vector3f& ReversedLightDir, float WorldScale, int TerrainSize)
+{
+    glUniform1i(m_useLightMapLoc, Enabled ? 1 : 0);
+
+    Vector3f Dir = ReversedLightDir;
+    Dir.Normalize();
+    glUniform3f(m_reversedLightDirLoc, Dir.x, Dir.y, Dir.z);
 
+    // One texel per height map point
+    glUniform2f(m_lightMapParamsLoc, 1.0f / WorldScale, 1.0f / (float)TerrainSize);
+}
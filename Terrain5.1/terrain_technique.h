@@ -32,6 +32,8 @@ public:
     void SetVP(const Matrix4f& VP);
 
     void SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height);
+
+    void SetLightMap(bool Enabled, const Vector3f& ReversedLightDir, float WorldScale, int TerrainSize);
 	
 private:
     GLuint m_VPLoc = -1;
@@ -44,6 +46,9 @@ private:
     GLuint m_tex2UnitLoc = -1;
     GLuint m_tex3UnitLoc = -1;
     GLuint m_reversedLightDirLoc = -1;
+    GLuint m_lightMapUnitLoc = -1;
+    GLuint m_useLightMapLoc = -1;
+    GLuint m_lightMapParamsLoc = -1;
 };
 
 #endif  /* TERRAIN_TECHNIQUE_H */
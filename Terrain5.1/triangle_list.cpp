@@ -40,14 +40,17 @@ void TriangleList::Destroy()
 {
     if (m_vao > 0) {
         glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
     }
 
     if (m_vb > 0) {
         glDeleteBuffers(1, &m_vb);
+        m_vb = 0;
     }
 
     if (m_ib > 0) {
         glDeleteBuffers(1, &m_ib);
+        m_ib = 0;
     }
 }
 
@@ -69,6 +72,9 @@ void TriangleList::CreateTriangleList(int Width, int Depth, const BaseTerrain* p
 
 void TriangleList::CreateGLState()
 {
+    // The terrain is re-created after every erosion
+    Destroy();
+
     glGenVertexArrays(1, &m_vao);
 
     glBindVertexArray(m_vao);
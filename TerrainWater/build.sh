@@ -6,9 +6,16 @@ CPPFLAGS=`pkg-config --cflags glew glfw3 assimp`
 CPPFLAGS="$CPPFLAGS -I$OGLDEV_DIR/Include -I$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW -ggdb3"
 LDFLAGS=`pkg-config --libs glew glfw3 assimp`
 LDFLAGS="$LDFLAGS -lX11 -ldl -lmeshoptimizer"
-SOURCES="terrain_demo13.cpp \
+SOURCES="terrain_water.cpp \
 	geomip_grid.cpp \
 	terrain_technique.cpp \
+	simple_water.cpp \
+	simple_water_technique.cpp \
+	ring_grid.cpp \
+	ocean_fft.cpp \
+	ocean_fft_technique.cpp \
+	ocean_technique.cpp \
+	ocean_water.cpp \
 	midpoint_disp_terrain.cpp \
 	terrain.cpp \
 	lod_manager.cpp \
@@ -31,4 +38,4 @@ SOURCES="terrain_demo13.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui_impl_glfw.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui_impl_opengl3.cpp "
 
-$CC $SOURCES $CPPFLAGS $LDFLAGS -o terrain_demo13
+$CC $SOURCES $CPPFLAGS $LDFLAGS -o terrain_water
@@ -0,0 +1,31 @@
+#version 330
+
+layout(location = 0) out vec4 FragColor;
+
+in vec2 oTex;
+in vec3 oWorldPos;
+
+uniform sampler2D gNormalMap;
+uniform vec3 gCameraPos;
+uniform vec3 gReversedLightDir;
+
+const vec3 WaterColor = vec3(15.0/255.0, 94.0/255.0, 156.0/255.0);     // same as simple_water.fs
+const vec3 SkyColor = vec3(135.0/255.0, 206.0/255.0, 235.0/255.0);     // the clear color of the demo
+
+void main()
+{
+    vec3 Normal = normalize(texture(gNormalMap, oTex).xyz);
+    vec3 ToCamera = normalize(gCameraPos - oWorldPos);
+
+    float Diffuse = max(dot(Normal, gReversedLightDir), 0.0);
+
+    // Schlick with the reflectance of water
+    float Fresnel = 0.02 + 0.98 * pow(1.0 - max(dot(Normal, ToCamera), 0.0), 5.0);
+
+    vec3 HalfVector = normalize(ToCamera + gReversedLightDir);
+    float Specular = pow(max(dot(Normal, HalfVector), 0.0), 128.0);
+
+    vec3 Color = mix(WaterColor * (0.5 + 0.5 * Diffuse), SkyColor, Fresnel) + vec3(Specular);
+
+    FragColor = vec4(Color, 1.0);
+}
@@ -0,0 +1,46 @@
+#version 330
+
+layout (location = 0) in vec3 Position;
+
+uniform mat4 gWVP;
+uniform float gHeight = 0.0f;
+uniform vec2 gGridCenter;           // the camera - the ring grid follows it in snapped steps
+uniform vec2 gGridSpacing;          // inner spacing and spacing ratio of the ring grid
+uniform float gPatchSize;
+uniform sampler2D gDisplacementMap;
+
+out vec2 oTex;
+out vec3 oWorldPos;
+
+// The vertices must stay fixed in the world while the camera moves or the waves swim
+// under them. The center of the grid is snapped to the power of two multiple of the
+// inner spacing below the spacing of the vertex, blended with the next coarser snap
+// over the radius so that neighbor rings never tear apart or fold over each other.
+vec2 CalcGridCenter(float Spacing)
+{
+    float Level = log2(Spacing / gGridSpacing.x);
+    float Snap = gGridSpacing.x * exp2(floor(Level));
+    vec2 Center = floor(gGridCenter / Snap) * Snap;
+    vec2 CoarseCenter = floor(gGridCenter / (Snap * 2.0)) * (Snap * 2.0);
+    return mix(Center, CoarseCenter, fract(Level));
+}
+
+void main()
+{
+    float Spacing = max(gGridSpacing.x, length(Position.xz) * gGridSpacing.y);
+    vec2 xz = Position.xz + CalcGridCenter(Spacing);
+
+    // Texel i of the maps is the displacement of the point at i * TexelSize
+    float MapSize = float(textureSize(gDisplacementMap, 0).x);
+    float TexelSize = gPatchSize / MapSize;
+    vec2 Tex = xz / gPatchSize + 0.5 / MapSize;
+
+    // The mipmaps remove the waves that are too short for the cells of the grid
+    float Lod = max(log2(Spacing / TexelSize), 0.0);
+    vec3 Displacement = textureLod(gDisplacementMap, Tex, Lod).xyz;
+
+    vec3 WorldPos = vec3(xz.x, gHeight, xz.y) + Displacement;
+    gl_Position = gWVP * vec4(WorldPos, 1.0);
+    oTex = Tex;
+    oWorldPos = WorldPos;
+}
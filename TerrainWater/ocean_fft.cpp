@@ -0,0 +1,337 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#include "ogldev_parallel.h"
+#include "ocean_fft.h"
+
+#define GRAVITY 9.81f
+#define PHILLIPS_ALPHA 0.0081f
+#define JONSWAP_GAMMA 3.3f
+#define OCEAN_RANDOM_SEED 1234
+#define MIN_FFT_LINES_PER_THREAD 16
+
+typedef std::complex<float> Complex;
+
+
+void OceanFFT::Init(const OceanParams& Params)
+{
+    m_params = Params;
+
+    const int N = OCEAN_FFT_SIZE;
+    float DeltaK = 2.0f * (float)M_PI / m_params.PatchSize;
+
+    std::mt19937 Generator(OCEAN_RANDOM_SEED);
+    std::normal_distribution<float> Gaussian(0.0f, 1.0f);
+
+    // E[|h0|^2] is half of the spectrum in the cell of k because h0(k) and h0(-k) both end up there
+    std::vector<Complex> h0(N * N);
+
+    for (int z = 0 ; z < N ; z++) {
+        for (int x = 0 ; x < N ; x++) {
+            float kx = (float)(x - N / 2) * DeltaK;
+            float kz = (float)(z - N / 2) * DeltaK;
+            float Amp = sqrtf(CalcSpectrum(kx, kz) / 4.0f) * DeltaK * m_params.Amplitude;
+            float r = Gaussian(Generator);
+            float i = Gaussian(Generator);
+            h0[z * N + x] = Complex(r, i) * Amp;
+        }
+    }
+
+    m_initialSpectrum.resize(N * N);
+
+    for (int z = 0 ; z < N ; z++) {
+        for (int x = 0 ; x < N ; x++) {
+            Complex Plus = h0[z * N + x];
+            Complex Minus = std::conj(h0[((N - z) % N) * N + (N - x) % N]);
+            m_initialSpectrum[z * N + x] = Vector4f(Plus.real(), Plus.imag(), Minus.real(), Minus.imag());
+        }
+    }
+
+    for (int i = 0 ; i < 3 ; i++) {
+        m_fields[i].resize(N * N);
+    }
+
+    m_displacements.resize(N * N);
+    m_normals.resize(N * N);
+}
+
+
+//
+// Directional wave number spectrum S(k) in m^4. Both spectrums are turned into the
+// omnidirectional F(k) (m^3) and spread with cos^2 around the wind so that the integral
+// of S over the plane is the variance of the height.
+//
+float OceanFFT::CalcSpectrum(float kx, float kz) const
+{
+    float k = sqrtf(kx * kx + kz * kz);
+
+    if (k < 1e-6f) {
+        return 0.0f;
+    }
+
+    float WindX = cosf(ToRadian(m_params.WindDir));
+    float WindZ = sinf(ToRadian(m_params.WindDir));
+    float CosTheta = (kx * WindX + kz * WindZ) / k;
+
+    // The waves travel with the wind
+    if (CosTheta <= 0.0f) {
+        return 0.0f;
+    }
+
+    float Spreading = 2.0f / (float)M_PI * CosTheta * CosTheta;
+    float V = std::max(m_params.WindSpeed, 0.1f);
+    float F = 0.0f;
+
+    if (m_params.Spectrum == OCEAN_SPECTRUM_PHILLIPS) {
+        float L = V * V / GRAVITY;
+        F = PHILLIPS_ALPHA / 2.0f * expf(-1.0f / (k * L * k * L)) / (k * k * k);
+    } else {
+        float Omega = sqrtf(GRAVITY * k);
+        float Fetch = std::max(m_params.Fetch, 1.0f);
+        float Alpha = 0.076f * powf(V * V / (Fetch * GRAVITY), 0.22f);
+        float OmegaPeak = 22.0f * powf(GRAVITY * GRAVITY / (V * Fetch), 1.0f / 3.0f);
+        float Sigma = (Omega <= OmegaPeak) ? 0.07f : 0.09f;
+        float Delta = (Omega - OmegaPeak) / (Sigma * OmegaPeak);
+        float PeakEnhancement = powf(JONSWAP_GAMMA, expf(-0.5f * Delta * Delta));
+        float Ratio = OmegaPeak / Omega;
+        float S = Alpha * GRAVITY * GRAVITY / powf(Omega, 5.0f) * expf(-1.25f * Ratio * Ratio * Ratio * Ratio) * PeakEnhancement;
+
+        // S is per dOmega and dOmega/dk = g / (2 * Omega) in deep water
+        F = S * GRAVITY / (2.0f * Omega);
+    }
+
+    float Damping = expf(-k * k * m_params.MinWaveLen * m_params.MinWaveLen);
+
+    return F * Spreading / k * Damping;
+}
+
+
+void OceanFFT::Update(float Time)
+{
+    UpdateSpectrum(Time);
+
+    for (int i = 0 ; i < 3 ; i++) {
+        InverseFFT2D(&m_fields[i][0], OCEAN_FFT_SIZE);
+    }
+
+    CalcDisplacements();
+}
+
+
+//
+// h(k, t) = h0(k) * exp(-i * w * t) + conj(h0(-k)) * exp(i * w * t)
+//
+// The horizontal displacement is i * k / |k| * h (a Gerstner wave moves the points towards
+// the crests) and the slopes are i * k * h. The real fields are packed in pairs so that
+// three complex transforms are enough for all five of them.
+//
+void OceanFFT::UpdateSpectrum(float Time)
+{
+    const int N = OCEAN_FFT_SIZE;
+    float DeltaK = 2.0f * (float)M_PI / m_params.PatchSize;
+    const Complex I(0.0f, 1.0f);
+
+    ParallelFor(0, N, [&](int StartZ, int EndZ) {
+        for (int z = StartZ ; z < EndZ ; z++) {
+            for (int x = 0 ; x < N ; x++) {
+                int Index = z * N + x;
+                const Vector4f& h0 = m_initialSpectrum[Index];
+
+                float kx = (float)(x - N / 2) * DeltaK;
+                float kz = (float)(z - N / 2) * DeltaK;
+                float k = sqrtf(kx * kx + kz * kz);
+                float Omega = sqrtf(GRAVITY * k);
+
+                Complex e(cosf(Omega * Time), -sinf(Omega * Time));
+                Complex h = Complex(h0.x, h0.y) * e + Complex(h0.z, h0.w) * std::conj(e);
+
+                float DirX = (k > 1e-6f) ? kx / k : 0.0f;
+                float DirZ = (k > 1e-6f) ? kz / k : 0.0f;
+
+                Complex ih = I * h;
+                Complex dx = ih * DirX;
+                Complex dz = ih * DirZ;
+                Complex sx = ih * kx;
+                Complex sz = ih * kz;
+
+                m_fields[0][Index] = h + I * dx;
+                m_fields[1][Index] = dz + I * sx;
+                m_fields[2][Index] = sz;
+            }
+        }
+    }, MIN_FFT_LINES_PER_THREAD);
+}
+
+
+// The wave vectors start at -N/2 so every texel is multiplied by (-1)^(x + z)
+void OceanFFT::CalcDisplacements()
+{
+    const int N = OCEAN_FFT_SIZE;
+    float Chop = m_params.Choppiness;
+
+    ParallelFor(0, N, [&](int StartZ, int EndZ) {
+        for (int z = StartZ ; z < EndZ ; z++) {
+            for (int x = 0 ; x < N ; x++) {
+                int Index = z * N + x;
+                float Sign = ((x + z) & 1) ? -1.0f : 1.0f;
+
+                float h  = m_fields[0][Index].real() * Sign;
+                float dx = m_fields[0][Index].imag() * Sign;
+                float dz = m_fields[1][Index].real() * Sign;
+                float sx = m_fields[1][Index].imag() * Sign;
+                float sz = m_fields[2][Index].real() * Sign;
+
+                m_displacements[Index] = Vector4f(dx * Chop, h, dz * Chop, 0.0f);
+
+                Vector3f Normal(-sx, 1.0f, -sz);
+                Normal.Normalize();
+                m_normals[Index] = Vector4f(Normal.x, Normal.y, Normal.z, 0.0f);
+            }
+        }
+    }, MIN_FFT_LINES_PER_THREAD);
+}
+
+
+static void InverseFFT1D(Complex* pData, int N, const std::vector<int>& BitReverse, const std::vector<Complex>& Twiddles)
+{
+    for (int i = 0 ; i < N ; i++) {
+        int j = BitReverse[i];
+
+        if (i < j) {
+            std::swap(pData[i], pData[j]);
+        }
+    }
+
+    for (int Len = 2 ; Len <= N ; Len <<= 1) {
+        int Half = Len / 2;
+        int Step = N / Len;
+
+        for (int i = 0 ; i < N ; i += Len) {
+            for (int j = 0 ; j < Half ; j++) {
+                Complex u = pData[i + j];
+                Complex v = pData[i + j + Half] * Twiddles[j * Step];
+                pData[i + j] = u + v;
+                pData[i + j + Half] = u - v;
+            }
+        }
+    }
+}
+
+
+void OceanFFT::InverseFFT2D(Complex* pData, int N)
+{
+    int Log2N = 0;
+
+    while ((1 << Log2N) < N) {
+        Log2N++;
+    }
+
+    if ((1 << Log2N) != N) {
+        printf("%s:%d - FFT size %d is not a power of two\n", __FILE__, __LINE__, N);
+        exit(0);
+    }
+
+    std::vector<int> BitReverse(N);
+
+    for (int i = 0 ; i < N ; i++) {
+        int r = 0;
+
+        for (int b = 0 ; b < Log2N ; b++) {
+            r |= ((i >> b) & 1) << (Log2N - 1 - b);
+        }
+
+        BitReverse[i] = r;
+    }
+
+    std::vector<Complex> Twiddles(N / 2);
+
+    for (int i = 0 ; i < N / 2 ; i++) {
+        float Angle = 2.0f * (float)M_PI * (float)i / (float)N;
+        Twiddles[i] = Complex(cosf(Angle), sinf(Angle));
+    }
+
+    ParallelFor(0, N, [&](int Start, int End) {
+        for (int Row = Start ; Row < End ; Row++) {
+            InverseFFT1D(pData + Row * N, N, BitReverse, Twiddles);
+        }
+    }, MIN_FFT_LINES_PER_THREAD);
+
+    // The columns are copied to a contiguous line so that the transform doesn't stride through the memory
+    ParallelFor(0, N, [&](int Start, int End) {
+        std::vector<Complex> Column(N);
+
+        for (int Col = Start ; Col < End ; Col++) {
+            for (int i = 0 ; i < N ; i++) {
+                Column[i] = pData[i * N + Col];
+            }
+
+            InverseFFT1D(&Column[0], N, BitReverse, Twiddles);
+
+            for (int i = 0 ; i < N ; i++) {
+                pData[i * N + Col] = Column[i];
+            }
+        }
+    }, MIN_FFT_LINES_PER_THREAD);
+}
+
+
+Vector3f OceanFFT::SampleDisplacement(float x, float z) const
+{
+    const int N = OCEAN_FFT_SIZE;
+    float TexelSize = m_params.PatchSize / (float)N;
+
+    float s = x / TexelSize;
+    float t = z / TexelSize;
+    int s0 = (int)floorf(s);
+    int t0 = (int)floorf(t);
+    float fs = s - (float)s0;
+    float ft = t - (float)t0;
+
+    auto Get = [&](int i, int j) {
+        i &= (N - 1);
+        j &= (N - 1);
+        const Vector4f& d = m_displacements[j * N + i];
+        return Vector3f(d.x, d.y, d.z);
+    };
+
+    Vector3f Bottom = Get(s0, t0) * (1.0f - fs) + Get(s0 + 1, t0) * fs;
+    Vector3f Top = Get(s0, t0 + 1) * (1.0f - fs) + Get(s0 + 1, t0 + 1) * fs;
+
+    return Bottom * (1.0f - ft) + Top * ft;
+}
+
+
+float OceanFFT::SampleHeight(float x, float z) const
+{
+    // A few fixed point iterations are enough unless the waves are about to fold
+    float RestX = x;
+    float RestZ = z;
+
+    for (int i = 0 ; i < 3 ; i++) {
+        Vector3f d = SampleDisplacement(RestX, RestZ);
+        RestX = x - d.x;
+        RestZ = z - d.z;
+    }
+
+    return SampleDisplacement(RestX, RestZ).y;
+}
@@ -0,0 +1,165 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+//
+// GPU version of OceanFFT::Update. Every work group handles one line of the maps:
+//
+//   Pass 0 - advances the initial spectrum to the current time (one row per group)
+//   Pass 1 - inverse FFT of the rows
+//   Pass 2 - inverse FFT of the columns
+//   Pass 3 - writes the displacement and normal maps (one row per group)
+//
+// The FFT is the same radix 2 decimation in time as the CPU. The line is loaded in bit
+// reversed order into shared memory and every stage ping-pongs between two copies of it.
+//
+
+#version 430
+
+#define FFT_SIZE 256                // OCEAN_FFT_SIZE
+#define LOG2_FFT_SIZE 8
+
+layout (local_size_x = FFT_SIZE) in;
+
+layout (binding = 0, rgba32f) readonly uniform image2D gInitialSpectrum;   // h0(k), conj(h0(-k))
+layout (binding = 1, rgba32f) uniform image2D gSpectrum0;                   // h + i*dx, dz + i*sx
+layout (binding = 2, rgba32f) uniform image2D gSpectrum1;                   // sz, unused
+layout (binding = 3, rgba32f) writeonly uniform image2D gDisplacementMap;
+layout (binding = 4, rgba16f) writeonly uniform image2D gNormalMap;
+
+uniform int gPass;
+uniform float gTime;
+uniform float gPatchSize;
+uniform float gChoppiness;
+
+const float PI = 3.14159265;
+const float GRAVITY = 9.81;
+
+shared vec4 gLine0[2][FFT_SIZE];
+shared vec4 gLine1[2][FFT_SIZE];
+
+
+vec2 ComplexMul(vec2 a, vec2 b)
+{
+    return vec2(a.x * b.x - a.y * b.y, a.x * b.y + a.y * b.x);
+}
+
+
+vec2 MulI(vec2 a)
+{
+    return vec2(-a.y, a.x);
+}
+
+
+// Two complex numbers in every vec4
+vec4 ComplexMul2(vec4 a, vec2 w)
+{
+    return vec4(ComplexMul(a.xy, w), ComplexMul(a.zw, w));
+}
+
+
+void UpdateSpectrum(ivec2 Pos)
+{
+    vec4 h0 = imageLoad(gInitialSpectrum, Pos);
+
+    vec2 k = vec2(Pos - ivec2(FFT_SIZE / 2)) * (2.0 * PI / gPatchSize);
+    float kLen = length(k);
+    float Omega = sqrt(GRAVITY * kLen);
+
+    vec2 e = vec2(cos(Omega * gTime), -sin(Omega * gTime));
+    vec2 h = ComplexMul(h0.xy, e) + ComplexMul(h0.zw, vec2(e.x, -e.y));
+
+    vec2 Dir = (kLen > 1e-6) ? k / kLen : vec2(0.0);
+
+    vec2 ih = MulI(h);
+    vec2 dx = ih * Dir.x;
+    vec2 dz = ih * Dir.y;
+    vec2 sx = ih * k.x;
+    vec2 sz = ih * k.y;
+
+    imageStore(gSpectrum0, Pos, vec4(h + MulI(dx), dz + MulI(sx)));
+    imageStore(gSpectrum1, Pos, vec4(sz, 0.0, 0.0));
+}
+
+
+void InverseFFT(int Line, int i, bool Columns)
+{
+    int Src = int(bitfieldReverse(uint(i)) >> (32 - LOG2_FFT_SIZE));
+    ivec2 SrcPos = Columns ? ivec2(Line, Src) : ivec2(Src, Line);
+
+    gLine0[0][i] = imageLoad(gSpectrum0, SrcPos);
+    gLine1[0][i] = imageLoad(gSpectrum1, SrcPos);
+
+    memoryBarrierShared();
+    barrier();
+
+    int Cur = 0;
+
+    for (int Len = 2 ; Len <= FFT_SIZE ; Len <<= 1) {
+        int Half = Len >> 1;
+        int j = i & (Len - 1);          // position inside the block of the butterflies
+        int k = j & (Half - 1);
+        int a = i - j + k;
+        int b = a + Half;
+
+        float Angle = 2.0 * PI * float(k) / float(Len);
+        vec2 w = vec2(cos(Angle), sin(Angle));
+        float Sign = (j < Half) ? 1.0 : -1.0;
+
+        gLine0[1 - Cur][i] = gLine0[Cur][a] + Sign * ComplexMul2(gLine0[Cur][b], w);
+        gLine1[1 - Cur][i] = gLine1[Cur][a] + Sign * ComplexMul2(gLine1[Cur][b], w);
+
+        memoryBarrierShared();
+        barrier();
+
+        Cur = 1 - Cur;
+    }
+
+    ivec2 Pos = Columns ? ivec2(Line, i) : ivec2(i, Line);
+
+    imageStore(gSpectrum0, Pos, gLine0[Cur][i]);
+    imageStore(gSpectrum1, Pos, gLine1[Cur][i]);
+}
+
+
+// The wave vectors start at -N/2 so every texel is multiplied by (-1)^(x + z)
+void CalcMaps(ivec2 Pos)
+{
+    float Sign = (((Pos.x + Pos.y) & 1) == 0) ? 1.0 : -1.0;
+
+    vec4 s0 = imageLoad(gSpectrum0, Pos) * Sign;
+    float sz = imageLoad(gSpectrum1, Pos).x * Sign;
+
+    imageStore(gDisplacementMap, Pos, vec4(s0.y * gChoppiness, s0.x, s0.z * gChoppiness, 0.0));
+    imageStore(gNormalMap, Pos, vec4(normalize(vec3(-s0.w, 1.0, -sz)), 0.0));
+}
+
+
+void main()
+{
+    int Line = int(gl_WorkGroupID.x);
+    int i = int(gl_LocalInvocationID.x);
+
+    if (gPass == 0) {
+        UpdateSpectrum(ivec2(i, Line));
+    } else if (gPass == 1) {
+        InverseFFT(Line, i, false);
+    } else if (gPass == 2) {
+        InverseFFT(Line, i, true);
+    } else {
+        CalcMaps(ivec2(i, Line));
+    }
+}
@@ -0,0 +1,97 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCEAN_FFT_H
+#define OCEAN_FFT_H
+
+#include <vector>
+#include <complex>
+
+#include "ogldev_math_3d.h"
+
+#define OCEAN_FFT_SIZE 256          // must match FFT_SIZE in ocean_fft.cs
+
+enum OCEAN_SPECTRUM {
+    OCEAN_SPECTRUM_PHILLIPS = 0,
+    OCEAN_SPECTRUM_JONSWAP = 1
+};
+
+struct OceanParams {
+    OCEAN_SPECTRUM Spectrum = OCEAN_SPECTRUM_JONSWAP;
+    float PatchSize = 1000.0f;      // world units (meters) covered by one tile of the maps
+    float WindSpeed = 15.0f;        // m/s
+    float WindDir = 45.0f;          // degrees
+    float Fetch = 100000.0f;        // JONSWAP only - the distance over which the wind blows (m)
+    float Amplitude = 1.0f;
+    float Choppiness = 1.0f;        // horizontal displacement towards the crests
+    float MinWaveLen = 1.0f;        // shorter waves are damped
+};
+
+//
+// Tessendorf style ocean: the waves are the sum of all the wave vectors of an N x N grid
+// in the frequency domain with random amplitudes from a wind wave spectrum. Every frame
+// the spectrum is advanced by the dispersion relation of deep water and the height, the
+// horizontal displacement and the slopes are brought back to the spatial domain with
+// inverse FFTs. The results tile every PatchSize world units.
+//
+// This is the CPU path. ocean_fft.cs runs the same steps in the same order on the GPU and
+// this class serves as its reference.
+//
+class OceanFFT {
+ public:
+    OceanFFT() {}
+
+    // The random numbers are seeded so the same parameters always create the same ocean
+    void Init(const OceanParams& Params);
+
+    void Update(float Time);
+
+    const OceanParams& GetParams() const { return m_params; }
+
+    // Per texel: h0(k) and conj(h0(-k)) as two complex numbers
+    const std::vector<Vector4f>& GetInitialSpectrum() const { return m_initialSpectrum; }
+
+    // Per texel: (x, y, z, 0) displacement of the point at (x, z) * PatchSize / N
+    const std::vector<Vector4f>& GetDisplacements() const { return m_displacements; }
+
+    const std::vector<Vector4f>& GetNormals() const { return m_normals; }
+
+    // Bilinear and tiled, of the point whose rest position is (x, z)
+    Vector3f SampleDisplacement(float x, float z) const;
+
+    // Height of the surface above (x, z) - finds the rest position that was displaced to (x, z)
+    float SampleHeight(float x, float z) const;
+
+    // In place, without normalization, rows and columns are split between threads
+    static void InverseFFT2D(std::complex<float>* pData, int N);
+
+ private:
+
+    float CalcSpectrum(float kx, float kz) const;
+
+    void UpdateSpectrum(float Time);
+
+    void CalcDisplacements();
+
+    OceanParams m_params;
+    std::vector<Vector4f> m_initialSpectrum;
+    std::vector<std::complex<float>> m_fields[3];     // h + i*dx, dz + i*sx, sz
+    std::vector<Vector4f> m_displacements;
+    std::vector<Vector4f> m_normals;
+};
+
+#endif
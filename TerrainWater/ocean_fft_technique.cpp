@@ -0,0 +1,78 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "ocean_fft_technique.h"
+
+
+OceanFFTTechnique::OceanFFTTechnique()
+{
+}
+
+
+bool OceanFFTTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_COMPUTE_SHADER, "ocean_fft.cs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_passLoc = GetUniformLocation("gPass");
+    m_timeLoc = GetUniformLocation("gTime");
+    m_patchSizeLoc = GetUniformLocation("gPatchSize");
+    m_choppinessLoc = GetUniformLocation("gChoppiness");
+
+    if (m_passLoc == INVALID_UNIFORM_LOCATION ||
+        m_timeLoc == INVALID_UNIFORM_LOCATION ||
+        m_patchSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_choppinessLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void OceanFFTTechnique::SetPass(int Pass)
+{
+    glUniform1i(m_passLoc, Pass);
+}
+
+
+void OceanFFTTechnique::SetTime(float Time)
+{
+    glUniform1f(m_timeLoc, Time);
+}
+
+
+void OceanFFTTechnique::SetPatchSize(float PatchSize)
+{
+    glUniform1f(m_patchSizeLoc, PatchSize);
+}
+
+
+void OceanFFTTechnique::SetChoppiness(float Choppiness)
+{
+    glUniform1f(m_choppinessLoc, Choppiness);
+}
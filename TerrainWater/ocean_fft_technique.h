@@ -0,0 +1,53 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCEAN_FFT_TECHNIQUE_H
+#define OCEAN_FFT_TECHNIQUE_H
+
+#include "technique.h"
+#include "ogldev_math_3d.h"
+
+// Image units of ocean_fft.cs
+#define OCEAN_INITIAL_SPECTRUM_IMAGE_UNIT   0
+#define OCEAN_SPECTRUM0_IMAGE_UNIT          1
+#define OCEAN_SPECTRUM1_IMAGE_UNIT          2
+#define OCEAN_DISPLACEMENT_IMAGE_UNIT       3
+#define OCEAN_NORMAL_IMAGE_UNIT             4
+
+#define OCEAN_FFT_NUM_PASSES 4
+
+class OceanFFTTechnique : public Technique
+{
+public:
+
+    OceanFFTTechnique();
+
+    virtual bool Init();
+
+    void SetPass(int Pass);
+    void SetTime(float Time);
+    void SetPatchSize(float PatchSize);
+    void SetChoppiness(float Choppiness);
+
+private:
+    GLuint m_passLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_timeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_patchSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_choppinessLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* OCEAN_FFT_TECHNIQUE_H */
@@ -0,0 +1,120 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "ocean_technique.h"
+#include "texture_config.h"
+
+
+OceanTechnique::OceanTechnique()
+{
+}
+
+
+bool OceanTechnique::Init()
+{
+    if (!Technique::Init()) {
+        return false;
+    }
+
+    if (!AddShader(GL_VERTEX_SHADER, "ocean.vs")) {
+        return false;
+    }
+
+    if (!AddShader(GL_FRAGMENT_SHADER, "ocean.fs")) {
+        return false;
+    }
+
+    if (!Finalize()) {
+        return false;
+    }
+
+    m_WVPLoc = GetUniformLocation("gWVP");
+    m_heightLoc = GetUniformLocation("gHeight");
+    m_gridCenterLoc = GetUniformLocation("gGridCenter");
+    m_gridSpacingLoc = GetUniformLocation("gGridSpacing");
+    m_patchSizeLoc = GetUniformLocation("gPatchSize");
+    m_displacementMapLoc = GetUniformLocation("gDisplacementMap");
+    m_normalMapLoc = GetUniformLocation("gNormalMap");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
+
+    if (m_WVPLoc == INVALID_UNIFORM_LOCATION ||
+        m_heightLoc == INVALID_UNIFORM_LOCATION ||
+        m_gridCenterLoc == INVALID_UNIFORM_LOCATION ||
+        m_gridSpacingLoc == INVALID_UNIFORM_LOCATION ||
+        m_patchSizeLoc == INVALID_UNIFORM_LOCATION ||
+        m_displacementMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    Enable();
+
+    glUniform1i(m_displacementMapLoc, OCEAN_DISPLACEMENT_TEXTURE_UNIT_INDEX);
+    glUniform1i(m_normalMapLoc, OCEAN_NORMAL_TEXTURE_UNIT_INDEX);
+
+    glUseProgram(0);
+
+    return true;
+}
+
+
+void OceanTechnique::SetWVP(const Matrix4f& WVP)
+{
+    glUniformMatrix4fv(m_WVPLoc, 1, GL_TRUE, (const GLfloat*)WVP.m);
+}
+
+
+void OceanTechnique::SetWaterHeight(float Height)
+{
+    glUniform1f(m_heightLoc, Height);
+}
+
+
+void OceanTechnique::SetGridCenter(float x, float z)
+{
+    glUniform2f(m_gridCenterLoc, x, z);
+}
+
+
+void OceanTechnique::SetGridSpacing(float InnerSpacing, float SpacingRatio)
+{
+    glUniform2f(m_gridSpacingLoc, InnerSpacing, SpacingRatio);
+}
+
+
+void OceanTechnique::SetPatchSize(float PatchSize)
+{
+    glUniform1f(m_patchSizeLoc, PatchSize);
+}
+
+
+void OceanTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void OceanTechnique::SetLightDir(const Vector3f& Dir)
+{
+    Vector3f ReversedLightDir = Dir * -1.0f;
+    ReversedLightDir.Normalize();
+    glUniform3f(m_reversedLightDirLoc, ReversedLightDir.x, ReversedLightDir.y, ReversedLightDir.z);
+}
@@ -0,0 +1,52 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCEAN_TECHNIQUE_H
+#define OCEAN_TECHNIQUE_H
+
+#include "technique.h"
+#include "ogldev_math_3d.h"
+
+class OceanTechnique : public Technique
+{
+public:
+
+    OceanTechnique();
+
+    virtual bool Init();
+
+    void SetWVP(const Matrix4f& WVP);
+    void SetWaterHeight(float Height);
+    void SetGridCenter(float x, float z);
+    void SetGridSpacing(float InnerSpacing, float SpacingRatio);
+    void SetPatchSize(float PatchSize);
+    void SetCameraPos(const Vector3f& CameraPos);
+    void SetLightDir(const Vector3f& Dir);
+
+private:
+    GLuint m_WVPLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_heightLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_gridCenterLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_gridSpacingLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_patchSizeLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_displacementMapLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_normalMapLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_cameraPosLoc = INVALID_UNIFORM_LOCATION;
+    GLuint m_reversedLightDirLoc = INVALID_UNIFORM_LOCATION;
+};
+
+#endif  /* OCEAN_TECHNIQUE_H */
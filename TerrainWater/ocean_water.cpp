@@ -0,0 +1,291 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <chrono>
+#include <algorithm>
+
+#include "ogldev_util.h"
+#include "ocean_water.h"
+#include "texture_config.h"
+
+#define OCEAN_GRID_NUM_SEGMENTS 256
+#define OCEAN_GRID_INNER_SPACING 1.0f
+
+
+OceanWater::~OceanWater()
+{
+    Destroy();
+}
+
+
+void OceanWater::Destroy()
+{
+    GLuint Textures[] = { m_initialSpectrum, m_spectrum[0], m_spectrum[1], m_displacementMap, m_normalMap };
+
+    for (int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(Textures) ; i++) {
+        if (Textures[i] > 0) {
+            glDeleteTextures(1, &Textures[i]);
+        }
+    }
+
+    m_initialSpectrum = m_spectrum[0] = m_spectrum[1] = m_displacementMap = m_normalMap = 0;
+
+    if (m_timerQueries[0] > 0) {
+        glDeleteQueries(2, m_timerQueries);
+        m_timerQueries[0] = m_timerQueries[1] = 0;
+    }
+
+    m_timerIssued[0] = m_timerIssued[1] = false;
+
+    m_grid.Destroy();
+}
+
+
+void OceanWater::Init(int Size, float WorldScale)
+{
+    Destroy();
+
+    if (!m_oceanTech.Init()) {
+        printf("Error initializing ocean tech\n");
+        exit(0);
+    }
+
+    m_gpuSupported = GLEW_VERSION_4_3 && m_fftTech.Init();
+
+    if (!m_gpuSupported) {
+        printf("The ocean FFT requires compute shaders (OpenGL 4.3) - using the CPU path\n");
+    }
+
+    m_useGPU = m_gpuSupported;
+
+    // Enough to cover the entire terrain from any point on it
+    float MaxRadius = (float)Size * WorldScale * sqrtf(2.0f);
+    m_grid.CreateRingGrid(OCEAN_GRID_NUM_SEGMENTS, OCEAN_GRID_INNER_SPACING, MaxRadius);
+
+    m_fft.Init(m_fft.GetParams());
+
+    CreateMaps();
+
+    UploadInitialSpectrum();
+
+    m_prevTime = GetCurrentTimeMillis();
+}
+
+
+void OceanWater::SetParams(const OceanParams& Params)
+{
+    m_fft.Init(Params);
+
+    if (m_initialSpectrum > 0) {
+        UploadInitialSpectrum();
+    }
+}
+
+
+static GLuint CreateMap(GLenum InternalFormat, bool Mipmaps)
+{
+    GLuint Texture = 0;
+    glGenTextures(1, &Texture);
+    glBindTexture(GL_TEXTURE_2D, Texture);
+
+    glTexImage2D(GL_TEXTURE_2D, 0, InternalFormat, OCEAN_FFT_SIZE, OCEAN_FFT_SIZE, 0, GL_RGBA, GL_FLOAT, NULL);
+
+    if (Mipmaps) {
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    } else {
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    return Texture;
+}
+
+
+void OceanWater::CreateMaps()
+{
+    m_initialSpectrum = CreateMap(GL_RGBA32F, false);
+    m_spectrum[0] = CreateMap(GL_RGBA32F, false);
+    m_spectrum[1] = CreateMap(GL_RGBA32F, false);
+    m_displacementMap = CreateMap(GL_RGBA32F, true);
+    m_normalMap = CreateMap(GL_RGBA16F, true);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void OceanWater::UploadInitialSpectrum()
+{
+    glBindTexture(GL_TEXTURE_2D, m_initialSpectrum);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OCEAN_FFT_SIZE, OCEAN_FFT_SIZE, GL_RGBA, GL_FLOAT, &m_fft.GetInitialSpectrum()[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void OceanWater::Render(const Matrix4f& WVP, const Vector3f& CameraPos, const Vector3f& LightDir)
+{
+    long long CurTime = GetCurrentTimeMillis();
+    m_time += (float)(CurTime - m_prevTime) / 1000.0f;
+    m_prevTime = CurTime;
+
+    if (m_useGPU) {
+        BeginTimer();
+        SimulateGPU(m_time);
+        EndTimer();
+    } else {
+        auto Start = std::chrono::steady_clock::now();
+        SimulateCPU(m_time);
+        auto End = std::chrono::steady_clock::now();
+        m_simulationTime = std::chrono::duration<float, std::milli>(End - Start).count();
+    }
+
+    m_oceanTech.Enable();
+    m_oceanTech.SetWVP(WVP);
+    m_oceanTech.SetWaterHeight(m_waterHeight);
+    m_oceanTech.SetGridCenter(CameraPos.x, CameraPos.z);
+    m_oceanTech.SetGridSpacing(m_grid.GetInnerSpacing(), m_grid.GetSpacingRatio());
+    m_oceanTech.SetPatchSize(m_fft.GetParams().PatchSize);
+    m_oceanTech.SetCameraPos(CameraPos);
+    m_oceanTech.SetLightDir(LightDir);
+
+    glActiveTexture(OCEAN_DISPLACEMENT_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_displacementMap);
+    glActiveTexture(OCEAN_NORMAL_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_normalMap);
+
+    m_grid.Render();
+}
+
+
+void OceanWater::SimulateCPU(float Time)
+{
+    m_fft.Update(Time);
+
+    glBindTexture(GL_TEXTURE_2D, m_displacementMap);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OCEAN_FFT_SIZE, OCEAN_FFT_SIZE, GL_RGBA, GL_FLOAT, &m_fft.GetDisplacements()[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, m_normalMap);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, OCEAN_FFT_SIZE, OCEAN_FFT_SIZE, GL_RGBA, GL_FLOAT, &m_fft.GetNormals()[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void OceanWater::SimulateGPU(float Time)
+{
+    const OceanParams& Params = m_fft.GetParams();
+
+    m_fftTech.Enable();
+    m_fftTech.SetTime(Time);
+    m_fftTech.SetPatchSize(Params.PatchSize);
+    m_fftTech.SetChoppiness(Params.Choppiness);
+
+    glBindImageTexture(OCEAN_INITIAL_SPECTRUM_IMAGE_UNIT, m_initialSpectrum, 0, GL_FALSE, 0, GL_READ_ONLY, GL_RGBA32F);
+    glBindImageTexture(OCEAN_SPECTRUM0_IMAGE_UNIT, m_spectrum[0], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(OCEAN_SPECTRUM1_IMAGE_UNIT, m_spectrum[1], 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    glBindImageTexture(OCEAN_DISPLACEMENT_IMAGE_UNIT, m_displacementMap, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+    glBindImageTexture(OCEAN_NORMAL_IMAGE_UNIT, m_normalMap, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+
+    // One work group per line in every pass
+    for (int Pass = 0 ; Pass < OCEAN_FFT_NUM_PASSES ; Pass++) {
+        m_fftTech.SetPass(Pass);
+        glDispatchCompute(OCEAN_FFT_SIZE, 1, 1);
+        glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+    }
+
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+    glBindTexture(GL_TEXTURE_2D, m_displacementMap);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, m_normalMap);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void OceanWater::BeginTimer()
+{
+    if (m_timerQueries[0] == 0) {
+        glGenQueries(2, m_timerQueries);
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, m_timerQueries[m_curTimer]);
+}
+
+
+void OceanWater::EndTimer()
+{
+    glEndQuery(GL_TIME_ELAPSED);
+
+    m_timerIssued[m_curTimer] = true;
+    m_curTimer = 1 - m_curTimer;
+
+    // The other query is from the previous frame
+    if (m_timerIssued[m_curTimer]) {
+        GLint Available = 0;
+        glGetQueryObjectiv(m_timerQueries[m_curTimer], GL_QUERY_RESULT_AVAILABLE, &Available);
+
+        if (Available) {
+            GLuint64 Nanoseconds = 0;
+            glGetQueryObjectui64v(m_timerQueries[m_curTimer], GL_QUERY_RESULT, &Nanoseconds);
+            m_simulationTime = (float)((double)Nanoseconds / 1000000.0);
+            m_timerIssued[m_curTimer] = false;
+        }
+    }
+}
+
+
+float OceanWater::ValidateGPU()
+{
+    if (!m_gpuSupported) {
+        printf("The GPU path of the ocean is not supported\n");
+        return -1.0f;
+    }
+
+    SimulateGPU(m_time);
+
+    std::vector<Vector4f> GPUDisplacements(OCEAN_FFT_SIZE * OCEAN_FFT_SIZE);
+    glBindTexture(GL_TEXTURE_2D, m_displacementMap);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, &GPUDisplacements[0]);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_fft.Update(m_time);
+
+    const std::vector<Vector4f>& CPUDisplacements = m_fft.GetDisplacements();
+    float MaxDiff = 0.0f;
+    float MaxHeight = 0.0f;
+
+    for (int i = 0 ; i < (int)CPUDisplacements.size() ; i++) {
+        const Vector4f& c = CPUDisplacements[i];
+        const Vector4f& g = GPUDisplacements[i];
+        MaxDiff = std::max(MaxDiff, std::max(fabsf(c.x - g.x), std::max(fabsf(c.y - g.y), fabsf(c.z - g.z))));
+        MaxHeight = std::max(MaxHeight, fabsf(c.y));
+    }
+
+    printf("Ocean GPU vs CPU: max difference %f, max height %f\n", MaxDiff, MaxHeight);
+
+    return MaxDiff;
+}
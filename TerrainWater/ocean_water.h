@@ -0,0 +1,108 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef OCEAN_WATER_H
+#define OCEAN_WATER_H
+
+#include <GL/glew.h>
+
+#include "ogldev_math_3d.h"
+#include "ocean_fft.h"
+#include "ocean_fft_technique.h"
+#include "ocean_technique.h"
+#include "ring_grid.h"
+
+//
+// Water from the FFT ocean of OceanFFT. The displacement and normal maps are updated every
+// frame by ocean_fft.cs when compute shaders are available and by OceanFFT on the CPU
+// otherwise. The cost doesn't depend on the number of waves - every texel of the maps is
+// a wave. The maps tile the ring grid every PatchSize world units.
+//
+class OceanWater {
+ public:
+
+    OceanWater() {}
+
+    ~OceanWater();
+
+    void Destroy();
+
+    void Init(int Size, float WorldScale);
+
+    // Re-creates the initial spectrum
+    void SetParams(const OceanParams& Params);
+
+    const OceanParams& GetParams() const { return m_fft.GetParams(); }
+
+    void SetWaterHeight(float Height) { m_waterHeight = Height; }
+
+    float GetWaterHeight() const { return m_waterHeight; }
+
+    bool IsGPUSupported() const { return m_gpuSupported; }
+
+    void SetUseGPU(bool UseGPU) { m_useGPU = UseGPU && m_gpuSupported; }
+
+    bool IsUsingGPU() const { return m_useGPU; }
+
+    void Render(const Matrix4f& WVP, const Vector3f& CameraPos, const Vector3f& LightDir);
+
+    // From the last update on the CPU
+    float SampleHeight(float x, float z) const { return m_waterHeight + m_fft.SampleHeight(x, z); }
+
+    // In milliseconds - the GPU time is a frame or two behind
+    float GetSimulationTime() const { return m_simulationTime; }
+
+    // Runs both paths for the same time and returns the largest difference between the displacements
+    float ValidateGPU();
+
+ private:
+
+    void CreateMaps();
+
+    void UploadInitialSpectrum();
+
+    void SimulateCPU(float Time);
+
+    void SimulateGPU(float Time);
+
+    void BeginTimer();
+
+    void EndTimer();
+
+    OceanFFT m_fft;
+    OceanFFTTechnique m_fftTech;
+    OceanTechnique m_oceanTech;
+    RingGrid m_grid;
+    bool m_gpuSupported = false;
+    bool m_useGPU = false;
+
+    GLuint m_initialSpectrum = 0;
+    GLuint m_spectrum[2] = { 0, 0 };
+    GLuint m_displacementMap = 0;
+    GLuint m_normalMap = 0;
+
+    GLuint m_timerQueries[2] = { 0, 0 };
+    bool m_timerIssued[2] = { false, false };
+    int m_curTimer = 0;
+
+    float m_waterHeight = 64.0f;
+    long long m_prevTime = 0;
+    float m_time = 0.0f;
+    float m_simulationTime = 0.0f;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <math.h>
+#include <assert.h>
+#include <vector>
+#include <algorithm>
+
+#include "ring_grid.h"
+
+
+RingGrid::~RingGrid()
+{
+    Destroy();
+}
+
+
+void RingGrid::Destroy()
+{
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+
+    if (m_vb > 0) {
+        glDeleteBuffers(1, &m_vb);
+        m_vb = 0;
+    }
+
+    if (m_ib > 0) {
+        glDeleteBuffers(1, &m_ib);
+        m_ib = 0;
+    }
+
+    m_numRings = 0;
+}
+
+
+void RingGrid::CreateRingGrid(int NumSegments, float InnerSpacing, float MaxRadius)
+{
+    Destroy();
+
+    m_numSegments = NumSegments;
+    m_innerSpacing = InnerSpacing;
+    m_spacingRatio = 2.0f * (float)M_PI / (float)NumSegments;
+
+    // The first rings are InnerSpacing apart until the segments become wider than that
+    std::vector<float> Radii;
+    float Radius = InnerSpacing;
+
+    while (true) {
+        Radii.push_back(Radius);
+
+        if (Radius >= MaxRadius) {
+            break;
+        }
+
+        Radius += std::max(InnerSpacing, Radius * m_spacingRatio);
+    }
+
+    m_numRings = (int)Radii.size();
+
+    CreateGLState();
+
+    PopulateBuffers(Radii);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    printf("Ring grid with %d rings and %d segments created (%d vertices)\n", m_numRings, m_numSegments, GetNumVertices());
+}
+
+
+void RingGrid::CreateGLState()
+{
+    glGenVertexArrays(1, &m_vao);
+
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+    glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+
+    int pos_loc = 0;
+
+    glEnableVertexAttribArray(pos_loc);
+    glVertexAttribPointer(pos_loc, 3, GL_FLOAT, GL_FALSE, sizeof(Vector3f), (const void*)0);
+}
+
+
+void RingGrid::PopulateBuffers(const std::vector<float>& Radii)
+{
+    std::vector<Vector3f> Vertices;
+    Vertices.reserve(GetNumVertices());
+
+    // The center is vertex zero and then the rings from the inside out
+    Vertices.push_back(Vector3f(0.0f, 0.0f, 0.0f));
+
+    for (int Ring = 0 ; Ring < m_numRings ; Ring++) {
+        for (int Seg = 0 ; Seg < m_numSegments ; Seg++) {
+            float Angle = (float)Seg * m_spacingRatio;
+            Vertices.push_back(Vector3f(Radii[Ring] * cosf(Angle), 0.0f, Radii[Ring] * sinf(Angle)));
+        }
+    }
+
+    std::vector<uint> Indices;
+    Indices.reserve(GetNumTriangles() * 3);
+
+    // Same winding as TriangleList
+    for (int Seg = 0 ; Seg < m_numSegments ; Seg++) {
+        int Next = (Seg + 1) % m_numSegments;
+        Indices.push_back(0);
+        Indices.push_back(1 + Next);
+        Indices.push_back(1 + Seg);
+    }
+
+    for (int Ring = 0 ; Ring < m_numRings - 1 ; Ring++) {
+        uint Inner = 1 + Ring * m_numSegments;
+        uint Outer = Inner + m_numSegments;
+
+        for (int Seg = 0 ; Seg < m_numSegments ; Seg++) {
+            int Next = (Seg + 1) % m_numSegments;
+
+            Indices.push_back(Inner + Seg);
+            Indices.push_back(Outer + Next);
+            Indices.push_back(Outer + Seg);
+
+            Indices.push_back(Inner + Seg);
+            Indices.push_back(Inner + Next);
+            Indices.push_back(Outer + Next);
+        }
+    }
+
+    assert(Indices.size() == GetNumTriangles() * 3);
+
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices[0]) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
+
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+}
+
+
+void RingGrid::Render()
+{
+    glBindVertexArray(m_vao);
+
+    glDrawElements(GL_TRIANGLES, GetNumTriangles() * 3, GL_UNSIGNED_INT, NULL);
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright 2024 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef RING_GRID_H
+#define RING_GRID_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "ogldev_math_3d.h"
+
+//
+// A disc of concentric rings around the origin which is moved with the camera. The
+// distance between the rings grows geometrically by the same ratio as the distance
+// between the segments of a ring so the cells are roughly square and their projected
+// size is about the same everywhere on the screen. The number of rings grows with the
+// log of the radius so the cost of the water doesn't depend on the size of the lake.
+//
+class RingGrid {
+ public:
+    RingGrid() {}
+
+    ~RingGrid();
+
+    void Destroy();
+
+    void CreateRingGrid(int NumSegments, float InnerSpacing, float MaxRadius);
+
+    void Render();
+
+    float GetInnerSpacing() const { return m_innerSpacing; }
+
+    // The spacing at radius R is about R * GetSpacingRatio()
+    float GetSpacingRatio() const { return m_spacingRatio; }
+
+    int GetNumVertices() const { return m_numSegments * m_numRings + 1; }
+
+    int GetNumTriangles() const { return m_numSegments * (2 * m_numRings - 1); }
+
+ private:
+
+    void CreateGLState();
+
+    void PopulateBuffers(const std::vector<float>& Radii);
+
+    int m_numSegments = 0;
+    int m_numRings = 0;
+    float m_innerSpacing = 0.0f;
+    float m_spacingRatio = 0.0f;
+    GLuint m_vao = 0;
+    GLuint m_vb = 0;
+    GLuint m_ib = 0;
+};
+
+#endif
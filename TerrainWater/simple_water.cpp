@@ -15,9 +15,14 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include "ogldev_parallel.h"
 #include "simple_water.h"
 #include "texture_config.h"
 
+#define RING_GRID_NUM_SEGMENTS 256
+#define RING_GRID_INNER_SPACING 0.5f
+#define MIN_WAVE_QUERIES_PER_THREAD 4096
+
 
 static float RandZeroToOne()
 {
@@ -45,7 +50,9 @@ void SimpleWater::Init(int Size, float WorldScale)
     m_waterTech.Enable();
     m_waterTech.SetWaterHeight(m_waterHeight);
 
-    m_water.CreateTriangleList(500, 500, 0.5f);
+    // Enough to cover the entire terrain from any point on it
+    float MaxRadius = (float)Size * WorldScale * sqrtf(2.0f);
+    m_water.CreateRingGrid(RING_GRID_NUM_SEGMENTS, RING_GRID_INNER_SPACING, MaxRadius);
 
     m_prevTime = GetCurrentTimeMillis();
 
@@ -61,11 +68,13 @@ void SimpleWater::SetWaveParam(int WaveIndex, const WaveParam& Wave)
 }
 
 
-void SimpleWater::Render(const Matrix4f& WVP)
+void SimpleWater::Render(const Matrix4f& WVP, const Vector3f& CameraPos)
 {
     m_waterTech.Enable();
     m_waterTech.SetWVP(WVP);
     m_waterTech.SetWaterHeight(m_waterHeight);
+    m_waterTech.SetGridCenter(CameraPos.x, CameraPos.z);
+    m_waterTech.SetGridSpacing(m_water.GetInnerSpacing(), m_water.GetSpacingRatio());
 
     long long CurTime = GetCurrentTimeMillis();
     long long DeltaTime = CurTime - m_prevTime;
@@ -86,6 +95,77 @@ void SimpleWater::Render(const Matrix4f& WVP)
    // UpdateWaves((int)DeltaTime);
 }
 
+float SimpleWater::SampleWaveHeight(float x, float z) const
+{
+    float Height = 0.0f;
+
+    SampleRange(&x, &z, 0, 1, &Height, NULL);
+
+    return Height;
+}
+
+
+void SimpleWater::SampleWaveHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals) const
+{
+    ParallelFor(0, Count, [&](int Start, int End) {
+        SampleRange(pX, pZ, Start, End, pHeights, pNormals);
+    }, MIN_WAVE_QUERIES_PER_THREAD);
+}
+
+
+// Same sum of waves as simple_water.vs
+void SimpleWater::SampleRange(const float* pX, const float* pZ, int Start, int End, float* pHeights, Vector3f* pNormals) const
+{
+    struct {
+        float FreqX;
+        float FreqZ;
+        float Phase;
+        float Amp;
+    } Waves[MAX_WAVES];
+
+    int NumWaves = 0;
+
+    for (int i = 0 ; i < MAX_WAVES ; i++) {
+        const WaveParam& w = m_waveParams[i];
+
+        if (w.WaveLen <= 0.0f) {
+            continue;
+        }
+
+        float Freq = 2.0f / w.WaveLen;
+        Waves[NumWaves].FreqX = w.Dir.x * Freq;
+        Waves[NumWaves].FreqZ = w.Dir.y * Freq;
+        Waves[NumWaves].Phase = w.Speed * Freq * m_time;
+        Waves[NumWaves].Amp = w.Amp;
+        NumWaves++;
+    }
+
+    for (int i = Start ; i < End ; i++) {
+        float Height = m_waterHeight;
+        float GradX = 0.0f;
+        float GradZ = 0.0f;
+
+        for (int j = 0 ; j < NumWaves ; j++) {
+            float Angle = pX[i] * Waves[j].FreqX + pZ[i] * Waves[j].FreqZ + Waves[j].Phase;
+            Height += Waves[j].Amp * sinf(Angle);
+
+            if (pNormals) {
+                float Slope = Waves[j].Amp * cosf(Angle);
+                GradX += Slope * Waves[j].FreqX;
+                GradZ += Slope * Waves[j].FreqZ;
+            }
+        }
+
+        pHeights[i] = Height;
+
+        if (pNormals) {
+            pNormals[i] = Vector3f(-GradX, 1.0f, -GradZ);
+            pNormals[i].Normalize();
+        }
+    }
+}
+
+
 float medianWavelength = 10.0f;
 float wavelengthRange = 1.0f;
 float medianDirection = 0.0f;
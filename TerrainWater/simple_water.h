@@ -20,7 +20,7 @@
 
 #include "ogldev_texture.h"
 #include "simple_water_technique.h"
-#include "triangle_list.h"
+#include "ring_grid.h"
 
 
 class SimpleWater {
@@ -38,13 +38,24 @@ class SimpleWater {
 
     float GetWaterHeight() const { return m_waterHeight; }
 
-    void Render(const Matrix4f& WVP);
+    // Height of the water surface at the time of the last Render - same as the vertex shader
+    float SampleWaveHeight(float x, float z) const;
+
+    // Batched version for many points (e.g. buoyancy). pNormals can be NULL.
+    void SampleWaveHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals = NULL) const;
+
+    void Render(const Matrix4f& WVP, const Vector3f& CameraPos);
+
+    int GetNumVertices() const { return m_water.GetNumVertices(); }
+
+    int GetNumTriangles() const { return m_water.GetNumTriangles(); }
 
  private:
     void InitWaves();
     void UpdateWaves(int DeltaTimeMillis);
+    void SampleRange(const float* pX, const float* pZ, int Start, int End, float* pHeights, Vector3f* pNormals) const;
 
-    TriangleList m_water;
+    RingGrid m_water;
     SimpleWaterTechnique m_waterTech;
     float m_waterHeight = 64.0f;
     long long m_prevTime = 0;
@@ -1,11 +1,12 @@
 #version 330
 
 layout (location = 0) in vec3 Position;
-layout (location = 1) in vec2 TexCoord;
 
 uniform mat4 gWVP;
 uniform float gHeight = 0.0f;
 uniform float gTime = 0.0f;
+uniform vec2 gGridCenter;           // the camera - the ring grid follows it in snapped steps
+uniform vec2 gGridSpacing;          // inner spacing and spacing ratio of the ring grid
 
 struct Wave {
     float WaveLen;
@@ -21,53 +22,56 @@ out float oHeight;
 out float oMaxHeight;
 out vec3 oNormal;
 
-float CalcSineFunc(Wave w)
+// Must match SimpleWater::SampleWaveHeights. The only difference is the fading of the waves
+// which are too short for the grid - they are far from the camera and would only add noise.
+void AddWave(Wave w, vec2 xz, float Spacing, inout float Height, inout vec2 Gradient)
 {
+    if (w.WaveLen <= 0.0) {
+        return;
+    }
+
     float Freq = 2.0 / w.WaveLen;
     float Phase = w.Speed * Freq;
-    vec3 Dir = vec3(w.Dir.x, 0.0, w.Dir.y);
-    float xz = dot(Dir, Position);
-    float Sine = w.Amp * sin(xz * Freq + Phase * gTime);    
-    return Sine;
+    float Angle = dot(w.Dir, xz) * Freq + Phase * gTime;
+
+    float Fade = clamp(w.WaveLen / (2.0 * Spacing) - 1.0, 0.0, 1.0);
+    float Amp = w.Amp * Fade;
+
+    Height += Amp * sin(Angle);
+    Gradient += (Amp * Freq * cos(Angle)) * w.Dir;
 }
 
-vec3 CalcNormal(Wave w)
+// The vertices must stay fixed in the world while the camera moves or the waves swim
+// under them. The center of the grid is snapped to the power of two multiple of the
+// inner spacing below the spacing of the vertex, blended with the next coarser snap
+// over the radius so that neighbor rings never tear apart or fold over each other.
+vec2 CalcGridCenter(float Spacing)
 {
-    float Freq = 2.0 / w.WaveLen;
-    float Phase = w.Speed * Freq;
-    float x = w.Dir.x * Position.x;
-    float z = w.Dir.y * Position.z;
-    vec3 Dir = vec3(w.Dir.x, 0.0, w.Dir.y);
-    float xz = dot(Dir, Position);
-    float dx = Freq * w.Amp * cos(xz * Freq + Phase * gTime);
-    float dz = Freq * w.Amp * cos(xz * Freq + Phase * gTime);
-    vec3 Tangent = normalize(vec3(dx, 0, 1));
-    vec3 Binormal = normalize(vec3(1, 0, dz));
-    vec3 Normal = cross(Binormal, Tangent);
-    Normal = normalize(Normal);
-    return Normal;
+    float Level = log2(Spacing / gGridSpacing.x);
+    float Snap = gGridSpacing.x * exp2(floor(Level));
+    vec2 Center = floor(gGridCenter / Snap) * Snap;
+    vec2 CoarseCenter = floor(gGridCenter / (Snap * 2.0)) * (Snap * 2.0);
+    return mix(Center, CoarseCenter, fract(Level));
 }
 
 void main()
 {
-    float Sine1 = CalcSineFunc(gWaveParam[0]);
-    vec3 Normal1 = CalcNormal(gWaveParam[0]);
-
-    float Sine2 = CalcSineFunc(gWaveParam[1]);
-    vec3 Normal2 = CalcNormal(gWaveParam[1]);
+    float Spacing = max(gGridSpacing.x, length(Position.xz) * gGridSpacing.y);
+    vec2 xz = Position.xz + CalcGridCenter(Spacing);
 
-    float Sine3 = CalcSineFunc(gWaveParam[2]);
-    vec3 Normal3 = CalcNormal(gWaveParam[2]);
+    float Height = 0.0;
+    vec2 Gradient = vec2(0.0);
+    float MaxHeight = 0.0;
 
-    float Sine4 = CalcSineFunc(gWaveParam[3]);
-    vec3 Normal4 = CalcNormal(gWaveParam[3]);
+    for (int i = 0 ; i < 4 ; i++) {
+        AddWave(gWaveParam[i], xz, Spacing, Height, Gradient);
+        MaxHeight += gWaveParam[i].Amp;
+    }
 
-    float Height = gHeight + Sine1 + Sine2 + Sine3 + Sine4;
-   
-    vec3 NewPosition = (Position + vec3(0.0, Height, 0.0));
+    vec3 NewPosition = vec3(xz.x, gHeight + Height, xz.y);
     gl_Position = gWVP * vec4(NewPosition, 1.0);
-    oTex = TexCoord;
-    oHeight = Sine1 + Sine2 + Sine3 + Sine4;
-    oMaxHeight = gWaveParam[0].Amp + gWaveParam[1].Amp + gWaveParam[2].Amp + gWaveParam[3].Amp;
-    oNormal = Normal1 + Normal2 + Normal3 + Normal4;
+    oTex = xz;
+    oHeight = Height;
+    oMaxHeight = MaxHeight;
+    oNormal = vec3(-Gradient.x, 1.0, -Gradient.y);
 }
@@ -45,10 +45,14 @@ bool SimpleWaterTechnique::Init()
     m_WVPLoc = GetUniformLocation("gWVP");
     m_heightLoc = GetUniformLocation("gHeight");
     m_timeLoc = GetUniformLocation("gTime");
+    m_gridCenterLoc = GetUniformLocation("gGridCenter");
+    m_gridSpacingLoc = GetUniformLocation("gGridSpacing");
 
     if (m_WVPLoc == INVALID_UNIFORM_LOCATION ||
         m_heightLoc == INVALID_UNIFORM_LOCATION ||
-        m_timeLoc == INVALID_UNIFORM_LOCATION) {
+        m_timeLoc == INVALID_UNIFORM_LOCATION ||
+        m_gridCenterLoc == INVALID_UNIFORM_LOCATION ||
+        m_gridSpacingLoc == INVALID_UNIFORM_LOCATION) {
         return false;
     }
 
@@ -101,6 +105,18 @@ void SimpleWaterTechnique::SetTime(float Time)
 }
 
 
+void SimpleWaterTechnique::SetGridCenter(float x, float z)
+{
+    glUniform2f(m_gridCenterLoc, x, z);
+}
+
+
+void SimpleWaterTechnique::SetGridSpacing(float InnerSpacing, float SpacingRatio)
+{
+    glUniform2f(m_gridSpacingLoc, InnerSpacing, SpacingRatio);
+}
+
+
 void SimpleWaterTechnique::SetWaveParam(int WaveIndex, const WaveParam& Wave)
 {
     if (WaveIndex >= MAX_WAVES) {
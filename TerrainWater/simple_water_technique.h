@@ -43,11 +43,15 @@ public:
     void SetWaterHeight(float Height);
     void SetTime(float Time);
     void SetWaveParam(int WaveIndex, const WaveParam& Wave);
+    void SetGridCenter(float x, float z);
+    void SetGridSpacing(float InnerSpacing, float SpacingRatio);
 
 private:
     GLuint m_WVPLoc = -1;
     GLuint m_heightLoc = -1;
     GLuint m_timeLoc = -1;
+    GLuint m_gridCenterLoc = -1;
+    GLuint m_gridSpacingLoc = -1;
     struct {
         GLuint WaveLenLoc = -1;
         GLuint SpeedLoc = -1;
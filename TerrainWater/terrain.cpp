@@ -23,6 +23,7 @@
 #include <sys/stat.h>
 #include <cerrno>
 #include <string.h>
+#include <algorithm>
 
 #include "terrain.h"
 #include "texture_config.h"
@@ -74,6 +75,7 @@ void BaseTerrain::Finalize()
     m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
 
     m_water.Init(m_terrainSize, m_worldScale);
+    m_ocean.Init(m_terrainSize, m_worldScale);
 }
 
 
@@ -112,6 +114,7 @@ void BaseTerrain::LoadFromFile(const char* pFilename)
     m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
 	
 	m_water.Init(m_terrainSize, m_worldScale);
+	m_ocean.Init(m_terrainSize, m_worldScale);
 }
 
 
@@ -190,7 +193,12 @@ void BaseTerrain::RenderTerrain(const BasicCamera& Camera)
 void BaseTerrain::RenderWater(const BasicCamera & Camera)
 {
     Matrix4f VP = Camera.GetViewProjMatrix();
-    m_water.Render(VP);
+
+    if (m_useOcean) {
+        m_ocean.Render(VP, Camera.GetPos(), m_lightDir);
+    } else {
+        m_water.Render(VP, Camera.GetPos());
+    }
 }
 
 
@@ -246,5 +254,9 @@ Vector3f BaseTerrain::ConstrainCameraPosToTerrain(const Vector3f& CameraPos)
 
     NewCameraPos.y += f;
 
+    // Keep the camera above the waves
+    float WaterHeight = m_water.SampleWaveHeight(NewCameraPos.x, NewCameraPos.z) + m_cameraHeight;
+    NewCameraPos.y = std::max(NewCameraPos.y, WaterHeight);
+
     return NewCameraPos;
 }
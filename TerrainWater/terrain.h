@@ -28,6 +28,7 @@
 #include "terrain_technique.h"
 #include "ogldev_skydome.h"
 #include "simple_water.h"
+#include "ocean_water.h"
 
 class BaseTerrain
 {
@@ -68,10 +69,24 @@ class BaseTerrain
 
     Vector3f ConstrainCameraPosToTerrain(const Vector3f& CameraPos);
 	
-    void SetWaterHeight(float Height) { m_water.SetWaterHeight(Height); }
+    void SetWaterHeight(float Height) { m_water.SetWaterHeight(Height); m_ocean.SetWaterHeight(Height); }
 
     void SetWaveParam(int WaveIndex, const WaveParam& Wave) { m_water.SetWaveParam(WaveIndex, Wave); }
 
+    float SampleWaveHeight(float x, float z) const { return m_water.SampleWaveHeight(x, z); }
+
+    void SampleWaveHeights(const float* pX, const float* pZ, int Count, float* pHeights, Vector3f* pNormals = NULL) const
+    {
+        m_water.SampleWaveHeights(pX, pZ, Count, pHeights, pNormals);
+    }
+
+    const SimpleWater& GetWater() const { return m_water; }
+
+    // Renders the FFT ocean instead of the sum of the waves of SimpleWater
+    void SetUseOcean(bool UseOcean) { m_useOcean = UseOcean; }
+
+    OceanWater& GetOcean() { return m_ocean; }
+
  protected:
 
 	void LoadHeightMapFile(const char* pFilename);
@@ -101,6 +116,8 @@ private:
     float m_cameraHeight = 2.0f;
     Skydome* m_pSkydome = NULL;		
     SimpleWater m_water;
+    OceanWater m_ocean;
+    bool m_useOcean = false;
 };
 
 #endif
@@ -137,6 +137,48 @@ public:
                 m_terrain.SetWaveParam(2, m_waveParams[2]);
                 m_terrain.SetWaveParam(3, m_waveParams[3]);
 
+                if (ImGui::Checkbox("FFT ocean", &m_useOcean)) {
+                    m_terrain.SetUseOcean(m_useOcean);
+                }
+
+                if (m_useOcean) {
+                    OceanWater& Ocean = m_terrain.GetOcean();
+                    OceanParams Params = Ocean.GetParams();
+                    int Spectrum = (int)Params.Spectrum;
+                    bool ParamsChanged = ImGui::Combo("Spectrum", &Spectrum, "Phillips\0JONSWAP\0");
+                    Params.Spectrum = (OCEAN_SPECTRUM)Spectrum;
+                    ParamsChanged |= ImGui::SliderFloat("Wind speed (m/s)", &Params.WindSpeed, 1.0f, 40.0f);
+                    ParamsChanged |= ImGui::SliderFloat("Wind direction", &Params.WindDir, 0.0f, 360.0f);
+                    ParamsChanged |= ImGui::SliderFloat("Amplitude", &Params.Amplitude, 0.0f, 4.0f);
+                    ParamsChanged |= ImGui::SliderFloat("Choppiness", &Params.Choppiness, 0.0f, 2.0f);
+                    ParamsChanged |= ImGui::SliderFloat("Patch size", &Params.PatchSize, 100.0f, 4000.0f);
+
+                    if (ParamsChanged) {
+                        Ocean.SetParams(Params);
+                    }
+
+                    bool UseGPU = Ocean.IsUsingGPU();
+
+                    if (Ocean.IsGPUSupported() && ImGui::Checkbox("Simulate on the GPU", &UseGPU)) {
+                        Ocean.SetUseGPU(UseGPU);
+                    }
+
+                    ImGui::Text("Ocean simulation %.3f ms (%s)", Ocean.GetSimulationTime(), UseGPU ? "GPU" : "CPU");
+
+                    if (Ocean.IsGPUSupported() && ImGui::Button("Validate GPU against CPU")) {
+                        m_oceanValidationError = Ocean.ValidateGPU();
+                    }
+
+                    if (m_oceanValidationError >= 0.0f) {
+                        ImGui::Text("Max difference %f", m_oceanValidationError);
+                    }
+                }
+
+                const SimpleWater& Water = m_terrain.GetWater();
+                Vector3f CameraPos = m_pGameCamera->GetPos();
+                ImGui::Text("Water grid: %d vertices, %d triangles", Water.GetNumVertices(), Water.GetNumTriangles());
+                ImGui::Text("Water height below the camera %.2f", Water.SampleWaveHeight(CameraPos.x, CameraPos.z));
+
                 ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
                 ImGui::End();
 
@@ -368,6 +410,8 @@ private:
     bool m_constrainCamera = false;	
     float m_waterHeight = 200.0f;
     WaveParam m_waveParams[MAX_WAVES];
+    bool m_useOcean = false;
+    float m_oceanValidationError = -1.0f;
 };
 
 TerrainDemo9* app = NULL;
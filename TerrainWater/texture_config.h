@@ -9,6 +9,10 @@
 #define COLOR_TEXTURE_UNIT_INDEX_2 2
 #define COLOR_TEXTURE_UNIT_3 GL_TEXTURE3
 #define COLOR_TEXTURE_UNIT_INDEX_3 3
+#define OCEAN_DISPLACEMENT_TEXTURE_UNIT GL_TEXTURE4
+#define OCEAN_DISPLACEMENT_TEXTURE_UNIT_INDEX 4
+#define OCEAN_NORMAL_TEXTURE_UNIT GL_TEXTURE5
+#define OCEAN_NORMAL_TEXTURE_UNIT_INDEX 5
 
 
 #endif